@@ -21,6 +21,7 @@
 
 #include <vector>
 #include <string>
+#include <memory>
 #include <functional>
 
 #ifdef DSHOWCAPTURE_EXPORTS
@@ -49,6 +50,67 @@ struct HDevice;
 struct HVideoEncoder;
 struct VideoConfig;
 struct AudioConfig;
+struct FrameBuffer;
+
+/**
+ * Reference counted handle to the data of a captured frame.  Unlike the raw
+ * pointer given to VideoProc/AudioProc, the data stays valid for as long as
+ * any copy of the handle exists, so frames can be queued without copying.
+ */
+class Frame {
+	std::shared_ptr<FrameBuffer> buffer;
+	unsigned char *data = nullptr;
+	size_t size = 0;
+	unsigned char *planes[DSHOW_MAX_PLANES] = {};
+	int linesize[DSHOW_MAX_PLANES] = {};
+	bool keyframe = false;
+
+public:
+	inline Frame() {}
+	inline Frame(const std::shared_ptr<FrameBuffer> &buffer_,
+		     unsigned char *data_, size_t size_)
+		: buffer(buffer_), data(data_), size(size_)
+	{
+	}
+
+	inline unsigned char *Data() const { return data; }
+	inline size_t Size() const { return size; }
+	inline bool Valid() const { return !!buffer; }
+
+	/**
+	 * First row of a video plane.  A negative linesize means the rows are
+	 * stored bottom-up in memory, starting from the returned row.  Planes
+	 * that aren't used (or aren't known, as with encoded video) are null.
+	 */
+	inline unsigned char *Plane(int i) const { return planes[i]; }
+	inline int Linesize(int i) const { return linesize[i]; }
+
+	inline void SetPlane(int i, unsigned char *plane, int linesize_)
+	{
+		planes[i] = plane;
+		linesize[i] = linesize_;
+	}
+
+	/**
+	 * Encoded video packet that can be decoded on its own (for H.264, one
+	 * holding an IDR picture).  Only set for formats the library parses.
+	 */
+	inline bool Keyframe() const { return keyframe; }
+	inline void SetKeyframe(bool keyframe_) { keyframe = keyframe_; }
+
+	inline void Release()
+	{
+		buffer.reset();
+		data = nullptr;
+		size = 0;
+		keyframe = false;
+
+		for (int i = 0; i < DSHOW_MAX_PLANES; i++) {
+			planes[i] = nullptr;
+			linesize[i] = 0;
+		}
+	}
+};
 
 typedef std::function<void(const VideoConfig &config, unsigned char *data,
 			   size_t size, long long startTime, long long stopTime,
@@ -59,6 +121,39 @@ typedef std::function<void(const AudioConfig &config, unsigned char *data,
 			   size_t size, long long startTime, long long stopTime)>
 	AudioProc;
 
+typedef std::function<void(const VideoConfig &config, const Frame &frame,
+			   long long startTime, long long stopTime,
+			   long rotation)>
+	VideoFrameProc;
+
+typedef std::function<void(const AudioConfig &config, const Frame &frame,
+			   long long startTime, long long stopTime)>
+	AudioFrameProc;
+
+enum class StreamEventType {
+	/** Timestamps skipped ahead by one or more frames */
+	DroppedFrames,
+	/** Sample had the same timestamp as the one before it */
+	DuplicateTimestamp,
+	/** Sample was flagged as a discontinuity, or time went backwards */
+	Discontinuity,
+};
+
+struct StreamEvent {
+	StreamEventType type;
+
+	/** Start time of the sample the event was detected on */
+	long long timestamp;
+
+	/** Time between the expected and the actual timestamp */
+	long long gap;
+
+	/** Estimated number of lost video frames or audio sample frames */
+	long long count;
+};
+
+typedef std::function<void(const StreamEvent &event)> StreamEventProc;
+
 enum class InitGraph {
 	False,
 	True,
@@ -85,6 +180,7 @@ enum class VideoFormat {
 	NV12,
 	YV12,
 	Y800,
+	I444,
 
 	/* packed YUV formats */
 	YVYU = 300,
@@ -104,6 +200,10 @@ enum class AudioFormat {
 	/* raw formats */
 	Wave16bit = 100,
 	WaveFloat,
+	Wave24bit, /* packed, three bytes per sample */
+	Wave32bit,
+	/** Float with each channel in a plane of its own, one after another */
+	WaveFloatPlanar,
 
 	/* encoded formats */
 	AAC = 200,
@@ -117,6 +217,36 @@ enum class AudioMode {
 	WaveOut,
 };
 
+/** What a delivery queue does when a sample arrives while it is full */
+enum class QueuePolicy {
+	DropOldest,
+	DropNewest,
+	/**
+	 * Wait on the streaming thread until there's room.  The capture pin
+	 * then tells upstream filters that it can block.
+	 */
+	Block,
+};
+
+/** Filter used when video is scaled to the requested size in software */
+enum class VideoScaling {
+	/** Deliver the resolution the device picked */
+	None,
+	/** Averages the source pixels covered by each output pixel */
+	Area,
+	Bilinear,
+	Bicubic,
+};
+
+/** Quality used when audio is resampled to the requested rate in software */
+enum class AudioResampling {
+	/** Deliver the sample rate the device picked */
+	None,
+	Fast,
+	Medium,
+	Best,
+};
+
 enum class Result {
 	Success,
 	InUse,
@@ -157,17 +287,70 @@ struct AudioDevice : DeviceId {
 struct Config : DeviceId {
 	/** Use the device's desired default config */
 	bool useDefaultConfig = true;
+
+	/**
+	 * Number of samples that may be queued between the DirectShow
+	 * streaming thread and the callback.  If non-zero, callbacks are
+	 * called from a dedicated thread instead of the streaming thread.
+	 */
+	int queueDepth = 0;
+
+	/** What to do with samples that arrive while the queue is full */
+	QueuePolicy queuePolicy = QueuePolicy::DropOldest;
+
+	/**
+	 * Replace sample timestamps with smoothed, monotonic ones recovered
+	 * from the sample times and their arrival times.
+	 */
+	bool smoothTimestamps = false;
+
+	/**
+	 * Deliver encoded packets as soon as the bitstream shows they're
+	 * complete (whole ADTS or AC-3 frames, or every slice of an H.264
+	 * picture), rather than when the next packet starts.  Where it can't
+	 * tell, packets are still grouped by timestamp.
+	 */
+	bool lowLatency = false;
+
+	/**
+	 * Called from the streaming thread when dropped frames, duplicated
+	 * timestamps or discontinuities are detected.
+	 */
+	StreamEventProc eventCallback;
 };
 
 struct VideoConfig : Config {
 	VideoProc callback;
 
+	/**
+	 * Receives frames as reference counted handles instead.  If set, it
+	 * is used in place of callback.
+	 */
+	VideoFrameProc frameCallback;
+
+	/**
+	 * Maximum number of device buffers frame handles may keep alive at
+	 * once.  Past this, frames are copied in to pooled memory so the
+	 * upstream allocator is never starved.
+	 */
+	int maxOutstandingFrames = 4;
+
 	/** Desired width/height of video. */
 	int cx = 0, cy_abs = 0;
 
-	/** Whether or not cy was negative. */
+	/**
+	 * Whether or not cy was negative.  For RGB formats this means the
+	 * frames are top-down.
+	 */
 	bool cy_flip = false;
 
+	/**
+	 * Always deliver RGB frames top-down (cy_flip will be set).  Frames
+	 * that reference device memory describe bottom-up data with negative
+	 * linesizes; data given to a plain callback is flipped in to a copy.
+	 */
+	bool topDown = false;
+
 	/** Desired frame interval (in 100-nanosecond units) */
 	long long frameInterval = 0;
 
@@ -176,11 +359,85 @@ struct VideoConfig : Config {
 
 	/** Desired video format. */
 	VideoFormat format = VideoFormat::Any;
+
+	/**
+	 * If the device doesn't offer cx x cy_abs, frames from the closest
+	 * mode it does offer are scaled to exactly that size with this filter.
+	 * Callbacks then get a config with the requested size.  Encoded
+	 * formats aren't scaled, and packed 4:2:2 needs even widths.
+	 */
+	VideoScaling scaling = VideoScaling::None;
+
+	/**
+	 * Decode MJPEG in software.  With internalFormat set to MJPEG, frames
+	 * are decoded to format, which must be I420 or NV12 (I420 is used
+	 * otherwise).  Decoded frames aren't rotated, or scaled other than
+	 * by decodeScale.  Needs the library built with ENABLE_MJPEG_DECODE.
+	 *
+	 * Without a queueDepth, callbacks are then called from the decoding
+	 * threads rather than the streaming thread: never two at once and
+	 * always in order, but not always from the same thread.
+	 */
+	bool decodeMJPEG = false;
+
+	/**
+	 * Decode MJPEG at 1/decodeScale of the device's size: 1, 2, 4 or 8.
+	 * Scaling is done in the IDCT, so a quarter size preview costs far
+	 * less than a full decode.  Callbacks get a config with the reduced
+	 * size.  To get a preview as well as full size frames, use
+	 * previewCallback instead.
+	 */
+	int decodeScale = 1;
+
+	/**
+	 * Threads MJPEG is decoded on, several frames at a time.  Zero picks
+	 * a count from the CPU.
+	 */
+	int decodeThreads = 0;
+
+	/**
+	 * Second output of MJPEG frames decoded at 1/previewScale of the
+	 * device's size, alongside whatever is delivered to callback.  Only
+	 * the IDCT work the preview size needs is done, so a thumbnail costs
+	 * far less than a full decode.  Previews are I420 or NV12 (format if
+	 * it's one of those, I420 otherwise), aren't rotated, and get a
+	 * config with the reduced size.  They're called from decoding threads
+	 * of their own, in order but possibly while callback is running, and
+	 * are dropped rather than queued when decoding falls behind.  Needs
+	 * internalFormat set to MJPEG and the library built with
+	 * ENABLE_MJPEG_DECODE.
+	 */
+	VideoFrameProc previewCallback;
+
+	/** 1, 2, 4 or 8 */
+	int previewScale = 4;
+
+	/**
+	 * Interval (in milliseconds) at which the camera roll is polled on
+	 * auto-rotating devices.
+	 */
+	int rotationPollInterval = 250;
+
+	/**
+	 * Rotate frames from auto-rotating devices upright in the library.
+	 * Callbacks then get a rotation of zero, and a config with cx and
+	 * cy_abs swapped while the device is turned sideways.
+	 */
+	bool autoRotate = false;
 };
 
 struct AudioConfig : Config {
 	AudioProc callback;
 
+	/**
+	 * Receives audio as reference counted handles instead.  If set, it
+	 * is used in place of callback.
+	 */
+	AudioFrameProc frameCallback;
+
+	/** See VideoConfig::maxOutstandingFrames */
+	int maxOutstandingFrames = 4;
+
 	/**
 		 * Use the audio attached to the video device
 		 *
@@ -194,14 +451,138 @@ struct AudioConfig : Config {
 	/** Desired sample rate */
 	int sampleRate = 0;
 
+	/**
+	 * Resamples audio to sampleRate when the device can't deliver it.
+	 * The device's own rate is still used for gap detection.
+	 */
+	AudioResampling resampling = AudioResampling::None;
+
 	/** Desired channels */
 	int channels = 0;
 
+	/**
+	 * Mixes the device's channels to channels in software when it
+	 * delivers a different layout, such as HDMI devices that always
+	 * deliver 7.1.
+	 */
+	bool mixChannels = false;
+
+	/**
+	 * Weights mixChannels uses instead of the default downmix: a row of
+	 * weights for each of the device's channels, per output channel.
+	 * Picking channels 1 and 2 of 8 is {1,0,0,0,0,0,0,0,
+	 * 0,1,0,0,0,0,0,0}.  The number of rows sets the channel count.
+	 */
+	std::vector<float> channelMatrix;
+
+	/**
+	 * Format the device delivers.  When it differs from format, the
+	 * audio is converted to format in software.
+	 */
+	AudioFormat internalFormat = AudioFormat::Any;
+
 	/** Desired audio format */
 	AudioFormat format = AudioFormat::Any;
 
+	/**
+	 * Codec setup of encoded audio the library parses, so it can be
+	 * muxed without probing: the AudioSpecificConfig for AAC, or the
+	 * payload of the MP4 dac3 or dec3 box for AC-3 and E-AC-3.  Filled in
+	 * from the stream once its first frame has been seen, along with
+	 * sampleRate and channels.
+	 */
+	std::vector<unsigned char> codecConfig;
+
 	/** Audio playback mode */
 	AudioMode mode = AudioMode::Capture;
+
+	/**
+	 * If non-zero, uncompressed audio is re-split so that every callback
+	 * receives exactly this many frames (e.g. 1024 for AAC), with
+	 * timestamps interpolated from the device's buffers.
+	 */
+	int packetFrames = 0;
+};
+
+#define DSHOW_HISTOGRAM_BUCKETS 128
+
+/**
+ * Log-linear histogram of durations in microseconds.  Values below 16 get a
+ * bucket each, larger values are split in to four buckets per power of two.
+ */
+struct Histogram {
+	unsigned long long count = 0;
+	unsigned long long sum = 0;
+	unsigned long long buckets[DSHOW_HISTOGRAM_BUCKETS] = {};
+
+	/** Exclusive upper bound of a bucket, in microseconds */
+	static inline unsigned long long BucketUpperBound(int index)
+	{
+		if (index < 16)
+			return (unsigned long long)index + 1;
+
+		int shift = (index - 16) / 4 + 2;
+		int sub = (index - 16) % 4;
+		return (unsigned long long)(5 + sub) << shift;
+	}
+
+	/** Approximate value below which the given fraction of values lie */
+	inline unsigned long long Percentile(double fraction) const
+	{
+		unsigned long long target =
+			(unsigned long long)((double)count * fraction);
+		unsigned long long total = 0;
+
+		for (int i = 0; i < DSHOW_HISTOGRAM_BUCKETS; i++) {
+			total += buckets[i];
+			if (total > target)
+				return BucketUpperBound(i);
+		}
+
+		return count ? BucketUpperBound(DSHOW_HISTOGRAM_BUCKETS - 1)
+			     : 0;
+	}
+};
+
+struct StreamStats {
+	/** Samples and bytes received from the device */
+	unsigned long long samples = 0;
+	unsigned long long bytes = 0;
+
+	/** Number of times the media type changed while capturing */
+	unsigned long long formatChanges = 0;
+
+	/** Estimated lost video frames or audio sample frames */
+	unsigned long long droppedFrames = 0;
+	unsigned long long duplicateTimestamps = 0;
+	unsigned long long discontinuities = 0;
+
+	/**
+	 * Estimated rate of sample timestamps relative to the host clock, in
+	 * parts per million (only with smoothTimestamps)
+	 */
+	double clockDriftPpm = 0.0;
+
+	/**
+	 * Difference between the time between sample arrivals and the time
+	 * between their timestamps
+	 */
+	Histogram arrivalJitter;
+
+	/** Time spent in the user callback */
+	Histogram callbackTime;
+
+	/**
+	 * Delay between a sample's timestamp and the graph clock at the time
+	 * its callback is called
+	 */
+	Histogram delay;
+
+	/** Number of samples that arrived while the delivery queue was full */
+	unsigned long long queueOverflows = 0;
+
+	/** Largest number of samples waiting in the delivery queue */
+	unsigned long long queueHighWater = 0;
 };
 
 class DSHOWCAPTURE_EXPORT Device {
@@ -234,6 +615,9 @@ public:
 	bool GetVideoDeviceId(DeviceId &id) const;
 	bool GetAudioDeviceId(DeviceId &id) const;
 
+	bool GetVideoStats(StreamStats &stats) const;
+	bool GetAudioStats(StreamStats &stats) const;
+
 	/**
 		 * Opens a DirectShow dialog associated with this device
 		 *
@@ -294,4 +678,27 @@ enum class LogType {
 typedef void (*LogCallback)(LogType type, const wchar_t *msg, void *param);
 
 DSHOWCAPTURE_EXPORT void SetLogCallback(LogCallback callback, void *param);
+
+/**
+ * Sets how many threads per-frame processing (scaling, format conversion,
+ * flipping and rotation) is split across.  The threads are shared by every
+ * Device, and the streaming thread delivering a frame counts as one of
+ * them, so 1 turns the workers off.  0 picks a count from the number of
+ * processors.  A non-zero affinityMask keeps the workers on those
+ * processors.  Takes effect from the next frame.
+ */
+DSHOWCAPTURE_EXPORT void SetWorkerThreads(int threads,
+					  unsigned long long affinityMask = 0);
+
+struct StatsExport {
+	/** Prometheus label set without braces, e.g. stream="video" */
+	std::string labels;
+	StreamStats stats;
+};
+
+/**
+ * Formats stream statistics in the Prometheus text exposition format.
+ */
+DSHOWCAPTURE_EXPORT std::string
+FormatPrometheusStats(const std::vector<StatsExport> &streams);
 };
@@ -0,0 +1,175 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "access-unit.hpp"
+#include "audio-parser.hpp"
+
+#include <algorithm>
+#include <string.h>
+
+namespace DShow {
+
+void H264AccessUnits::Reset()
+{
+	nals.clear();
+	slices = 0;
+	lastSlices = 0;
+	learnedSlices = 0;
+	varies = false;
+	sentEarly = false;
+}
+
+static inline bool IsSlice(int type)
+{
+	return type == H264_NAL_SLICE || type == H264_NAL_IDR;
+}
+
+bool H264AccessUnits::Add(const unsigned char *data, size_t size,
+			  bool timestamped)
+{
+	/* only a sample that begins with a start code can begin a unit */
+	size_t first = FindStartCode(data, std::min(size, (size_t)4));
+	bool aligned = first <= 1;
+
+	SplitH264(data, size, nals);
+
+	bool begins = false;
+	if (aligned && !nals.empty()) {
+		const H264NAL &nal = nals[0];
+
+		switch (nal.type) {
+		case H264_NAL_AUD:
+		case H264_NAL_SEI:
+		case H264_NAL_SPS:
+		case H264_NAL_PPS:
+			begins = true;
+			break;
+		case H264_NAL_SLICE:
+		case H264_NAL_IDR:
+			begins = GetH264FirstMB(nal.data, nal.size) == 0;
+			break;
+		}
+	}
+
+	/* whatever follows a packet that was sent early has to begin the
+	 * next one, or the packet was missing slices */
+	if (sentEarly && !begins && !timestamped) {
+		varies = true;
+		learnedSlices = 0;
+	}
+
+	sentEarly = false;
+
+	bool starts = begins && slices;
+	if (starts || timestamped)
+		EndPacket();
+
+	for (const H264NAL &nal : nals) {
+		if (IsSlice(nal.type))
+			slices++;
+	}
+
+	return starts;
+}
+
+void H264AccessUnits::AddPayload(const unsigned char *data, size_t size,
+				 size_t scanned, bool timestamped)
+{
+	if (!scanned) {
+		Add(data, size, timestamped);
+		return;
+	}
+
+	/* back up over a start code that was cut off last time.  One that
+	 * was already whole had its type byte counted with it */
+	size_t back = std::min(scanned, (size_t)3);
+	SplitH264(data + scanned - back, size - scanned + back, nals);
+
+	for (const H264NAL &nal : nals) {
+		if (IsSlice(nal.type))
+			slices++;
+	}
+}
+
+void H264AccessUnits::EndPacket()
+{
+	/* already done if the packet was sent early */
+	if (!slices)
+		return;
+
+	if (learnedSlices && slices != learnedSlices)
+		varies = true;
+
+	learnedSlices = !varies && slices == lastSlices ? slices : 0;
+	lastSlices = slices;
+	slices = 0;
+}
+
+void H264AccessUnits::PacketDone()
+{
+	EndPacket();
+	sentEarly = true;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void AudioAccessUnits::Reset(AudioFormat format_)
+{
+	format = format_;
+	headerSize = GetAudioFrameHeaderSize(format);
+	headerBytes = 0;
+	remaining = 0;
+	frames = 0;
+	lost = false;
+}
+
+void AudioAccessUnits::Add(const unsigned char *data, size_t size)
+{
+	size_t pos = 0;
+
+	while (Active() && pos < size) {
+		if (remaining) {
+			size_t skip = std::min(remaining, size - pos);
+			remaining -= skip;
+			pos += skip;
+			continue;
+		}
+
+		/* headers can be split between samples */
+		size_t copy = std::min(headerSize - headerBytes, size - pos);
+		memcpy(header + headerBytes, data + pos, copy);
+		headerBytes += copy;
+		pos += copy;
+
+		if (headerBytes < headerSize)
+			break;
+
+		size_t frameSize = GetAudioFrameSize(format, header);
+		if (frameSize < headerSize) {
+			lost = true;
+			break;
+		}
+
+		remaining = frameSize - headerSize;
+		headerBytes = 0;
+		frames++;
+	}
+}
+
+}; /* namespace DShow */
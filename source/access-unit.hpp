@@ -0,0 +1,111 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+#include "h264-parser.hpp"
+
+#include <vector>
+#include <stddef.h>
+
+namespace DShow {
+
+/**
+ * Works out from the bitstream where H.264 access units end, one sample at
+ * a time.  A sample that begins with an AUD, a parameter set, SEI or the
+ * first slice of a picture starts a new access unit.  Once the last two
+ * access units had the same number of slices, one is also complete when
+ * that many slices have arrived.  If the count ever changes, or a packet
+ * sent early turns out to have been cut short, packets are only ended by
+ * the start of the next one until Reset.
+ */
+class H264AccessUnits {
+	std::vector<H264NAL> nals;
+	int slices = 0;
+	int lastSlices = 0;
+	int learnedSlices = 0;
+	bool varies = false;
+	bool sentEarly = false;
+
+	void EndPacket();
+
+public:
+	void Reset();
+
+	/**
+	 * Scans the next sample.  Returns true if the bitstream shows that it
+	 * starts a new access unit, and the packet so far should be sent
+	 * first.  Samples with a timestamp always start one.
+	 */
+	bool Add(const unsigned char *data, size_t size, bool timestamped);
+
+	/**
+	 * Scans a PES packet's payload as the demuxer reassembles it, given
+	 * all of it so far, of which the first scanned bytes were seen
+	 * before.  Its first piece is treated like a sample.
+	 */
+	void AddPayload(const unsigned char *data, size_t size,
+			size_t scanned, bool timestamped);
+
+	/**
+	 * Whether the packet has all of its slices.  The last one may not
+	 * have all of its data yet, which the caller has to know from
+	 * elsewhere.
+	 */
+	inline bool Complete() const
+	{
+		return learnedSlices && slices == learnedSlices;
+	}
+
+	/** Learns from a packet that was sent as soon as it was complete */
+	void PacketDone();
+};
+
+/**
+ * Follows ADTS or AC-3 frame lengths across samples.  A packet is complete
+ * as soon as it ends on a frame boundary.  If the stream stops making
+ * sense, it gives up until it's reset.
+ */
+class AudioAccessUnits {
+	size_t headerSize = 0;
+	AudioFormat format = AudioFormat::Any;
+
+	unsigned char header[8];
+	size_t headerBytes = 0;
+	size_t remaining = 0;
+	int frames = 0;
+	bool lost = false;
+
+public:
+	void Reset(AudioFormat format);
+
+	inline bool Active() const { return headerSize && !lost; }
+
+	void Add(const unsigned char *data, size_t size);
+
+	inline bool Complete() const
+	{
+		return Active() && frames && !remaining && !headerBytes;
+	}
+
+	inline void PacketDone() { frames = 0; }
+};
+
+}; /* namespace DShow */
@@ -0,0 +1,858 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "audio-convert.hpp"
+#include "dshow-simd.hpp"
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace DShow {
+
+/* everything but float to float goes through a block of float samples
+ * small enough to stay in the L1 cache */
+#define AUDIO_BLOCK_SAMPLES 2048
+
+/* mixing keeps four blocks (input, its planes, mixed planes, interleaved
+ * output), so they're smaller */
+#define MIX_BLOCK_SAMPLES 1024
+
+#define S16_SCALE (1.0f / 32768.0f)
+#define S32_SCALE (1.0f / 2147483648.0f)
+
+typedef void (*ToFloatFunc)(const void *src, float *dst, size_t count);
+typedef void (*ToS16Func)(const float *src, int16_t *dst, size_t count);
+
+/* plane c of the output starts at dst + c * stride */
+typedef void (*DeinterleaveFunc)(const float *src, float *dst, size_t stride,
+				 size_t frames, int channels);
+typedef void (*InterleaveFunc)(const float *src, size_t stride, float *dst,
+			       size_t frames, int channels);
+
+/* output plane m is the sum of the input planes weighted by row m of the
+ * matrix.  Zero weights are skipped */
+typedef void (*MixFunc)(const float *src, size_t srcStride, int inChannels,
+			float *dst, size_t dstStride, int outChannels,
+			const float *matrix, size_t frames);
+
+enum {
+	INPUT_S16,
+	INPUT_S24,
+	INPUT_S32,
+	INPUT_FLOAT,
+	INPUT_COUNT,
+};
+
+static int InputIndex(AudioFormat format)
+{
+	switch (format) {
+	case AudioFormat::Wave16bit:
+		return INPUT_S16;
+	case AudioFormat::Wave24bit:
+		return INPUT_S24;
+	case AudioFormat::Wave32bit:
+		return INPUT_S32;
+	case AudioFormat::WaveFloat:
+		return INPUT_FLOAT;
+	default:
+		return -1;
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+/* scalar                                                                   */
+
+static void S16ToFloatScalar(const void *src, float *dst, size_t count)
+{
+	const int16_t *s = (const int16_t *)src;
+
+	for (size_t i = 0; i < count; i++)
+		dst[i] = (float)s[i] * S16_SCALE;
+}
+
+/* 24-bit samples are moved to the top of a 32-bit int, which a float holds
+ * exactly */
+static void S24ToFloatScalar(const void *src, float *dst, size_t count)
+{
+	const uint8_t *s = (const uint8_t *)src;
+
+	for (size_t i = 0; i < count; i++) {
+		uint32_t v = ((uint32_t)s[0] << 8) | ((uint32_t)s[1] << 16) |
+			     ((uint32_t)s[2] << 24);
+		dst[i] = (float)(int32_t)v * S32_SCALE;
+		s += 3;
+	}
+}
+
+static void S32ToFloatScalar(const void *src, float *dst, size_t count)
+{
+	const int32_t *s = (const int32_t *)src;
+
+	for (size_t i = 0; i < count; i++)
+		dst[i] = (float)s[i] * S32_SCALE;
+}
+
+static void FloatToFloat(const void *src, float *dst, size_t count)
+{
+	memcpy(dst, src, count * sizeof(float));
+}
+
+/* written so that NaN clips to -1, the way maxps treats it */
+static inline float Clip(float x)
+{
+	x = x > -1.0f ? x : -1.0f;
+	return x < 1.0f ? x : 1.0f;
+}
+
+static void FloatToS16Scalar(const float *src, int16_t *dst, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		long v = lrintf(Clip(src[i]) * 32768.0f);
+		dst[i] = (int16_t)std::min(v, 32767L);
+	}
+}
+
+static void DeinterleaveScalar(const float *src, float *dst, size_t stride,
+			       size_t frames, int channels)
+{
+	for (size_t i = 0; i < frames; i++) {
+		for (int c = 0; c < channels; c++)
+			dst[c * stride + i] = src[c];
+		src += channels;
+	}
+}
+
+static void InterleaveScalar(const float *src, size_t stride, float *dst,
+			     size_t frames, int channels)
+{
+	for (size_t i = 0; i < frames; i++) {
+		for (int c = 0; c < channels; c++)
+			dst[c] = src[c * stride + i];
+		dst += channels;
+	}
+}
+
+static void MixScalar(const float *src, size_t srcStride, int inChannels,
+		      float *dst, size_t dstStride, int outChannels,
+		      const float *matrix, size_t frames)
+{
+	for (int m = 0; m < outChannels; m++) {
+		const float *weights = matrix + m * inChannels;
+		float *out = dst + m * dstStride;
+
+		for (size_t i = 0; i < frames; i++) {
+			float sum = 0.0f;
+
+			for (int c = 0; c < inChannels; c++) {
+				if (weights[c] != 0.0f)
+					sum += src[c * srcStride + i] *
+					       weights[c];
+			}
+
+			out[i] = sum;
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+/* x86                                                                      */
+
+#ifdef SIMD_X86
+
+SIMD_TARGET("sse2")
+static void S16ToFloatSSE2(const void *src, float *dst, size_t count)
+{
+	const int16_t *s = (const int16_t *)src;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 scale = _mm_set1_ps(S32_SCALE);
+	size_t i = 0;
+
+	/* unpacking with zero below puts the samples in the top half */
+	for (; i + 8 <= count; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		__m128i lo = _mm_unpacklo_epi16(zero, v);
+		__m128i hi = _mm_unpackhi_epi16(zero, v);
+
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(dst + i + 4,
+			      _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+
+	S16ToFloatScalar(s + i, dst + i, count - i);
+}
+
+SIMD_TARGET("ssse3")
+static void S24ToFloatSSSE3(const void *src, float *dst, size_t count)
+{
+	const uint8_t *s = (const uint8_t *)src;
+	const __m128i shuffle = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6,
+					      7, 8, -1, 9, 10, 11);
+	const __m128 scale = _mm_set1_ps(S32_SCALE);
+	size_t i = 0;
+
+	/* four samples come from the first 12 of 16 bytes loaded, so stop
+	 * while the load still fits */
+	for (; i + 6 <= count; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i * 3));
+		v = _mm_shuffle_epi8(v, shuffle);
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+	}
+
+	S24ToFloatScalar(s + i * 3, dst + i, count - i);
+}
+
+SIMD_TARGET("sse2")
+static void S32ToFloatSSE2(const void *src, float *dst, size_t count)
+{
+	const int32_t *s = (const int32_t *)src;
+	const __m128 scale = _mm_set1_ps(S32_SCALE);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+	}
+
+	S32ToFloatScalar(s + i, dst + i, count - i);
+}
+
+/* cvtps rounds to nearest even like lrintf, and packs saturates 32768 */
+SIMD_TARGET("sse2")
+static void FloatToS16SSE2(const float *src, int16_t *dst, size_t count)
+{
+	const __m128 min = _mm_set1_ps(-1.0f);
+	const __m128 max = _mm_set1_ps(1.0f);
+	const __m128 scale = _mm_set1_ps(32768.0f);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m128 a = _mm_loadu_ps(src + i);
+		__m128 b = _mm_loadu_ps(src + i + 4);
+
+		a = _mm_mul_ps(_mm_min_ps(_mm_max_ps(a, min), max), scale);
+		b = _mm_mul_ps(_mm_min_ps(_mm_max_ps(b, min), max), scale);
+		_mm_storeu_si128((__m128i *)(dst + i),
+				 _mm_packs_epi32(_mm_cvtps_epi32(a),
+						 _mm_cvtps_epi32(b)));
+	}
+
+	FloatToS16Scalar(src + i, dst + i, count - i);
+}
+
+SIMD_TARGET("avx2")
+static void S16ToFloatAVX2(const void *src, float *dst, size_t count)
+{
+	const int16_t *s = (const int16_t *)src;
+	const __m256 scale = _mm256_set1_ps(S16_SCALE);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256i v = _mm256_cvtepi16_epi32(
+			_mm_loadu_si128((const __m128i *)(s + i)));
+		_mm256_storeu_ps(dst + i,
+				 _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+	}
+
+	S16ToFloatScalar(s + i, dst + i, count - i);
+}
+
+SIMD_TARGET("avx2")
+static void S32ToFloatAVX2(const void *src, float *dst, size_t count)
+{
+	const int32_t *s = (const int32_t *)src;
+	const __m256 scale = _mm256_set1_ps(S32_SCALE);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+		_mm256_storeu_ps(dst + i,
+				 _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+	}
+
+	S32ToFloatScalar(s + i, dst + i, count - i);
+}
+
+SIMD_TARGET("avx2")
+static void FloatToS16AVX2(const float *src, int16_t *dst, size_t count)
+{
+	const __m256 min = _mm256_set1_ps(-1.0f);
+	const __m256 max = _mm256_set1_ps(1.0f);
+	const __m256 scale = _mm256_set1_ps(32768.0f);
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m256 a = _mm256_loadu_ps(src + i);
+		__m256 b = _mm256_loadu_ps(src + i + 8);
+
+		a = _mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(a, min), max),
+				  scale);
+		b = _mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(b, min), max),
+				  scale);
+
+		/* packs works within lanes, which leaves the quarters out
+		 * of order */
+		__m256i v = _mm256_packs_epi32(_mm256_cvtps_epi32(a),
+					       _mm256_cvtps_epi32(b));
+		v = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256((__m256i *)(dst + i), v);
+	}
+
+	FloatToS16SSE2(src + i, dst + i, count - i);
+}
+
+/* planar output is made four frames at a time.  2, 4, 6 and 8 channels
+ * (stereo through 7.1) get shuffles of their own; other counts gather each
+ * channel's four samples */
+
+SIMD_TARGET("sse2")
+static void Deinterleave2SSE2(const float *src, float *dst, size_t stride,
+			      size_t frames, int channels)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= frames; i += 4) {
+		__m128 a = _mm_loadu_ps(src);
+		__m128 b = _mm_loadu_ps(src + 4);
+
+		_mm_storeu_ps(dst + i,
+			      _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(dst + stride + i,
+			      _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+		src += 8;
+	}
+
+	DeinterleaveScalar(src, dst + i, stride, frames - i, channels);
+}
+
+SIMD_TARGET("sse2")
+static inline void Store4x4(__m128 r0, __m128 r1, __m128 r2, __m128 r3,
+			    float *dst, size_t stride)
+{
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	_mm_storeu_ps(dst, r0);
+	_mm_storeu_ps(dst + stride, r1);
+	_mm_storeu_ps(dst + stride * 2, r2);
+	_mm_storeu_ps(dst + stride * 3, r3);
+}
+
+SIMD_TARGET("sse2")
+static void Deinterleave4SSE2(const float *src, float *dst, size_t stride,
+			      size_t frames, int channels)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= frames; i += 4) {
+		Store4x4(_mm_loadu_ps(src), _mm_loadu_ps(src + 4),
+			 _mm_loadu_ps(src + 8), _mm_loadu_ps(src + 12), dst + i,
+			 stride);
+		src += 16;
+	}
+
+	DeinterleaveScalar(src, dst + i, stride, frames - i, channels);
+}
+
+SIMD_TARGET("sse2")
+static void Deinterleave6SSE2(const float *src, float *dst, size_t stride,
+			      size_t frames, int channels)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= frames; i += 4) {
+		__m128 v0 = _mm_loadu_ps(src);
+		__m128 v1 = _mm_loadu_ps(src + 4);
+		__m128 v2 = _mm_loadu_ps(src + 8);
+		__m128 v3 = _mm_loadu_ps(src + 12);
+		__m128 v4 = _mm_loadu_ps(src + 16);
+		__m128 v5 = _mm_loadu_ps(src + 20);
+
+		/* frames 1 and 3 straddle two registers each */
+		__m128 f1 = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(1, 0, 3, 2));
+		__m128 f3 = _mm_shuffle_ps(v4, v5, _MM_SHUFFLE(1, 0, 3, 2));
+		Store4x4(v0, f1, v3, f3, dst + i, stride);
+
+		/* channels 4 and 5 of frames 0-1 and 2-3 */
+		__m128 g0 = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(3, 2, 1, 0));
+		__m128 g1 = _mm_shuffle_ps(v4, v5, _MM_SHUFFLE(3, 2, 1, 0));
+		_mm_storeu_ps(dst + stride * 4 + i,
+			      _mm_shuffle_ps(g0, g1, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(dst + stride * 5 + i,
+			      _mm_shuffle_ps(g0, g1, _MM_SHUFFLE(3, 1, 3, 1)));
+		src += 24;
+	}
+
+	DeinterleaveScalar(src, dst + i, stride, frames - i, channels);
+}
+
+SIMD_TARGET("sse2")
+static void Deinterleave8SSE2(const float *src, float *dst, size_t stride,
+			      size_t frames, int channels)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= frames; i += 4) {
+		Store4x4(_mm_loadu_ps(src), _mm_loadu_ps(src + 8),
+			 _mm_loadu_ps(src + 16), _mm_loadu_ps(src + 24),
+			 dst + i, stride);
+		Store4x4(_mm_loadu_ps(src + 4), _mm_loadu_ps(src + 12),
+			 _mm_loadu_ps(src + 20), _mm_loadu_ps(src + 28),
+			 dst + stride * 4 + i, stride);
+		src += 32;
+	}
+
+	DeinterleaveScalar(src, dst + i, stride, frames - i, channels);
+}
+
+SIMD_TARGET("sse2")
+static void DeinterleaveGatherSSE2(const float *src, float *dst, size_t stride,
+				   size_t frames, int channels)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= frames; i += 4) {
+		for (int c = 0; c < channels; c++)
+			_mm_storeu_ps(dst + c * stride + i,
+				      _mm_setr_ps(src[c], src[c + channels],
+						  src[c + channels * 2],
+						  src[c + channels * 3]));
+		src += channels * 4;
+	}
+
+	DeinterleaveScalar(src, dst + i, stride, frames - i, channels);
+}
+
+SIMD_TARGET("sse2")
+static void InterleaveSSE2(const float *src, size_t stride, float *dst,
+			   size_t frames, int channels)
+{
+	size_t i = 0;
+
+	if (channels == 2) {
+		const float *left = src;
+		const float *right = src + stride;
+
+		for (; i + 4 <= frames; i += 4) {
+			__m128 l = _mm_loadu_ps(left + i);
+			__m128 r = _mm_loadu_ps(right + i);
+
+			_mm_storeu_ps(dst, _mm_unpacklo_ps(l, r));
+			_mm_storeu_ps(dst + 4, _mm_unpackhi_ps(l, r));
+			dst += 8;
+		}
+	}
+
+	InterleaveScalar(src + i, stride, dst, frames - i, channels);
+}
+
+SIMD_TARGET("sse2")
+static void MixSSE2(const float *src, size_t srcStride, int inChannels,
+		    float *dst, size_t dstStride, int outChannels,
+		    const float *matrix, size_t frames)
+{
+	size_t end = frames & ~(size_t)3;
+
+	for (int m = 0; m < outChannels; m++) {
+		const float *weights = matrix + m * inChannels;
+		float *out = dst + m * dstStride;
+
+		for (size_t i = 0; i < end; i += 4) {
+			__m128 sum = _mm_setzero_ps();
+
+			for (int c = 0; c < inChannels; c++) {
+				if (weights[c] == 0.0f)
+					continue;
+
+				__m128 v = _mm_loadu_ps(src + c * srcStride +
+							i);
+				__m128 w = _mm_set1_ps(weights[c]);
+				sum = _mm_add_ps(sum, _mm_mul_ps(v, w));
+			}
+
+			_mm_storeu_ps(out + i, sum);
+		}
+	}
+
+	MixScalar(src + end, srcStride, inChannels, dst + end, dstStride,
+		  outChannels, matrix, frames - end);
+}
+
+SIMD_TARGET("avx2")
+static void MixAVX2(const float *src, size_t srcStride, int inChannels,
+		    float *dst, size_t dstStride, int outChannels,
+		    const float *matrix, size_t frames)
+{
+	size_t end = frames & ~(size_t)7;
+
+	for (int m = 0; m < outChannels; m++) {
+		const float *weights = matrix + m * inChannels;
+		float *out = dst + m * dstStride;
+
+		for (size_t i = 0; i < end; i += 8) {
+			__m256 sum = _mm256_setzero_ps();
+
+			for (int c = 0; c < inChannels; c++) {
+				if (weights[c] == 0.0f)
+					continue;
+
+				__m256 v = _mm256_loadu_ps(src + c * srcStride +
+							   i);
+				__m256 w = _mm256_set1_ps(weights[c]);
+				sum = _mm256_add_ps(sum, _mm256_mul_ps(v, w));
+			}
+
+			_mm256_storeu_ps(out + i, sum);
+		}
+	}
+
+	MixSSE2(src + end, srcStride, inChannels, dst + end, dstStride,
+		outChannels, matrix, frames - end);
+}
+
+#endif
+
+/* ------------------------------------------------------------------------ */
+
+struct AudioKernels {
+	ToFloatFunc toFloat[INPUT_COUNT];
+	ToS16Func toS16;
+	DeinterleaveFunc deinterleave[9];
+	InterleaveFunc interleave;
+	MixFunc mix;
+};
+
+static const AudioKernels scalarKernels = {
+	{S16ToFloatScalar, S24ToFloatScalar, S32ToFloatScalar, FloatToFloat},
+	FloatToS16Scalar,
+	{DeinterleaveScalar, DeinterleaveScalar, DeinterleaveScalar,
+	 DeinterleaveScalar, DeinterleaveScalar, DeinterleaveScalar,
+	 DeinterleaveScalar, DeinterleaveScalar, DeinterleaveScalar},
+	InterleaveScalar,
+	MixScalar,
+};
+
+#ifdef SIMD_X86
+
+#define SSE2_DEINTERLEAVE                                                  \
+	{                                                                  \
+		DeinterleaveScalar, DeinterleaveScalar, Deinterleave2SSE2, \
+			DeinterleaveGatherSSE2, Deinterleave4SSE2,         \
+			DeinterleaveGatherSSE2, Deinterleave6SSE2,         \
+			DeinterleaveGatherSSE2, Deinterleave8SSE2          \
+	}
+
+static const AudioKernels sse2Kernels = {
+	{S16ToFloatSSE2, S24ToFloatScalar, S32ToFloatSSE2, FloatToFloat},
+	FloatToS16SSE2,
+	SSE2_DEINTERLEAVE,
+	InterleaveSSE2,
+	MixSSE2,
+};
+
+static const AudioKernels ssse3Kernels = {
+	{S16ToFloatSSE2, S24ToFloatSSSE3, S32ToFloatSSE2, FloatToFloat},
+	FloatToS16SSE2,
+	SSE2_DEINTERLEAVE,
+	InterleaveSSE2,
+	MixSSE2,
+};
+
+static const AudioKernels avx2Kernels = {
+	{S16ToFloatAVX2, S24ToFloatSSSE3, S32ToFloatAVX2, FloatToFloat},
+	FloatToS16AVX2,
+	SSE2_DEINTERLEAVE,
+	InterleaveSSE2,
+	MixAVX2,
+};
+
+#endif
+
+static const AudioKernels &GetAudioKernels(ConvertPath path)
+{
+	switch (path) {
+#ifdef SIMD_X86
+	case ConvertPath::SSE2:
+		return sse2Kernels;
+	case ConvertPath::SSSE3:
+		return ssse3Kernels;
+	case ConvertPath::AVX2:
+		return avx2Kernels;
+#endif
+	default:
+		return scalarKernels;
+	}
+}
+
+int AudioSampleSize(AudioFormat format)
+{
+	switch (format) {
+	case AudioFormat::Wave16bit:
+		return 2;
+	case AudioFormat::Wave24bit:
+		return 3;
+	case AudioFormat::Wave32bit:
+	case AudioFormat::WaveFloat:
+	case AudioFormat::WaveFloatPlanar:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+bool CanConvertAudio(AudioFormat inFormat, AudioFormat outFormat)
+{
+	if (inFormat == outFormat || InputIndex(inFormat) < 0)
+		return false;
+
+	return outFormat == AudioFormat::Wave16bit ||
+	       outFormat == AudioFormat::WaveFloat ||
+	       outFormat == AudioFormat::WaveFloatPlanar;
+}
+
+bool ConvertAudio(AudioFormat inFormat, const void *src,
+		  AudioFormat outFormat, void *dst, size_t frames,
+		  int channels)
+{
+	static const ConvertPath path = GetConvertPath();
+	return ConvertAudio(inFormat, src, outFormat, dst, frames, channels,
+			    path);
+}
+
+bool ConvertAudio(AudioFormat inFormat, const void *src,
+		  AudioFormat outFormat, void *dst, size_t frames,
+		  int channels, ConvertPath path)
+{
+	if (!CanConvertAudio(inFormat, outFormat))
+		return false;
+	if (!src || !dst || channels <= 0 || channels > AUDIO_BLOCK_SAMPLES)
+		return false;
+	if (!ConvertPathSupported(path))
+		return false;
+
+	const AudioKernels &kernels = GetAudioKernels(path);
+	ToFloatFunc toFloat = kernels.toFloat[InputIndex(inFormat)];
+	DeinterleaveFunc deinterleave =
+		channels <= 8 ? kernels.deinterleave[channels]
+			      : DeinterleaveScalar;
+	bool planar = outFormat == AudioFormat::WaveFloatPlanar;
+	float *planes = (float *)dst;
+
+	if (outFormat == AudioFormat::WaveFloat) {
+		toFloat(src, planes, frames * channels);
+		return true;
+	}
+
+	if (planar && inFormat == AudioFormat::WaveFloat) {
+		deinterleave((const float *)src, planes, frames, frames,
+			     channels);
+		return true;
+	}
+
+	float block[AUDIO_BLOCK_SAMPLES];
+	size_t blockFrames = AUDIO_BLOCK_SAMPLES / channels;
+	size_t frameSize = AudioSampleSize(inFormat) * channels;
+
+	for (size_t i = 0; i < frames; i += blockFrames) {
+		size_t count = std::min(blockFrames, frames - i);
+
+		toFloat((const uint8_t *)src + i * frameSize, block,
+			count * channels);
+
+		if (planar)
+			deinterleave(block, planes + i, frames, count,
+				     channels);
+		else
+			kernels.toS16(block, (int16_t *)dst + i * channels,
+				      count * channels);
+	}
+
+	return true;
+}
+
+bool CanMixAudio(AudioFormat inFormat, AudioFormat outFormat)
+{
+	if (InputIndex(inFormat) < 0)
+		return false;
+
+	return outFormat == AudioFormat::Wave16bit ||
+	       outFormat == AudioFormat::WaveFloat ||
+	       outFormat == AudioFormat::WaveFloatPlanar;
+}
+
+bool MixAudio(AudioFormat inFormat, const void *src, int inChannels,
+	      AudioFormat outFormat, void *dst, int outChannels,
+	      const float *matrix, size_t frames)
+{
+	static const ConvertPath path = GetConvertPath();
+	return MixAudio(inFormat, src, inChannels, outFormat, dst, outChannels,
+			matrix, frames, path);
+}
+
+bool MixAudio(AudioFormat inFormat, const void *src, int inChannels,
+	      AudioFormat outFormat, void *dst, int outChannels,
+	      const float *matrix, size_t frames, ConvertPath path)
+{
+	if (!CanMixAudio(inFormat, outFormat))
+		return false;
+	if (!src || !dst || !matrix)
+		return false;
+	if (inChannels <= 0 || inChannels > MAX_MIX_CHANNELS ||
+	    outChannels <= 0 || outChannels > MAX_MIX_CHANNELS)
+		return false;
+	if (!ConvertPathSupported(path))
+		return false;
+
+	const AudioKernels &kernels = GetAudioKernels(path);
+	ToFloatFunc toFloat = kernels.toFloat[InputIndex(inFormat)];
+	DeinterleaveFunc deinterleave =
+		inChannels <= 8 ? kernels.deinterleave[inChannels]
+				: DeinterleaveScalar;
+	bool planar = outFormat == AudioFormat::WaveFloatPlanar;
+
+	/* each block is made in to float, split in to planes, mixed and put
+	 * back together while it's still in the cache, so src and dst are
+	 * only swept over once */
+	float input[MIX_BLOCK_SAMPLES];
+	float planes[MIX_BLOCK_SAMPLES];
+	float mixed[MIX_BLOCK_SAMPLES];
+	float output[MIX_BLOCK_SAMPLES];
+	size_t blockFrames =
+		MIX_BLOCK_SAMPLES / std::max(inChannels, outChannels);
+	size_t frameSize = AudioSampleSize(inFormat) * inChannels;
+
+	for (size_t i = 0; i < frames; i += blockFrames) {
+		size_t count = std::min(blockFrames, frames - i);
+		const void *block = (const uint8_t *)src + i * frameSize;
+		const float *interleaved = (const float *)block;
+
+		if (inFormat != AudioFormat::WaveFloat) {
+			toFloat(block, input, count * inChannels);
+			interleaved = input;
+		}
+
+		deinterleave(interleaved, planes, blockFrames, count,
+			     inChannels);
+
+		if (planar) {
+			kernels.mix(planes, blockFrames, inChannels,
+				    (float *)dst + i, frames, outChannels,
+				    matrix, count);
+			continue;
+		}
+
+		kernels.mix(planes, blockFrames, inChannels, mixed,
+			    blockFrames, outChannels, matrix, count);
+
+		if (outFormat == AudioFormat::WaveFloat) {
+			kernels.interleave(mixed, blockFrames,
+					   (float *)dst + i * outChannels,
+					   count, outChannels);
+		} else {
+			kernels.interleave(mixed, blockFrames, output, count,
+					   outChannels);
+			kernels.toS16(output,
+				      (int16_t *)dst + i * outChannels,
+				      count * outChannels);
+		}
+	}
+
+	return true;
+}
+
+/* speaker positions of the default WAVEFORMATEXTENSIBLE layouts */
+enum Speaker {
+	FrontLeft,
+	FrontRight,
+	FrontCenter,
+	LowFrequency,
+	SideLeft,
+	SideRight,
+};
+
+static const Speaker *GetSpeakers(int channels)
+{
+	static const Speaker stereo[] = {FrontLeft, FrontRight};
+	static const Speaker surround[] = {FrontLeft, FrontRight, FrontCenter};
+	static const Speaker quad[] = {FrontLeft, FrontRight, SideLeft,
+				       SideRight};
+	static const Speaker surround51[] = {FrontLeft,   FrontRight,
+					     FrontCenter, LowFrequency,
+					     SideLeft,    SideRight};
+	static const Speaker surround71[] = {FrontLeft,   FrontRight,
+					     FrontCenter, LowFrequency,
+					     SideLeft,    SideRight,
+					     SideLeft,    SideRight};
+
+	switch (channels) {
+	case 2:
+		return stereo;
+	case 3:
+		return surround;
+	case 4:
+		return quad;
+	case 6:
+		return surround51;
+	case 8:
+		return surround71;
+	default:
+		return nullptr;
+	}
+}
+
+void GetDefaultChannelMatrix(int inChannels, int outChannels,
+			     std::vector<float> &matrix)
+{
+	const Speaker *speakers = GetSpeakers(inChannels);
+
+	matrix.assign((size_t)inChannels * outChannels, 0.0f);
+
+	if (outChannels == inChannels || !speakers ||
+	    (outChannels != 1 && outChannels != 2)) {
+		for (int i = 0; i < std::min(inChannels, outChannels); i++)
+			matrix[i * inChannels + i] = 1.0f;
+		return;
+	}
+
+	/* center and surrounds at -3 dB, no LFE, and each row scaled so it
+	 * can't clip */
+	for (int m = 0; m < outChannels; m++) {
+		float *row = matrix.data() + m * inChannels;
+		float sum = 0.0f;
+
+		for (int c = 0; c < inChannels; c++) {
+			Speaker s = speakers[c];
+			bool left = s == FrontLeft || s == SideLeft;
+			bool right = s == FrontRight || s == SideRight;
+			bool front = s == FrontLeft || s == FrontRight;
+
+			if (s == LowFrequency)
+				continue;
+			if (outChannels == 2 && (m == 0 ? right : left))
+				continue;
+
+			row[c] = front ? 1.0f : 0.70710678f;
+			sum += row[c];
+		}
+
+		for (int c = 0; c < inChannels; c++)
+			row[c] /= sum;
+	}
+}
+
+}; /* namespace DShow */
@@ -0,0 +1,80 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+#include "dshow-convert.hpp"
+
+#include <vector>
+#include <stddef.h>
+
+#define MAX_MIX_CHANNELS 32
+
+namespace DShow {
+
+/** Bytes per sample of uncompressed audio, or zero */
+int AudioSampleSize(AudioFormat format);
+
+/**
+ * Any interleaved PCM layout can be converted to 16-bit, float or planar
+ * float
+ */
+bool CanConvertAudio(AudioFormat inFormat, AudioFormat outFormat);
+
+/**
+ * Converts frames of interleaved audio.  Planar output is written one
+ * channel after another, each plane frames samples long.  Floats are
+ * clipped to [-1, 1] when converted to integers, rounding to nearest.
+ * Every path produces the same output as the scalar path.
+ */
+bool ConvertAudio(AudioFormat inFormat, const void *src,
+		  AudioFormat outFormat, void *dst, size_t frames,
+		  int channels);
+
+bool ConvertAudio(AudioFormat inFormat, const void *src,
+		  AudioFormat outFormat, void *dst, size_t frames,
+		  int channels, ConvertPath path);
+
+/** Same as CanConvertAudio, but the formats may also be the same */
+bool CanMixAudio(AudioFormat inFormat, AudioFormat outFormat);
+
+/**
+ * Converts and mixes channels at the same time.  Output channel m is the
+ * sum of the input channels weighted by row m of matrix, which has
+ * outChannels rows of inChannels weights.  Up to MAX_MIX_CHANNELS channels
+ * either way.
+ */
+bool MixAudio(AudioFormat inFormat, const void *src, int inChannels,
+	      AudioFormat outFormat, void *dst, int outChannels,
+	      const float *matrix, size_t frames);
+
+bool MixAudio(AudioFormat inFormat, const void *src, int inChannels,
+	      AudioFormat outFormat, void *dst, int outChannels,
+	      const float *matrix, size_t frames, ConvertPath path);
+
+/**
+ * Standard downmix of 3.0, quad, 5.1 and 7.1 to stereo or mono (center and
+ * surrounds at -3 dB, no LFE, rows normalized).  Otherwise the first
+ * channels are kept as they are.
+ */
+void GetDefaultChannelMatrix(int inChannels, int outChannels,
+			     std::vector<float> &matrix);
+
+}; /* namespace DShow */
@@ -0,0 +1,130 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "audio-packetizer.hpp"
+
+#include <string.h>
+
+namespace DShow {
+
+void AudioPacketizer::Reset(int sampleRate_, int blockAlign_,
+			    int packetFrames_)
+{
+	sampleRate = sampleRate_;
+	blockAlign = blockAlign_;
+
+	if (sampleRate > 0 && blockAlign > 0 && packetFrames_ > 0) {
+		packetFrames = (size_t)packetFrames_;
+		packetBytes = packetFrames * blockAlign;
+	} else {
+		packetFrames = 0;
+		packetBytes = 0;
+	}
+
+	partial.resize(packetBytes);
+	Clear();
+}
+
+void AudioPacketizer::Clear()
+{
+	partialSize = 0;
+	padPartial = false;
+	input = nullptr;
+	inputSize = 0;
+	inputOffset = 0;
+}
+
+void AudioPacketizer::Push(const unsigned char *data, size_t size,
+			   long long startTime)
+{
+	input = data;
+	inputSize = size - size % blockAlign;
+	inputOffset = 0;
+	inputTime = startTime;
+
+	/* if the buffer doesn't follow on from the carried over frames, pad
+	 * them out with silence rather than stretching them over the gap */
+	if (partialSize) {
+		long long expected =
+			partialTime + FramesToTime(partialSize / blockAlign);
+		long long diff = startTime - expected;
+		long long tolerance = FramesToTime(packetFrames) / 2;
+
+		if (diff > tolerance || diff < -tolerance)
+			padPartial = true;
+	}
+}
+
+bool AudioPacketizer::Pop(Packet &packet)
+{
+	if (partialSize) {
+		if (padPartial) {
+			memset(partial.data() + partialSize, 0,
+			       packetBytes - partialSize);
+			partialSize = packetBytes;
+			padPartial = false;
+		} else {
+			size_t take = packetBytes - partialSize;
+			if (take > inputSize - inputOffset)
+				take = inputSize - inputOffset;
+
+			memcpy(partial.data() + partialSize,
+			       input + inputOffset, take);
+			partialSize += take;
+			inputOffset += take;
+		}
+
+		if (partialSize < packetBytes)
+			return false;
+
+		packet.data = partial.data();
+		packet.size = packetBytes;
+		packet.startTime = partialTime;
+		packet.stopTime = partialTime + FramesToTime(packetFrames);
+		packet.inPlace = false;
+		partialSize = 0;
+		return true;
+	}
+
+	size_t remaining = inputSize - inputOffset;
+	size_t offsetFrames = inputOffset / blockAlign;
+	long long time = inputTime + FramesToTime(offsetFrames);
+
+	if (remaining >= packetBytes) {
+		packet.data = input + inputOffset;
+		packet.size = packetBytes;
+		packet.startTime = time;
+		packet.stopTime =
+			inputTime + FramesToTime(offsetFrames + packetFrames);
+		packet.inPlace = true;
+		inputOffset += packetBytes;
+		return true;
+	}
+
+	if (remaining) {
+		memcpy(partial.data(), input + inputOffset, remaining);
+		partialSize = remaining;
+		partialTime = time;
+		inputOffset = inputSize;
+	}
+
+	return false;
+}
+
+}; /* namespace DShow */
@@ -0,0 +1,86 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+
+namespace DShow {
+
+/**
+ * Re-splits uncompressed audio in to packets of exactly packetFrames frames.
+ * Whole packets are returned in place from the pushed buffer; only frames
+ * that straddle two buffers are copied, so buffers that are already a
+ * multiple of the packet size are never copied at all.
+ *
+ * Usage: Push() a buffer, then call Pop() until it returns false before the
+ * next Push().
+ */
+class AudioPacketizer {
+	int sampleRate = 0;
+	int blockAlign = 0;
+	size_t packetFrames = 0;
+	size_t packetBytes = 0;
+
+	/* frames carried over from the previous buffer */
+	std::vector<unsigned char> partial;
+	size_t partialSize = 0;
+	long long partialTime = 0;
+	bool padPartial = false;
+
+	const unsigned char *input = nullptr;
+	size_t inputSize = 0;
+	size_t inputOffset = 0;
+	long long inputTime = 0;
+
+	inline long long FramesToTime(size_t frames) const
+	{
+		return (long long)frames * 10000000LL / sampleRate;
+	}
+
+public:
+	struct Packet {
+		const unsigned char *data;
+		size_t size;
+		long long startTime;
+		long long stopTime;
+
+		/** Data points in to the pushed buffer rather than a copy */
+		bool inPlace;
+	};
+
+	/** packetFrames of zero disables packetizing */
+	void Reset(int sampleRate, int blockAlign, int packetFrames);
+
+	/** Drops any carried over frames */
+	void Clear();
+
+	inline bool Active() const { return packetBytes != 0; }
+
+	void Push(const unsigned char *data, size_t size, long long startTime);
+
+	/**
+	 * Returns the next complete packet.  Data stays valid until the next
+	 * call to Pop() or Push().
+	 */
+	bool Pop(Packet &packet);
+};
+
+}; /* namespace DShow */
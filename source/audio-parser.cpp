@@ -0,0 +1,655 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "audio-parser.hpp"
+
+#include <algorithm>
+#include <stdint.h>
+
+namespace DShow {
+
+/* reads bits MSB first.  Reading past the end gives zeros and sets overrun */
+class AudioBitReader {
+	const unsigned char *data;
+	size_t size;
+	size_t pos = 0;
+
+public:
+	bool overrun = false;
+
+	inline AudioBitReader(const unsigned char *data_, size_t size_)
+		: data(data_), size(size_)
+	{
+	}
+
+	/** Bits read so far */
+	inline size_t Position() const { return pos; }
+
+	inline unsigned Bit()
+	{
+		if (pos >= size * 8) {
+			overrun = true;
+			return 0;
+		}
+
+		unsigned bit = (data[pos >> 3] >> (7 - (pos & 7))) & 1;
+		pos++;
+		return bit;
+	}
+
+	inline uint32_t Bits(int count)
+	{
+		uint32_t value = 0;
+		while (count--)
+			value = (value << 1) | Bit();
+		return value;
+	}
+
+	inline void Skip(size_t count)
+	{
+		pos += count;
+		if (pos > size * 8)
+			overrun = true;
+	}
+};
+
+/* writes bits MSB first, padding the last byte with zeros */
+class AudioBitWriter {
+	std::vector<unsigned char> &bytes;
+	size_t pos = 0;
+
+public:
+	inline AudioBitWriter(std::vector<unsigned char> &bytes_)
+		: bytes(bytes_)
+	{
+		bytes.clear();
+	}
+
+	inline void Put(uint32_t value, int count)
+	{
+		while (count--) {
+			if (!(pos & 7))
+				bytes.push_back(0);
+			if ((value >> count) & 1)
+				bytes.back() |= 0x80 >> (pos & 7);
+			pos++;
+		}
+	}
+};
+
+/* ------------------------------------------------------------------------ */
+/* frame sizes                                                              */
+
+size_t GetADTSFrameSize(const unsigned char *header)
+{
+	/* syncword, with a layer of zero */
+	if (header[0] != 0xFF || (header[1] & 0xF6) != 0xF0)
+		return 0;
+	if (((header[2] >> 2) & 0xF) > 12)
+		return 0;
+
+	size_t size = ((size_t)(header[3] & 0x03) << 11) |
+		      ((size_t)header[4] << 3) | (header[5] >> 5);
+	size_t headerSize = (header[1] & 1) ? 7 : 9;
+	return size > headerSize ? size : 0;
+}
+
+/* AC-3 bit rates in kbit/s, for each pair of frmsizecod values */
+static const int ac3Rates[19] = {32,  40,  48,  56,  64,  80,  96,
+				 112, 128, 160, 192, 224, 256, 320,
+				 384, 448, 512, 576, 640};
+
+size_t GetAC3FrameSize(const unsigned char *header)
+{
+	if (header[0] != 0x0B || header[1] != 0x77)
+		return 0;
+
+	int bsid = header[5] >> 3;
+
+	/* E-AC-3 has its size in 16-bit words in the header */
+	if (bsid > 10 && bsid <= 16)
+		return ((((size_t)header[2] & 0x7) << 8) | header[3]) * 2 + 2;
+	if (bsid > 10)
+		return 0;
+
+	int fscod = header[4] >> 6;
+	int frmsizecod = header[4] & 0x3F;
+	if (fscod == 3 || frmsizecod >= 38)
+		return 0;
+
+	/* 1536 samples per frame, counted in 16-bit words */
+	int rate = ac3Rates[frmsizecod >> 1];
+	switch (fscod) {
+	case 0:
+		return (size_t)rate * 4;
+	case 1:
+		return ((size_t)rate * 96000 / 44100 + (frmsizecod & 1)) * 2;
+	default:
+		return (size_t)rate * 6;
+	}
+}
+
+size_t GetLOASFrameSize(const unsigned char *header)
+{
+	/* 11-bit syncword, then 13 bits of length */
+	if (header[0] != 0x56 || (header[1] & 0xE0) != 0xE0)
+		return 0;
+
+	size_t size = ((size_t)(header[1] & 0x1F) << 8) | header[2];
+	return size ? size + LOAS_HEADER_SIZE : 0;
+}
+
+size_t GetAudioFrameHeaderSize(AudioFormat format)
+{
+	switch (format) {
+	case AudioFormat::AAC:
+		return ADTS_HEADER_SIZE;
+	case AudioFormat::AC3:
+		return AC3_HEADER_SIZE;
+	default:
+		return 0;
+	}
+}
+
+size_t GetAudioFrameSize(AudioFormat format, const unsigned char *header)
+{
+	switch (format) {
+	case AudioFormat::AAC:
+		return GetADTSFrameSize(header);
+	case AudioFormat::AC3:
+		return GetAC3FrameSize(header);
+	default:
+		return 0;
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+/* AAC                                                                      */
+
+static const int aacRates[13] = {96000, 88200, 64000, 48000, 44100,
+				 32000, 24000, 22050, 16000, 12000,
+				 11025, 8000,  7350};
+
+/* channels of each channelConfiguration, zero where there is a program
+ * config element instead or it's reserved */
+static const int aacChannels[16] = {0, 1, 2, 3, 4, 5, 6, 8,
+				    0, 0, 0, 7, 8, 0, 8, 0};
+
+static inline int GetAudioObjectType(AudioBitReader &bits)
+{
+	int type = (int)bits.Bits(5);
+	return type == 31 ? 32 + (int)bits.Bits(6) : type;
+}
+
+static inline int GetAACSampleRate(AudioBitReader &bits)
+{
+	int index = (int)bits.Bits(4);
+	if (index == 15)
+		return (int)bits.Bits(24);
+	return index < 13 ? aacRates[index] : 0;
+}
+
+/*
+ * Reads an AudioSpecificConfig far enough to know where it ends.  Only the
+ * general audio object types are known, and a program config element in
+ * place of the channel configuration isn't.
+ */
+static bool ParseAudioSpecificConfig(AudioBitReader &bits, AudioFrameInfo &info)
+{
+	int type = GetAudioObjectType(bits);
+	int rate = GetAACSampleRate(bits);
+	int channelConfig = (int)bits.Bits(4);
+	bool sbr = false;
+	bool ps = false;
+
+	/* explicit SBR and PS signal the output rate, then the core type */
+	if (type == 5 || type == 29) {
+		sbr = true;
+		ps = type == 29;
+		rate = GetAACSampleRate(bits);
+		type = GetAudioObjectType(bits);
+	}
+
+	switch (type) {
+	case 1:
+	case 2:
+	case 3:
+	case 4:
+	case 6:
+	case 7:
+		break;
+	default:
+		return false;
+	}
+
+	/* GASpecificConfig */
+	int samples = bits.Bit() ? 960 : 1024;
+	if (bits.Bit())
+		bits.Skip(14); /* coreCoderDelay */
+	unsigned extension = bits.Bit();
+
+	if (!channelConfig || !aacChannels[channelConfig])
+		return false;
+	if (type == 6)
+		bits.Skip(3); /* layerNr */
+	if (extension)
+		bits.Skip(1); /* extensionFlag3 */
+
+	if (bits.overrun || !rate)
+		return false;
+
+	info.sampleRate = rate;
+	info.channels = aacChannels[channelConfig];
+	if (ps && info.channels == 1)
+		info.channels = 2;
+	info.samples = sbr ? samples * 2 : samples;
+	return true;
+}
+
+bool ParseADTSFrame(const unsigned char *data, size_t size,
+		    AudioFrameInfo &info, std::vector<unsigned char> &config)
+{
+	if (size < ADTS_HEADER_SIZE)
+		return false;
+
+	size_t frameSize = GetADTSFrameSize(data);
+	if (!frameSize || frameSize > size)
+		return false;
+
+	int profile = data[2] >> 6;
+	int rateIndex = (data[2] >> 2) & 0xF;
+	int channelConfig = ((data[2] & 1) << 2) | (data[3] >> 6);
+	int blocks = (data[6] & 3) + 1;
+
+	info.size = frameSize;
+	info.sampleRate = aacRates[rateIndex];
+	info.samples = 1024 * blocks;
+
+	/* zero means the channels are in a program config element inside
+	 * the frame */
+	if (channelConfig)
+		info.channels = aacChannels[channelConfig];
+
+	AudioBitWriter out(config);
+	out.Put(profile + 1, 5);
+	out.Put(rateIndex, 4);
+	out.Put(channelConfig, 4);
+	out.Put(0, 3); /* 1024 samples, no core coder, no extension */
+	return true;
+}
+
+/* LatmGetValue() of ISO/IEC 14496-3 */
+static inline uint32_t GetLATMValue(AudioBitReader &bits)
+{
+	int bytes = (int)bits.Bits(2) + 1;
+	return bits.Bits(bytes * 8);
+}
+
+/*
+ * A LOAS frame is an AudioMuxElement with muxConfigPresent set, which
+ * carries its StreamMuxConfig unless it uses the same one as before.  Only
+ * streams with a single program and layer are known.
+ */
+bool ParseLOASFrame(const unsigned char *data, size_t size,
+		    AudioFrameInfo &info, std::vector<unsigned char> &config)
+{
+	if (size < LOAS_HEADER_SIZE)
+		return false;
+
+	size_t frameSize = GetLOASFrameSize(data);
+	if (!frameSize || frameSize > size)
+		return false;
+
+	const unsigned char *mux = data + LOAS_HEADER_SIZE;
+	size_t muxSize = frameSize - LOAS_HEADER_SIZE;
+	AudioBitReader bits(mux, muxSize);
+
+	/* useSameStreamMux */
+	if (bits.Bit()) {
+		if (!info.samples)
+			return false;
+
+		info.size = frameSize;
+		return true;
+	}
+
+	unsigned version = bits.Bit();
+	if (version && bits.Bit()) /* audioMuxVersionA */
+		return false;
+	if (version)
+		GetLATMValue(bits); /* taraBufferFullness */
+
+	bits.Skip(1); /* allStreamsSameTimeFraming */
+	int subFrames = (int)bits.Bits(6) + 1;
+	int programs = (int)bits.Bits(4) + 1;
+	int layers = (int)bits.Bits(3) + 1;
+	if (programs != 1 || layers != 1)
+		return false;
+
+	size_t configBits = version ? GetLATMValue(bits) : 0;
+	size_t start = bits.Position();
+
+	AudioFrameInfo next = info;
+	if (!ParseAudioSpecificConfig(bits, next))
+		return false;
+
+	/* version 1 gives the length, which covers any extensions after the
+	 * part that was read */
+	size_t used = bits.Position() - start;
+	if (!version)
+		configBits = used;
+	if (configBits < used || start + configBits > muxSize * 8)
+		return false;
+
+	AudioBitReader in(mux, muxSize);
+	in.Skip(start);
+
+	AudioBitWriter out(config);
+	for (size_t i = 0; i < configBits; i++)
+		out.Put(in.Bit(), 1);
+
+	info = next;
+	info.size = frameSize;
+	info.samples *= subFrames;
+	return true;
+}
+
+/* ------------------------------------------------------------------------ */
+/* AC-3                                                                     */
+
+static const int ac3SampleRates[3] = {48000, 44100, 32000};
+static const int eac3HalfRates[3] = {24000, 22050, 16000};
+static const int eac3Blocks[4] = {1, 2, 3, 6};
+
+/* full-range channels of each acmod */
+static const int ac3Channels[8] = {2, 1, 2, 3, 3, 4, 4, 5};
+
+/* the dec3 box only describes the first independent substream, and bsmod
+ * is left as complete main, since E-AC-3 has it deep in the metadata */
+static bool ParseEAC3Frame(const unsigned char *data, size_t frameSize,
+			   AudioFrameInfo &info,
+			   std::vector<unsigned char> &config)
+{
+	AudioBitReader bits(data + 2, frameSize - 2);
+
+	int type = (int)bits.Bits(2);
+	int substream = (int)bits.Bits(3);
+	bits.Skip(11); /* frmsiz */
+
+	int rate;
+	int fscod = (int)bits.Bits(2);
+	int blocks;
+
+	if (fscod == 3) {
+		int fscod2 = (int)bits.Bits(2);
+		if (fscod2 == 3)
+			return false;
+
+		rate = eac3HalfRates[fscod2];
+		blocks = 6;
+	} else {
+		rate = ac3SampleRates[fscod];
+		blocks = eac3Blocks[bits.Bits(2)];
+	}
+
+	int acmod = (int)bits.Bits(3);
+	int lfeon = (int)bits.Bit();
+	int bsid = (int)bits.Bits(5);
+
+	if (type == 3)
+		return false;
+
+	/* dependent substreams and further programs belong to the frame of
+	 * the first program before them */
+	if (type == 1 || substream) {
+		if (!info.sampleRate)
+			return false;
+
+		info.size = frameSize;
+		info.samples = 0;
+		return true;
+	}
+
+	info.size = frameSize;
+	info.sampleRate = rate;
+	info.channels = ac3Channels[acmod] + lfeon;
+	info.samples = 256 * blocks;
+
+	/* kbit/s */
+	long long dataRate = (long long)frameSize * 8 * rate /
+			     ((long long)info.samples * 1000);
+
+	AudioBitWriter out(config);
+	out.Put((uint32_t)std::min(dataRate, 0x1FFFLL), 13);
+	out.Put(0, 3); /* num_ind_sub */
+	out.Put(fscod, 2);
+	out.Put(bsid, 5);
+	out.Put(0, 2); /* reserved, asvc */
+	out.Put(0, 3); /* bsmod */
+	out.Put(acmod, 3);
+	out.Put(lfeon, 1);
+	out.Put(0, 3);
+	out.Put(0, 4); /* num_dep_sub */
+	out.Put(0, 1);
+	return true;
+}
+
+bool ParseAC3Frame(const unsigned char *data, size_t size,
+		   AudioFrameInfo &info, std::vector<unsigned char> &config)
+{
+	if (size < AC3_HEADER_SIZE)
+		return false;
+
+	size_t frameSize = GetAC3FrameSize(data);
+	if (!frameSize || frameSize > size)
+		return false;
+
+	if ((data[5] >> 3) > 10)
+		return ParseEAC3Frame(data, frameSize, info, config);
+
+	AudioBitReader bits(data + 4, frameSize - 4);
+	int fscod = (int)bits.Bits(2);
+	int frmsizecod = (int)bits.Bits(6);
+	int bsid = (int)bits.Bits(5);
+	int bsmod = (int)bits.Bits(3);
+	int acmod = (int)bits.Bits(3);
+
+	if ((acmod & 1) && acmod != 1)
+		bits.Skip(2); /* cmixlev */
+	if (acmod & 4)
+		bits.Skip(2); /* surmixlev */
+	if (acmod == 2)
+		bits.Skip(2); /* dsurmod */
+	int lfeon = (int)bits.Bit();
+
+	info.size = frameSize;
+	info.sampleRate = ac3SampleRates[fscod];
+	info.channels = ac3Channels[acmod] + lfeon;
+	info.samples = 1536;
+
+	AudioBitWriter out(config);
+	out.Put(fscod, 2);
+	out.Put(bsid, 5);
+	out.Put(bsmod, 3);
+	out.Put(acmod, 3);
+	out.Put(lfeon, 1);
+	out.Put(frmsizecod >> 1, 5);
+	out.Put(0, 5);
+	return true;
+}
+
+/* ------------------------------------------------------------------------ */
+/* AudioFrameParser                                                         */
+
+void AudioFrameParser::Reset(AudioFormat format_, bool latm_,
+			     const std::shared_ptr<FramePool> &pool_,
+			     const FrameProc &callback_)
+{
+	format = format_;
+	latm = latm_ && format == AudioFormat::AAC;
+	headerSize = latm ? LOAS_HEADER_SIZE : GetAudioFrameHeaderSize(format);
+	pool = pool_;
+	callback = callback_;
+
+	if (!pool || !callback)
+		headerSize = 0;
+
+	info = AudioFrameInfo();
+	config.clear();
+	Clear();
+}
+
+void AudioFrameParser::Clear()
+{
+	partial.clear();
+	partialSize = 0;
+	hasPacketTime = false;
+	hasBase = false;
+	baseSamples = 0;
+}
+
+size_t AudioFrameParser::FrameSize(const unsigned char *header) const
+{
+	return latm ? GetLOASFrameSize(header)
+		    : GetAudioFrameSize(format, header);
+}
+
+bool AudioFrameParser::ParseFrame(const unsigned char *data, size_t size,
+				  AudioFrameInfo &next)
+{
+	next = info;
+
+	if (latm)
+		return ParseLOASFrame(data, size, next, config);
+	if (format == AudioFormat::AAC)
+		return ParseADTSFrame(data, size, next, config);
+	return ParseAC3Frame(data, size, next, config);
+}
+
+/* frames are timed from the timestamp of the packet the first of them
+ * started in */
+void AudioFrameParser::StartFrame()
+{
+	if (!hasPacketTime)
+		return;
+
+	baseTime = packetTime;
+	baseSamples = 0;
+	hasBase = true;
+	hasPacketTime = false;
+}
+
+bool AudioFrameParser::Deliver(const unsigned char *data, size_t size,
+			       const Frame *packet, bool startsHere)
+{
+	AudioFrameInfo next;
+	if (!ParseFrame(data, size, next))
+		return false;
+
+	if (startsHere)
+		StartFrame();
+
+	/* carry on from the time the samples so far took at the old rate */
+	if (hasBase && next.sampleRate != info.sampleRate) {
+		if (info.sampleRate)
+			baseTime += baseSamples * 10000000LL / info.sampleRate;
+		baseSamples = 0;
+	}
+
+	info = next;
+
+	if (!hasBase || !info.sampleRate)
+		return true;
+
+	long long startTime =
+		baseTime + baseSamples * 10000000LL / info.sampleRate;
+	baseSamples += info.samples;
+	long long stopTime =
+		baseTime + baseSamples * 10000000LL / info.sampleRate;
+
+	bool whole = packet && data == packet->Data() &&
+		     size == packet->Size();
+	callback(whole ? *packet : pool->Copy(data, size), startTime,
+		 stopTime);
+	return true;
+}
+
+void AudioFrameParser::Add(const Frame &packet, bool hasTime, long long time)
+{
+	const unsigned char *data = packet.Data();
+	size_t size = packet.Size();
+	size_t pos = 0;
+
+	if (!Active())
+		return;
+
+	if (hasTime) {
+		hasPacketTime = true;
+		packetTime = time;
+	}
+
+	/* finish the frame that started in an earlier packet.  If its header
+	 * turns out not to be one, the search carries on a byte later */
+	while (!partial.empty() && !partialSize) {
+		size_t copy = std::min(headerSize - partial.size(), size - pos);
+		partial.insert(partial.end(), data + pos, data + pos + copy);
+		pos += copy;
+
+		if (partial.size() < headerSize)
+			return;
+
+		partialSize = FrameSize(partial.data());
+		if (!partialSize)
+			partial.erase(partial.begin());
+	}
+
+	if (!partial.empty()) {
+		size_t copy =
+			std::min(partialSize - partial.size(), size - pos);
+		partial.insert(partial.end(), data + pos, data + pos + copy);
+		pos += copy;
+
+		if (partial.size() < partialSize)
+			return;
+
+		Deliver(partial.data(), partialSize, nullptr, false);
+		partial.clear();
+		partialSize = 0;
+	}
+
+	while (pos < size) {
+		size_t left = size - pos;
+		size_t frameSize = left >= headerSize ? FrameSize(data + pos)
+						      : 0;
+
+		if (left < headerSize || frameSize > left) {
+			StartFrame();
+			partial.assign(data + pos, data + size);
+			partialSize = frameSize;
+			break;
+		}
+
+		if (frameSize && Deliver(data + pos, frameSize, &packet, true))
+			pos += frameSize;
+		else
+			pos++;
+	}
+}
+
+}; /* namespace DShow */
@@ -0,0 +1,150 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+#include "frame-buffer.hpp"
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <stddef.h>
+
+namespace DShow {
+
+/* bytes needed to read the length of a frame */
+#define ADTS_HEADER_SIZE 7
+#define AC3_HEADER_SIZE 6
+#define LOAS_HEADER_SIZE 3
+
+/** Length of the ADTS frame starting at header, or zero if it isn't one */
+size_t GetADTSFrameSize(const unsigned char *header);
+
+/**
+ * Length of the AC-3 or E-AC-3 frame starting at header, or zero if it
+ * isn't one
+ */
+size_t GetAC3FrameSize(const unsigned char *header);
+
+/**
+ * Length of the LOAS frame (LATM with a sync layer) starting at header, or
+ * zero if it isn't one
+ */
+size_t GetLOASFrameSize(const unsigned char *header);
+
+/**
+ * Bytes GetAudioFrameSize needs for the format, or zero if the library
+ * can't find frame lengths in it
+ */
+size_t GetAudioFrameHeaderSize(AudioFormat format);
+size_t GetAudioFrameSize(AudioFormat format, const unsigned char *header);
+
+struct AudioFrameInfo {
+	/** Bytes in the frame, header included */
+	size_t size = 0;
+
+	int sampleRate = 0;
+	int channels = 0;
+
+	/** Samples per channel the frame decodes to */
+	int samples = 0;
+};
+
+/*
+ * Parse a whole frame.  config is set to the codec setup the frame carries:
+ * the AudioSpecificConfig for AAC, and the payload of the MP4 dac3 or dec3
+ * box for AC-3 and E-AC-3.  LATM frames that reuse the setup of the frames
+ * before them, and E-AC-3 substreams other than the first independent one,
+ * only set the size and leave the rest of info and config as they were.
+ */
+bool ParseADTSFrame(const unsigned char *data, size_t size,
+		    AudioFrameInfo &info, std::vector<unsigned char> &config);
+bool ParseLOASFrame(const unsigned char *data, size_t size,
+		    AudioFrameInfo &info, std::vector<unsigned char> &config);
+bool ParseAC3Frame(const unsigned char *data, size_t size,
+		   AudioFrameInfo &info, std::vector<unsigned char> &config);
+
+/**
+ * Splits AAC (ADTS or LATM), AC-3 and E-AC-3 packets in to single codec
+ * frames, which may span packets.  A packet's timestamp belongs to the
+ * first frame that starts in it, and the frames after that one are timed
+ * from the samples before them.
+ *
+ * Frames are copied out of their packet in to the pool, unless the packet
+ * is exactly one frame.  E-AC-3 dependent substreams go out as frames of
+ * their own, with no samples.  Data that doesn't parse is skipped until
+ * the next frame that does.
+ */
+class AudioFrameParser {
+public:
+	typedef std::function<void(const Frame &frame, long long startTime,
+				   long long stopTime)>
+		FrameProc;
+
+private:
+	AudioFormat format = AudioFormat::Any;
+	bool latm = false;
+	size_t headerSize = 0;
+	std::shared_ptr<FramePool> pool;
+	FrameProc callback;
+
+	/* frame that started in an earlier packet, and its size once the
+	 * header is in */
+	std::vector<unsigned char> partial;
+	size_t partialSize = 0;
+
+	AudioFrameInfo info;
+	std::vector<unsigned char> config;
+
+	bool hasPacketTime = false;
+	long long packetTime = 0;
+	bool hasBase = false;
+	long long baseTime = 0;
+	long long baseSamples = 0;
+
+	size_t FrameSize(const unsigned char *header) const;
+	bool ParseFrame(const unsigned char *data, size_t size,
+			AudioFrameInfo &next);
+	void StartFrame();
+	bool Deliver(const unsigned char *data, size_t size,
+		     const Frame *packet, bool startsHere);
+
+public:
+	/** Formats other than AAC and AC-3 leave the parser inactive */
+	void Reset(AudioFormat format, bool latm,
+		   const std::shared_ptr<FramePool> &pool,
+		   const FrameProc &callback);
+
+	/** Drops the partial frame and the timing, keeping the setup */
+	void Clear();
+
+	inline bool Active() const { return headerSize != 0; }
+
+	void Add(const Frame &packet, bool hasTime, long long time);
+
+	/** Format of the last frame */
+	inline const AudioFrameInfo &Info() const { return info; }
+	inline const std::vector<unsigned char> &Config() const
+	{
+		return config;
+	}
+};
+
+}; /* namespace DShow */
@@ -0,0 +1,370 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "audio-resampler.hpp"
+#include "dshow-simd.hpp"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+namespace DShow {
+
+#define MAX_PHASES 1024
+#define MAX_TAPS 512
+#define TAP_ALIGN 8
+
+/* input frames buffered per channel beyond the filter's history */
+#define BLOCK_FRAMES 4096
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+struct ResamplerQuality {
+	int taps;
+	double rolloff;
+	double beta;
+};
+
+/* taps are for upsampling, downsampling widens the filter to keep the same
+ * transition band */
+static const ResamplerQuality *GetQuality(AudioResampling quality)
+{
+	static const ResamplerQuality fast = {16, 0.85, 6.0};
+	static const ResamplerQuality medium = {32, 0.91, 8.0};
+	static const ResamplerQuality best = {64, 0.945, 10.0};
+
+	switch (quality) {
+	case AudioResampling::Fast:
+		return &fast;
+	case AudioResampling::Medium:
+		return &medium;
+	case AudioResampling::Best:
+		return &best;
+	default:
+		return nullptr;
+	}
+}
+
+static double BesselI0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+
+	for (int k = 1; k < 50; k++) {
+		double t = x / (2.0 * k);
+		term *= t * t;
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+
+	return sum;
+}
+
+static long long GCD(long long a, long long b)
+{
+	while (b) {
+		long long t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/* ------------------------------------------------------------------------ */
+/* dot products, taps a multiple of 8.  Every path sums in eight lanes that */
+/* are folded in the same order, so all of them give the same output        */
+
+typedef float (*DotFunc)(const float *a, const float *b, int count);
+
+static float DotScalar(const float *a, const float *b, int count)
+{
+	float acc[8] = {};
+
+	for (int i = 0; i < count; i += 8) {
+		for (int j = 0; j < 8; j++)
+			acc[j] += a[i + j] * b[i + j];
+	}
+
+	float t0 = acc[0] + acc[4];
+	float t1 = acc[1] + acc[5];
+	float t2 = acc[2] + acc[6];
+	float t3 = acc[3] + acc[7];
+	return (t0 + t2) + (t1 + t3);
+}
+
+#ifdef SIMD_X86
+
+SIMD_TARGET("sse2")
+static inline float Fold(__m128 t)
+{
+	t = _mm_add_ps(t, _mm_movehl_ps(t, t));
+	t = _mm_add_ss(t, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 1, 1, 1)));
+	return _mm_cvtss_f32(t);
+}
+
+SIMD_TARGET("sse2")
+static float DotSSE2(const float *a, const float *b, int count)
+{
+	__m128 lo = _mm_setzero_ps();
+	__m128 hi = _mm_setzero_ps();
+
+	for (int i = 0; i < count; i += 8) {
+		lo = _mm_add_ps(lo, _mm_mul_ps(_mm_loadu_ps(a + i),
+					       _mm_loadu_ps(b + i)));
+		hi = _mm_add_ps(hi, _mm_mul_ps(_mm_loadu_ps(a + i + 4),
+					       _mm_loadu_ps(b + i + 4)));
+	}
+
+	return Fold(_mm_add_ps(lo, hi));
+}
+
+/* multiply and add are kept separate (no FMA) to match the other paths */
+SIMD_TARGET("avx2")
+static float DotAVX2(const float *a, const float *b, int count)
+{
+	__m256 acc = _mm256_setzero_ps();
+
+	for (int i = 0; i < count; i += 8)
+		acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(a + i),
+						       _mm256_loadu_ps(b + i)));
+
+	return Fold(_mm_add_ps(_mm256_castps256_ps128(acc),
+			       _mm256_extractf128_ps(acc, 1)));
+}
+
+#endif
+
+#ifdef SIMD_NEON
+
+static float DotNEON(const float *a, const float *b, int count)
+{
+	float32x4_t lo = vdupq_n_f32(0.0f);
+	float32x4_t hi = vdupq_n_f32(0.0f);
+
+	for (int i = 0; i < count; i += 8) {
+		lo = vaddq_f32(lo, vmulq_f32(vld1q_f32(a + i),
+					     vld1q_f32(b + i)));
+		hi = vaddq_f32(hi, vmulq_f32(vld1q_f32(a + i + 4),
+					     vld1q_f32(b + i + 4)));
+	}
+
+	float32x4_t t = vaddq_f32(lo, hi);
+	float32x2_t u = vadd_f32(vget_low_f32(t), vget_high_f32(t));
+	return vget_lane_f32(vpadd_f32(u, u), 0);
+}
+
+#endif
+
+static DotFunc GetDotFunc(ConvertPath path)
+{
+	switch (path) {
+#ifdef SIMD_X86
+	case ConvertPath::SSE2:
+	case ConvertPath::SSSE3:
+		return DotSSE2;
+	case ConvertPath::AVX2:
+		return DotAVX2;
+#endif
+#ifdef SIMD_NEON
+	case ConvertPath::NEON:
+		return DotNEON;
+#endif
+	default:
+		return DotScalar;
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+
+bool AudioResampler::Reset(int inRate_, int outRate_, int channels_,
+			   AudioResampling quality)
+{
+	static const ConvertPath path = GetConvertPath();
+	return Reset(inRate_, outRate_, channels_, quality, path);
+}
+
+bool AudioResampler::Reset(int inRate_, int outRate_, int channels_,
+			   AudioResampling quality, ConvertPath path_)
+{
+	const ResamplerQuality *q = GetQuality(quality);
+
+	taps = 0;
+	if (!q || inRate_ <= 0 || outRate_ <= 0 || channels_ <= 0)
+		return false;
+	if (inRate_ == outRate_ || !ConvertPathSupported(path_))
+		return false;
+
+	long long gcd = GCD(inRate_, outRate_);
+	up = outRate_ / gcd;
+	down = inRate_ / gcd;
+
+	double ratio = std::min(1.0, (double)outRate_ / (double)inRate_);
+	double cutoff = q->rolloff * ratio;
+	int width = (int)ceil(q->taps / ratio);
+	width = (width + TAP_ALIGN - 1) / TAP_ALIGN * TAP_ALIGN;
+	width = std::min(width, MAX_TAPS);
+
+	inRate = inRate_;
+	outRate = outRate_;
+	channels = channels_;
+	path = path_;
+	taps = width;
+	phases = (int)std::min(up, (long long)MAX_PHASES);
+
+	/* Kaiser windowed sinc, each phase normalized to unity gain */
+	coeffs.resize((size_t)(phases + 1) * taps);
+
+	double center = taps / 2 - 1;
+	double norm = BesselI0(q->beta);
+
+	for (int p = 0; p <= phases; p++) {
+		float *filter = coeffs.data() + (size_t)p * taps;
+		double sum = 0.0;
+
+		for (int k = 0; k < taps; k++) {
+			double t = k - center - (double)p / phases;
+			double x = t / (taps / 2);
+			double w = x <= -1.0 || x >= 1.0
+					   ? 0.0
+					   : BesselI0(q->beta *
+						      sqrt(1.0 - x * x)) /
+						     norm;
+			double s = t == 0.0 ? 1.0
+					    : sin(M_PI * cutoff * t) /
+						      (M_PI * cutoff * t);
+			filter[k] = (float)(s * w);
+			sum += filter[k];
+		}
+
+		for (int k = 0; k < taps; k++)
+			filter[k] = (float)(filter[k] / sum);
+	}
+
+	stride = taps + BLOCK_FRAMES;
+	planes.resize(stride * channels);
+	Clear();
+	return true;
+}
+
+void AudioResampler::Clear()
+{
+	/* history starts out silent, with the first input frame under the
+	 * center of the filter */
+	std::fill(planes.begin(), planes.end(), 0.0f);
+	avail = taps ? taps / 2 - 1 : 0;
+	pos = 0;
+	phase = 0;
+}
+
+size_t AudioResampler::Filter(std::vector<float> &output)
+{
+	if (avail < pos + taps)
+		return 0;
+
+	/* outputs n count while pos + (phase + n * down) / up + taps <=
+	 * avail */
+	long long room = (long long)(avail - taps - pos) + 1;
+	size_t count = (size_t)((room * up - phase + down - 1) / down);
+
+	size_t offset = output.size();
+	output.resize(offset + count * channels);
+
+	DotFunc dot = GetDotFunc(path);
+	float *out = output.data() + offset;
+
+	for (size_t n = 0; n < count; n++) {
+		int index = phases == up ? (int)phase
+					 : (int)((phase * phases + up / 2) /
+						 up);
+		const float *filter = coeffs.data() + (size_t)index * taps;
+
+		for (int c = 0; c < channels; c++)
+			*(out++) = dot(planes.data() + stride * c + pos,
+				       filter, taps);
+
+		phase += down;
+		pos += (size_t)(phase / up);
+		phase %= up;
+	}
+
+	return count;
+}
+
+size_t AudioResampler::Process(const float *input, size_t frames,
+			       long long startTime, std::vector<float> &output,
+			       long long &outputTime)
+{
+	size_t total = 0;
+	size_t done = 0;
+
+	if (!taps)
+		return 0;
+
+	while (done < frames) {
+		size_t count = std::min(frames - done, stride - avail);
+		size_t start = avail;
+
+		for (int c = 0; c < channels; c++) {
+			float *plane = planes.data() + stride * c + avail;
+			const float *src = input + done * channels + c;
+
+			for (size_t i = 0; i < count; i++)
+				plane[i] = src[i * channels];
+		}
+
+		avail += count;
+
+		/* the first output is timed from where its center falls
+		 * relative to this block of input */
+		if (!total) {
+			long long offset = ((long long)pos + taps / 2 - 1 -
+					    (long long)start) *
+						   up +
+					   phase;
+			long long blockTime =
+				startTime + (long long)done * 10000000LL /
+						    inRate;
+			outputTime = blockTime + offset * 10000000LL /
+							 (up * inRate);
+		}
+
+		total += Filter(output);
+		done += count;
+
+		/* keep what the next output still needs; if the output
+		 * stepped past the end, the skipped input is dropped as it
+		 * arrives */
+		size_t keep = std::min(pos, avail);
+		for (int c = 0; c < channels; c++) {
+			float *plane = planes.data() + stride * c;
+			memmove(plane, plane + keep,
+				(avail - keep) * sizeof(float));
+		}
+
+		avail -= keep;
+		pos -= keep;
+	}
+
+	return total;
+}
+
+}; /* namespace DShow */
@@ -0,0 +1,90 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+#include "dshow-convert.hpp"
+
+#include <vector>
+#include <stddef.h>
+
+namespace DShow {
+
+/**
+ * Streaming polyphase windowed-sinc resampler for interleaved float audio.
+ * The rate ratio is kept exactly, so output never drifts from the input;
+ * ratios that would need more than 1024 filters use the nearest of 1024.
+ *
+ * Output is delayed by half the filter, but timestamps are worked out from
+ * where each output frame falls in the input, so they stay exact across
+ * buffers.
+ */
+class AudioResampler {
+	int inRate = 0;
+	int outRate = 0;
+	int channels = 0;
+	int taps = 0;
+	ConvertPath path = ConvertPath::Scalar;
+
+	/* outRate / inRate in lowest terms */
+	long long up = 0;
+	long long down = 0;
+
+	/* phases + 1 filters of taps weights, the last one being the first
+	 * moved along by one input frame */
+	int phases = 0;
+	std::vector<float> coeffs;
+
+	/* one plane of history per channel, stride floats apart */
+	std::vector<float> planes;
+	size_t stride = 0;
+	size_t avail = 0;
+
+	/* next output is centered on input frame pos + taps / 2 - 1, plus
+	 * phase / up */
+	size_t pos = 0;
+	long long phase = 0;
+
+	size_t Filter(std::vector<float> &output);
+
+public:
+	bool Reset(int inRate, int outRate, int channels,
+		   AudioResampling quality);
+	bool Reset(int inRate, int outRate, int channels,
+		   AudioResampling quality, ConvertPath path);
+
+	/** Drops history, for when the input is discontinuous */
+	void Clear();
+
+	inline bool Active() const { return taps != 0; }
+
+	/** Input frames the output lags behind by */
+	inline int Delay() const { return taps / 2; }
+
+	/**
+	 * Appends the output frames this input completes, and returns how
+	 * many there were.  outputTime is set to the timestamp of the first
+	 * one.
+	 */
+	size_t Process(const float *input, size_t frames, long long startTime,
+		       std::vector<float> &output, long long &outputTime);
+};
+
+}; /* namespace DShow */
@@ -274,8 +274,15 @@ STDMETHODIMP CapturePin::NotifyAllocator(IMemAllocator *pAllocator,
 {
 	PrintFunc(L"CapturePin::NotifyAllocator");
 
-	DSHOW_UNUSED(pAllocator);
 	DSHOW_UNUSED(bReadOnly);
+
+	/* upstream has already set the allocator's properties by now */
+	ALLOCATOR_PROPERTIES props;
+	if (pAllocator && SUCCEEDED(pAllocator->GetProperties(&props)))
+		allocatorBuffers = props.cBuffers;
+	else
+		allocatorBuffers = 0;
+
 	return S_OK;
 }
 
@@ -319,7 +326,7 @@ STDMETHODIMP CapturePin::ReceiveMultiple(IMediaSample **pSamples, long nSamples,
 
 STDMETHODIMP CapturePin::ReceiveCanBlock()
 {
-	return S_FALSE;
+	return canBlock ? S_OK : S_FALSE;
 }
 
 bool CapturePin::IsValidMediaType(const AM_MEDIA_TYPE *pmt) const
@@ -452,13 +459,13 @@ STDMETHODIMP CaptureFilter::GetState(DWORD dwMSecs, FILTER_STATE *State)
 
 STDMETHODIMP CaptureFilter::SetSyncSource(IReferenceClock *pClock)
 {
-	DSHOW_UNUSED(pClock);
+	clock = pClock;
 	return S_OK;
 }
 
 STDMETHODIMP CaptureFilter::GetSyncSource(IReferenceClock **pClock)
 {
-	*pClock = nullptr;
+	clock.CopyTo(pClock);
 	return NOERROR;
 }
 
@@ -483,11 +490,23 @@ STDMETHODIMP CaptureFilter::Run(REFERENCE_TIME tStart)
 	PrintFunc(L"CaptureFilter::Run");
 
 	state = State_Running;
-
-	DSHOW_UNUSED(tStart);
+	startTime = tStart;
 	return S_OK;
 }
 
+bool CaptureFilter::GetStreamTime(REFERENCE_TIME &time) const
+{
+	REFERENCE_TIME now;
+
+	if (state != State_Running || !clock)
+		return false;
+	if (FAILED(clock->GetTime(&now)))
+		return false;
+
+	time = now - startTime;
+	return true;
+}
+
 // IBaseFilter methods
 STDMETHODIMP CaptureFilter::EnumPins(IEnumPins **ppEnum)
 {
@@ -46,6 +46,8 @@ class CapturePin : public IPin, public IMemInputPin {
 	CaptureFilter *filter;
 	MediaType connectedMediaType;
 	volatile bool flushing = false;
+	volatile long allocatorBuffers = 0;
+	volatile bool canBlock = false;
 
 	bool IsValidMediaType(const AM_MEDIA_TYPE *pmt) const;
 
@@ -85,6 +87,15 @@ public:
 	STDMETHODIMP ReceiveMultiple(IMediaSample **pSamples, long nSamples,
 				     long *nSamplesProcessed);
 	STDMETHODIMP ReceiveCanBlock();
+
+	/**
+	 * Buffers in the allocator upstream delivers samples from, or zero
+	 * if it isn't known
+	 */
+	inline long AllocatorBuffers() const { return allocatorBuffers; }
+
+	/** Whether the callback may block, as reported by ReceiveCanBlock */
+	inline void SetReceiveCanBlock(bool block) { canBlock = block; }
 };
 
 class CaptureFilter : public IBaseFilter {
@@ -93,6 +104,8 @@ class CaptureFilter : public IBaseFilter {
 	volatile long refCount;
 	FILTER_STATE state;
 	ComPtr<IFilterGraph> graph;
+	ComPtr<IReferenceClock> clock;
+	REFERENCE_TIME startTime = 0;
 	ComPtr<CapturePin> pin;
 
 	ComPtr<IAMFilterMiscFlags> misc;
@@ -125,6 +138,9 @@ public:
 	STDMETHODIMP QueryVendorInfo(LPWSTR *pVendorInfo);
 
 	inline CapturePin *GetPin() const { return (CapturePin *)pin; }
+
+	/** Current stream time of the graph clock, if running */
+	bool GetStreamTime(REFERENCE_TIME &time) const;
 };
 
 class CaptureEnumPins : public IEnumPins {
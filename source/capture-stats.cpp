@@ -0,0 +1,301 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "capture-stats.hpp"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace DShow {
+
+static inline int HighestBit(unsigned long long value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return (int)index;
+#else
+	return 63 - __builtin_clzll(value);
+#endif
+}
+
+static inline int GetBucket(unsigned long long value)
+{
+	if (value < 16)
+		return (int)value;
+
+	int bit = HighestBit(value);
+	int index = 16 + (bit - 4) * 4 + (int)((value >> (bit - 2)) & 3);
+	return index < DSHOW_HISTOGRAM_BUCKETS ? index
+					       : DSHOW_HISTOGRAM_BUCKETS - 1;
+}
+
+/* single writer, so a relaxed load/store pair is enough to increment */
+static inline void Add(std::atomic<unsigned long long> &counter,
+		       unsigned long long value)
+{
+	counter.store(counter.load(std::memory_order_relaxed) + value,
+		      std::memory_order_relaxed);
+}
+
+AtomicHistogram::AtomicHistogram() : sum(0)
+{
+	for (auto &bucket : buckets)
+		bucket.store(0, std::memory_order_relaxed);
+}
+
+void AtomicHistogram::Record(unsigned long long value)
+{
+	Add(buckets[GetBucket(value)], 1);
+	Add(sum, value);
+}
+
+void AtomicHistogram::Snapshot(Histogram &histogram) const
+{
+	histogram.count = 0;
+
+	for (int i = 0; i < DSHOW_HISTOGRAM_BUCKETS; i++) {
+		histogram.buckets[i] = buckets[i].load(
+			std::memory_order_relaxed);
+		histogram.count += histogram.buckets[i];
+	}
+
+	histogram.sum = sum.load(std::memory_order_relaxed);
+}
+
+static inline unsigned long long ToMicroseconds(long long time)
+{
+	return time > 0 ? (unsigned long long)time / 10 : 0;
+}
+
+StreamTelemetry::StreamTelemetry()
+	: samples(0),
+	  bytes(0),
+	  formatChanges(0),
+	  droppedFrames(0),
+	  duplicateTimestamps(0),
+	  discontinuities(0),
+	  driftPpb(0)
+{
+}
+
+void StreamTelemetry::RecordArrival(long long hostTime, size_t size,
+				    bool hasTime, long long timestamp)
+{
+	Add(samples, 1);
+	Add(bytes, size);
+
+	if (!hasTime)
+		return;
+
+	if (hasLast) {
+		long long jitter = (hostTime - lastArrival) -
+				   (timestamp - lastTimestamp);
+		arrivalJitter.Record(ToMicroseconds(jitter < 0 ? -jitter
+							       : jitter));
+	}
+
+	lastArrival = hostTime;
+	lastTimestamp = timestamp;
+	hasLast = true;
+}
+
+void StreamTelemetry::RecordCallback(long long duration)
+{
+	callbackTime.Record(ToMicroseconds(duration));
+}
+
+void StreamTelemetry::RecordDelay(long long delay_)
+{
+	delay.Record(ToMicroseconds(delay_));
+}
+
+void StreamTelemetry::RecordFormatChange()
+{
+	formatChanges++;
+}
+
+void StreamTelemetry::RecordEvent(const StreamEvent &event)
+{
+	switch (event.type) {
+	case StreamEventType::DroppedFrames:
+		Add(droppedFrames, (unsigned long long)event.count);
+		break;
+	case StreamEventType::DuplicateTimestamp:
+		Add(duplicateTimestamps, 1);
+		break;
+	case StreamEventType::Discontinuity:
+		Add(discontinuities, 1);
+		break;
+	}
+}
+
+void StreamTelemetry::RecordDrift(double ppm)
+{
+	driftPpb.store((long long)(ppm * 1000.0), std::memory_order_relaxed);
+}
+
+void StreamTelemetry::Snapshot(StreamStats &stats) const
+{
+	stats.samples = samples.load(std::memory_order_relaxed);
+	stats.bytes = bytes.load(std::memory_order_relaxed);
+	stats.formatChanges = formatChanges.load(std::memory_order_relaxed);
+	stats.droppedFrames = droppedFrames.load(std::memory_order_relaxed);
+	stats.duplicateTimestamps =
+		duplicateTimestamps.load(std::memory_order_relaxed);
+	stats.discontinuities = discontinuities.load(std::memory_order_relaxed);
+	stats.clockDriftPpm =
+		(double)driftPpb.load(std::memory_order_relaxed) / 1000.0;
+
+	arrivalJitter.Snapshot(stats.arrivalJitter);
+	callbackTime.Snapshot(stats.callbackTime);
+	delay.Snapshot(stats.delay);
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void Append(std::string &out, const char *format, ...)
+{
+	char str[512];
+	va_list args;
+
+	va_start(args, format);
+	int len = vsnprintf(str, sizeof(str), format, args);
+	va_end(args);
+
+	if (len > 0)
+		out.append(str, (size_t)len < sizeof(str) ? (size_t)len
+							  : sizeof(str) - 1);
+}
+
+typedef unsigned long long StreamStats::*CounterMember;
+typedef Histogram StreamStats::*HistogramMember;
+
+static void WriteCounter(std::string &out,
+			 const std::vector<StatsExport> &streams,
+			 const char *name, const char *type, const char *help,
+			 CounterMember member)
+{
+	Append(out, "# HELP dshowcapture_%s %s\n", name, help);
+	Append(out, "# TYPE dshowcapture_%s %s\n", name, type);
+
+	for (const StatsExport &stream : streams)
+		Append(out, "dshowcapture_%s{%s} %llu\n", name,
+		       stream.labels.c_str(), stream.stats.*member);
+}
+
+static void WriteDrift(std::string &out,
+		       const std::vector<StatsExport> &streams)
+{
+	Append(out, "# HELP dshowcapture_clock_drift_ppm Sample clock drift "
+		    "relative to the host clock\n");
+	Append(out, "# TYPE dshowcapture_clock_drift_ppm gauge\n");
+
+	for (const StatsExport &stream : streams)
+		Append(out, "dshowcapture_clock_drift_ppm{%s} %g\n",
+		       stream.labels.c_str(), stream.stats.clockDriftPpm);
+}
+
+static void WriteHistogram(std::string &out,
+			   const std::vector<StatsExport> &streams,
+			   const char *name, const char *help,
+			   HistogramMember member)
+{
+	Append(out, "# HELP dshowcapture_%s_seconds %s\n", name, help);
+	Append(out, "# TYPE dshowcapture_%s_seconds histogram\n", name);
+
+	for (const StatsExport &stream : streams) {
+		const Histogram &histogram = stream.stats.*member;
+		const char *labels = stream.labels.c_str();
+		const char *sep = stream.labels.empty() ? "" : ",";
+		unsigned long long total = 0;
+
+		/* buckets past the last used one would all repeat the
+		 * count, so they are left to +Inf */
+		int last = DSHOW_HISTOGRAM_BUCKETS - 1;
+		while (last > 0 && !histogram.buckets[last])
+			last--;
+
+		for (int i = 0; i <= last; i++) {
+			total += histogram.buckets[i];
+			Append(out,
+			       "dshowcapture_%s_seconds_bucket{%s%sle=\"%g\"} "
+			       "%llu\n",
+			       name, labels, sep,
+			       (double)Histogram::BucketUpperBound(i) /
+				       1000000.0,
+			       total);
+		}
+
+		Append(out,
+		       "dshowcapture_%s_seconds_bucket{%s%sle=\"+Inf\"} "
+		       "%llu\n",
+		       name, labels, sep, histogram.count);
+		Append(out, "dshowcapture_%s_seconds_sum{%s} %g\n", name,
+		       labels, (double)histogram.sum / 1000000.0);
+		Append(out, "dshowcapture_%s_seconds_count{%s} %llu\n", name,
+		       labels, histogram.count);
+	}
+}
+
+std::string FormatPrometheusStats(const std::vector<StatsExport> &streams)
+{
+	std::string out;
+
+	WriteCounter(out, streams, "samples_total", "counter",
+		     "Samples received from the device", &StreamStats::samples);
+	WriteCounter(out, streams, "bytes_total", "counter",
+		     "Bytes received from the device", &StreamStats::bytes);
+	WriteCounter(out, streams, "format_changes_total", "counter",
+		     "Media type changes while capturing",
+		     &StreamStats::formatChanges);
+	WriteCounter(out, streams, "dropped_frames_total", "counter",
+		     "Estimated lost video frames or audio sample frames",
+		     &StreamStats::droppedFrames);
+	WriteCounter(out, streams, "duplicate_timestamps_total", "counter",
+		     "Samples with the same timestamp as the previous one",
+		     &StreamStats::duplicateTimestamps);
+	WriteCounter(out, streams, "discontinuities_total", "counter",
+		     "Stream discontinuities", &StreamStats::discontinuities);
+	WriteDrift(out, streams);
+	WriteCounter(out, streams, "queue_overflows_total", "counter",
+		     "Samples that arrived while the delivery queue was full",
+		     &StreamStats::queueOverflows);
+	WriteCounter(out, streams, "queue_high_water", "gauge",
+		     "Largest number of samples waiting in the delivery queue",
+		     &StreamStats::queueHighWater);
+
+	WriteHistogram(out, streams, "arrival_jitter",
+		       "Sample arrival jitter relative to sample timestamps",
+		       &StreamStats::arrivalJitter);
+	WriteHistogram(out, streams, "callback_duration",
+		       "Time spent in the capture callback",
+		       &StreamStats::callbackTime);
+	WriteHistogram(out, streams, "delay",
+		       "Delay between sample timestamp and callback",
+		       &StreamStats::delay);
+
+	return out;
+}
+
+}; /* namespace DShow */
@@ -0,0 +1,82 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+
+#include <atomic>
+
+namespace DShow {
+
+/**
+ * Lock-free version of Histogram.  Written by a single thread, snapshots may
+ * be taken from any thread.  The count of a snapshot is the total of its
+ * buckets, so it's consistent with them even while values are recorded.
+ */
+class AtomicHistogram {
+	std::atomic<unsigned long long> sum;
+	std::atomic<unsigned long long> buckets[DSHOW_HISTOGRAM_BUCKETS];
+
+public:
+	AtomicHistogram();
+
+	void Record(unsigned long long value);
+	void Snapshot(Histogram &histogram) const;
+};
+
+/**
+ * Per-stream capture statistics.  All times are in 100-nanosecond units,
+ * histograms are kept in microseconds.  Arrivals are recorded on the
+ * streaming thread and callbacks on whichever thread calls them, so each
+ * counter only ever has one writer.
+ */
+class StreamTelemetry {
+	std::atomic<unsigned long long> samples;
+	std::atomic<unsigned long long> bytes;
+	std::atomic<unsigned long long> formatChanges;
+	std::atomic<unsigned long long> droppedFrames;
+	std::atomic<unsigned long long> duplicateTimestamps;
+	std::atomic<unsigned long long> discontinuities;
+	std::atomic<long long> driftPpb;
+
+	AtomicHistogram arrivalJitter;
+	AtomicHistogram callbackTime;
+	AtomicHistogram delay;
+
+	/* streaming thread only */
+	long long lastArrival = 0;
+	long long lastTimestamp = 0;
+	bool hasLast = false;
+
+public:
+	StreamTelemetry();
+
+	void RecordArrival(long long hostTime, size_t size, bool hasTime,
+			   long long timestamp);
+	void RecordCallback(long long duration);
+	void RecordDelay(long long delay);
+	void RecordFormatChange();
+	void RecordEvent(const StreamEvent &event);
+	void RecordDrift(double ppm);
+
+	void Snapshot(StreamStats &stats) const;
+};
+
+}; /* namespace DShow */
@@ -0,0 +1,152 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "clock-recovery.hpp"
+
+#include <math.h>
+
+namespace DShow {
+
+/* error past which the stream is assumed to have jumped and is resynced */
+#define RESYNC_THRESHOLD 5000000LL
+
+/* minimum span of host time before drift is reported */
+#define DRIFT_MIN_SPAN 10000000LL
+
+ClockRecovery::ClockRecovery(size_t windowSize_)
+	: windowSize(windowSize_ > 2 ? windowSize_ : 2)
+{
+	window.reserve(windowSize);
+}
+
+void ClockRecovery::Reset(long long nominalInterval_)
+{
+	nominalInterval = nominalInterval_;
+	window.clear();
+	next = 0;
+	hasBase = false;
+	hasLast = false;
+	driftPpm = 0.0;
+}
+
+/* least-squares estimate of the sample time at the given host time,
+ * relative to the base */
+double ClockRecovery::Fit(double host) const
+{
+	size_t count = window.size();
+	double meanHost = 0.0;
+	double meanRaw = 0.0;
+
+	for (const Point &point : window) {
+		meanHost += point.host;
+		meanRaw += point.raw;
+	}
+
+	meanHost /= (double)count;
+	meanRaw /= (double)count;
+
+	double covariance = 0.0;
+	double variance = 0.0;
+
+	for (const Point &point : window) {
+		double dx = point.host - meanHost;
+		covariance += dx * (point.raw - meanRaw);
+		variance += dx * dx;
+	}
+
+	double slope = variance > 0.0 ? covariance / variance : 1.0;
+	return meanRaw + slope * (host - meanHost);
+}
+
+long long ClockRecovery::Process(long long rawTime, long long hostTime,
+				 long long duration)
+{
+	if (hasBase) {
+		double host = (double)(hostTime - baseHost);
+		double error = (double)(rawTime - baseRaw) - Fit(host);
+
+		if (fabs(error) > (double)RESYNC_THRESHOLD) {
+			window.clear();
+			next = 0;
+			hasBase = false;
+			hasLast = false;
+		}
+	}
+
+	if (!hasBase) {
+		baseHost = hostTime;
+		baseRaw = rawTime;
+		hasBase = true;
+	}
+
+	Point point;
+	point.host = (double)(hostTime - baseHost);
+	point.raw = (double)(rawTime - baseRaw);
+
+	if (window.size() < windowSize) {
+		window.push_back(point);
+	} else {
+		window[next] = point;
+		next = (next + 1) % windowSize;
+	}
+
+	double fit = Fit(point.host);
+	if (hostTime - baseHost >= DRIFT_MIN_SPAN)
+		driftPpm = (fit / point.host - 1.0) * 1000000.0;
+
+	long long fitted = baseRaw + llround(fit);
+	long long out = fitted;
+
+	if (hasLast) {
+		if (nominalInterval > 0) {
+			/* stay on the frame grid, skipping whole frames when
+			 * the fit moves ahead by more than half a frame.  when
+			 * the grid gets more than half a frame ahead of the
+			 * fit instead (a device faster than its nominal rate)
+			 * it's re-anchored to the fit, or it would drift ahead
+			 * without limit */
+			long long steps = (fitted - lastOut +
+					   nominalInterval / 2) /
+					  nominalInterval;
+			if (steps >= 1)
+				out = lastOut + steps * nominalInterval;
+
+		} else {
+			/* keep buffers contiguous unless the fit has moved
+			 * away by more than half a buffer, in either
+			 * direction */
+			long long expected = lastOut + lastDuration;
+			long long tolerance = lastDuration / 2;
+			long long diff = fitted - expected;
+
+			if (diff <= tolerance && diff >= -tolerance)
+				out = expected;
+		}
+
+		if (out <= lastOut)
+			out = lastOut + 1;
+	}
+
+	hasLast = true;
+	lastOut = out;
+	lastDuration = duration;
+	return out;
+}
+
+}; /* namespace DShow */
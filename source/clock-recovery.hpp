@@ -0,0 +1,80 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+
+namespace DShow {
+
+/**
+ * Produces smoothed, monotonic presentation timestamps from jittery sample
+ * timestamps.  Sample times are fit against host arrival times with a
+ * least-squares line over a sliding window, and the fitted time is then
+ * snapped to the nominal frame interval (or, for audio, to the end of the
+ * previous buffer) so that regular streams come out perfectly regular.
+ * Whenever the snapped time ends up more than half an interval from the
+ * fit, it's re-anchored to the fit, so a device that runs off its nominal
+ * rate stays within half an interval of its real timing.
+ *
+ * All times are in 100-nanosecond units.
+ */
+class ClockRecovery {
+	struct Point {
+		double host;
+		double raw;
+	};
+
+	std::vector<Point> window;
+	size_t windowSize;
+	size_t next = 0;
+
+	long long nominalInterval = 0;
+
+	bool hasBase = false;
+	long long baseHost = 0;
+	long long baseRaw = 0;
+
+	bool hasLast = false;
+	long long lastOut = 0;
+	long long lastDuration = 0;
+
+	double driftPpm = 0.0;
+
+	double Fit(double host) const;
+
+public:
+	ClockRecovery(size_t windowSize = 120);
+
+	/**
+	 * Starts over.  nominalInterval is the expected time between samples
+	 * (zero if samples vary in length, as with audio).
+	 */
+	void Reset(long long nominalInterval);
+
+	/** Returns the smoothed start time for a sample */
+	long long Process(long long rawTime, long long hostTime,
+			  long long duration);
+
+	/** Rate of sample time relative to host time, in parts per million */
+	inline double DriftPpm() const { return driftPpm; }
+};
+
+}; /* namespace DShow */
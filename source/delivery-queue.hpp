@@ -0,0 +1,180 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+#include "ring-queue.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace DShow {
+
+/**
+ * Hands items from the DirectShow streaming thread to a dedicated consumer
+ * thread through a bounded ring, so a slow callback cannot stall the
+ * upstream filters.  The mutex is only used to put either side to sleep; the
+ * items themselves never pass through it.
+ */
+template<typename T> class DeliveryQueue {
+	RingQueue<T> ring;
+	QueuePolicy policy;
+	std::function<void(T &item)> callback;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable itemReady;
+	std::condition_variable spaceReady;
+	std::atomic<bool> consumerWaiting;
+	std::atomic<bool> producerWaiting;
+	std::atomic<bool> stopping;
+
+	std::atomic<unsigned long long> overflows;
+	std::atomic<unsigned long long> highWater;
+
+	inline void WakeConsumer()
+	{
+		if (consumerWaiting) {
+			std::lock_guard<std::mutex> lock(mutex);
+			itemReady.notify_one();
+		}
+	}
+
+	inline void WakeProducer()
+	{
+		if (producerWaiting) {
+			std::lock_guard<std::mutex> lock(mutex);
+			spaceReady.notify_one();
+		}
+	}
+
+	void Run()
+	{
+		for (;;) {
+			T item;
+
+			while (!stopping && ring.Pop(item)) {
+				callback(item);
+				item = T();
+				WakeProducer();
+			}
+
+			std::unique_lock<std::mutex> lock(mutex);
+			consumerWaiting = true;
+			itemReady.wait(lock, [this]() {
+				return stopping || !ring.Empty();
+			});
+			consumerWaiting = false;
+
+			if (stopping)
+				break;
+		}
+	}
+
+	bool WaitForSpace()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		producerWaiting = true;
+		spaceReady.wait(lock, [this]() {
+			return stopping || ring.Size() < ring.Depth();
+		});
+		producerWaiting = false;
+
+		return !stopping;
+	}
+
+public:
+	inline DeliveryQueue(size_t depth, QueuePolicy policy_,
+			     std::function<void(T &item)> callback_)
+		: ring(depth),
+		  policy(policy_),
+		  callback(callback_),
+		  consumerWaiting(false),
+		  producerWaiting(false),
+		  stopping(false),
+		  overflows(0),
+		  highWater(0)
+	{
+	}
+
+	inline ~DeliveryQueue() { Stop(); }
+
+	inline void Start()
+	{
+		if (thread.joinable())
+			return;
+
+		stopping = false;
+		thread = std::thread(&DeliveryQueue::Run, this);
+	}
+
+	/* stops the consumer thread and discards anything still queued */
+	inline void Stop()
+	{
+		if (thread.joinable()) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+				itemReady.notify_one();
+				spaceReady.notify_one();
+			}
+
+			thread.join();
+		}
+
+		T item;
+		while (ring.Pop(item))
+			item = T();
+	}
+
+	void Push(T &&item)
+	{
+		if (!ring.Push(std::move(item))) {
+			overflows++;
+
+			if (policy == QueuePolicy::DropNewest)
+				return;
+
+			if (policy == QueuePolicy::DropOldest) {
+				T oldest;
+				ring.Pop(oldest);
+			} else if (!WaitForSpace()) {
+				return;
+			}
+
+			if (!ring.Push(std::move(item)))
+				return;
+		}
+
+		unsigned long long size = ring.Size();
+		if (size > highWater.load(std::memory_order_relaxed))
+			highWater.store(size, std::memory_order_relaxed);
+
+		WakeConsumer();
+	}
+
+	inline unsigned long long Overflows() const { return overflows; }
+	inline unsigned long long HighWater() const { return highWater; }
+};
+
+}; /* namespace DShow */
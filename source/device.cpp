@@ -20,17 +20,35 @@
 #include "device.hpp"
 #include "dshow-device-defs.hpp"
 #include "dshow-media-type.hpp"
+#include "dshow-convert.hpp"
+#include "dshow-rotate.hpp"
+#include "audio-convert.hpp"
 #include "dshow-formats.hpp"
 #include "dshow-enum.hpp"
+#include "worker-pool.hpp"
 #include "log.hpp"
 
 #define ROCKET_WAIT_TIME_MS 5000
 
 namespace DShow {
 
+/* host clock in 100-nanosecond units */
+static inline long long GetHostTime()
+{
+	static LARGE_INTEGER frequency = {};
+	LARGE_INTEGER count;
+
+	if (!frequency.QuadPart)
+		QueryPerformanceFrequency(&frequency);
+
+	QueryPerformanceCounter(&count);
+	return (long long)((double)count.QuadPart * 10000000.0 /
+			   (double)frequency.QuadPart);
+}
+
 bool SetRocketEnabled(IBaseFilter *encoder, bool enable);
 
-HDevice::HDevice() : initialized(false), active(false) {}
+HDevice::HDevice() : rotation(0), initialized(false), active(false) {}
 
 HDevice::~HDevice()
 {
@@ -39,6 +57,9 @@ HDevice::~HDevice()
 
 	DisconnectFilters();
 
+	if (rotationStop)
+		CloseHandle(rotationStop);
+
 	/*
 	 * the sleeps for the rocket are required.  It seems that you cannot
 	 * simply start/stop the stream right away after/before you enable or
@@ -83,51 +104,699 @@ bool HDevice::EnsureInactive(const wchar_t *func)
 	return true;
 }
 
-inline void HDevice::SendToCallback(bool video, unsigned char *data,
-				    size_t size, long long startTime,
-				    long long stopTime, long rotation)
+void EncodedData::Append(IMediaSample *sample, const unsigned char *data,
+			 size_t size_, size_t maxSegments)
+{
+	if (segments.size() >= maxSegments) {
+		for (EncodedSegment &segment : segments)
+			bytes.insert(bytes.end(), segment.data,
+				     segment.data + segment.size);
+		segments.clear();
+	}
+
+	if (!maxSegments) {
+		bytes.insert(bytes.end(), data, data + size_);
+		size += size_;
+		return;
+	}
+
+	EncodedSegment segment;
+	segment.sample = sample;
+	segment.data = data;
+	segment.size = size_;
+	segments.push_back(segment);
+
+	size += size_;
+}
+
+/* returns the sample only if the packet can be used without copying */
+IMediaSample *EncodedData::Sample() const
+{
+	return (bytes.empty() && segments.size() == 1) ? segments[0].sample
+						       : nullptr;
+}
+
+const unsigned char *EncodedData::Data()
+{
+	if (bytes.empty() && segments.size() == 1)
+		return segments[0].data;
+
+	if (!segments.empty()) {
+		size_t offset = bytes.size();
+		bytes.resize(size);
+
+		for (EncodedSegment &segment : segments) {
+			memcpy(bytes.data() + offset, segment.data,
+			       segment.size);
+			offset += segment.size;
+		}
+
+		segments.clear();
+	}
+
+	return bytes.data();
+}
+
+void EncodedData::Clear()
+{
+	segments.clear();
+	bytes.resize(0);
+	size = 0;
+}
+
+inline void HDevice::SendToCallback(bool video, IMediaSample *sample,
+				    unsigned char *data, size_t size,
+				    long long startTime, long long stopTime,
+				    long rotation)
 {
 	if (!size)
 		return;
 
+	SendToCallback(video, MakeFrame(video, sample, data, size), startTime,
+		       stopTime, rotation);
+}
+
+inline Frame HDevice::MakeFrame(bool video, IMediaSample *sample,
+				unsigned char *data, size_t size)
+{
+	/* plain callbacks only borrow the data for the duration of the call,
+	 * so the sample only needs to be referenced if the frame is queued or
+	 * handed to a frame callback */
+	bool keep = video ? videoQueue || videoConfig.frameCallback
+			  : audioQueue || audioConfig.frameCallback;
+	FramePool &pool = video ? *videoFrames : *audioFrames;
+	Frame frame = keep ? pool.Wrap(sample, data, size)
+			   : Frame(nullptr, data, size);
+
 	if (video)
-		videoConfig.callback(videoConfig, data, size, startTime,
-				     stopTime, rotation);
+		SetVideoPlanes(frame, false);
+
+	return frame;
+}
+
+inline void HDevice::SendToCallback(bool video, const Frame &frame,
+				    long long startTime, long long stopTime,
+				    long rotation)
+{
+	if (video) {
+		if (videoQueue) {
+			if (!videoSnapshot)
+				videoSnapshot = make_shared<VideoConfig>(
+					OutputVideoConfig());
+
+			VideoPacket packet;
+			packet.config = videoSnapshot;
+			packet.frame = frame;
+			packet.startTime = startTime;
+			packet.stopTime = stopTime;
+			packet.rotation = rotation;
+			videoQueue->Push(move(packet));
+
+		} else {
+			const VideoConfig &config = OutputVideoConfig();
+
+			RecordDelay(true, startTime);
+			long long callStart = GetHostTime();
+
+			if (config.frameCallback)
+				config.frameCallback(config, frame, startTime,
+						     stopTime, rotation);
+			else
+				config.callback(config, frame.Data(),
+						frame.Size(), startTime, stopTime,
+						rotation);
+
+			videoTelemetry.RecordCallback(GetHostTime() -
+						      callStart);
+		}
+	} else {
+		if (audioQueue) {
+			if (!audioSnapshot)
+				audioSnapshot =
+					make_shared<AudioConfig>(audioConfig);
+
+			AudioPacket packet;
+			packet.config = audioSnapshot;
+			packet.frame = frame;
+			packet.startTime = startTime;
+			packet.stopTime = stopTime;
+			audioQueue->Push(move(packet));
+
+		} else {
+			RecordDelay(false, startTime);
+			long long callStart = GetHostTime();
+
+			if (audioConfig.frameCallback)
+				audioConfig.frameCallback(audioConfig, frame,
+							  startTime, stopTime);
+			else
+				audioConfig.callback(audioConfig, frame.Data(),
+						     frame.Size(), startTime,
+						     stopTime);
+
+			audioTelemetry.RecordCallback(GetHostTime() -
+						      callStart);
+		}
+	}
+}
+
+/* converts uncompressed audio to the format that was asked for, mixing the
+ * device's channels at the same time if mix is set, in to a pooled buffer */
+bool HDevice::ConvertAudioFrame(AudioFormat inFormat, bool mix,
+				const void *data, size_t size, Frame &frame)
+{
+	AudioFormat outFormat = audioConfig.format;
+	int channels = audioConfig.channels;
+	int inChannels = mix ? deviceChannels : channels;
+
+	if (channels <= 0 || inChannels <= 0)
+		return false;
+
+	/* a trailing partial frame can't be converted and is dropped */
+	size_t frames = size / (AudioSampleSize(inFormat) * inChannels);
+	size_t planeSize = frames * AudioSampleSize(outFormat);
+	if (!frames)
+		return false;
+
+	frame = audioFrames->Allocate(planeSize * channels);
+
+	bool success = mix ? MixAudio(inFormat, data, inChannels, outFormat,
+				      frame.Data(), channels,
+				      channelMatrix.data(), frames)
+			   : ConvertAudio(inFormat, data, outFormat,
+					  frame.Data(), frames, channels);
+	if (!success)
+		return false;
+
+	if (outFormat == AudioFormat::WaveFloatPlanar) {
+		for (int i = 0; i < channels && i < DSHOW_MAX_PLANES; i++)
+			frame.SetPlane(i, frame.Data() + planeSize * i,
+				       (int)planeSize);
+	}
+
+	return true;
+}
+
+/* resamples audio from the device to float at the rate that was asked for,
+ * in to audioResampled */
+bool HDevice::ResampleAudio(const unsigned char *data, size_t size,
+			    long long startTime, long long &outputTime)
+{
+	AudioFormat format = audioConfig.internalFormat;
+	int channels = audioConfig.channels;
+	size_t frames = size / (AudioSampleSize(format) * deviceChannels);
+	const float *input = (const float *)data;
+
+	/* channels are mixed first so that fewer are resampled */
+	if (mixAudio) {
+		audioFloat.resize(frames * channels);
+		MixAudio(format, data, deviceChannels, AudioFormat::WaveFloat,
+			 audioFloat.data(), channels, channelMatrix.data(),
+			 frames);
+		input = audioFloat.data();
+
+	} else if (format != AudioFormat::WaveFloat) {
+		audioFloat.resize(frames * channels);
+		ConvertAudio(format, data, AudioFormat::WaveFloat,
+			     audioFloat.data(), frames, channels);
+		input = audioFloat.data();
+	}
+
+	audioResampled.clear();
+	return audioResampler.Process(input, frames, startTime, audioResampled,
+				      outputTime) != 0;
+}
+
+/* uncompressed audio that has to be converted, resampled or re-split before
+ * it's delivered */
+void HDevice::ProcessAudio(IMediaSample *sample, const unsigned char *data,
+			   size_t size, long long startTime,
+			   long long stopTime)
+{
+	AudioFormat format = audioConfig.internalFormat;
+	bool mix = mixAudio;
+	Frame frame;
+
+	if (resampleAudio) {
+		if (!ResampleAudio(data, size, startTime, startTime))
+			return;
+
+		size_t frames = audioResampled.size() / audioConfig.channels;
+		stopTime = startTime + (long long)frames * 10000000LL /
+					       audioConfig.sampleRate;
+
+		sample = nullptr;
+		data = (const unsigned char *)audioResampled.data();
+		size = audioResampled.size() * sizeof(float);
+		format = AudioFormat::WaveFloat;
+		mix = false;
+	}
+
+	bool same = format == audioConfig.format && !mix;
+
+	if (!audioPacketizer.Active()) {
+		if (same)
+			SendToCallback(false, sample, (unsigned char *)data,
+				       size, startTime, stopTime, 0);
+		else if (ConvertAudioFrame(format, mix, data, size, frame))
+			SendToCallback(false, frame, startTime, stopTime, 0);
+		return;
+	}
+
+	AudioPacketizer::Packet packet;
+
+	audioPacketizer.Push(data, size, startTime);
+	while (audioPacketizer.Pop(packet)) {
+		if (same)
+			SendToCallback(false, packet.inPlace ? sample : nullptr,
+				       (unsigned char *)packet.data,
+				       packet.size, packet.startTime,
+				       packet.stopTime, 0);
+		else if (ConvertAudioFrame(format, mix, packet.data,
+					   packet.size, frame))
+			SendToCallback(false, frame, packet.startTime,
+				       packet.stopTime, 0);
+	}
+}
+
+/* scales frames in the device's format to the size that was asked for, in
+ * to a pooled buffer */
+bool HDevice::ScaleVideoFrame(const Frame &input, Frame &frame)
+{
+	int linesize[3];
+	size_t offset[3];
+	size_t size = GetVideoLayout(videoConfig.internalFormat, scaleCX,
+				     scaleCY, linesize, offset);
+
+	if (!size || !input.Plane(0))
+		return false;
+
+	frame = videoFrames->Allocate(size);
+
+	const unsigned char *src[3];
+	int srcLinesize[3];
+	unsigned char *dst[3];
+
+	for (int i = 0; i < 3; i++) {
+		src[i] = input.Plane(i);
+		srcLinesize[i] = input.Linesize(i);
+		dst[i] = linesize[i] ? frame.Data() + offset[i] : nullptr;
+		frame.SetPlane(i, dst[i], linesize[i]);
+	}
+
+	ParallelSlices(scaleCY, videoScaler.SliceAlign(),
+		       [&](int begin, int end) {
+			       videoScaler.ScaleSlice(src, srcLinesize, dst,
+						      linesize, begin, end);
+		       });
+	return true;
+}
+
+/* converts packed YUV from the device to the planar format that was asked
+ * for, in to a pooled buffer */
+bool HDevice::ConvertVideoFrame(const Frame &input, int cx, int cy,
+				Frame &frame)
+{
+	VideoFormat inFormat = videoConfig.internalFormat;
+	VideoFormat outFormat = videoConfig.format;
+
+	if (!input.Plane(0) || !CanConvertPackedYUV(inFormat, outFormat))
+		return false;
+
+	int linesize[3];
+	size_t offset[3];
+	size_t outSize = GetVideoLayout(outFormat, cx, cy, linesize, offset);
+	if (!outSize)
+		return false;
+
+	frame = videoFrames->Allocate(outSize);
+
+	unsigned char *planes[3];
+	for (int i = 0; i < 3; i++) {
+		planes[i] = linesize[i] ? frame.Data() + offset[i] : nullptr;
+		frame.SetPlane(i, planes[i], linesize[i]);
+	}
+
+	/* 4:2:0 chroma rows are made from pairs of rows, so slices are
+	 * split on even rows */
+	ParallelSlices(cy, 2, [&](int begin, int end) {
+		const unsigned char *src =
+			input.Plane(0) + (ptrdiff_t)begin * input.Linesize(0);
+		unsigned char *dst[3];
+
+		for (int i = 0; i < 3; i++) {
+			ptrdiff_t row = GetPlaneRow(outFormat, i, begin);
+			dst[i] = planes[i] ? planes[i] + row * linesize[i]
+					   : nullptr;
+		}
+
+		ConvertPackedYUV(inFormat, src, input.Linesize(0), outFormat,
+				 dst, linesize, cx, end - begin);
+	});
+	return true;
+}
+
+/* describes the planes of a frame in the device's own format, optionally
+ * walking bottom-up RGB from its last row so that it reads top-down */
+void HDevice::SetVideoPlanes(Frame &frame, bool topDown) const
+{
+	int linesize[3];
+	size_t offset[3];
+	size_t size = GetVideoLayout(videoConfig.internalFormat, videoConfig.cx,
+				     videoConfig.cy_abs, linesize, offset);
+
+	if (!size || frame.Size() < size)
+		return;
+
+	if (topDown && bottomUpVideo) {
+		frame.SetPlane(0, frame.Data() + size - linesize[0],
+			       -linesize[0]);
+		return;
+	}
+
+	for (int i = 0; i < 3 && linesize[i]; i++)
+		frame.SetPlane(i, frame.Data() + offset[i], linesize[i]);
+}
+
+/* delivers bottom-up RGB top-down.  frames that reference the sample just
+ * describe it with a negative linesize, otherwise the rows are flipped while
+ * copying in to a pooled buffer */
+bool HDevice::FlipVideoFrame(IMediaSample *sample, unsigned char *data,
+			     size_t size, Frame &frame)
+{
+	int linesize = videoConfig.cx * 4;
+	int cy = videoConfig.cy_abs;
+	size_t frameSize = (size_t)linesize * cy;
+
+	if (size < frameSize)
+		return false;
+
+	unsigned char *lastRow = data + frameSize - linesize;
+	bool keep = videoQueue || videoConfig.frameCallback;
+
+	if (keep && videoFrames->CanWrap()) {
+		frame = videoFrames->Wrap(sample, data, size);
+		SetVideoPlanes(frame, true);
+		return true;
+	}
+
+	frame = videoFrames->Allocate(frameSize);
+	unsigned char *dst = frame.Data();
+
+	ParallelSlices(cy, 1, [&](int begin, int end) {
+		CopyPlane(lastRow - (ptrdiff_t)begin * linesize, -linesize,
+			  dst + (ptrdiff_t)begin * linesize, linesize, linesize,
+			  end - begin);
+	});
+
+	frame.SetPlane(0, dst, linesize);
+	return true;
+}
+
+/* turns frames from auto-rotating devices upright, in to a pooled buffer */
+bool HDevice::RotateVideoFrame(VideoFormat format, const Frame &input,
+			       int cx, int cy, int degrees, Frame &frame)
+{
+	bool sideways = degrees == 90 || degrees == 270;
+	int linesize[3];
+	size_t offset[3];
+	size_t size = GetVideoLayout(format, sideways ? cy : cx,
+				     sideways ? cx : cy, linesize, offset);
+
+	if (!size || !input.Plane(0) ||
+	    !CanRotateVideo(format, cx, cy, degrees))
+		return false;
+
+	frame = videoFrames->Allocate(size);
+
+	const unsigned char *src[3];
+	int srcLinesize[3];
+	unsigned char *dst[3];
+
+	for (int i = 0; i < 3; i++) {
+		src[i] = input.Plane(i);
+		srcLinesize[i] = input.Linesize(i);
+		dst[i] = linesize[i] ? frame.Data() + offset[i] : nullptr;
+		frame.SetPlane(i, dst[i], linesize[i]);
+	}
+
+	ParallelSlices(sideways ? cx : cy, 2, [&](int begin, int end) {
+		RotateVideoSlice(format, src, srcLinesize, dst, linesize, cx,
+				 cy, degrees, begin, end);
+	});
+	return true;
+}
+
+/* switches the config given to callbacks when the applied rotation
+ * changes */
+void HDevice::SetVideoRotation(int degrees)
+{
+	if (degrees == videoRotation)
+		return;
+
+	videoRotation = degrees;
+	videoSnapshot.reset();
+	UpdateOutputConfig();
+}
+
+void HDevice::UpdateOutputConfig()
+{
+	if (!scaleVideo && !videoRotation && decodeScale == 1)
+		return;
+
+	outputConfig = videoConfig;
+
+	if (scaleVideo) {
+		outputConfig.cx = scaleCX;
+		outputConfig.cy_abs = scaleCY;
+	} else if (decodeScale > 1) {
+		outputConfig.cx =
+			MJPEGDecoder::ScaledSize(videoConfig.cx, decodeScale);
+		outputConfig.cy_abs = MJPEGDecoder::ScaledSize(
+			videoConfig.cy_abs, decodeScale);
+	}
+
+	if (videoRotation == 90 || videoRotation == 270)
+		swap(outputConfig.cx, outputConfig.cy_abs);
+
+	/* scaled and rotated frames are written top-down */
+	if (outputConfig.format == VideoFormat::ARGB ||
+	    outputConfig.format == VideoFormat::XRGB)
+		outputConfig.cy_flip = true;
+}
+
+/* runs the software stages for raw video: scaling, format conversion,
+ * flipping and rotation.  roll is cleared if the frame was rotated
+ * upright */
+bool HDevice::ProcessVideoFrame(IMediaSample *sample, unsigned char *data,
+				size_t size, long &roll, Frame &frame)
+{
+	VideoFormat format = convertVideo ? videoConfig.format
+					  : videoConfig.internalFormat;
+	int cx = scaleVideo ? scaleCX : videoConfig.cx;
+	int cy = scaleVideo ? scaleCY : videoConfig.cy_abs;
+	int degrees = videoConfig.autoRotate ? NormalizeRotation(roll) : 0;
+
+	if (!CanRotateVideo(format, cx, cy, degrees))
+		degrees = 0;
+
+	SetVideoRotation(degrees);
+
+	/* the device's frame is only read once, straight from the sample */
+	Frame input(nullptr, data, size);
+
+	if (!degrees && !scaleVideo) {
+		if (flipVideo)
+			return FlipVideoFrame(sample, data, size, frame);
+		if (!convertVideo) {
+			frame = MakeFrame(true, sample, data, size);
+			return true;
+		}
+
+		SetVideoPlanes(input, false);
+		return ConvertVideoFrame(input, cx, cy, frame);
+	}
+
+	SetVideoPlanes(input, true);
+
+	/* scaling goes first while the frame is still in the device's
+	 * format, which is never bigger than the converted one */
+	if (scaleVideo) {
+		Frame scaled;
+		if (!ScaleVideoFrame(input, scaled))
+			return false;
+		input = scaled;
+	}
+
+	if (convertVideo) {
+		Frame converted;
+		if (!ConvertVideoFrame(input, cx, cy, converted))
+			return false;
+		input = converted;
+	}
+
+	if (!degrees) {
+		frame = input;
+		return true;
+	}
+
+	roll = 0;
+	return RotateVideoFrame(format, input, cx, cy, degrees, frame);
+}
+
+/* upstream filters must be told if Receive can block, which it does while a
+ * queue with the Block policy is full.  Demuxed audio is received on the
+ * video pin */
+void HDevice::UpdateReceiveCanBlock()
+{
+	bool videoBlocks = videoQueue &&
+			   videoConfig.queuePolicy == QueuePolicy::Block;
+	bool audioBlocks = audioQueue &&
+			   audioConfig.queuePolicy == QueuePolicy::Block;
+
+	if (videoCapture)
+		videoCapture->GetPin()->SetReceiveCanBlock(
+			videoBlocks || (demuxedAudio && audioBlocks));
+	if (audioCapture)
+		audioCapture->GetPin()->SetReceiveCanBlock(audioBlocks);
+}
+
+/* how far the graph clock has moved past the sample's timestamp by the time
+ * the sample reaches its callback */
+void HDevice::RecordDelay(bool video, long long startTime)
+{
+	CaptureFilter *capture = video || demuxedAudio ? videoCapture
+						       : audioCapture;
+	REFERENCE_TIME streamTime;
+
+	if (capture && capture->GetStreamTime(streamTime)) {
+		StreamTelemetry &telemetry =
+			video ? videoTelemetry : audioTelemetry;
+		telemetry.RecordDelay(streamTime - startTime);
+	}
+}
+
+void HDevice::DetectGaps(bool video, bool discontinuity, long long startTime,
+			 size_t size)
+{
+	GapDetector &detector = video ? videoGaps : audioGaps;
+	StreamEvent event;
+
+	if (!detector.Process(startTime, discontinuity, size, event))
+		return;
+
+	StreamTelemetry &telemetry = video ? videoTelemetry : audioTelemetry;
+	telemetry.RecordEvent(event);
+
+	const StreamEventProc &callback = video ? videoConfig.eventCallback
+						: audioConfig.eventCallback;
+	if (callback)
+		callback(event);
+}
+
+void HDevice::RecoverClock(bool video, long long arrival, long long &startTime,
+			   long long &stopTime)
+{
+	bool smooth = video ? videoConfig.smoothTimestamps
+			    : audioConfig.smoothTimestamps;
+	if (!smooth)
+		return;
+
+	ClockRecovery &clock = video ? videoClock : audioClock;
+	StreamTelemetry &telemetry = video ? videoTelemetry : audioTelemetry;
+	long long duration = stopTime - startTime;
+
+	startTime = clock.Process(startTime, arrival, duration);
+	stopTime = startTime + duration;
+	telemetry.RecordDrift(clock.DriftPpm());
+}
+
+void HDevice::DeliverVideo(const VideoPacket &packet)
+{
+	const VideoConfig &config = *packet.config;
+
+	RecordDelay(true, packet.startTime);
+	long long callStart = GetHostTime();
+
+	if (config.frameCallback)
+		config.frameCallback(config, packet.frame, packet.startTime,
+				     packet.stopTime, packet.rotation);
 	else
-		audioConfig.callback(audioConfig, data, size, startTime,
-				     stopTime);
+		config.callback(config, packet.frame.Data(),
+				packet.frame.Size(), packet.startTime,
+				packet.stopTime, packet.rotation);
+
+	videoTelemetry.RecordCallback(GetHostTime() - callStart);
+}
+
+void HDevice::DeliverAudio(const AudioPacket &packet)
+{
+	const AudioConfig &config = *packet.config;
+
+	RecordDelay(false, packet.startTime);
+	long long callStart = GetHostTime();
+
+	if (config.frameCallback)
+		config.frameCallback(config, packet.frame, packet.startTime,
+				     packet.stopTime);
+	else
+		config.callback(config, packet.frame.Data(),
+				packet.frame.Size(), packet.startTime,
+				packet.stopTime);
+
+	audioTelemetry.RecordCallback(GetHostTime() - callStart);
+}
+
+void HDevice::GetStats(bool video, StreamStats &stats) const
+{
+	stats = StreamStats();
+
+	if (video)
+		videoTelemetry.Snapshot(stats);
+	else
+		audioTelemetry.Snapshot(stats);
+
+	if (video && videoQueue) {
+		stats.queueOverflows = videoQueue->Overflows();
+		stats.queueHighWater = videoQueue->HighWater();
+	} else if (!video && audioQueue) {
+		stats.queueOverflows = audioQueue->Overflows();
+		stats.queueHighWater = audioQueue->HighWater();
+	}
 }
 
 void HDevice::Receive(bool isVideo, IMediaSample *sample)
 {
 	BYTE *ptr;
 	MediaTypePtr mt;
-	long roll = 0;
 	bool encoded = isVideo ? ((int)videoConfig.format >= 400)
 			       : ((int)audioConfig.format >= 200);
 
 	if (!sample)
 		return;
 
-	if (isVideo ? !videoConfig.callback : !audioConfig.callback)
+	if (isVideo ? !videoConfig.callback && !videoConfig.frameCallback
+		    : !audioConfig.callback && !audioConfig.frameCallback)
 		return;
 
 	/* auto-rotation for devices such as streamcam */
-	if (isVideo && rotatableDevice) {
-		ComQIPtr<IAMCameraControl> cc(videoFilter);
-		if (cc) {
-			long ccf = 0;
-			cc->Get(CameraControl_Roll, &roll, &ccf);
-		}
-	}
+	long roll = isVideo ? rotation.load(memory_order_relaxed) : 0;
 
+	/* some drivers attach a media type to every sample, so only copy
+	 * and convert it when it actually differs from the current one */
 	if (sample->GetMediaType(&mt) == S_OK) {
-		if (isVideo) {
+		MediaTypeFingerprint fp = GetMediaTypeFingerprint(*mt);
+
+		if (isVideo && fp != videoFingerprint) {
 			videoMediaType = mt;
 			ConvertVideoSettings();
-		} else {
+			videoSnapshot.reset();
+			videoTelemetry.RecordFormatChange();
+		} else if (!isVideo && fp != audioFingerprint) {
 			audioMediaType = mt;
 			ConvertAudioSettings();
+			audioSnapshot.reset();
+			audioTelemetry.RecordFormatChange();
 		}
 	}
 
@@ -138,29 +807,463 @@ void HDevice::Receive(bool isVideo, IMediaSample *sample)
 	if (FAILED(sample->GetPointer(&ptr)))
 		return;
 
-	long long startTime, stopTime;
+	long long startTime = 0, stopTime = 0;
 	bool hasTime = SUCCEEDED(sample->GetTime(&startTime, &stopTime));
 
+	long long arrival = GetHostTime();
+	StreamTelemetry &telemetry = isVideo ? videoTelemetry : audioTelemetry;
+	telemetry.RecordArrival(arrival, size, hasTime, startTime);
+
+	/* encoded packets are split over several samples, only the first of
+	 * which has a timestamp */
+	if (hasTime) {
+		DetectGaps(isVideo, sample->IsDiscontinuity() == S_OK,
+			   startTime, size);
+		RecoverClock(isVideo, arrival, startTime, stopTime);
+	}
+
+	/* dropped if the decoding threads have fallen behind */
+	if (hasTime && isVideo && previewVideo)
+		previewDecoder.Decode(videoFrames->Wrap(sample, ptr, size),
+				      startTime, stopTime);
+
 	if (encoded) {
-		EncodedData &data = isVideo ? encodedVideo : encodedAudio;
-
-		/* packets that have time are the first packet in a group of
-		 * segments */
-		if (hasTime) {
-			SendToCallback(isVideo, data.bytes.data(),
-				       data.bytes.size(), data.lastStartTime,
-				       data.lastStopTime, roll);
-
-			data.bytes.resize(0);
-			data.lastStartTime = startTime;
-			data.lastStopTime = stopTime;
-		}
+		ReceiveEncoded(isVideo, sample, ptr, size, hasTime, startTime,
+			       stopTime, roll);
+
+	} else if (hasTime && !isVideo &&
+		   (audioPacketizer.Active() || convertAudio || mixAudio ||
+		    resampleAudio)) {
+		ProcessAudio(sample, ptr, size, startTime, stopTime);
+
+	} else if (hasTime && isVideo && decodeVideo) {
+		/* dropped if the decoding threads have fallen behind */
+		mjpegDecoder.Decode(videoFrames->Wrap(sample, ptr, size),
+				    startTime, stopTime);
+
+	} else if (hasTime && isVideo &&
+		   (flipVideo || convertVideo || scaleVideo ||
+		    videoConfig.autoRotate)) {
+		Frame frame;
 
-		data.bytes.insert(data.bytes.end(), (unsigned char *)ptr,
-				  (unsigned char *)ptr + size);
+		if (ProcessVideoFrame(sample, ptr, size, roll, frame))
+			SendToCallback(true, frame, startTime, stopTime, roll);
 
 	} else if (hasTime) {
-		SendToCallback(isVideo, ptr, size, startTime, stopTime, roll);
+		SendToCallback(isVideo, sample, ptr, size, startTime, stopTime,
+			       roll);
+	}
+}
+
+/* encoded packets are split over several samples, only the first of which
+ * has a timestamp.  In low latency mode the bitstream also tells where they
+ * start and end */
+void HDevice::ReceiveEncoded(bool video, IMediaSample *sample,
+			     const unsigned char *ptr, size_t size,
+			     bool hasTime, long long startTime,
+			     long long stopTime, long roll)
+{
+	EncodedData &data = video ? encodedVideo : encodedAudio;
+	bool lowLatency = video ? videoConfig.lowLatency &&
+					  videoConfig.format == VideoFormat::H264
+				: audioConfig.lowLatency && audioUnits.Active();
+	bool starts = hasTime;
+
+	if (lowLatency && video)
+		starts = videoUnits.Add(ptr, size, hasTime) || hasTime;
+
+	/* packets found in the bitstream, or that follow one that was sent
+	 * early, carry on from the time of the last one */
+	if (lowLatency && !hasTime && (starts || !data.size)) {
+		long long duration = data.lastStopTime - data.lastStartTime;
+		startTime = data.lastStopTime;
+		stopTime = startTime + duration;
+		starts = true;
+	}
+
+	if (starts) {
+		if (data.size)
+			SendEncodedPacket(video, data, roll);
+
+		data.Clear();
+		data.lastStartTime = startTime;
+		data.lastStopTime = stopTime;
+
+		if (!video)
+			audioUnits.PacketDone();
+	}
+
+	data.Append(sample, ptr, size, EncodedSegmentLimit(video));
+
+	if (!lowLatency)
+		return;
+
+	bool complete;
+	if (video) {
+		/* a picture whose last slice goes on in to the next sample is
+		 * sent cut short once, after which its slice count isn't
+		 * trusted */
+		complete = videoUnits.Complete();
+	} else {
+		audioUnits.Add(ptr, size);
+		complete = audioUnits.Complete();
+	}
+
+	if (complete) {
+		SendEncodedPacket(video, data, roll);
+		data.Clear();
+
+		if (video)
+			videoUnits.PacketDone();
+		else
+			audioUnits.PacketDone();
+	}
+}
+
+/* samples held for a packet and by frame handles both come out of the
+ * upstream allocator, and at least one of its buffers must stay free for
+ * the device to keep delivering */
+size_t HDevice::EncodedSegmentLimit(bool video) const
+{
+	CaptureFilter *capture = video ? videoCapture : audioCapture;
+	long buffers = capture ? capture->GetPin()->AllocatorBuffers() : 0;
+
+	if (!buffers)
+		return MAX_ENCODED_SEGMENTS;
+
+	const shared_ptr<FramePool> &pool = video ? videoFrames : audioFrames;
+	long spare = buffers - 1 - (pool ? pool->Outstanding() : 0);
+	if (spare <= 0)
+		return 0;
+
+	return spare < MAX_ENCODED_SEGMENTS ? (size_t)spare
+					    : MAX_ENCODED_SEGMENTS;
+}
+
+void HDevice::SendEncodedPacket(bool video, EncodedData &data, long roll)
+{
+	IMediaSample *first = data.Sample();
+	unsigned char *ptr = (unsigned char *)data.Data();
+	Frame frame = MakeFrame(video, first, ptr, data.size);
+
+	SendEncodedFrame(video, frame, data.lastStartTime, data.lastStopTime,
+			 roll);
+}
+
+void HDevice::SendEncodedFrame(bool video, Frame &frame, long long startTime,
+			       long long stopTime, long roll)
+{
+	if (video && videoConfig.format == VideoFormat::H264) {
+		H264Parser::PacketInfo info;
+		h264Parser.Parse(frame.Data(), frame.Size(), info);
+
+		if (info.spsChanged)
+			ApplyH264SPS();
+		frame.SetKeyframe(info.keyframe);
+	}
+
+	SendToCallback(video, frame, startTime, stopTime, roll);
+}
+
+/* encoded devices send a transport stream, which is demuxed here.  Packets
+ * come back out through ReceiveDemuxed */
+void HDevice::ReceiveTransport(IMediaSample *sample)
+{
+	BYTE *ptr;
+
+	if (!sample)
+		return;
+
+	int size = sample->GetActualDataLength();
+	if (!size)
+		return;
+
+	if (FAILED(sample->GetPointer(&ptr)))
+		return;
+
+	long long stopTime;
+	hasTransportTime =
+		SUCCEEDED(sample->GetTime(&transportTime, &stopTime));
+
+	tsDemuxer.Input(ptr, (size_t)size);
+}
+
+/* in low latency mode, unbounded PES packets are sent as soon as the
+ * bitstream shows they're complete rather than when the next one starts */
+bool HDevice::DemuxedPayload(TSStream stream, const TSPacket &packet,
+			     const unsigned char *data, size_t size,
+			     size_t scanned, bool padded)
+{
+	if (stream == TSStream::Audio) {
+		if (!audioConfig.lowLatency || !audioUnits.Active() ||
+		    encodedInfo.audioLATM)
+			return false;
+
+		if (!scanned)
+			audioUnits.PacketDone();
+
+		audioUnits.Add(data + scanned, size - scanned);
+		return audioUnits.Complete();
+	}
+
+	if (!videoConfig.lowLatency || videoConfig.format != VideoFormat::H264)
+		return false;
+
+	videoUnits.AddPayload(data, size, scanned, packet.hasPts);
+
+	/* the last slice usually goes on over several transport packets,
+	 * only the padding at the end of the PES packet shows it's all
+	 * there */
+	if (!padded || !videoUnits.Complete())
+		return false;
+
+	videoUnits.PacketDone();
+	return true;
+}
+
+void HDevice::ReceiveDemuxed(TSStream stream, const TSPacket &packet)
+{
+	bool video = stream == TSStream::Video;
+	bool parseAudio = !video && audioParser.Active();
+
+	if (video ? !videoConfig.callback && !videoConfig.frameCallback
+		  : !audioConfig.callback && !audioConfig.frameCallback)
+		return;
+
+	long long arrival = GetHostTime();
+	size_t size = packet.frame.Size();
+	StreamTelemetry &telemetry = video ? videoTelemetry : audioTelemetry;
+
+	if (!packet.hasPts) {
+		ReceiveUntimed(video, parseAudio, packet, arrival);
+		return;
+	}
+
+	/* both streams share the offset from the stream time of the first
+	 * timestamp, so they stay in sync */
+	if (!hasDemuxOffset) {
+		REFERENCE_TIME now = transportTime;
+
+		if (!hasTransportTime && !videoCapture->GetStreamTime(now))
+			now = 0;
+
+		demuxOffset = now - packet.dts;
+		hasDemuxOffset = true;
+	}
+
+	/* B-frames put presentation times out of order, so gaps and the
+	 * clock go by decode times, and the presentation time is moved along
+	 * with the decode time */
+	long long startTime = packet.pts + demuxOffset;
+	long long decodeTime = packet.dts + demuxOffset;
+	long long duration = videoConfig.frameInterval;
+
+	/* audio packets vary in length, so each is taken to be as long as
+	 * the gap before it */
+	if (!video) {
+		duration = hasDemuxAudio && startTime > lastDemuxAudio
+				   ? startTime - lastDemuxAudio
+				   : 0;
+		lastDemuxAudio = startTime;
+		hasDemuxAudio = true;
+	}
+
+	telemetry.RecordArrival(arrival, size, true, decodeTime);
+	DetectGaps(video, packet.discontinuity, decodeTime, size);
+
+	long long recovered = decodeTime;
+	long long recoveredStop = decodeTime + duration;
+	RecoverClock(video, arrival, recovered, recoveredStop);
+
+	startTime += recovered - decodeTime;
+	long long stopTime = startTime + duration;
+
+	if (parseAudio) {
+		/* a frame left unfinished before the gap can't be finished
+		 * from after it */
+		if (packet.discontinuity)
+			audioParser.Clear();
+
+		audioParser.Add(packet.frame, true, startTime);
+		return;
+	}
+
+	if (video) {
+		lastDemuxVideo = startTime;
+		hasDemuxVideo = true;
+	}
+
+	Frame frame = packet.frame;
+	SendEncodedFrame(video, frame, startTime, stopTime, 0);
+}
+
+/* PES packets don't need a timestamp, and the rest of one that was sent
+ * early never has one.  Video carries on a frame after the last packet, and
+ * audio frames are timed from the samples before them.  Audio that can't
+ * be split in to frames is dropped */
+void HDevice::ReceiveUntimed(bool video, bool parseAudio,
+			     const TSPacket &packet, long long arrival)
+{
+	StreamTelemetry &telemetry = video ? videoTelemetry : audioTelemetry;
+	size_t size = packet.frame.Size();
+
+	if (video ? !hasDemuxVideo : !parseAudio)
+		return;
+
+	telemetry.RecordArrival(arrival, size, false, 0);
+
+	if (parseAudio) {
+		if (packet.discontinuity)
+			audioParser.Clear();
+
+		audioParser.Add(packet.frame, false, 0);
+		return;
+	}
+
+	long long duration = videoConfig.frameInterval;
+	long long startTime = lastDemuxVideo + duration;
+	lastDemuxVideo = startTime;
+
+	Frame frame = packet.frame;
+	SendEncodedFrame(true, frame, startTime, startTime + duration, 0);
+}
+
+/* the size and rate encoded devices are set up with are only a guess, the
+ * SPS has the real ones */
+void HDevice::ApplyH264SPS()
+{
+	const H264SPS &sps = h264Parser.SPS();
+	long long frameInterval = sps.frameInterval
+					  ? sps.frameInterval
+					  : videoConfig.frameInterval;
+
+	if (sps.width == videoConfig.cx && sps.height == videoConfig.cy_abs &&
+	    frameInterval == videoConfig.frameInterval)
+		return;
+
+	Debug(L"H.264 stream is %dx%d, interval %lld", sps.width, sps.height,
+	      frameInterval);
+
+	videoConfig.cx = sps.width;
+	videoConfig.cy_abs = sps.height;
+	videoConfig.frameInterval = frameInterval;
+	videoGaps.ResetVideo(frameInterval);
+	videoClock.Reset(frameInterval);
+	videoSnapshot.reset();
+}
+
+/* the rate and channels demuxed audio is set up with are only a guess, the
+ * frames have the real ones */
+void HDevice::SendAudioFrame(const Frame &frame, long long startTime,
+			     long long stopTime)
+{
+	const AudioFrameInfo &info = audioParser.Info();
+	const vector<unsigned char> &config = audioParser.Config();
+	int channels = info.channels ? info.channels : audioConfig.channels;
+
+	if (info.sampleRate != audioConfig.sampleRate ||
+	    channels != audioConfig.channels ||
+	    config != audioConfig.codecConfig) {
+		Debug(L"Encoded audio stream is %d Hz, %d channels",
+		      info.sampleRate, channels);
+
+		audioConfig.sampleRate = info.sampleRate;
+		audioConfig.channels = channels;
+		audioConfig.codecConfig = config;
+		audioSnapshot.reset();
+	}
+
+	SendToCallback(false, frame, startTime, stopTime, 0);
+}
+
+void HDevice::UpdateRotation(IAMCameraControl *control)
+{
+	long roll = 0;
+	long flags = 0;
+
+	if (SUCCEEDED(control->Get(CameraControl_Roll, &roll, &flags)))
+		rotation.store(roll, memory_order_relaxed);
+}
+
+void HDevice::RotationThread()
+{
+	DWORD interval = (DWORD)max(videoConfig.rotationPollInterval, 1);
+	ComPtr<IAMCameraControl> control;
+
+	HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+	if (FAILED(hr)) {
+		WarningHR(L"Rotation thread: CoInitializeEx failed", hr);
+		return;
+	}
+
+	hr = interfaceTable->GetInterfaceFromGlobal(cameraControlCookie,
+						    IID_IAMCameraControl,
+						    (void **)&control);
+	if (FAILED(hr)) {
+		WarningHR(L"Rotation thread: Failed to get camera control",
+			  hr);
+	} else {
+		while (WaitForSingleObject(rotationStop, interval) ==
+		       WAIT_TIMEOUT)
+			UpdateRotation(control);
+	}
+
+	/* proxies must be released before leaving the apartment */
+	control.Release();
+	CoUninitialize();
+}
+
+void HDevice::StartRotationThread()
+{
+	HRESULT hr;
+
+	if (!cameraControl)
+		return;
+
+	if (!rotationStop)
+		rotationStop = CreateEvent(nullptr, true, false, nullptr);
+	if (!rotationStop) {
+		Warning(L"Failed to create rotation event, auto-rotation "
+			L"disabled");
+		return;
+	}
+
+	if (!interfaceTable) {
+		hr = CoCreateInstance(CLSID_StdGlobalInterfaceTable, nullptr,
+				      CLSCTX_INPROC_SERVER,
+				      IID_IGlobalInterfaceTable,
+				      (void **)&interfaceTable);
+		if (FAILED(hr)) {
+			WarningHR(L"Failed to create global interface table, "
+				  L"auto-rotation disabled",
+				  hr);
+			return;
+		}
+	}
+
+	hr = interfaceTable->RegisterInterfaceInGlobal(
+		cameraControl, IID_IAMCameraControl, &cameraControlCookie);
+	if (FAILED(hr)) {
+		WarningHR(L"Failed to register camera control, auto-rotation "
+			  L"disabled",
+			  hr);
+		return;
+	}
+
+	ResetEvent(rotationStop);
+	rotationThread = thread(&HDevice::RotationThread, this);
+}
+
+void HDevice::StopRotationThread()
+{
+	if (rotationThread.joinable()) {
+		SetEvent(rotationStop);
+		rotationThread.join();
+	}
+
+	if (cameraControlCookie) {
+		interfaceTable->RevokeInterfaceFromGlobal(cameraControlCookie);
+		cameraControlCookie = 0;
 	}
 }
 
@@ -169,6 +1272,12 @@ void HDevice::ConvertVideoSettings()
 	VIDEOINFOHEADER *vih = (VIDEOINFOHEADER *)videoMediaType->pbFormat;
 	BITMAPINFOHEADER *bmih = GetBitmapInfoHeader(videoMediaType);
 
+	videoFingerprint = GetMediaTypeFingerprint(videoMediaType);
+
+	/* frames still being decoded go out with the old config */
+	mjpegDecoder.Flush();
+	previewDecoder.Flush();
+
 	if (bmih) {
 		Debug(L"Video media type changed");
 
@@ -176,37 +1285,265 @@ void HDevice::ConvertVideoSettings()
 		videoConfig.cy_abs = labs(bmih->biHeight);
 		videoConfig.cy_flip = bmih->biHeight < 0;
 		videoConfig.frameInterval = vih->AvgTimePerFrame;
+		videoGaps.ResetVideo(videoConfig.frameInterval);
+		videoClock.Reset(videoConfig.frameInterval);
 
 		bool same = videoConfig.internalFormat == videoConfig.format;
 		GetMediaTypeVFormat(videoMediaType, videoConfig.internalFormat);
 
 		if (same)
 			videoConfig.format = videoConfig.internalFormat;
+
+		convertVideo = videoConfig.format != videoConfig.internalFormat &&
+			       CanConvertPackedYUV(videoConfig.internalFormat,
+						   videoConfig.format);
+
+		bool rgb = videoConfig.internalFormat == VideoFormat::ARGB ||
+			   videoConfig.internalFormat == VideoFormat::XRGB;
+		bottomUpVideo = rgb && !videoConfig.cy_flip;
+		flipVideo = videoConfig.topDown && bottomUpVideo;
+		if (flipVideo)
+			videoConfig.cy_flip = true;
+
+		ResetMJPEGDecoder();
+		ResetPreviewDecoder();
+		ResetVideoScaler();
+		UpdateOutputConfig();
 	}
 }
 
+void HDevice::ResetMJPEGDecoder()
+{
+	decodeVideo = false;
+	decodeScale = 1;
+	mjpegDecoder.Stop();
+
+	if (!videoConfig.decodeMJPEG ||
+	    videoConfig.internalFormat != VideoFormat::MJPEG)
+		return;
+
+	VideoFormat format = videoConfig.format;
+	if (format != VideoFormat::I420 && format != VideoFormat::NV12)
+		format = VideoFormat::I420;
+
+	int scale = videoConfig.decodeScale;
+	if (!MJPEGDecoder::ValidScale(scale)) {
+		Warning(L"MJPEG can't be decoded at 1/%d size, decoding at "
+			L"full size",
+			scale);
+		scale = 1;
+	}
+
+	decodeVideo = mjpegDecoder.Reset(
+		format, videoConfig.cx, videoConfig.cy_abs, scale,
+		videoConfig.decodeThreads, videoFrames,
+		[this](const Frame &frame, long long startTime,
+		       long long stopTime) {
+			SendToCallback(true, frame, startTime, stopTime, 0);
+		});
+
+	if (decodeVideo) {
+		videoConfig.format = format;
+		decodeScale = scale;
+	} else {
+		Warning(L"Can't decode %dx%d MJPEG, it will be delivered "
+			L"encoded",
+			videoConfig.cx, videoConfig.cy_abs);
+	}
+}
+
+void HDevice::ResetPreviewDecoder()
+{
+	previewVideo = false;
+	previewDecoder.Stop();
+
+	if (!videoConfig.previewCallback ||
+	    videoConfig.internalFormat != VideoFormat::MJPEG)
+		return;
+
+	int scale = videoConfig.previewScale;
+	if (!MJPEGDecoder::ValidScale(scale)) {
+		Warning(L"MJPEG previews can't be decoded at 1/%d size",
+			scale);
+		return;
+	}
+
+	previewConfig = videoConfig;
+	if (previewConfig.format != VideoFormat::I420 &&
+	    previewConfig.format != VideoFormat::NV12)
+		previewConfig.format = VideoFormat::I420;
+
+	previewConfig.cx = MJPEGDecoder::ScaledSize(videoConfig.cx, scale);
+	previewConfig.cy_abs =
+		MJPEGDecoder::ScaledSize(videoConfig.cy_abs, scale);
+	previewConfig.cy_flip = false;
+
+	previewVideo = previewDecoder.Reset(
+		previewConfig.format, videoConfig.cx, videoConfig.cy_abs,
+		scale, videoConfig.decodeThreads, videoFrames,
+		[this](const Frame &frame, long long startTime,
+		       long long stopTime) {
+			previewConfig.previewCallback(previewConfig, frame,
+						      startTime, stopTime, 0);
+		});
+
+	if (!previewVideo)
+		Warning(L"Can't decode %dx%d MJPEG previews",
+			videoConfig.cx, videoConfig.cy_abs);
+}
+
+/* scaling is only set up when the device couldn't give the size that was
+ * asked for */
+void HDevice::ResetVideoScaler()
+{
+	int cx = videoConfig.cx;
+	int cy = videoConfig.cy_abs;
+
+	scaleVideo = false;
+	videoScaler.Clear();
+
+	if (videoConfig.scaling == VideoScaling::None || !scaleCX || !scaleCY)
+		return;
+	if (decodeVideo)
+		return;
+	if (scaleCX == cx && scaleCY == cy)
+		return;
+
+	scaleVideo = videoScaler.Reset(videoConfig.internalFormat, cx, cy,
+				       scaleCX, scaleCY, videoConfig.scaling);
+	if (!scaleVideo)
+		Warning(L"Can't scale %dx%d video to %dx%d, it will be "
+			L"delivered at %dx%d",
+			cx, cy, scaleCX, scaleCY, cx, cy);
+}
+
 void HDevice::ConvertAudioSettings()
 {
 	WAVEFORMATEX *wfex =
 		reinterpret_cast<WAVEFORMATEX *>(audioMediaType->pbFormat);
 
+	audioFingerprint = GetMediaTypeFingerprint(audioMediaType);
+
 	Debug(L"Audio media type changed");
 
 	audioConfig.sampleRate = wfex->nSamplesPerSec;
 	audioConfig.channels = wfex->nChannels;
 
-	if (wfex->wFormatTag == WAVE_FORMAT_RAW_AAC1)
-		audioConfig.format = AudioFormat::AAC;
-	else if (wfex->wFormatTag == WAVE_FORMAT_DVM)
-		audioConfig.format = AudioFormat::AC3;
-	else if (wfex->wFormatTag == WAVE_FORMAT_MPEG)
-		audioConfig.format = AudioFormat::MPGA;
-	else if (wfex->wBitsPerSample == 16)
-		audioConfig.format = AudioFormat::Wave16bit;
-	else if (wfex->wBitsPerSample == 32)
-		audioConfig.format = AudioFormat::WaveFloat;
+	audioConfig.internalFormat = AudioFormat::Unknown;
+	GetMediaTypeAFormat(audioMediaType, audioConfig.internalFormat);
+	audioConfig.codecConfig.clear();
+
+	convertAudio = CanConvertAudio(audioConfig.internalFormat,
+				       audioConfig.format);
+	if (!convertAudio)
+		audioConfig.format = audioConfig.internalFormat;
+
+	ResetAudioMixer();
+	ResetAudioResampler();
+	audioUnits.Reset(audioConfig.internalFormat);
+	ResetAudioParser();
+
+	/* sample counts can only be checked for uncompressed audio, and are
+	 * counted in the device's format.  Resampled audio is packetized
+	 * after resampling, as float */
+	bool encoded = (int)audioConfig.internalFormat >= 200;
+	audioGaps.ResetAudio(wfex->nSamplesPerSec,
+			     encoded ? 0 : wfex->nBlockAlign);
+	audioClock.Reset(0);
+
+	int blockAlign = encoded ? 0 : wfex->nBlockAlign;
+	if (resampleAudio)
+		blockAlign = (int)sizeof(float) * audioConfig.channels;
+	audioPacketizer.Reset(audioConfig.sampleRate, blockAlign,
+			      audioConfig.packetFrames);
+}
+
+/* mixing is set up when the device couldn't give the channels that were asked
+ * for, or a matrix was given */
+void HDevice::ResetAudioMixer()
+{
+	int channels = audioConfig.channels;
+	const vector<float> &matrix = audioConfig.channelMatrix;
+	int outChannels = mixChannels;
+
+	mixAudio = false;
+	deviceChannels = channels;
+
+	if (!audioConfig.mixChannels || channels <= 0)
+		return;
+
+	if (!matrix.empty()) {
+		outChannels = (int)(matrix.size() / channels);
+		if (matrix.size() % channels)
+			outChannels = 0;
+	} else if (!outChannels || outChannels == channels) {
+		return;
+	}
+
+	/* channels are mixed as float, so the result has to be delivered in a
+	 * format float can be converted to */
+	if (outChannels > 0 && outChannels <= MAX_MIX_CHANNELS &&
+	    channels <= MAX_MIX_CHANNELS &&
+	    CanMixAudio(audioConfig.internalFormat, audioConfig.format)) {
+		if (matrix.empty())
+			GetDefaultChannelMatrix(channels, outChannels,
+						channelMatrix);
+		else
+			channelMatrix = matrix;
+
+		mixAudio = true;
+		audioConfig.channels = outChannels;
+	} else {
+		Warning(L"Can't mix %d audio channels to %d, they will be "
+			L"delivered as they are",
+			channels, outChannels);
+	}
+}
+
+/* resampling is only set up when the device couldn't give the rate that was
+ * asked for */
+void HDevice::ResetAudioResampler()
+{
+	int rate = audioConfig.sampleRate;
+	AudioFormat format = audioConfig.format;
+
+	resampleAudio = false;
+	audioResampler.Clear();
+
+	if (audioConfig.resampling == AudioResampling::None || !resampleRate)
+		return;
+	if (resampleRate == rate)
+		return;
+
+	/* audio is resampled as float, so it has to be uncompressed and
+	 * delivered in a format float can be converted to */
+	if (AudioSampleSize(audioConfig.internalFormat) &&
+	    (format == AudioFormat::WaveFloat ||
+	     CanConvertAudio(AudioFormat::WaveFloat, format)))
+		resampleAudio = audioResampler.Reset(rate, resampleRate,
+						     audioConfig.channels,
+						     audioConfig.resampling);
+
+	if (resampleAudio)
+		audioConfig.sampleRate = resampleRate;
 	else
-		audioConfig.format = AudioFormat::Unknown;
+		Warning(L"Can't resample %d Hz audio to %d Hz, it will be "
+			L"delivered at %d Hz",
+			rate, resampleRate, rate);
+}
+
+/* demuxed AAC and AC-3 are split in to single codec frames, timed from the
+ * samples in them */
+void HDevice::ResetAudioParser()
+{
+	AudioFormat format = demuxedAudio ? audioConfig.internalFormat
+					  : AudioFormat::Any;
+
+	audioParser.Reset(format, encodedInfo.audioLATM, audioFrames,
+			  [this](const Frame &frame, long long startTime,
+				 long long stopTime) {
+				  SendAudioFrame(frame, startTime, stopTime);
+			  });
 }
 
 #define HD_PVR1_NAME L"Hauppauge HD PVR Capture"
@@ -351,7 +1688,19 @@ bool HDevice::SetVideoConfig(VideoConfig *config)
 	    !EnsureInactive(L"SetVideoConfig"))
 		return false;
 
+	mjpegDecoder.Stop();
+	decodeVideo = false;
+	previewDecoder.Stop();
+	previewVideo = false;
+	h264Parser.Reset();
+	videoUnits.Reset();
+	tsDemuxer = TSDemuxer();
+	encodedDevice = false;
 	videoMediaType = NULL;
+	videoQueue.reset();
+	videoSnapshot.reset();
+	cameraControl.Release();
+	rotation = 0;
 	graph->RemoveFilter(videoFilter);
 	graph->RemoveFilter(videoCapture);
 	videoFilter.Release();
@@ -380,11 +1729,24 @@ bool HDevice::SetVideoConfig(VideoConfig *config)
 	}
 
 	videoConfig = *config;
+	videoFrames = make_shared<FramePool>(config->maxOutstandingFrames);
+
+	/* the size asked for, before it's replaced by the closest one the
+	 * device has */
+	scaleCX = config->useDefaultConfig ? 0 : config->cx;
+	scaleCY = config->useDefaultConfig ? 0 : config->cy_abs;
 
 	if (!SetupVideoCapture(filter, videoConfig))
 		return false;
 
-	*config = videoConfig;
+	if (videoConfig.queueDepth > 0)
+		videoQueue.reset(new DeliveryQueue<VideoPacket>(
+			videoConfig.queueDepth, videoConfig.queuePolicy,
+			[this](VideoPacket &packet) { DeliverVideo(packet); }));
+
+	UpdateReceiveCanBlock();
+
+	*config = OutputVideoConfig();
 	return true;
 }
 
@@ -496,6 +1858,18 @@ bool HDevice::SetupAudioCapture(IBaseFilter *filter, AudioConfig &config)
 	return true;
 }
 
+bool HDevice::SetupDemuxedAudio(AudioConfig &config)
+{
+	demuxedAudio = true;
+	audioMediaType = demuxAudioType;
+	ConvertAudioSettings();
+
+	audioConfig = config;
+	tsDemuxer.SetStream(TSStream::Audio, encodedInfo.audioPacketID,
+			    audioFrames);
+	return true;
+}
+
 bool HDevice::SetupAudioOutput(IBaseFilter *filter, AudioConfig &config)
 {
 	ComPtr<IBaseFilter> outputFilter;
@@ -540,6 +1914,12 @@ bool HDevice::SetAudioConfig(AudioConfig *config)
 	audioCapture.Release();
 	audioOutput.Release();
 	audioMediaType = NULL;
+	audioQueue.reset();
+	audioSnapshot.reset();
+	tsDemuxer.SetStream(TSStream::Audio, TS_NULL_PID, nullptr);
+	demuxedAudio = false;
+	ResetAudioParser();
+	UpdateReceiveCanBlock();
 
 	if (!config)
 		return true;
@@ -557,6 +1937,12 @@ bool HDevice::SetAudioConfig(AudioConfig *config)
 			return false;
 		}
 
+		if (encodedDevice && config->mode != AudioMode::Capture) {
+			Error(L"Audio from encoded devices can only be "
+			      L"captured");
+			return false;
+		}
+
 		filter = videoFilter;
 	} else if (config->useSeparateAudioFilter) {
 		bool success =
@@ -582,11 +1968,28 @@ bool HDevice::SetAudioConfig(AudioConfig *config)
 		return false;
 
 	audioConfig = *config;
+	audioFrames = make_shared<FramePool>(config->maxOutstandingFrames);
+
+	/* the rate asked for, before it's replaced by the closest one the
+	 * device has */
+	resampleRate = config->useDefaultConfig ? 0 : config->sampleRate;
+	mixChannels = config->useDefaultConfig ? 0 : config->channels;
 
 	if (config->mode == AudioMode::Capture) {
-		if (!SetupAudioCapture(filter, audioConfig))
+		bool demux = encodedDevice && config->useVideoDevice;
+		if (demux ? !SetupDemuxedAudio(audioConfig)
+			  : !SetupAudioCapture(filter, audioConfig))
 			return false;
 
+		if (audioConfig.queueDepth > 0)
+			audioQueue.reset(new DeliveryQueue<AudioPacket>(
+				audioConfig.queueDepth, audioConfig.queuePolicy,
+				[this](AudioPacket &packet) {
+					DeliverAudio(packet);
+				}));
+
+		UpdateReceiveCanBlock();
+
 		*config = audioConfig;
 		return true;
 	}
@@ -735,7 +2138,14 @@ bool HDevice::ConnectFilters()
 	    !EnsureInactive(L"ConnectFilters"))
 		return false;
 
-	if (videoCapture != NULL) {
+	if (videoCapture != NULL && encodedDevice) {
+		/* the transport stream goes straight to the capture filter */
+		success = DirectConnectFilters(graph, videoFilter, videoCapture);
+		if (!success)
+			Warning(L"HDevice::ConnectFilters: Failed to connect "
+				L"encoded device to capture filter");
+
+	} else if (videoCapture != NULL) {
 		success = ConnectPins(PIN_CATEGORY_CAPTURE, MEDIATYPE_Video,
 				      videoFilter, videoCapture);
 		if (!success) {
@@ -769,6 +2179,12 @@ bool HDevice::ConnectFilters()
 		}
 	}
 
+	if (success && rotatableDevice && videoFilter) {
+		cameraControl = ComQIPtr<IAMCameraControl>(videoFilter);
+		if (cameraControl)
+			UpdateRotation(cameraControl);
+	}
+
 	if (success)
 		LogFilters(graph);
 
@@ -804,9 +2220,20 @@ Result HDevice::Start()
 	if (!!rocketEncoder)
 		Sleep(ROCKET_WAIT_TIME_MS);
 
+	/* consumers must be running before the first sample arrives */
+	if (videoQueue)
+		videoQueue->Start();
+	if (audioQueue)
+		audioQueue->Start();
+
 	hr = control->Run();
 
 	if (FAILED(hr)) {
+		if (videoQueue)
+			videoQueue->Stop();
+		if (audioQueue)
+			audioQueue->Stop();
+
 		if (hr == (HRESULT)0x8007001F) {
 			WarningHR(L"Run failed, device already in use", hr);
 			return Result::InUse;
@@ -816,6 +2243,8 @@ Result HDevice::Start()
 		}
 	}
 
+	StartRotationThread();
+
 	active = true;
 	return Result::Success;
 }
@@ -823,8 +2252,32 @@ Result HDevice::Start()
 void HDevice::Stop()
 {
 	if (active) {
+		StopRotationThread();
 		control->Stop();
 		active = false;
+
+		/* frames still being decoded are delivered before the queues
+		 * stop */
+		mjpegDecoder.Flush();
+		previewDecoder.Flush();
+
+		if (videoQueue)
+			videoQueue->Stop();
+		if (audioQueue)
+			audioQueue->Stop();
+
+		/* release any samples still held for partial packets */
+		encodedVideo.Clear();
+		encodedAudio.Clear();
+		h264Parser.Reset();
+		tsDemuxer.Reset();
+		hasDemuxOffset = false;
+		hasDemuxAudio = false;
+		hasDemuxVideo = false;
+		videoUnits.Reset();
+		audioUnits.Reset(audioConfig.internalFormat);
+		audioParser.Clear();
+		audioPacketizer.Clear();
 	}
 }
 
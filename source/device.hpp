@@ -20,18 +20,79 @@
 #pragma once
 
 #include "../dshowcapture.hpp"
+#include "access-unit.hpp"
 #include "capture-filter.hpp"
+#include "frame-buffer.hpp"
+#include "delivery-queue.hpp"
+#include "capture-stats.hpp"
+#include "gap-detector.hpp"
+#include "clock-recovery.hpp"
+#include "audio-packetizer.hpp"
+#include "audio-parser.hpp"
+#include "audio-resampler.hpp"
+#include "dshow-scale.hpp"
+#include "h264-parser.hpp"
+#include "mjpeg-decoder.hpp"
+#include "ts-demuxer.hpp"
 
+#include <atomic>
 #include <string>
+#include <thread>
 #include <vector>
 using namespace std;
 
 namespace DShow {
 
+/*
+ * Maximum number of media samples an encoded packet may hold on to before
+ * the remaining data is spilled in to the pooled buffer.  Holding samples
+ * keeps them from going back to the upstream allocator, so fewer are held
+ * when the allocator has few buffers (see EncodedSegmentLimit).
+ */
+#define MAX_ENCODED_SEGMENTS 4
+
+struct EncodedSegment {
+	ComPtr<IMediaSample> sample;
+	const unsigned char *data;
+	size_t size;
+};
+
+/**
+ * Scatter-gather list of the samples that make up one encoded packet.  The
+ * samples are referenced rather than copied until the packet is complete,
+ * and are only flattened when there is more than one of them.
+ */
 struct EncodedData {
 	long long lastStartTime = 0;
 	long long lastStopTime = 0;
+	vector<EncodedSegment> segments;
+	size_t size = 0;
+
+	/* pooled buffer, keeps its capacity between packets */
 	vector<unsigned char> bytes;
+
+	/* held samples are spilled once there would be more than
+	 * maxSegments of them, and none are held if it's zero */
+	void Append(IMediaSample *sample, const unsigned char *data,
+		    size_t size, size_t maxSegments);
+	IMediaSample *Sample() const;
+	const unsigned char *Data();
+	void Clear();
+};
+
+struct VideoPacket {
+	shared_ptr<const VideoConfig> config;
+	Frame frame;
+	long long startTime = 0;
+	long long stopTime = 0;
+	long rotation = 0;
+};
+
+struct AudioPacket {
+	shared_ptr<const AudioConfig> config;
+	Frame frame;
+	long long startTime = 0;
+	long long stopTime = 0;
 };
 
 struct EncodedDevice {
@@ -44,6 +105,10 @@ struct EncodedDevice {
 	AudioFormat audioFormat;
 	ULONG audioPacketID;
 	DWORD samplesPerSec;
+
+	/* AAC is sent as LOAS/LATM rather than ADTS, only known from the
+	 * PMT */
+	bool audioLATM;
 };
 
 struct HDevice {
@@ -59,32 +124,210 @@ struct HDevice {
 	ComPtr<IBaseFilter> rocketEncoder;
 	MediaType videoMediaType;
 	MediaType audioMediaType;
+	MediaTypeFingerprint videoFingerprint;
+	MediaTypeFingerprint audioFingerprint;
 	VideoConfig videoConfig;
 	AudioConfig audioConfig;
 
 	bool encodedDevice = false;
 	bool rotatableDevice = false;
+
+	/* audio of encoded devices is demuxed from the video device's
+	 * transport stream rather than captured by a filter of its own */
+	bool demuxedAudio = false;
+	MediaType demuxAudioType;
+
+	/* the streams of an encoded device, from the table of known devices
+	 * until the transport stream says where they really are */
+	EncodedDevice encodedInfo = {};
+
+	/* videoConfig.format is produced from internalFormat in software */
+	bool convertVideo = false;
+
+	/* bottom-up RGB, and whether it's delivered top-down anyway
+	 * (videoConfig.topDown) */
+	bool bottomUpVideo = false;
+	bool flipVideo = false;
+
+	/* MJPEG from the device is decoded to videoConfig.format
+	 * (videoConfig.decodeMJPEG) */
+	bool decodeVideo = false;
+	int decodeScale = 1;
+
+	/* MJPEG is also decoded at reduced size for
+	 * videoConfig.previewCallback, which gets previewConfig */
+	bool previewVideo = false;
+	VideoConfig previewConfig;
+
+	/* size frames are scaled to (videoConfig.scaling) */
+	bool scaleVideo = false;
+	int scaleCX = 0;
+	int scaleCY = 0;
+	VideoScaler videoScaler;
+
+	/* audioConfig.format is produced from internalFormat in software */
+	bool convertAudio = false;
+
+	/* the device's channels are mixed to audioConfig.channels
+	 * (audioConfig.mixChannels) */
+	bool mixAudio = false;
+	int mixChannels = 0;
+	int deviceChannels = 0;
+	vector<float> channelMatrix;
+
+	/* rate audio is resampled to (audioConfig.resampling) */
+	bool resampleAudio = false;
+	int resampleRate = 0;
+
+	/* rotation applied to delivered frames (videoConfig.autoRotate) */
+	int videoRotation = 0;
+
+	/* config callbacks get while frames are scaled or rotated */
+	VideoConfig outputConfig;
+
+	/* roll is sampled off the streaming thread for rotatable devices.  The
+	 * polling thread gets the control through the global interface table,
+	 * as it's in an apartment of its own */
+	ComPtr<IAMCameraControl> cameraControl;
+	ComPtr<IGlobalInterfaceTable> interfaceTable;
+	DWORD cameraControlCookie = 0;
+	atomic<long> rotation;
+	HANDLE rotationStop = nullptr;
+	thread rotationThread;
+
 	bool initialized;
 	bool active;
 
 	EncodedData encodedVideo;
 	EncodedData encodedAudio;
 
+	shared_ptr<FramePool> videoFrames;
+	shared_ptr<FramePool> audioFrames;
+
+	/* queued delivery; packets carry a snapshot of the config that is
+	 * only rebuilt when the media type changes */
+	unique_ptr<DeliveryQueue<VideoPacket>> videoQueue;
+	unique_ptr<DeliveryQueue<AudioPacket>> audioQueue;
+	shared_ptr<const VideoConfig> videoSnapshot;
+	shared_ptr<const AudioConfig> audioSnapshot;
+
+	StreamTelemetry videoTelemetry;
+	StreamTelemetry audioTelemetry;
+
+	/* streaming thread only */
+	GapDetector videoGaps;
+	GapDetector audioGaps;
+	ClockRecovery videoClock;
+	ClockRecovery audioClock;
+	H264Parser h264Parser;
+	TSDemuxer tsDemuxer;
+	bool hasTransportTime = false;
+	long long transportTime = 0;
+	bool hasDemuxOffset = false;
+	long long demuxOffset = 0;
+	bool hasDemuxAudio = false;
+	long long lastDemuxAudio = 0;
+	bool hasDemuxVideo = false;
+	long long lastDemuxVideo = 0;
+	H264AccessUnits videoUnits;
+	AudioAccessUnits audioUnits;
+	AudioFrameParser audioParser;
+	AudioPacketizer audioPacketizer;
+	AudioResampler audioResampler;
+	vector<float> audioFloat;
+	vector<float> audioResampled;
+
+	/* deliver from threads of their own, so they're declared last to be
+	 * stopped before anything they deliver to is destroyed */
+	MJPEGDecoder mjpegDecoder;
+	MJPEGDecoder previewDecoder;
+
 	HDevice();
 	~HDevice();
 
 	void ConvertVideoSettings();
+	void ResetVideoScaler();
+	void ResetMJPEGDecoder();
+	void ResetPreviewDecoder();
 	void ConvertAudioSettings();
+	void ResetAudioMixer();
+	void ResetAudioResampler();
+	void ResetAudioParser();
 
 	bool EnsureInitialized(const wchar_t *func);
 	bool EnsureActive(const wchar_t *func);
 	bool EnsureInactive(const wchar_t *func);
 
-	inline void SendToCallback(bool video, unsigned char *data, size_t size,
+	inline void SendToCallback(bool video, IMediaSample *sample,
+				   unsigned char *data, size_t size,
+				   long long startTime, long long stopTime,
+				   long rotation);
+	inline void SendToCallback(bool video, const Frame &frame,
 				   long long startTime, long long stopTime,
 				   long rotation);
+	inline Frame MakeFrame(bool video, IMediaSample *sample,
+			       unsigned char *data, size_t size);
+
+	inline const VideoConfig &OutputVideoConfig() const
+	{
+		return scaleVideo || videoRotation || decodeScale > 1
+			       ? outputConfig
+			       : videoConfig;
+	}
+
+	bool ProcessVideoFrame(IMediaSample *sample, unsigned char *data,
+			       size_t size, long &roll, Frame &frame);
+	bool ScaleVideoFrame(const Frame &input, Frame &frame);
+	bool ConvertVideoFrame(const Frame &input, int cx, int cy,
+			       Frame &frame);
+	void SetVideoPlanes(Frame &frame, bool topDown) const;
+	bool FlipVideoFrame(IMediaSample *sample, unsigned char *data,
+			    size_t size, Frame &frame);
+	bool RotateVideoFrame(VideoFormat format, const Frame &input, int cx,
+			      int cy, int degrees, Frame &frame);
+	void SetVideoRotation(int degrees);
+	bool ConvertAudioFrame(AudioFormat inFormat, bool mix,
+			       const void *data, size_t size, Frame &frame);
+	bool ResampleAudio(const unsigned char *data, size_t size,
+			   long long startTime, long long &outputTime);
+	void ProcessAudio(IMediaSample *sample, const unsigned char *data,
+			  size_t size, long long startTime, long long stopTime);
+	void UpdateOutputConfig();
+	void ReceiveEncoded(bool video, IMediaSample *sample,
+			    const unsigned char *ptr, size_t size, bool hasTime,
+			    long long startTime, long long stopTime, long roll);
+	size_t EncodedSegmentLimit(bool video) const;
+	void SendEncodedPacket(bool video, EncodedData &data, long roll);
+	void SendEncodedFrame(bool video, Frame &frame, long long startTime,
+			      long long stopTime, long roll);
+	void ReceiveTransport(IMediaSample *sample);
+	bool DemuxedPayload(TSStream stream, const TSPacket &packet,
+			    const unsigned char *data, size_t size,
+			    size_t scanned, bool padded);
+	void ReceiveDemuxed(TSStream stream, const TSPacket &packet);
+	void ReceiveUntimed(bool video, bool parseAudio,
+			    const TSPacket &packet, long long arrival);
+	void ApplyH264SPS();
+	void SendAudioFrame(const Frame &frame, long long startTime,
+			    long long stopTime);
+	void ApplyTSProgram(const TSProgram &program);
 
 	void Receive(bool video, IMediaSample *sample);
+	void UpdateReceiveCanBlock();
+
+	void RecordDelay(bool video, long long startTime);
+	void DetectGaps(bool video, bool discontinuity, long long startTime,
+			size_t size);
+	void RecoverClock(bool video, long long arrival, long long &startTime,
+			  long long &stopTime);
+	void DeliverVideo(const VideoPacket &packet);
+	void DeliverAudio(const AudioPacket &packet);
+	void GetStats(bool video, StreamStats &stats) const;
+
+	void UpdateRotation(IAMCameraControl *control);
+	void RotationThread();
+	void StartRotationThread();
+	void StopRotationThread();
 
 	bool SetupEncodedVideoCapture(IBaseFilter *filter, VideoConfig &config,
 				      const EncodedDevice &info);
@@ -96,6 +339,7 @@ struct HDevice {
 
 	bool SetupVideoCapture(IBaseFilter *filter, VideoConfig &config);
 	bool SetupAudioCapture(IBaseFilter *filter, AudioConfig &config);
+	bool SetupDemuxedAudio(AudioConfig &config);
 
 	bool SetupAudioOutput(IBaseFilter *filter, AudioConfig &config);
 
@@ -21,8 +21,6 @@
 #include "dshow-enum.hpp"
 #include "log.hpp"
 
-#include <bdaiface.h>
-
 #include <vector>
 #include <string>
 
@@ -472,15 +470,6 @@ bool DirectConnectFilters(IFilterGraph *graph, IBaseFilter *filterOut,
 	return connected;
 }
 
-HRESULT MapPinToPacketID(IPin *pin, ULONG packetID)
-{
-	ComQIPtr<IMPEG2PIDMap> pidMap(pin);
-	if (!pidMap)
-		return E_NOINTERFACE;
-
-	return pidMap->MapPID(1, &packetID, MEDIA_ELEMENTARY_STREAM);
-}
-
 wstring ConvertHRToEnglish(HRESULT hr)
 {
 	LPWSTR buffer = NULL;
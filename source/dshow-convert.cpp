@@ -0,0 +1,884 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "dshow-convert.hpp"
+#include "dshow-simd.hpp"
+
+#include <utility>
+#include <string.h>
+#include <stddef.h>
+
+#ifdef SIMD_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace DShow {
+
+/* byte offsets of the two luma and two chroma values in a four byte
+ * macropixel.  for YUY2 and UYVY C0 is U, for YVYU it's V */
+template<bool chromaFirst> struct Macropixel {
+	enum {
+		Y0 = chromaFirst ? 1 : 0,
+		Y1 = chromaFirst ? 3 : 2,
+		C0 = chromaFirst ? 0 : 1,
+		C1 = chromaFirst ? 2 : 3,
+	};
+};
+
+typedef void (*To420Func)(const unsigned char *src0,
+			  const unsigned char *src1, unsigned char *y0,
+			  unsigned char *y1, unsigned char *c0,
+			  unsigned char *c1, int width);
+typedef void (*ToNV12Func)(const unsigned char *src0,
+			   const unsigned char *src1, unsigned char *y0,
+			   unsigned char *y1, unsigned char *uv, int width);
+typedef void (*To444Func)(const unsigned char *src, unsigned char *y,
+			  unsigned char *c0, unsigned char *c1, int width);
+
+struct Kernels {
+	To420Func to420[2];
+	ToNV12Func toNV12[2][2];
+	To444Func to444[2];
+};
+
+/* ------------------------------------------------------------------------ */
+/* scalar reference, also used for the pixels left over by the SIMD paths   */
+
+static inline unsigned char Average(unsigned char a, unsigned char b)
+{
+	return (unsigned char)((a + b + 1) >> 1);
+}
+
+template<bool chromaFirst>
+static void To420Scalar(const unsigned char *src0, const unsigned char *src1,
+			unsigned char *y0, unsigned char *y1,
+			unsigned char *c0, unsigned char *c1, int width)
+{
+	typedef Macropixel<chromaFirst> M;
+
+	for (int x = 0; x < width; x += 2) {
+		y0[x] = src0[M::Y0];
+		y1[x] = src1[M::Y0];
+		if (x + 1 < width) {
+			y0[x + 1] = src0[M::Y1];
+			y1[x + 1] = src1[M::Y1];
+		}
+
+		c0[x / 2] = Average(src0[M::C0], src1[M::C0]);
+		c1[x / 2] = Average(src0[M::C1], src1[M::C1]);
+		src0 += 4;
+		src1 += 4;
+	}
+}
+
+template<bool chromaFirst, bool swapUV>
+static void ToNV12Scalar(const unsigned char *src0, const unsigned char *src1,
+			 unsigned char *y0, unsigned char *y1,
+			 unsigned char *uv, int width)
+{
+	typedef Macropixel<chromaFirst> M;
+
+	for (int x = 0; x < width; x += 2) {
+		y0[x] = src0[M::Y0];
+		y1[x] = src1[M::Y0];
+		if (x + 1 < width) {
+			y0[x + 1] = src0[M::Y1];
+			y1[x + 1] = src1[M::Y1];
+		}
+
+		unsigned char c0 = Average(src0[M::C0], src1[M::C0]);
+		unsigned char c1 = Average(src0[M::C1], src1[M::C1]);
+		uv[x] = swapUV ? c1 : c0;
+		uv[x + 1] = swapUV ? c0 : c1;
+		src0 += 4;
+		src1 += 4;
+	}
+}
+
+template<bool chromaFirst>
+static void To444Scalar(const unsigned char *src, unsigned char *y,
+			unsigned char *c0, unsigned char *c1, int width)
+{
+	typedef Macropixel<chromaFirst> M;
+
+	for (int x = 0; x < width; x += 2) {
+		y[x] = src[M::Y0];
+		c0[x] = src[M::C0];
+		c1[x] = src[M::C1];
+		if (x + 1 < width) {
+			y[x + 1] = src[M::Y1];
+			c0[x + 1] = src[M::C0];
+			c1[x + 1] = src[M::C1];
+		}
+		src += 4;
+	}
+}
+
+#define KERNEL_TABLE(path)                                               \
+	{                                                                \
+		{To420##path<false>, To420##path<true>},                 \
+			{{ToNV12##path<false, false>,                    \
+			  ToNV12##path<false, true>},                    \
+			 {ToNV12##path<true, false>,                     \
+			  ToNV12##path<true, true>}},                    \
+		{                                                        \
+			To444##path<false>, To444##path<true>            \
+		}                                                        \
+	}
+
+static const Kernels scalarKernels = KERNEL_TABLE(Scalar);
+
+#ifdef SIMD_X86
+
+/* ------------------------------------------------------------------------ */
+/* SSE2, 16 pixels at a time                                                */
+
+template<bool chromaFirst>
+SIMD_TARGET("sse2")
+static inline void SplitSSE2(const unsigned char *src, __m128i &y, __m128i &c)
+{
+	const __m128i mask = _mm_set1_epi16(0x00FF);
+	__m128i a = _mm_loadu_si128((const __m128i *)src);
+	__m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+	__m128i even = _mm_packus_epi16(_mm_and_si128(a, mask),
+					_mm_and_si128(b, mask));
+	__m128i odd = _mm_packus_epi16(_mm_srli_epi16(a, 8),
+				       _mm_srli_epi16(b, 8));
+
+	y = chromaFirst ? odd : even;
+	c = chromaFirst ? even : odd;
+}
+
+template<bool chromaFirst>
+SIMD_TARGET("sse2")
+static void To420SSE2(const unsigned char *src0, const unsigned char *src1,
+		      unsigned char *y0, unsigned char *y1, unsigned char *c0,
+		      unsigned char *c1, int width)
+{
+	const __m128i mask = _mm_set1_epi16(0x00FF);
+	int x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		__m128i ya, ca, yb, cb;
+		SplitSSE2<chromaFirst>(src0 + x * 2, ya, ca);
+		SplitSSE2<chromaFirst>(src1 + x * 2, yb, cb);
+		_mm_storeu_si128((__m128i *)(y0 + x), ya);
+		_mm_storeu_si128((__m128i *)(y1 + x), yb);
+
+		__m128i c = _mm_avg_epu8(ca, cb);
+		__m128i even = _mm_and_si128(c, mask);
+		__m128i odd = _mm_srli_epi16(c, 8);
+		_mm_storel_epi64((__m128i *)(c0 + x / 2),
+				 _mm_packus_epi16(even, even));
+		_mm_storel_epi64((__m128i *)(c1 + x / 2),
+				 _mm_packus_epi16(odd, odd));
+	}
+
+	To420Scalar<chromaFirst>(src0 + x * 2, src1 + x * 2, y0 + x, y1 + x,
+				 c0 + x / 2, c1 + x / 2, width - x);
+}
+
+template<bool chromaFirst, bool swapUV>
+SIMD_TARGET("sse2")
+static void ToNV12SSE2(const unsigned char *src0, const unsigned char *src1,
+		       unsigned char *y0, unsigned char *y1, unsigned char *uv,
+		       int width)
+{
+	int x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		__m128i ya, ca, yb, cb;
+		SplitSSE2<chromaFirst>(src0 + x * 2, ya, ca);
+		SplitSSE2<chromaFirst>(src1 + x * 2, yb, cb);
+		_mm_storeu_si128((__m128i *)(y0 + x), ya);
+		_mm_storeu_si128((__m128i *)(y1 + x), yb);
+
+		__m128i c = _mm_avg_epu8(ca, cb);
+		if (swapUV)
+			c = _mm_or_si128(_mm_slli_epi16(c, 8),
+					 _mm_srli_epi16(c, 8));
+		_mm_storeu_si128((__m128i *)(uv + x), c);
+	}
+
+	ToNV12Scalar<chromaFirst, swapUV>(src0 + x * 2, src1 + x * 2, y0 + x,
+					  y1 + x, uv + x, width - x);
+}
+
+template<bool chromaFirst>
+SIMD_TARGET("sse2")
+static void To444SSE2(const unsigned char *src, unsigned char *y,
+		      unsigned char *c0, unsigned char *c1, int width)
+{
+	const __m128i mask = _mm_set1_epi16(0x00FF);
+	int x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		__m128i luma, c;
+		SplitSSE2<chromaFirst>(src + x * 2, luma, c);
+		_mm_storeu_si128((__m128i *)(y + x), luma);
+
+		__m128i even = _mm_and_si128(c, mask);
+		__m128i odd = _mm_srli_epi16(c, 8);
+		_mm_storeu_si128((__m128i *)(c0 + x),
+				 _mm_or_si128(even, _mm_slli_epi16(even, 8)));
+		_mm_storeu_si128((__m128i *)(c1 + x),
+				 _mm_or_si128(odd, _mm_slli_epi16(odd, 8)));
+	}
+
+	To444Scalar<chromaFirst>(src + x * 2, y + x, c0 + x, c1 + x,
+				 width - x);
+}
+
+static const Kernels sse2Kernels = KERNEL_TABLE(SSE2);
+
+/* ------------------------------------------------------------------------ */
+/* SSSE3, 16 pixels at a time using byte shuffles instead of pack           */
+
+template<bool chromaFirst>
+SIMD_TARGET("ssse3")
+static inline void SplitSSSE3(const unsigned char *src, __m128i &y,
+			      __m128i &c)
+{
+	/* luma to the low half, chroma to the high half */
+	const __m128i split =
+		chromaFirst ? _mm_setr_epi8(1, 3, 5, 7, 9, 11, 13, 15, 0, 2,
+					    4, 6, 8, 10, 12, 14)
+			    : _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3,
+					    5, 7, 9, 11, 13, 15);
+	__m128i a = _mm_loadu_si128((const __m128i *)src);
+	__m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+
+	a = _mm_shuffle_epi8(a, split);
+	b = _mm_shuffle_epi8(b, split);
+	y = _mm_unpacklo_epi64(a, b);
+	c = _mm_unpackhi_epi64(a, b);
+}
+
+template<bool chromaFirst>
+SIMD_TARGET("ssse3")
+static void To420SSSE3(const unsigned char *src0, const unsigned char *src1,
+		       unsigned char *y0, unsigned char *y1, unsigned char *c0,
+		       unsigned char *c1, int width)
+{
+	const __m128i split = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3,
+					    5, 7, 9, 11, 13, 15);
+	int x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		__m128i ya, ca, yb, cb;
+		SplitSSSE3<chromaFirst>(src0 + x * 2, ya, ca);
+		SplitSSSE3<chromaFirst>(src1 + x * 2, yb, cb);
+		_mm_storeu_si128((__m128i *)(y0 + x), ya);
+		_mm_storeu_si128((__m128i *)(y1 + x), yb);
+
+		__m128i c = _mm_shuffle_epi8(_mm_avg_epu8(ca, cb), split);
+		_mm_storel_epi64((__m128i *)(c0 + x / 2), c);
+		_mm_storel_epi64((__m128i *)(c1 + x / 2),
+				 _mm_unpackhi_epi64(c, c));
+	}
+
+	To420Scalar<chromaFirst>(src0 + x * 2, src1 + x * 2, y0 + x, y1 + x,
+				 c0 + x / 2, c1 + x / 2, width - x);
+}
+
+template<bool chromaFirst, bool swapUV>
+SIMD_TARGET("ssse3")
+static void ToNV12SSSE3(const unsigned char *src0, const unsigned char *src1,
+			unsigned char *y0, unsigned char *y1,
+			unsigned char *uv, int width)
+{
+	const __m128i swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11,
+					   10, 13, 12, 15, 14);
+	int x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		__m128i ya, ca, yb, cb;
+		SplitSSSE3<chromaFirst>(src0 + x * 2, ya, ca);
+		SplitSSSE3<chromaFirst>(src1 + x * 2, yb, cb);
+		_mm_storeu_si128((__m128i *)(y0 + x), ya);
+		_mm_storeu_si128((__m128i *)(y1 + x), yb);
+
+		__m128i c = _mm_avg_epu8(ca, cb);
+		if (swapUV)
+			c = _mm_shuffle_epi8(c, swap);
+		_mm_storeu_si128((__m128i *)(uv + x), c);
+	}
+
+	ToNV12Scalar<chromaFirst, swapUV>(src0 + x * 2, src1 + x * 2, y0 + x,
+					  y1 + x, uv + x, width - x);
+}
+
+template<bool chromaFirst>
+SIMD_TARGET("ssse3")
+static void To444SSSE3(const unsigned char *src, unsigned char *y,
+		       unsigned char *c0, unsigned char *c1, int width)
+{
+	const __m128i dupEven = _mm_setr_epi8(0, 0, 2, 2, 4, 4, 6, 6, 8, 8,
+					      10, 10, 12, 12, 14, 14);
+	const __m128i dupOdd = _mm_setr_epi8(1, 1, 3, 3, 5, 5, 7, 7, 9, 9,
+					     11, 11, 13, 13, 15, 15);
+	int x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		__m128i luma, c;
+		SplitSSSE3<chromaFirst>(src + x * 2, luma, c);
+		_mm_storeu_si128((__m128i *)(y + x), luma);
+		_mm_storeu_si128((__m128i *)(c0 + x),
+				 _mm_shuffle_epi8(c, dupEven));
+		_mm_storeu_si128((__m128i *)(c1 + x),
+				 _mm_shuffle_epi8(c, dupOdd));
+	}
+
+	To444Scalar<chromaFirst>(src + x * 2, y + x, c0 + x, c1 + x,
+				 width - x);
+}
+
+static const Kernels ssse3Kernels = KERNEL_TABLE(SSSE3);
+
+/* ------------------------------------------------------------------------ */
+/* AVX2, 32 pixels at a time.  shuffles only work within 128 bit lanes, so  */
+/* 64 bit quarters are put back in order with a permute afterwards          */
+
+template<bool chromaFirst>
+SIMD_TARGET("avx2")
+static inline void SplitAVX2(const unsigned char *src, __m256i &y, __m256i &c)
+{
+	const __m256i split =
+		chromaFirst
+			? _mm256_setr_epi8(1, 3, 5, 7, 9, 11, 13, 15, 0, 2, 4,
+					   6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11,
+					   13, 15, 0, 2, 4, 6, 8, 10, 12, 14)
+			: _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5,
+					   7, 9, 11, 13, 15, 0, 2, 4, 6, 8, 10,
+					   12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+	__m256i a = _mm256_loadu_si256((const __m256i *)src);
+	__m256i b = _mm256_loadu_si256((const __m256i *)(src + 32));
+
+	a = _mm256_shuffle_epi8(a, split);
+	b = _mm256_shuffle_epi8(b, split);
+	y = _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(a, b), 0xD8);
+	c = _mm256_permute4x64_epi64(_mm256_unpackhi_epi64(a, b), 0xD8);
+}
+
+template<bool chromaFirst>
+SIMD_TARGET("avx2")
+static void To420AVX2(const unsigned char *src0, const unsigned char *src1,
+		      unsigned char *y0, unsigned char *y1, unsigned char *c0,
+		      unsigned char *c1, int width)
+{
+	const __m256i split = _mm256_setr_epi8(
+		0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15, 0, 2, 4,
+		6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+	int x = 0;
+
+	for (; x + 32 <= width; x += 32) {
+		__m256i ya, ca, yb, cb;
+		SplitAVX2<chromaFirst>(src0 + x * 2, ya, ca);
+		SplitAVX2<chromaFirst>(src1 + x * 2, yb, cb);
+		_mm256_storeu_si256((__m256i *)(y0 + x), ya);
+		_mm256_storeu_si256((__m256i *)(y1 + x), yb);
+
+		__m256i c = _mm256_shuffle_epi8(_mm256_avg_epu8(ca, cb), split);
+		c = _mm256_permute4x64_epi64(c, 0xD8);
+		_mm_storeu_si128((__m128i *)(c0 + x / 2),
+				 _mm256_castsi256_si128(c));
+		_mm_storeu_si128((__m128i *)(c1 + x / 2),
+				 _mm256_extracti128_si256(c, 1));
+	}
+
+	To420Scalar<chromaFirst>(src0 + x * 2, src1 + x * 2, y0 + x, y1 + x,
+				 c0 + x / 2, c1 + x / 2, width - x);
+}
+
+template<bool chromaFirst, bool swapUV>
+SIMD_TARGET("avx2")
+static void ToNV12AVX2(const unsigned char *src0, const unsigned char *src1,
+		       unsigned char *y0, unsigned char *y1, unsigned char *uv,
+		       int width)
+{
+	const __m256i swap = _mm256_setr_epi8(
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14, 1, 0, 3,
+		2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	int x = 0;
+
+	for (; x + 32 <= width; x += 32) {
+		__m256i ya, ca, yb, cb;
+		SplitAVX2<chromaFirst>(src0 + x * 2, ya, ca);
+		SplitAVX2<chromaFirst>(src1 + x * 2, yb, cb);
+		_mm256_storeu_si256((__m256i *)(y0 + x), ya);
+		_mm256_storeu_si256((__m256i *)(y1 + x), yb);
+
+		__m256i c = _mm256_avg_epu8(ca, cb);
+		if (swapUV)
+			c = _mm256_shuffle_epi8(c, swap);
+		_mm256_storeu_si256((__m256i *)(uv + x), c);
+	}
+
+	ToNV12Scalar<chromaFirst, swapUV>(src0 + x * 2, src1 + x * 2, y0 + x,
+					  y1 + x, uv + x, width - x);
+}
+
+template<bool chromaFirst>
+SIMD_TARGET("avx2")
+static void To444AVX2(const unsigned char *src, unsigned char *y,
+		      unsigned char *c0, unsigned char *c1, int width)
+{
+	const __m256i dupEven = _mm256_setr_epi8(
+		0, 0, 2, 2, 4, 4, 6, 6, 8, 8, 10, 10, 12, 12, 14, 14, 0, 0, 2,
+		2, 4, 4, 6, 6, 8, 8, 10, 10, 12, 12, 14, 14);
+	const __m256i dupOdd = _mm256_setr_epi8(
+		1, 1, 3, 3, 5, 5, 7, 7, 9, 9, 11, 11, 13, 13, 15, 15, 1, 1, 3,
+		3, 5, 5, 7, 7, 9, 9, 11, 11, 13, 13, 15, 15);
+	int x = 0;
+
+	for (; x + 32 <= width; x += 32) {
+		__m256i luma, c;
+		SplitAVX2<chromaFirst>(src + x * 2, luma, c);
+		_mm256_storeu_si256((__m256i *)(y + x), luma);
+		_mm256_storeu_si256((__m256i *)(c0 + x),
+				    _mm256_shuffle_epi8(c, dupEven));
+		_mm256_storeu_si256((__m256i *)(c1 + x),
+				    _mm256_shuffle_epi8(c, dupOdd));
+	}
+
+	To444Scalar<chromaFirst>(src + x * 2, y + x, c0 + x, c1 + x,
+				 width - x);
+}
+
+static const Kernels avx2Kernels = KERNEL_TABLE(AVX2);
+
+/* ------------------------------------------------------------------------ */
+
+struct CPUFeatures {
+	bool sse2 = false;
+	bool ssse3 = false;
+	bool avx2 = false;
+
+	CPUFeatures();
+};
+
+static void GetCPUID(int leaf, int regs[4])
+{
+#ifdef _MSC_VER
+	__cpuidex(regs, leaf, 0);
+#else
+	unsigned int a, b, c, d;
+	__cpuid_count(leaf, 0, a, b, c, d);
+	regs[0] = (int)a;
+	regs[1] = (int)b;
+	regs[2] = (int)c;
+	regs[3] = (int)d;
+#endif
+}
+
+/* whether the OS saves the upper halves of the ymm registers */
+static bool OSSavesYMM()
+{
+#ifdef _MSC_VER
+	return (_xgetbv(0) & 6) == 6;
+#else
+	unsigned int eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return (eax & 6) == 6;
+#endif
+}
+
+CPUFeatures::CPUFeatures()
+{
+	int regs[4];
+
+	GetCPUID(0, regs);
+	int maxLeaf = regs[0];
+	if (maxLeaf < 1)
+		return;
+
+	GetCPUID(1, regs);
+	sse2 = (regs[3] & (1 << 26)) != 0;
+	ssse3 = (regs[2] & (1 << 9)) != 0;
+
+	bool osxsave = (regs[2] & (1 << 27)) != 0;
+	bool avx = (regs[2] & (1 << 28)) != 0;
+	if (maxLeaf < 7 || !osxsave || !avx || !OSSavesYMM())
+		return;
+
+	GetCPUID(7, regs);
+	avx2 = (regs[1] & (1 << 5)) != 0;
+}
+
+static const CPUFeatures &GetCPUFeatures()
+{
+	static CPUFeatures features;
+	return features;
+}
+
+#endif
+
+#ifdef SIMD_NEON
+
+/* ------------------------------------------------------------------------ */
+/* NEON, 32 pixels at a time.  vld4 splits the macropixels in to their four */
+/* bytes, which are indexed the same way as Macropixel                      */
+
+template<bool chromaFirst>
+static void To420NEON(const unsigned char *src0, const unsigned char *src1,
+		      unsigned char *y0, unsigned char *y1, unsigned char *c0,
+		      unsigned char *c1, int width)
+{
+	typedef Macropixel<chromaFirst> M;
+	int x = 0;
+
+	for (; x + 32 <= width; x += 32) {
+		uint8x16x4_t a = vld4q_u8(src0 + x * 2);
+		uint8x16x4_t b = vld4q_u8(src1 + x * 2);
+		uint8x16x2_t ya, yb;
+
+		ya.val[0] = a.val[M::Y0];
+		ya.val[1] = a.val[M::Y1];
+		yb.val[0] = b.val[M::Y0];
+		yb.val[1] = b.val[M::Y1];
+		vst2q_u8(y0 + x, ya);
+		vst2q_u8(y1 + x, yb);
+
+		vst1q_u8(c0 + x / 2, vrhaddq_u8(a.val[M::C0], b.val[M::C0]));
+		vst1q_u8(c1 + x / 2, vrhaddq_u8(a.val[M::C1], b.val[M::C1]));
+	}
+
+	To420Scalar<chromaFirst>(src0 + x * 2, src1 + x * 2, y0 + x, y1 + x,
+				 c0 + x / 2, c1 + x / 2, width - x);
+}
+
+template<bool chromaFirst, bool swapUV>
+static void ToNV12NEON(const unsigned char *src0, const unsigned char *src1,
+		       unsigned char *y0, unsigned char *y1, unsigned char *uv,
+		       int width)
+{
+	typedef Macropixel<chromaFirst> M;
+	int x = 0;
+
+	for (; x + 32 <= width; x += 32) {
+		uint8x16x4_t a = vld4q_u8(src0 + x * 2);
+		uint8x16x4_t b = vld4q_u8(src1 + x * 2);
+		uint8x16x2_t ya, yb, c;
+
+		ya.val[0] = a.val[M::Y0];
+		ya.val[1] = a.val[M::Y1];
+		yb.val[0] = b.val[M::Y0];
+		yb.val[1] = b.val[M::Y1];
+		vst2q_u8(y0 + x, ya);
+		vst2q_u8(y1 + x, yb);
+
+		c.val[swapUV ? 1 : 0] = vrhaddq_u8(a.val[M::C0], b.val[M::C0]);
+		c.val[swapUV ? 0 : 1] = vrhaddq_u8(a.val[M::C1], b.val[M::C1]);
+		vst2q_u8(uv + x, c);
+	}
+
+	ToNV12Scalar<chromaFirst, swapUV>(src0 + x * 2, src1 + x * 2, y0 + x,
+					  y1 + x, uv + x, width - x);
+}
+
+template<bool chromaFirst>
+static void To444NEON(const unsigned char *src, unsigned char *y,
+		      unsigned char *c0, unsigned char *c1, int width)
+{
+	typedef Macropixel<chromaFirst> M;
+	int x = 0;
+
+	for (; x + 32 <= width; x += 32) {
+		uint8x16x4_t a = vld4q_u8(src + x * 2);
+		uint8x16x2_t luma, u, v;
+
+		luma.val[0] = a.val[M::Y0];
+		luma.val[1] = a.val[M::Y1];
+		u.val[0] = u.val[1] = a.val[M::C0];
+		v.val[0] = v.val[1] = a.val[M::C1];
+		vst2q_u8(y + x, luma);
+		vst2q_u8(c0 + x, u);
+		vst2q_u8(c1 + x, v);
+	}
+
+	To444Scalar<chromaFirst>(src + x * 2, y + x, c0 + x, c1 + x,
+				 width - x);
+}
+
+static const Kernels neonKernels = KERNEL_TABLE(NEON);
+
+#endif
+
+bool ConvertPathSupported(ConvertPath path)
+{
+	switch (path) {
+	case ConvertPath::Scalar:
+		return true;
+#ifdef SIMD_X86
+	case ConvertPath::SSE2:
+		return GetCPUFeatures().sse2;
+	case ConvertPath::SSSE3:
+		return GetCPUFeatures().ssse3;
+	case ConvertPath::AVX2:
+		return GetCPUFeatures().avx2;
+#endif
+#ifdef SIMD_NEON
+	case ConvertPath::NEON:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+ConvertPath GetConvertPath()
+{
+	static const ConvertPath order[] = {
+		ConvertPath::AVX2,
+		ConvertPath::SSSE3,
+		ConvertPath::SSE2,
+		ConvertPath::NEON,
+	};
+
+	for (ConvertPath path : order) {
+		if (ConvertPathSupported(path))
+			return path;
+	}
+
+	return ConvertPath::Scalar;
+}
+
+static const Kernels &GetKernels(ConvertPath path)
+{
+	switch (path) {
+#ifdef SIMD_X86
+	case ConvertPath::SSE2:
+		return sse2Kernels;
+	case ConvertPath::SSSE3:
+		return ssse3Kernels;
+	case ConvertPath::AVX2:
+		return avx2Kernels;
+#endif
+#ifdef SIMD_NEON
+	case ConvertPath::NEON:
+		return neonKernels;
+#endif
+	default:
+		return scalarKernels;
+	}
+}
+
+bool IsPackedYUV(VideoFormat format)
+{
+	switch (format) {
+	case VideoFormat::YVYU:
+	case VideoFormat::YUY2:
+	case VideoFormat::UYVY:
+	case VideoFormat::HDYC:
+		return true;
+	default:
+		return false;
+	}
+}
+
+size_t GetVideoLayout(VideoFormat format, int width, int height,
+		      int linesize[3], size_t offset[3])
+{
+	int lumaWidth = width;
+	int chromaWidth = (width + 1) / 2;
+	int chromaHeight = (height + 1) / 2;
+	int planes;
+
+	switch (format) {
+	case VideoFormat::ARGB:
+	case VideoFormat::XRGB:
+		planes = 1;
+		lumaWidth = width * 4;
+		break;
+	case VideoFormat::YVYU:
+	case VideoFormat::YUY2:
+	case VideoFormat::UYVY:
+	case VideoFormat::HDYC:
+		planes = 1;
+		lumaWidth = (width + 1) / 2 * 4;
+		break;
+	case VideoFormat::I420:
+	case VideoFormat::YV12:
+		planes = 3;
+		break;
+	case VideoFormat::NV12:
+		planes = 2;
+		chromaWidth *= 2;
+		break;
+	case VideoFormat::I444:
+		planes = 3;
+		chromaWidth = width;
+		chromaHeight = height;
+		break;
+	case VideoFormat::Y800:
+		planes = 1;
+		break;
+	default:
+		return 0;
+	}
+
+	size_t size = 0;
+
+	for (int i = 0; i < 3; i++) {
+		linesize[i] = 0;
+		offset[i] = 0;
+		if (i >= planes)
+			continue;
+
+		linesize[i] = i ? chromaWidth : lumaWidth;
+		offset[i] = size;
+		size += (size_t)linesize[i] * (i ? chromaHeight : height);
+	}
+
+	return size;
+}
+
+int GetPlaneRow(VideoFormat format, int plane, int row)
+{
+	bool subsampled = format == VideoFormat::I420 ||
+			  format == VideoFormat::YV12 ||
+			  format == VideoFormat::NV12;
+
+	return plane && subsampled ? row / 2 : row;
+}
+
+bool CanConvertPackedYUV(VideoFormat inFormat, VideoFormat outFormat)
+{
+	if (!IsPackedYUV(inFormat))
+		return false;
+
+	switch (outFormat) {
+	case VideoFormat::I420:
+	case VideoFormat::YV12:
+	case VideoFormat::NV12:
+	case VideoFormat::I444:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool ConvertPackedYUV(VideoFormat inFormat, const unsigned char *src,
+		      int srcLinesize, VideoFormat outFormat,
+		      unsigned char *const dst[3], const int dstLinesize[3],
+		      int width, int height)
+{
+	static const ConvertPath path = GetConvertPath();
+	return ConvertPackedYUV(inFormat, src, srcLinesize, outFormat, dst,
+				dstLinesize, width, height, path);
+}
+
+bool ConvertPackedYUV(VideoFormat inFormat, const unsigned char *src,
+		      int srcLinesize, VideoFormat outFormat,
+		      unsigned char *const dst[3], const int dstLinesize[3],
+		      int width, int height, ConvertPath path)
+{
+	if (!CanConvertPackedYUV(inFormat, outFormat))
+		return false;
+	if (!src || width <= 0 || height <= 0)
+		return false;
+	if (!ConvertPathSupported(path))
+		return false;
+
+	const Kernels &kernels = GetKernels(path);
+	bool chromaFirst = inFormat == VideoFormat::UYVY ||
+			   inFormat == VideoFormat::HDYC;
+
+	/* YVYU is YUY2 with its chroma swapped, so its first chroma value is
+	 * V rather than U */
+	bool swapUV = inFormat == VideoFormat::YVYU;
+
+	unsigned char *y = dst[0];
+	ptrdiff_t yLinesize = dstLinesize[0];
+
+	if (outFormat == VideoFormat::NV12) {
+		ToNV12Func func = kernels.toNV12[chromaFirst][swapUV];
+		ptrdiff_t uvLinesize = dstLinesize[1];
+
+		for (int row = 0; row < height; row += 2) {
+			ptrdiff_t next = row + 1 < height ? 1 : 0;
+			const unsigned char *s = src + row * (ptrdiff_t)srcLinesize;
+			unsigned char *dy = y + row * yLinesize;
+
+			func(s, s + next * srcLinesize, dy,
+			     dy + next * yLinesize,
+			     dst[1] + row / 2 * uvLinesize, width);
+		}
+
+		return true;
+	}
+
+	unsigned char *c0 = dst[1];
+	unsigned char *c1 = dst[2];
+	ptrdiff_t c0Linesize = dstLinesize[1];
+	ptrdiff_t c1Linesize = dstLinesize[2];
+
+	if ((outFormat == VideoFormat::YV12) != swapUV) {
+		std::swap(c0, c1);
+		std::swap(c0Linesize, c1Linesize);
+	}
+
+	if (outFormat == VideoFormat::I444) {
+		To444Func func = kernels.to444[chromaFirst];
+
+		for (int row = 0; row < height; row++)
+			func(src + row * (ptrdiff_t)srcLinesize,
+			     y + row * yLinesize, c0 + row * c0Linesize,
+			     c1 + row * c1Linesize, width);
+
+		return true;
+	}
+
+	To420Func func = kernels.to420[chromaFirst];
+
+	for (int row = 0; row < height; row += 2) {
+		ptrdiff_t next = row + 1 < height ? 1 : 0;
+		const unsigned char *s = src + row * (ptrdiff_t)srcLinesize;
+		unsigned char *dy = y + row * yLinesize;
+
+		func(s, s + next * srcLinesize, dy, dy + next * yLinesize,
+		     c0 + row / 2 * c0Linesize, c1 + row / 2 * c1Linesize,
+		     width);
+	}
+
+	return true;
+}
+
+/* rows are copied with memcpy, which is already vectorized; hand written
+ * SIMD copy and row swap loops measured no faster even for 4K frames */
+void CopyPlane(const unsigned char *src, int srcLinesize, unsigned char *dst,
+	       int dstLinesize, int rowBytes, int height)
+{
+	if (srcLinesize == rowBytes && dstLinesize == rowBytes) {
+		memcpy(dst, src, (size_t)rowBytes * height);
+		return;
+	}
+
+	for (int row = 0; row < height; row++) {
+		memcpy(dst, src, rowBytes);
+		src += srcLinesize;
+		dst += dstLinesize;
+	}
+}
+
+}; /* namespace DShow */
@@ -0,0 +1,83 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+
+#include <stddef.h>
+
+namespace DShow {
+
+enum class ConvertPath {
+	Scalar,
+	SSE2,
+	SSSE3,
+	AVX2,
+	NEON,
+};
+
+/** Fastest conversion path supported by the CPU */
+ConvertPath GetConvertPath();
+bool ConvertPathSupported(ConvertPath path);
+
+bool IsPackedYUV(VideoFormat format);
+
+/**
+ * Layout of a tightly packed uncompressed frame.  Unused planes get a
+ * linesize and offset of zero.  Returns the total size, or zero if the
+ * format is encoded or unknown.
+ */
+size_t GetVideoLayout(VideoFormat format, int width, int height,
+		      int linesize[3], size_t offset[3]);
+
+/**
+ * Row of a plane that holds the given row of the frame, for splitting frames
+ * in to slices.  With 4:2:0 chroma, row must be even.
+ */
+int GetPlaneRow(VideoFormat format, int plane, int row);
+
+/** Packed YUV can be converted to I420, YV12, NV12 and I444 */
+bool CanConvertPackedYUV(VideoFormat inFormat, VideoFormat outFormat);
+
+/**
+ * Converts packed 4:2:2 YUV to a planar format.  Planes are given in memory
+ * order (Y, V, U for YV12), and linesizes may be negative.  Chroma is
+ * averaged vertically for 4:2:0 output, rounding up, and duplicated
+ * horizontally for 4:4:4 output.  Every path produces the same output as
+ * the scalar path.
+ */
+bool ConvertPackedYUV(VideoFormat inFormat, const unsigned char *src,
+		      int srcLinesize, VideoFormat outFormat,
+		      unsigned char *const dst[3], const int dstLinesize[3],
+		      int width, int height);
+
+/**
+ * Copies the rows of a plane.  Either linesize may be negative, so passing
+ * the last row of a bottom-up image with a negative linesize flips it.
+ */
+void CopyPlane(const unsigned char *src, int srcLinesize, unsigned char *dst,
+	       int dstLinesize, int rowBytes, int height);
+
+bool ConvertPackedYUV(VideoFormat inFormat, const unsigned char *src,
+		      int srcLinesize, VideoFormat outFormat,
+		      unsigned char *const dst[3], const int dstLinesize[3],
+		      int width, int height, ConvertPath path);
+
+}; /* namespace DShow */
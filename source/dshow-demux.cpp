@@ -39,19 +39,9 @@ static inline const GUID &VideoFormatToSubType(VideoFormat format)
 	return GUID_NULL;
 }
 
-bool CreateDemuxVideoPin(IBaseFilter *demuxFilter, MediaType &mt, long width,
-			 long height, long long frameTime, VideoFormat format)
+bool CreateDemuxVideoType(MediaType &mt, long width, long height,
+			  long long frameTime, VideoFormat format)
 {
-	ComQIPtr<IMpeg2Demultiplexer> demuxer(demuxFilter);
-	if (!demuxer) {
-		Warning(L"CreateDemuxVideoPin: Failed to get "
-			L"IMpeg2Demultiplexer from filter");
-		return false;
-	}
-
-	ComPtr<IPin> pin;
-	HRESULT hr;
-
 	VIDEOINFOHEADER *vih = mt.AllocFormat<VIDEOINFOHEADER>();
 	vih->bmiHeader.biSize = sizeof(vih->bmiHeader);
 	vih->bmiHeader.biWidth = width;
@@ -62,7 +52,7 @@ bool CreateDemuxVideoPin(IBaseFilter *demuxFilter, MediaType &mt, long width,
 	vih->AvgTimePerFrame = frameTime;
 
 	if (!vih->bmiHeader.biCompression) {
-		Warning(L"CreateDemuxVideoPin: Invalid video format");
+		Warning(L"CreateDemuxVideoType: Invalid video format");
 		return false;
 	}
 
@@ -70,18 +60,6 @@ bool CreateDemuxVideoPin(IBaseFilter *demuxFilter, MediaType &mt, long width,
 	mt->subtype = VideoFormatToSubType(format);
 	mt->formattype = FORMAT_VideoInfo;
 	mt->bTemporalCompression = true;
-
-	wchar_t *name = (wchar_t *)CoTaskMemAlloc(sizeof(DEMUX_VIDEO_PIN));
-	memcpy(name, DEMUX_VIDEO_PIN, sizeof(DEMUX_VIDEO_PIN));
-
-	hr = demuxer->CreateOutputPin(mt, name, &pin);
-	if (FAILED(hr)) {
-		WarningHR(L"CreateDemuxVideoPin: Failed to create video pin "
-			  L"on demuxer",
-			  hr);
-		return false;
-	}
-
 	return true;
 }
 
@@ -109,20 +87,9 @@ static inline const GUID &AudioFormatToSubType(AudioFormat format)
 	return GUID_NULL;
 }
 
-bool CreateDemuxAudioPin(IBaseFilter *demuxFilter, MediaType &mt,
-			 DWORD samplesPerSec, WORD bitsPerSample, WORD channels,
-			 AudioFormat format)
+bool CreateDemuxAudioType(MediaType &mt, DWORD samplesPerSec,
+			  WORD bitsPerSample, WORD channels, AudioFormat format)
 {
-	ComQIPtr<IMpeg2Demultiplexer> demuxer(demuxFilter);
-	if (!demuxer) {
-		Warning(L"CreateDemuxAudioPin: Failed to get "
-			L"IMpeg2Demultiplexer from filter");
-		return false;
-	}
-
-	ComPtr<IPin> pin;
-	HRESULT hr;
-
 	WAVEFORMATEX *wfex = mt.AllocFormat<WAVEFORMATEX>();
 	wfex->wFormatTag = AudioFormatToFormatTag(format);
 	wfex->nChannels = channels;
@@ -130,7 +97,7 @@ bool CreateDemuxAudioPin(IBaseFilter *demuxFilter, MediaType &mt,
 	wfex->wBitsPerSample = bitsPerSample;
 
 	if (!wfex->wFormatTag) {
-		Warning(L"CreateDemuxAudioPin: Invalid audio format");
+		Warning(L"CreateDemuxAudioType: Invalid audio format");
 		return false;
 	}
 
@@ -138,18 +105,6 @@ bool CreateDemuxAudioPin(IBaseFilter *demuxFilter, MediaType &mt,
 	mt->subtype = AudioFormatToSubType(format);
 	mt->formattype = FORMAT_WaveFormatEx;
 	mt->bTemporalCompression = true;
-
-	wchar_t *name = (wchar_t *)CoTaskMemAlloc(sizeof(DEMUX_AUDIO_PIN));
-	memcpy(name, DEMUX_AUDIO_PIN, sizeof(DEMUX_AUDIO_PIN));
-
-	hr = demuxer->CreateOutputPin(mt, name, &pin);
-	if (FAILED(hr)) {
-		WarningHR(L"CreateDemuxAudioPin: Failed to create audio pin "
-			  L"on demuxer",
-			  hr);
-		return false;
-	}
-
 	return true;
 }
 
@@ -25,14 +25,14 @@
 
 namespace DShow {
 
-#define DEMUX_VIDEO_PIN L"Demuxer Video Pin"
-#define DEMUX_AUDIO_PIN L"Demuxer Audio Pin"
-
-bool CreateDemuxVideoPin(IBaseFilter *demuxFilter, MediaType &mt, long width,
-			 long height, long long frameTime, VideoFormat format);
+/*
+ * Media types of the elementary streams demuxed from an encoded device's
+ * transport stream
+ */
+bool CreateDemuxVideoType(MediaType &mt, long width, long height,
+			  long long frameTime, VideoFormat format);
 
-bool CreateDemuxAudioPin(IBaseFilter *demuxFilter, MediaType &mt,
-			 DWORD samplesPerSec, WORD bitsPerSample, WORD channels,
-			 AudioFormat format);
+bool CreateDemuxAudioType(MediaType &mt, DWORD samplesPerSec,
+			  WORD bitsPerSample, WORD channels, AudioFormat format);
 
 }; /* namespace DShow */
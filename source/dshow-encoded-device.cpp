@@ -25,17 +25,19 @@
 #include "device.hpp"
 #include "log.hpp"
 
+#include <map>
+#include <mutex>
+
 namespace DShow {
 
 static inline bool CreateFilters(IBaseFilter *filter, IBaseFilter **crossbar,
-				 IBaseFilter **encoder, IBaseFilter **demuxer)
+				 IBaseFilter **encoder)
 {
 	ComPtr<IPin> inputPin;
 	ComPtr<IPin> outputPin;
 	REGPINMEDIUM inMedium;
 	REGPINMEDIUM outMedium;
 	bool hasOutMedium;
-	HRESULT hr;
 
 	if (!GetPinByName(filter, PINDIR_INPUT, nullptr, &inputPin)) {
 		Warning(L"Encoded Device: Failed to get input pin");
@@ -63,22 +65,13 @@ static inline bool CreateFilters(IBaseFilter *filter, IBaseFilter **crossbar,
 	if (hasOutMedium)
 		GetFilterByMedium(KSCATEGORY_ENCODER, outMedium, encoder);
 
-	hr = CoCreateInstance(CLSID_MPEG2Demultiplexer, nullptr,
-			      CLSCTX_INPROC_SERVER, IID_IBaseFilter,
-			      (void **)demuxer);
-	if (FAILED(hr)) {
-		WarningHR(L"Encoded Device: Failed to create demuxer", hr);
-		return false;
-	}
-
 	return true;
 }
 
 static inline bool ConnectEncodedFilters(IGraphBuilder *graph,
 					 IBaseFilter *filter,
 					 IBaseFilter *crossbar,
-					 IBaseFilter *encoder,
-					 IBaseFilter *demuxer)
+					 IBaseFilter *encoder)
 {
 	if (!DirectConnectFilters(graph, crossbar, filter)) {
 		Warning(L"Encoded Device: Failed to connect crossbar to "
@@ -86,59 +79,9 @@ static inline bool ConnectEncodedFilters(IGraphBuilder *graph,
 		return false;
 	}
 
-	if (!!encoder) {
-		if (!DirectConnectFilters(graph, filter, encoder)) {
-			Warning(L"Encoded Device: Failed to connect device to "
-				L"encoder");
-			return false;
-		}
-
-		if (!DirectConnectFilters(graph, encoder, demuxer)) {
-			Warning(L"Encoded Device: Failed to connect encoder to "
-				L"demuxer");
-			return false;
-		}
-	} else {
-		if (!DirectConnectFilters(graph, filter, demuxer)) {
-			Warning(L"Encoded Device: Failed to connect device to "
-				L"demuxer");
-			return false;
-		}
-	}
-
-	return true;
-}
-
-static inline bool MapPacketIDs(IBaseFilter *demuxer, ULONG video, ULONG audio)
-{
-	ComPtr<IPin> videoPin, audioPin;
-	HRESULT hr;
-
-	if (!GetPinByName(demuxer, PINDIR_OUTPUT, DEMUX_VIDEO_PIN, &videoPin)) {
-		Warning(L"Encoded Device: Could not get video pin from "
-			L"demuxer");
-		return false;
-	}
-
-	if (!GetPinByName(demuxer, PINDIR_OUTPUT, DEMUX_AUDIO_PIN, &audioPin)) {
-		Warning(L"Encoded Device: Could not get audio pin from "
-			L"demuxer");
-		return false;
-	}
-
-	hr = MapPinToPacketID(videoPin, video);
-	if (FAILED(hr)) {
-		WarningHR(L"Encoded Device: Failed to map demuxer video pin "
-			  L"packet ID",
-			  hr);
-		return false;
-	}
-
-	hr = MapPinToPacketID(audioPin, audio);
-	if (FAILED(hr)) {
-		WarningHR(L"Encoded Device: Failed to map demuxer audio pin "
-			  L"packet ID",
-			  hr);
+	if (!!encoder && !DirectConnectFilters(graph, filter, encoder)) {
+		Warning(L"Encoded Device: Failed to connect device to "
+			L"encoder");
 		return false;
 	}
 
@@ -197,40 +140,105 @@ bool SetRocketEnabled(IBaseFilter *encoder, bool enable)
 	return SUCCEEDED(hr);
 }
 
+/*
+ * Streams found in the transport streams of encoded devices, by device path,
+ * so that the next time a device starts it's on the right streams from the
+ * first packet
+ */
+static mutex programMutex;
+static map<wstring, TSProgram> programCache;
+
+static inline const wstring &ProgramKey(const VideoConfig &config)
+{
+	return config.path.empty() ? config.name : config.path;
+}
+
+static bool GetCachedProgram(const VideoConfig &config, TSProgram &program)
+{
+	lock_guard<mutex> lock(programMutex);
+	auto it = programCache.find(ProgramKey(config));
+	if (it == programCache.end())
+		return false;
+
+	program = it->second;
+	return true;
+}
+
+static void CacheProgram(const VideoConfig &config, const TSProgram &program)
+{
+	lock_guard<mutex> lock(programMutex);
+	programCache[ProgramKey(config)] = program;
+}
+
+static void UseProgram(EncodedDevice &info, const TSProgram &program)
+{
+	if (program.videoPID != TS_NULL_PID)
+		info.videoPacketID = program.videoPID;
+
+	if (program.audioPID != TS_NULL_PID) {
+		info.audioPacketID = program.audioPID;
+		info.audioFormat = program.audioFormat;
+		info.audioLATM =
+			program.audioStreamType == TS_STREAM_AAC_LATM;
+	}
+}
+
+/*
+ * The device (or its encoder) sends an MPEG-2 transport stream, which is
+ * captured as is and demuxed by TSDemuxer.  Audio is taken from the same
+ * stream when the audio config uses the video device.
+ *
+ * The packet IDs and codecs in the table of known devices are only used
+ * until the stream's own PAT and PMT have been seen.
+ */
 bool HDevice::SetupEncodedVideoCapture(IBaseFilter *filter, VideoConfig &config,
 				       const EncodedDevice &info)
 {
 	ComPtr<IBaseFilter> crossbar;
 	ComPtr<IBaseFilter> encoder;
-	ComPtr<IBaseFilter> demuxer;
-	MediaType mtVideo;
-	MediaType mtAudio;
+	TSProgram cached;
 
-	if (!CreateFilters(filter, &crossbar, &encoder, &demuxer))
+	if (!CreateFilters(filter, &crossbar, &encoder))
 		return false;
 
-	if (!CreateDemuxVideoPin(demuxer, mtVideo, info.width, info.height,
-				 info.frameInterval, info.videoFormat))
+	encodedInfo = info;
+	if (GetCachedProgram(config, cached))
+		UseProgram(encodedInfo, cached);
+
+	if (!CreateDemuxVideoType(videoMediaType, info.width, info.height,
+				  info.frameInterval, info.videoFormat))
 		return false;
 
-	if (!CreateDemuxAudioPin(demuxer, mtAudio, info.samplesPerSec, 16, 2,
-				 info.audioFormat))
+	if (!CreateDemuxAudioType(demuxAudioType, encodedInfo.samplesPerSec,
+				  16, 2, encodedInfo.audioFormat))
 		return false;
 
-	config.cx = info.width;
-	config.cy_abs = labs(info.height);
-	config.cy_flip = info.height < 0;
-	config.frameInterval = info.frameInterval;
 	config.format = info.videoFormat;
 	config.internalFormat = info.videoFormat;
+	ConvertVideoSettings();
 
 	PinCaptureInfo pci;
-	pci.callback = [this](IMediaSample *s) { Receive(true, s); };
-	pci.expectedMajorType = mtVideo->majortype;
-	pci.expectedSubType = mtVideo->subtype;
+	pci.callback = [this](IMediaSample *s) { ReceiveTransport(s); };
+	pci.expectedMajorType = MEDIATYPE_Stream;
+	pci.expectedSubType = MEDIASUBTYPE_MPEG2_TRANSPORT;
 
 	videoCapture = new CaptureFilter(pci);
-	videoFilter = demuxer;
+	videoFilter = !!encoder ? encoder.Get() : filter;
+
+	tsDemuxer.SetCallback([this](TSStream stream, const TSPacket &packet) {
+		ReceiveDemuxed(stream, packet);
+	});
+	tsDemuxer.SetPayloadCallback(
+		[this](TSStream stream, const TSPacket &packet,
+		       const unsigned char *data, size_t size, size_t scanned,
+		       bool padded) {
+			return DemuxedPayload(stream, packet, data, size,
+					      scanned, padded);
+		});
+	tsDemuxer.SetProgramCallback(
+		[this](const TSProgram &program) { ApplyTSProgram(program); });
+	tsDemuxer.SetStream(TSStream::Video, encodedInfo.videoPacketID,
+			    videoFrames);
 
 	if (!!encoder && config.name.find(L"IT9910") != std::string::npos) {
 		rocketEncoder = encoder;
@@ -241,20 +249,46 @@ bool HDevice::SetupEncodedVideoCapture(IBaseFilter *filter, VideoConfig &config,
 
 	graph->AddFilter(crossbar, L"Crossbar");
 	graph->AddFilter(filter, L"Device");
-	graph->AddFilter(demuxer, L"Demuxer");
 	graph->AddFilter(videoCapture, L"Capture Filter");
 
 	if (!!encoder)
 		graph->AddFilter(encoder, L"Encoder");
 
-	bool success = ConnectEncodedFilters(graph, filter, crossbar, encoder,
-					     demuxer);
-	if (success)
-		success = MapPacketIDs(demuxer, info.videoPacketID,
-				       info.audioPacketID);
+	bool success = ConnectEncodedFilters(graph, filter, crossbar, encoder);
 
 	encodedDevice = success;
 	return success;
 }
 
+/* called from the streaming thread once the PMT has been seen, after the
+ * demuxer has moved to the streams it lists */
+void HDevice::ApplyTSProgram(const TSProgram &program)
+{
+	AudioFormat audioFormat = encodedInfo.audioFormat;
+	bool audioLATM = encodedInfo.audioLATM;
+
+	Debug(L"Encoded device streams: video PID 0x%X (type 0x%02X), "
+	      L"audio PID 0x%X (type 0x%02X)",
+	      program.videoPID, program.videoStreamType, program.audioPID,
+	      program.audioStreamType);
+
+	CacheProgram(videoConfig, program);
+	UseProgram(encodedInfo, program);
+
+	if (encodedInfo.audioFormat == audioFormat &&
+	    encodedInfo.audioLATM == audioLATM)
+		return;
+
+	if (!CreateDemuxAudioType(demuxAudioType, encodedInfo.samplesPerSec,
+				  16, 2, encodedInfo.audioFormat))
+		return;
+
+	if (demuxedAudio) {
+		audioMediaType = demuxAudioType;
+		ConvertAudioSettings();
+		audioSnapshot.reset();
+		audioTelemetry.RecordFormatChange();
+	}
+}
+
 }; /* namespace DShow */
@@ -21,6 +21,7 @@
 #include <mutex>
 #include "dshow-enum.hpp"
 #include "dshow-formats.hpp"
+#include "audio-convert.hpp"
 #include "log.hpp"
 
 #undef DEFINE_GUID
@@ -138,14 +139,7 @@ static bool Get_FORMAT_WaveFormatEx_Data(AudioInfo &info,
 		return false;
 	}
 
-	switch (wfex->wBitsPerSample) {
-	case 16:
-		info.format = AudioFormat::Wave16bit;
-		break;
-	case 32:
-		info.format = AudioFormat::WaveFloat;
-		break;
-	}
+	GetMediaTypeAFormat(mt, info.format);
 
 	info.minChannels = ascc->MinimumChannels;
 	info.maxChannels = ascc->MaximumChannels;
@@ -295,13 +289,18 @@ struct ClosestAudioData {
 	AudioConfig &config;
 	MediaType &mt;
 	int bestVal;
+	bool bestConverted;
 	bool found;
 
 	ClosestAudioData &operator=(ClosestAudioData const &) = delete;
 	ClosestAudioData &operator=(ClosestAudioData &&) = delete;
 
 	inline ClosestAudioData(AudioConfig &config, MediaType &mt)
-		: config(config), mt(mt), bestVal(0), found(false)
+		: config(config),
+		  mt(mt),
+		  bestVal(0),
+		  bestConverted(false),
+		  found(false)
 	{
 	}
 };
@@ -321,9 +320,19 @@ static bool ClosestAudioMTCallback(ClosestAudioData &data,
 	MediaType copiedMT = mt;
 	WAVEFORMATEX *wfex = (WAVEFORMATEX *)copiedMT->pbFormat;
 
-	if (data.config.format != AudioFormat::Any &&
-	    data.config.format != info.format)
-		return true;
+	/* formats that have to be converted are only used if no caps
+	 * deliver the requested format directly */
+	bool converted = false;
+
+	if (data.config.internalFormat != AudioFormat::Any) {
+		if (data.config.internalFormat != info.format)
+			return true;
+	} else if (data.config.format != AudioFormat::Any &&
+		   data.config.format != info.format) {
+		if (!CanConvertAudio(info.format, data.config.format))
+			return true;
+		converted = true;
+	}
 
 	int sampleRateVal = 0;
 	int channelsVal = 0;
@@ -348,7 +357,11 @@ static bool ClosestAudioMTCallback(ClosestAudioData &data,
 
 	int totalVal = sampleRateVal + channelsVal;
 
-	if (!data.found || data.bestVal > totalVal) {
+	bool better = converted == data.bestConverted
+			      ? data.bestVal > totalVal
+			      : data.bestConverted;
+
+	if (!data.found || better) {
 		if (channelsVal == 0) {
 			LONG channels = data.config.channels;
 			ClampToGranularity(channels, info.minChannels,
@@ -372,8 +385,9 @@ static bool ClosestAudioMTCallback(ClosestAudioData &data,
 		data.mt = copiedMT;
 		data.found = true;
 		data.bestVal = totalVal;
+		data.bestConverted = converted;
 
-		if (totalVal == 0)
+		if (totalVal == 0 && !converted)
 			return false;
 	}
 
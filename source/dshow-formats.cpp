@@ -68,6 +68,8 @@ DWORD VFormatToFourCC(VideoFormat format)
 		return MAKEFOURCC('Y', 'V', '1', '2');
 	case VideoFormat::Y800:
 		return MAKEFOURCC('Y', '8', '0', '0');
+	case VideoFormat::I444:
+		return MAKEFOURCC('I', '4', '4', '4');
 
 	/* packed YUV formats */
 	case VideoFormat::YVYU:
@@ -143,6 +145,8 @@ WORD VFormatBits(VideoFormat format)
 		return 12;
 	case VideoFormat::Y800:
 		return 8;
+	case VideoFormat::I444:
+		return 24;
 
 	/* packed YUV formats */
 	case VideoFormat::YVYU:
@@ -165,6 +169,7 @@ WORD VFormatPlanes(VideoFormat format)
 
 	/* planar YUV formats */
 	case VideoFormat::I420:
+	case VideoFormat::I444:
 		return 3;
 	case VideoFormat::NV12:
 	case VideoFormat::YV12:
@@ -211,6 +216,9 @@ static bool GetFourCCVFormat(DWORD fourCC, VideoFormat &format)
 	case MAKEFOURCC('Y', '8', '0', '0'):
 		format = VideoFormat::Y800;
 		break;
+	case MAKEFOURCC('I', '4', '4', '4'):
+		format = VideoFormat::I444;
+		break;
 
 	/* packed YUV formats */
 	case MAKEFOURCC('Y', 'V', 'Y', 'U'):
@@ -298,4 +306,49 @@ bool GetMediaTypeVFormat(const AM_MEDIA_TYPE &mt, VideoFormat &format)
 	return true;
 }
 
+static bool IsFloatAudio(const WAVEFORMATEX *wfex, ULONG size)
+{
+	if (wfex->wFormatTag == WAVE_FORMAT_IEEE_FLOAT)
+		return true;
+	if (wfex->wFormatTag != WAVE_FORMAT_EXTENSIBLE ||
+	    size < sizeof(WAVEFORMATEXTENSIBLE))
+		return false;
+
+	const WAVEFORMATEXTENSIBLE *wfext =
+		reinterpret_cast<const WAVEFORMATEXTENSIBLE *>(wfex);
+	return wfext->SubFormat == KSDATAFORMAT_SUBTYPE_IEEE_FLOAT;
+}
+
+bool GetMediaTypeAFormat(const AM_MEDIA_TYPE &mt, AudioFormat &format)
+{
+	if (mt.formattype != FORMAT_WaveFormatEx || !mt.pbFormat ||
+	    mt.cbFormat < sizeof(WAVEFORMATEX))
+		return false;
+
+	const WAVEFORMATEX *wfex =
+		reinterpret_cast<const WAVEFORMATEX *>(mt.pbFormat);
+
+	format = AudioFormat::Unknown;
+
+	/* encoded formats */
+	if (wfex->wFormatTag == WAVE_FORMAT_RAW_AAC1)
+		format = AudioFormat::AAC;
+	else if (wfex->wFormatTag == WAVE_FORMAT_DVM)
+		format = AudioFormat::AC3;
+	else if (wfex->wFormatTag == WAVE_FORMAT_MPEG)
+		format = AudioFormat::MPGA;
+
+	/* raw formats */
+	else if (wfex->wBitsPerSample == 16)
+		format = AudioFormat::Wave16bit;
+	else if (wfex->wBitsPerSample == 24)
+		format = AudioFormat::Wave24bit;
+	else if (wfex->wBitsPerSample == 32)
+		format = IsFloatAudio(wfex, mt.cbFormat)
+				 ? AudioFormat::WaveFloat
+				 : AudioFormat::Wave32bit;
+
+	return true;
+}
+
 }; /* namespace DShow */
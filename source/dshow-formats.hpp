@@ -33,5 +33,6 @@ WORD VFormatPlanes(VideoFormat format);
 GUID VFormatToSubType(VideoFormat format);
 
 bool GetMediaTypeVFormat(const AM_MEDIA_TYPE &mt, VideoFormat &format);
+bool GetMediaTypeAFormat(const AM_MEDIA_TYPE &mt, AudioFormat &format);
 
 }; /*namespace DShow */
@@ -77,6 +77,25 @@ BITMAPINFOHEADER *GetBitmapInfoHeader(AM_MEDIA_TYPE &mt)
 	return NULL;
 }
 
+MediaTypeFingerprint GetMediaTypeFingerprint(const AM_MEDIA_TYPE &mt)
+{
+	MediaTypeFingerprint fp;
+	fp.majortype = mt.majortype;
+	fp.subtype = mt.subtype;
+	fp.formattype = mt.formattype;
+	fp.cbFormat = mt.pbFormat ? mt.cbFormat : 0;
+
+	/* 64-bit FNV-1a */
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+	for (ULONG i = 0; i < fp.cbFormat; i++) {
+		hash ^= mt.pbFormat[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	fp.formatHash = hash;
+	return fp;
+}
+
 const BITMAPINFOHEADER *GetBitmapInfoHeader(const AM_MEDIA_TYPE &mt)
 {
 	if (mt.formattype == FORMAT_VideoInfo) {
@@ -29,6 +29,36 @@ void FreeMediaType(AM_MEDIA_TYPE &mt);
 BITMAPINFOHEADER *GetBitmapInfoHeader(AM_MEDIA_TYPE &mt);
 const BITMAPINFOHEADER *GetBitmapInfoHeader(const AM_MEDIA_TYPE &mt);
 
+/**
+ * Cheap identity of a media type, used to tell whether a media type attached
+ * to a sample actually differs from the one already in use without copying
+ * it.
+ */
+struct MediaTypeFingerprint {
+	GUID majortype;
+	GUID subtype;
+	GUID formattype;
+	ULONG cbFormat;
+	unsigned long long formatHash;
+
+	inline MediaTypeFingerprint() { memset(this, 0, sizeof(*this)); }
+
+	inline bool operator==(const MediaTypeFingerprint &fp) const
+	{
+		return formatHash == fp.formatHash &&
+		       cbFormat == fp.cbFormat && subtype == fp.subtype &&
+		       majortype == fp.majortype &&
+		       formattype == fp.formattype;
+	}
+
+	inline bool operator!=(const MediaTypeFingerprint &fp) const
+	{
+		return !(*this == fp);
+	}
+};
+
+MediaTypeFingerprint GetMediaTypeFingerprint(const AM_MEDIA_TYPE &mt);
+
 class MediaTypePtr;
 
 class MediaType {
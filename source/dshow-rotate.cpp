@@ -0,0 +1,552 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "dshow-rotate.hpp"
+#include "dshow-convert.hpp"
+#include "dshow-simd.hpp"
+
+#include <algorithm>
+#include <string.h>
+#include <stddef.h>
+
+namespace DShow {
+
+/* transposes are done a register tile at a time, visiting the tiles in
+ * blocks of this many elements square so that destination cache lines are
+ * filled completely before moving on to the next ones.  must be a multiple
+ * of every tile size */
+#define ROTATE_BLOCK 64
+
+typedef void (*TileFunc)(const unsigned char *src, ptrdiff_t srcLinesize,
+			 unsigned char *dst, ptrdiff_t dstLinesize);
+
+template<typename T>
+static void TransposeScalar(const unsigned char *src, ptrdiff_t srcLinesize,
+			    unsigned char *dst, ptrdiff_t dstLinesize,
+			    int width, int height)
+{
+	for (int y = 0; y < height; y++) {
+		const unsigned char *s = src + y * srcLinesize;
+		unsigned char *d = dst + y * sizeof(T);
+
+		for (int x = 0; x < width; x++) {
+			memcpy(d, s, sizeof(T));
+			s += sizeof(T);
+			d += dstLinesize;
+		}
+	}
+}
+
+template<typename T>
+static void TransposeTiled(const unsigned char *src, ptrdiff_t srcLinesize,
+			   unsigned char *dst, ptrdiff_t dstLinesize,
+			   int width, int height, int tile, TileFunc func)
+{
+	int tiledWidth = width - width % tile;
+	int tiledHeight = height - height % tile;
+
+	for (int by = 0; by < tiledHeight; by += ROTATE_BLOCK) {
+		int byEnd = std::min(by + ROTATE_BLOCK, tiledHeight);
+
+		for (int bx = 0; bx < tiledWidth; bx += ROTATE_BLOCK) {
+			int bxEnd = std::min(bx + ROTATE_BLOCK, tiledWidth);
+
+			for (int y = by; y < byEnd; y += tile) {
+				for (int x = bx; x < bxEnd; x += tile)
+					func(src + y * srcLinesize +
+						     x * sizeof(T),
+					     srcLinesize,
+					     dst + x * dstLinesize +
+						     y * sizeof(T),
+					     dstLinesize);
+			}
+		}
+	}
+
+	/* columns and rows that don't fill a whole tile */
+	TransposeScalar<T>(src + tiledWidth * sizeof(T), srcLinesize,
+			   dst + tiledWidth * dstLinesize, dstLinesize,
+			   width - tiledWidth, height);
+	TransposeScalar<T>(src + tiledHeight * srcLinesize, srcLinesize,
+			   dst + tiledHeight * sizeof(T), dstLinesize,
+			   tiledWidth, height - tiledHeight);
+}
+
+template<typename T>
+static void ReverseRowScalar(const unsigned char *src, unsigned char *dst,
+			     int width)
+{
+	for (int x = 0; x < width; x++)
+		memcpy(dst + x * sizeof(T), src + (width - 1 - x) * sizeof(T),
+		       sizeof(T));
+}
+
+#ifdef SIMD_X86
+
+/* each round interleaves row i with row i + n/2, which rotates the bits of
+ * an element's row/column index left by one.  after log2(n) rounds the row
+ * and column bits have traded places */
+
+SIMD_TARGET("sse2")
+static void Tile8x16SSE2(const unsigned char *src, ptrdiff_t srcLinesize,
+			 unsigned char *dst, ptrdiff_t dstLinesize)
+{
+	__m128i a[16], b[16];
+
+	for (int i = 0; i < 16; i++)
+		a[i] = _mm_loadu_si128((const __m128i *)(src + i * srcLinesize));
+
+	for (int round = 0; round < 4; round++) {
+		for (int i = 0; i < 8; i++) {
+			b[i * 2] = _mm_unpacklo_epi8(a[i], a[i + 8]);
+			b[i * 2 + 1] = _mm_unpackhi_epi8(a[i], a[i + 8]);
+		}
+		for (int i = 0; i < 16; i++)
+			a[i] = b[i];
+	}
+
+	for (int i = 0; i < 16; i++)
+		_mm_storeu_si128((__m128i *)(dst + i * dstLinesize), a[i]);
+}
+
+SIMD_TARGET("sse2")
+static void Tile16x8SSE2(const unsigned char *src, ptrdiff_t srcLinesize,
+			 unsigned char *dst, ptrdiff_t dstLinesize)
+{
+	__m128i a[8], b[8];
+
+	for (int i = 0; i < 8; i++)
+		a[i] = _mm_loadu_si128((const __m128i *)(src + i * srcLinesize));
+
+	for (int round = 0; round < 3; round++) {
+		for (int i = 0; i < 4; i++) {
+			b[i * 2] = _mm_unpacklo_epi16(a[i], a[i + 4]);
+			b[i * 2 + 1] = _mm_unpackhi_epi16(a[i], a[i + 4]);
+		}
+		for (int i = 0; i < 8; i++)
+			a[i] = b[i];
+	}
+
+	for (int i = 0; i < 8; i++)
+		_mm_storeu_si128((__m128i *)(dst + i * dstLinesize), a[i]);
+}
+
+SIMD_TARGET("sse2")
+static void Tile32x4SSE2(const unsigned char *src, ptrdiff_t srcLinesize,
+			 unsigned char *dst, ptrdiff_t dstLinesize)
+{
+	__m128i r0 = _mm_loadu_si128((const __m128i *)src);
+	__m128i r1 = _mm_loadu_si128((const __m128i *)(src + srcLinesize));
+	__m128i r2 = _mm_loadu_si128((const __m128i *)(src + srcLinesize * 2));
+	__m128i r3 = _mm_loadu_si128((const __m128i *)(src + srcLinesize * 3));
+
+	__m128i t0 = _mm_unpacklo_epi32(r0, r1);
+	__m128i t1 = _mm_unpacklo_epi32(r2, r3);
+	__m128i t2 = _mm_unpackhi_epi32(r0, r1);
+	__m128i t3 = _mm_unpackhi_epi32(r2, r3);
+
+	_mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi64(t0, t1));
+	_mm_storeu_si128((__m128i *)(dst + dstLinesize),
+			 _mm_unpackhi_epi64(t0, t1));
+	_mm_storeu_si128((__m128i *)(dst + dstLinesize * 2),
+			 _mm_unpacklo_epi64(t2, t3));
+	_mm_storeu_si128((__m128i *)(dst + dstLinesize * 3),
+			 _mm_unpackhi_epi64(t2, t3));
+}
+
+/* 8x8 32 bit elements: 4x4 transposes within each 128 bit lane, then the
+ * lanes are exchanged between rows i and i + 4 */
+SIMD_TARGET("avx2")
+static void Tile32x8AVX2(const unsigned char *src, ptrdiff_t srcLinesize,
+			 unsigned char *dst, ptrdiff_t dstLinesize)
+{
+	__m256 r[8], t[8], u[8];
+
+	for (int i = 0; i < 8; i++)
+		r[i] = _mm256_loadu_ps((const float *)(src + i * srcLinesize));
+
+	for (int i = 0; i < 8; i += 2) {
+		t[i] = _mm256_unpacklo_ps(r[i], r[i + 1]);
+		t[i + 1] = _mm256_unpackhi_ps(r[i], r[i + 1]);
+	}
+
+	for (int i = 0; i < 8; i += 4) {
+		u[i] = _mm256_shuffle_ps(t[i], t[i + 2], 0x44);
+		u[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], 0xEE);
+		u[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], 0x44);
+		u[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], 0xEE);
+	}
+
+	for (int i = 0; i < 4; i++) {
+		_mm256_storeu_ps((float *)(dst + i * dstLinesize),
+				 _mm256_permute2f128_ps(u[i], u[i + 4], 0x20));
+		_mm256_storeu_ps((float *)(dst + (i + 4) * dstLinesize),
+				 _mm256_permute2f128_ps(u[i], u[i + 4], 0x31));
+	}
+}
+
+template<typename T>
+SIMD_TARGET("sse2")
+static void ReverseRowSSE2(const unsigned char *src, unsigned char *dst,
+			   int width)
+{
+	const int count = 16 / sizeof(T);
+	int x = 0;
+
+	for (; x + count <= width; x += count) {
+		__m128i v = _mm_loadu_si128(
+			(const __m128i *)(src + (width - x - count) * sizeof(T)));
+
+		v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+		if (sizeof(T) <= 2) {
+			v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+			v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+		}
+		if (sizeof(T) == 1)
+			v = _mm_or_si128(_mm_slli_epi16(v, 8),
+					 _mm_srli_epi16(v, 8));
+
+		_mm_storeu_si128((__m128i *)(dst + x * sizeof(T)), v);
+	}
+
+	ReverseRowScalar<T>(src, dst + x * sizeof(T), width - x);
+}
+
+#endif
+
+static ConvertPath GetRotatePath()
+{
+	static const ConvertPath path = GetConvertPath();
+	return path;
+}
+
+template<typename T>
+static void Transpose(const unsigned char *src, ptrdiff_t srcLinesize,
+		      unsigned char *dst, ptrdiff_t dstLinesize, int width,
+		      int height)
+{
+#ifdef SIMD_X86
+	ConvertPath path = GetRotatePath();
+	bool sse2 = path == ConvertPath::SSE2 || path == ConvertPath::SSSE3 ||
+		    path == ConvertPath::AVX2;
+
+	if (sizeof(T) == 4 && path == ConvertPath::AVX2) {
+		TransposeTiled<T>(src, srcLinesize, dst, dstLinesize, width,
+				  height, 8, Tile32x8AVX2);
+		return;
+	}
+
+	if (sse2) {
+		if (sizeof(T) == 1)
+			TransposeTiled<T>(src, srcLinesize, dst, dstLinesize,
+					  width, height, 16, Tile8x16SSE2);
+		else if (sizeof(T) == 2)
+			TransposeTiled<T>(src, srcLinesize, dst, dstLinesize,
+					  width, height, 8, Tile16x8SSE2);
+		else
+			TransposeTiled<T>(src, srcLinesize, dst, dstLinesize,
+					  width, height, 4, Tile32x4SSE2);
+		return;
+	}
+#endif
+
+	TransposeScalar<T>(src, srcLinesize, dst, dstLinesize, width, height);
+}
+
+template<typename T>
+static void ReverseRow(const unsigned char *src, unsigned char *dst,
+		       int width)
+{
+#ifdef SIMD_X86
+	if (GetRotatePath() != ConvertPath::Scalar) {
+		ReverseRowSSE2<T>(src, dst, width);
+		return;
+	}
+#endif
+
+	ReverseRowScalar<T>(src, dst, width);
+}
+
+template<typename T>
+static void Rotate(const unsigned char *src, ptrdiff_t srcLinesize,
+		   unsigned char *dst, ptrdiff_t dstLinesize, int width,
+		   int height, int degrees)
+{
+	switch (degrees) {
+	case 90:
+		/* transpose of the source read from the bottom up */
+		Transpose<T>(src + (height - 1) * srcLinesize, -srcLinesize,
+			     dst, dstLinesize, width, height);
+		break;
+
+	case 180:
+		for (int y = 0; y < height; y++)
+			ReverseRow<T>(src + (height - 1 - y) * srcLinesize,
+				      dst + y * dstLinesize, width);
+		break;
+
+	case 270:
+		/* transpose written from the bottom up */
+		Transpose<T>(src, srcLinesize,
+			     dst + (width - 1) * dstLinesize, -dstLinesize,
+			     width, height);
+		break;
+
+	default:
+		CopyPlane(src, (int)srcLinesize, dst, (int)dstLinesize,
+			  width * (int)sizeof(T), height);
+	}
+}
+
+void RotatePlane(const unsigned char *src, int srcLinesize, unsigned char *dst,
+		 int dstLinesize, int width, int height, int elementSize,
+		 int degrees)
+{
+	if (elementSize == 1)
+		Rotate<unsigned char>(src, srcLinesize, dst, dstLinesize,
+				      width, height, degrees);
+	else if (elementSize == 2)
+		Rotate<unsigned short>(src, srcLinesize, dst, dstLinesize,
+				       width, height, degrees);
+	else if (elementSize == 4)
+		Rotate<unsigned int>(src, srcLinesize, dst, dstLinesize, width,
+				     height, degrees);
+}
+
+static inline unsigned char Average(unsigned char a, unsigned char b)
+{
+	return (unsigned char)((a + b + 1) >> 1);
+}
+
+/* packed 4:2:2 is turned sideways as 16 bit luma/chroma pairs, after which
+ * each row only holds one kind of chroma.  rows that came from the same
+ * source macropixels are paired back up, and the vertically neighbouring
+ * chroma samples that now sit side by side are averaged */
+static void RecombinePackedChroma(unsigned char *dst, ptrdiff_t linesize,
+				  int width, int height, bool chromaFirst,
+				  bool evenRowsC0)
+{
+	int offset = chromaFirst ? 0 : 1;
+
+	for (int y = 0; y + 1 < height; y += 2) {
+		unsigned char *row0 = dst + y * linesize + offset;
+		unsigned char *row1 = row0 + linesize;
+		unsigned char *c0Row = evenRowsC0 ? row0 : row1;
+		unsigned char *c1Row = evenRowsC0 ? row1 : row0;
+
+		for (int x = 0; x < width / 2; x++) {
+			unsigned char c0 = Average(c0Row[0], c0Row[2]);
+			unsigned char c1 = Average(c1Row[0], c1Row[2]);
+
+			row0[0] = row1[0] = c0;
+			row0[2] = row1[2] = c1;
+			row0 += 4;
+			row1 += 4;
+			c0Row += 4;
+			c1Row += 4;
+		}
+	}
+}
+
+/* destination rows [begin, end) of a plane come from a strip of source rows
+ * (0 and 180 degrees) or columns (90 and 270 degrees) */
+static void RotatePlaneRows(const unsigned char *src, ptrdiff_t srcLinesize,
+			    unsigned char *dst, ptrdiff_t dstLinesize,
+			    int width, int height, int elementSize, int degrees,
+			    int begin, int end)
+{
+	int rows = end - begin;
+
+	switch (degrees) {
+	case 90:
+		src += begin * elementSize;
+		width = rows;
+		break;
+	case 180:
+		src += (height - end) * srcLinesize;
+		height = rows;
+		break;
+	case 270:
+		src += (width - end) * elementSize;
+		width = rows;
+		break;
+	default:
+		src += begin * srcLinesize;
+		height = rows;
+	}
+
+	RotatePlane(src, (int)srcLinesize, dst + begin * dstLinesize,
+		    (int)dstLinesize, width, height, elementSize, degrees);
+}
+
+static void RotatePacked(const unsigned char *src, ptrdiff_t srcLinesize,
+			 unsigned char *dst, ptrdiff_t dstLinesize, int width,
+			 int height, int degrees, bool chromaFirst, int begin,
+			 int end)
+{
+	int y0 = chromaFirst ? 1 : 0;
+
+	switch (degrees) {
+	case 90:
+	case 270:
+		RotatePlaneRows(src, srcLinesize, dst, dstLinesize, width,
+				height, 2, degrees, begin, end);
+		RecombinePackedChroma(dst + begin * dstLinesize, dstLinesize,
+				      height, end - begin, chromaFirst,
+				      degrees == 90);
+		break;
+
+	case 180:
+		/* macropixels in reverse order, with their two luma values
+		 * swapped */
+		for (int y = begin; y < end; y++) {
+			const unsigned char *s =
+				src + (height - 1 - y) * srcLinesize +
+				(width / 2 - 1) * 4;
+			unsigned char *d = dst + y * dstLinesize;
+
+			for (int x = 0; x < width / 2; x++) {
+				d[0] = s[0];
+				d[1] = s[1];
+				d[2] = s[2];
+				d[3] = s[3];
+				d[y0] = s[y0 + 2];
+				d[y0 + 2] = s[y0];
+				s -= 4;
+				d += 4;
+			}
+		}
+		break;
+
+	default:
+		CopyPlane(src + begin * srcLinesize, (int)srcLinesize,
+			  dst + begin * dstLinesize, (int)dstLinesize,
+			  width * 2, end - begin);
+	}
+}
+
+int NormalizeRotation(long degrees)
+{
+	long rotation = ((degrees % 360) + 360) % 360;
+	return (int)((rotation + 45) / 90 % 4 * 90);
+}
+
+bool CanRotateVideo(VideoFormat format, int width, int height, int degrees)
+{
+	if (degrees != 0 && degrees != 90 && degrees != 180 && degrees != 270)
+		return false;
+	if (width <= 0 || height <= 0)
+		return false;
+
+	switch (format) {
+	case VideoFormat::ARGB:
+	case VideoFormat::XRGB:
+	case VideoFormat::I420:
+	case VideoFormat::NV12:
+	case VideoFormat::YV12:
+	case VideoFormat::Y800:
+	case VideoFormat::I444:
+		return true;
+
+	case VideoFormat::YVYU:
+	case VideoFormat::YUY2:
+	case VideoFormat::UYVY:
+	case VideoFormat::HDYC:
+		return width % 2 == 0 && (degrees % 180 == 0 || height % 2 == 0);
+
+	default:
+		return false;
+	}
+}
+
+bool RotateVideo(VideoFormat format, const unsigned char *const src[3],
+		 const int srcLinesize[3], unsigned char *const dst[3],
+		 const int dstLinesize[3], int width, int height, int degrees)
+{
+	int rows = degrees == 90 || degrees == 270 ? width : height;
+	return RotateVideoSlice(format, src, srcLinesize, dst, dstLinesize,
+				width, height, degrees, 0, rows);
+}
+
+bool RotateVideoSlice(VideoFormat format, const unsigned char *const src[3],
+		      const int srcLinesize[3], unsigned char *const dst[3],
+		      const int dstLinesize[3], int width, int height,
+		      int degrees, int begin, int end)
+{
+	if (!CanRotateVideo(format, width, height, degrees))
+		return false;
+
+	bool sideways = degrees == 90 || degrees == 270;
+	int rows = sideways ? width : height;
+	int chromaWidth = (width + 1) / 2;
+	int chromaHeight = (height + 1) / 2;
+	int chromaRows = (rows + 1) / 2;
+	int chromaBegin = begin / 2;
+	int chromaEnd = end == rows ? chromaRows : end / 2;
+
+	switch (format) {
+	case VideoFormat::ARGB:
+	case VideoFormat::XRGB:
+		RotatePlaneRows(src[0], srcLinesize[0], dst[0], dstLinesize[0],
+				width, height, 4, degrees, begin, end);
+		break;
+
+	case VideoFormat::Y800:
+		RotatePlaneRows(src[0], srcLinesize[0], dst[0], dstLinesize[0],
+				width, height, 1, degrees, begin, end);
+		break;
+
+	case VideoFormat::I444:
+		for (int i = 0; i < 3; i++)
+			RotatePlaneRows(src[i], srcLinesize[i], dst[i],
+					dstLinesize[i], width, height, 1,
+					degrees, begin, end);
+		break;
+
+	case VideoFormat::I420:
+	case VideoFormat::YV12:
+		RotatePlaneRows(src[0], srcLinesize[0], dst[0], dstLinesize[0],
+				width, height, 1, degrees, begin, end);
+		for (int i = 1; i < 3; i++)
+			RotatePlaneRows(src[i], srcLinesize[i], dst[i],
+					dstLinesize[i], chromaWidth,
+					chromaHeight, 1, degrees, chromaBegin,
+					chromaEnd);
+		break;
+
+	case VideoFormat::NV12:
+		RotatePlaneRows(src[0], srcLinesize[0], dst[0], dstLinesize[0],
+				width, height, 1, degrees, begin, end);
+		RotatePlaneRows(src[1], srcLinesize[1], dst[1], dstLinesize[1],
+				chromaWidth, chromaHeight, 2, degrees,
+				chromaBegin, chromaEnd);
+		break;
+
+	default:
+		RotatePacked(src[0], srcLinesize[0], dst[0], dstLinesize[0],
+			     width, height, degrees,
+			     format == VideoFormat::UYVY ||
+				     format == VideoFormat::HDYC,
+			     begin, end);
+	}
+
+	return true;
+}
+
+}; /* namespace DShow */
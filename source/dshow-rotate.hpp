@@ -0,0 +1,63 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+
+namespace DShow {
+
+/** Converts a rotation in degrees to 0, 90, 180 or 270 */
+int NormalizeRotation(long degrees);
+
+/**
+ * Whether frames of this format and size can be rotated by the given
+ * amount (packed 4:2:2 can only be turned sideways with an even height).
+ */
+bool CanRotateVideo(VideoFormat format, int width, int height, int degrees);
+
+/**
+ * Rotates a plane of 1, 2 or 4 byte elements clockwise by 0, 90, 180 or 270
+ * degrees.  width and height are those of the source, in elements.
+ * Linesizes may be negative.
+ */
+void RotatePlane(const unsigned char *src, int srcLinesize, unsigned char *dst,
+		 int dstLinesize, int width, int height, int elementSize,
+		 int degrees);
+
+/**
+ * Rotates a whole frame clockwise.  width and height are those of the
+ * source; for 90 and 270 degrees the destination planes must be sized for
+ * the swapped dimensions.
+ */
+bool RotateVideo(VideoFormat format, const unsigned char *const src[3],
+		 const int srcLinesize[3], unsigned char *const dst[3],
+		 const int dstLinesize[3], int width, int height,
+		 int degrees);
+
+/**
+ * Rotates destination rows [begin, end) of a frame, so that a frame can be
+ * rotated in slices.  Slices have to be split on even rows.
+ */
+bool RotateVideoSlice(VideoFormat format, const unsigned char *const src[3],
+		      const int srcLinesize[3], unsigned char *const dst[3],
+		      const int dstLinesize[3], int width, int height,
+		      int degrees, int begin, int end);
+
+}; /* namespace DShow */
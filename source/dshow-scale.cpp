@@ -0,0 +1,723 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "dshow-scale.hpp"
+#include "dshow-convert.hpp"
+#include "dshow-simd.hpp"
+
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+namespace DShow {
+
+/* filter weights sum to 1 << SCALE_BITS.  the vertical pass keeps
+ * SCALE_EXTRA_BITS of fraction in the 16-bit row it hands to the horizontal
+ * pass, which leaves room for the overshoot of bicubic weights */
+#define SCALE_BITS 14
+#define SCALE_EXTRA_BITS 6
+#define VSHIFT (SCALE_BITS - SCALE_EXTRA_BITS)
+#define HSHIFT (SCALE_BITS + SCALE_EXTRA_BITS)
+
+static double Kernel(VideoScaling filter, double x)
+{
+	x = fabs(x);
+
+	if (filter == VideoScaling::Bilinear)
+		return x < 1.0 ? 1.0 - x : 0.0;
+
+	/* Catmull-Rom */
+	if (x < 1.0)
+		return (1.5 * x - 2.5) * x * x + 1.0;
+	if (x < 2.0)
+		return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+	return 0.0;
+}
+
+/* weights are spread over a source span that grows with the downscaling
+ * ratio, so that every source pixel contributes.  taps past either edge are
+ * folded on to the edge pixel */
+static void BuildFilter(VideoScaler::Filter &f, int srcSize, int dstSize,
+			VideoScaling filter, int align)
+{
+	double scale = (double)srcSize / (double)dstSize;
+	double stretch = std::max(scale, 1.0);
+	double radius = (filter == VideoScaling::Bicubic ? 2.0 : 1.0) * stretch;
+	std::vector<std::vector<double>> weights(dstSize);
+	int taps = 1;
+
+	f.start.resize(dstSize);
+
+	for (int x = 0; x < dstSize; x++) {
+		double left = x * scale;
+		double right = (x + 1) * scale;
+		double center = left + scale * 0.5 - 0.5;
+		int first, last;
+
+		if (filter == VideoScaling::Area) {
+			first = (int)floor(left);
+			last = (int)ceil(right) - 1;
+		} else {
+			first = (int)floor(center - radius) + 1;
+			last = (int)floor(center + radius);
+		}
+
+		int lo = std::min(std::max(first, 0), srcSize - 1);
+		int hi = std::min(std::max(last, 0), srcSize - 1);
+		std::vector<double> &w = weights[x];
+
+		w.assign(hi - lo + 1, 0.0);
+
+		for (int i = first; i <= last; i++) {
+			int pos = std::min(std::max(i, 0), srcSize - 1);
+			double weight;
+
+			if (filter == VideoScaling::Area)
+				weight = std::min(i + 1.0, right) -
+					 std::max((double)i, left);
+			else
+				weight = Kernel(filter, (i - center) / stretch);
+
+			w[pos - lo] += weight;
+		}
+
+		f.start[x] = lo;
+		taps = std::max(taps, hi - lo + 1);
+	}
+
+	f.taps = (taps + align - 1) / align * align;
+	f.coeffs.assign((size_t)dstSize * f.taps, 0);
+
+	for (int x = 0; x < dstSize; x++) {
+		const std::vector<double> &w = weights[x];
+		int16_t *c = &f.coeffs[(size_t)x * f.taps];
+		double total = 0.0;
+		int sum = 0;
+		size_t peak = 0;
+
+		for (double weight : w)
+			total += weight;
+		if (total <= 0.0) {
+			c[w.size() / 2] = 1 << SCALE_BITS;
+			continue;
+		}
+
+		/* rounding error goes to the largest weight so every output
+		 * sums to exactly one */
+		for (size_t i = 0; i < w.size(); i++) {
+			c[i] = (int16_t)lrint(w[i] / total * (1 << SCALE_BITS));
+			sum += c[i];
+			if (abs(c[i]) > abs(c[peak]))
+				peak = i;
+		}
+
+		c[peak] = (int16_t)(c[peak] + (1 << SCALE_BITS) - sum);
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+/* vertical pass: rows of 8-bit samples to a row of 16-bit samples          */
+
+typedef void (*VScaleFunc)(const unsigned char *const *rows,
+			   const int16_t *coeffs, int taps, int16_t *dst,
+			   int width);
+
+static inline int16_t ClampS16(int v)
+{
+	return (int16_t)std::min(std::max(v, -32768), 32767);
+}
+
+static inline unsigned char ClampU8(int v)
+{
+	return (unsigned char)std::min(std::max(v, 0), 255);
+}
+
+static inline int VRound(int sum)
+{
+	return (sum + (1 << (VSHIFT - 1))) >> VSHIFT;
+}
+
+static inline int HRound(int sum)
+{
+	return (sum + (1 << (HSHIFT - 1))) >> HSHIFT;
+}
+
+static void VScaleColumns(const unsigned char *const *rows,
+			  const int16_t *coeffs, int taps, int16_t *dst, int x,
+			  int width)
+{
+	for (; x < width; x++) {
+		int sum = 0;
+		for (int k = 0; k < taps; k++)
+			sum += coeffs[k] * rows[k][x];
+		dst[x] = ClampS16(VRound(sum));
+	}
+}
+
+static void VScaleScalar(const unsigned char *const *rows,
+			 const int16_t *coeffs, int taps, int16_t *dst,
+			 int width)
+{
+	VScaleColumns(rows, coeffs, taps, dst, 0, width);
+}
+
+/* ------------------------------------------------------------------------ */
+/* horizontal pass: a 16-bit row to 8-bit samples                           */
+
+typedef void (*HScaleFunc)(const int16_t *src, const VideoScaler::Filter &f,
+			   unsigned char *dst, int x, int width);
+
+static void HScaleStrided(const int16_t *src, const VideoScaler::Filter &f,
+			  int step, unsigned char *dst, int dstStep, int x,
+			  int width)
+{
+	for (; x < width; x++) {
+		const int16_t *c = &f.coeffs[(size_t)x * f.taps];
+		const int16_t *s = src + f.start[x] * step;
+		int sum = 0;
+
+		for (int k = 0; k < f.taps; k++)
+			sum += c[k] * s[k * step];
+
+		dst[x * dstStep] = ClampU8(HRound(sum));
+	}
+}
+
+template<int channels>
+static void HScaleScalar(const int16_t *src, const VideoScaler::Filter &f,
+			 unsigned char *dst, int x, int width)
+{
+	for (int i = 0; i < channels; i++)
+		HScaleStrided(src + i, f, channels, dst + i, channels, x,
+			      width);
+}
+
+#ifdef SIMD_X86
+
+SIMD_TARGET("sse2")
+static inline __m128i PairCoeffs(const int16_t *coeffs)
+{
+	return _mm_set1_epi32((int)((uint16_t)coeffs[0] |
+				    ((uint32_t)(uint16_t)coeffs[1] << 16)));
+}
+
+/* taps are taken in pairs: interleaving the samples of two rows lets one
+ * madd weight both of them and add them together */
+SIMD_TARGET("sse2")
+static int VScaleBlocksSSE2(const unsigned char *const *rows,
+			    const int16_t *coeffs, int taps, int16_t *dst,
+			    int x, int width)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi32(1 << (VSHIFT - 1));
+
+	for (; x + 16 <= width; x += 16) {
+		__m128i s0 = round, s1 = round, s2 = round, s3 = round;
+
+		for (int k = 0; k < taps; k += 2) {
+			__m128i c = PairCoeffs(coeffs + k);
+			__m128i a = _mm_loadu_si128(
+				(const __m128i *)(rows[k] + x));
+			__m128i b = _mm_loadu_si128(
+				(const __m128i *)(rows[k + 1] + x));
+			__m128i lo = _mm_unpacklo_epi8(a, b);
+			__m128i hi = _mm_unpackhi_epi8(a, b);
+
+			s0 = _mm_add_epi32(s0, _mm_madd_epi16(_mm_unpacklo_epi8(
+							       lo, zero),
+						       c));
+			s1 = _mm_add_epi32(s1, _mm_madd_epi16(_mm_unpackhi_epi8(
+							       lo, zero),
+						       c));
+			s2 = _mm_add_epi32(s2, _mm_madd_epi16(_mm_unpacklo_epi8(
+							       hi, zero),
+						       c));
+			s3 = _mm_add_epi32(s3, _mm_madd_epi16(_mm_unpackhi_epi8(
+							       hi, zero),
+						       c));
+		}
+
+		s0 = _mm_srai_epi32(s0, VSHIFT);
+		s1 = _mm_srai_epi32(s1, VSHIFT);
+		s2 = _mm_srai_epi32(s2, VSHIFT);
+		s3 = _mm_srai_epi32(s3, VSHIFT);
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_packs_epi32(s0, s1));
+		_mm_storeu_si128((__m128i *)(dst + x + 8),
+				 _mm_packs_epi32(s2, s3));
+	}
+
+	return x;
+}
+
+SIMD_TARGET("sse2")
+static void VScaleSSE2(const unsigned char *const *rows, const int16_t *coeffs,
+		       int taps, int16_t *dst, int width)
+{
+	int x = VScaleBlocksSSE2(rows, coeffs, taps, dst, 0, width);
+	VScaleColumns(rows, coeffs, taps, dst, x, width);
+}
+
+/* widening 16 samples at a time with cvtepu8 keeps them in order across the
+ * two lanes, so nothing needs permuting after packing */
+SIMD_TARGET("avx2")
+static void VScaleAVX2(const unsigned char *const *rows, const int16_t *coeffs,
+		       int taps, int16_t *dst, int width)
+{
+	const __m256i round = _mm256_set1_epi32(1 << (VSHIFT - 1));
+	int x = 0;
+
+	for (; x + 32 <= width; x += 32) {
+		__m256i s0 = round, s1 = round, s2 = round, s3 = round;
+
+		for (int k = 0; k < taps; k += 2) {
+			__m256i c = _mm256_broadcastsi128_si256(
+				PairCoeffs(coeffs + k));
+			__m256i a0 = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+				(const __m128i *)(rows[k] + x)));
+			__m256i b0 = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+				(const __m128i *)(rows[k + 1] + x)));
+			__m256i a1 = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+				(const __m128i *)(rows[k] + x + 16)));
+			__m256i b1 = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+				(const __m128i *)(rows[k + 1] + x + 16)));
+
+			s0 = _mm256_add_epi32(
+				s0, _mm256_madd_epi16(
+					    _mm256_unpacklo_epi16(a0, b0), c));
+			s1 = _mm256_add_epi32(
+				s1, _mm256_madd_epi16(
+					    _mm256_unpackhi_epi16(a0, b0), c));
+			s2 = _mm256_add_epi32(
+				s2, _mm256_madd_epi16(
+					    _mm256_unpacklo_epi16(a1, b1), c));
+			s3 = _mm256_add_epi32(
+				s3, _mm256_madd_epi16(
+					    _mm256_unpackhi_epi16(a1, b1), c));
+		}
+
+		s0 = _mm256_srai_epi32(s0, VSHIFT);
+		s1 = _mm256_srai_epi32(s1, VSHIFT);
+		s2 = _mm256_srai_epi32(s2, VSHIFT);
+		s3 = _mm256_srai_epi32(s3, VSHIFT);
+		_mm256_storeu_si256((__m256i *)(dst + x),
+				    _mm256_packs_epi32(s0, s1));
+		_mm256_storeu_si256((__m256i *)(dst + x + 16),
+				    _mm256_packs_epi32(s2, s3));
+	}
+
+	x = VScaleBlocksSSE2(rows, coeffs, taps, dst, x, width);
+	VScaleColumns(rows, coeffs, taps, dst, x, width);
+}
+
+/* rounds, shifts and saturates four sums per register down to bytes */
+SIMD_TARGET("sse2")
+static inline __m128i HPack(__m128i a, __m128i b)
+{
+	const __m128i round = _mm_set1_epi32(1 << (HSHIFT - 1));
+
+	a = _mm_srai_epi32(_mm_add_epi32(a, round), HSHIFT);
+	b = _mm_srai_epi32(_mm_add_epi32(b, round), HSHIFT);
+	__m128i s = _mm_packs_epi32(a, b);
+	return _mm_packus_epi16(s, s);
+}
+
+/* one channel: four outputs at a time, each one's partial sums reduced
+ * together at the end */
+SIMD_TARGET("sse2")
+static void HScale1SSE2(const int16_t *src, const VideoScaler::Filter &f,
+			unsigned char *dst, int x, int width)
+{
+	int taps = f.taps;
+
+	for (; x + 4 <= width; x += 4) {
+		__m128i acc[4];
+
+		for (int i = 0; i < 4; i++) {
+			const int16_t *c = &f.coeffs[(size_t)(x + i) * taps];
+			const int16_t *s = src + f.start[x + i];
+			__m128i sum = _mm_setzero_si128();
+			int k = 0;
+
+			for (; k + 8 <= taps; k += 8)
+				sum = _mm_add_epi32(
+					sum,
+					_mm_madd_epi16(
+						_mm_loadu_si128(
+							(const __m128i *)(s +
+									  k)),
+						_mm_loadu_si128(
+							(const __m128i *)(c +
+									  k))));
+			if (k < taps)
+				sum = _mm_add_epi32(
+					sum,
+					_mm_madd_epi16(
+						_mm_loadl_epi64(
+							(const __m128i *)(s +
+									  k)),
+						_mm_loadl_epi64(
+							(const __m128i *)(c +
+									  k))));
+			acc[i] = sum;
+		}
+
+		__m128i t0 = _mm_add_epi32(_mm_unpacklo_epi32(acc[0], acc[1]),
+					   _mm_unpackhi_epi32(acc[0], acc[1]));
+		__m128i t1 = _mm_add_epi32(_mm_unpacklo_epi32(acc[2], acc[3]),
+					   _mm_unpackhi_epi32(acc[2], acc[3]));
+		__m128i sums = _mm_add_epi32(_mm_unpacklo_epi64(t0, t1),
+					     _mm_unpackhi_epi64(t0, t1));
+		int out = _mm_cvtsi128_si32(HPack(sums, sums));
+		memcpy(dst + x, &out, 4);
+	}
+
+	HScaleScalar<1>(src, f, dst, x, width);
+}
+
+/* two channels (NV12 chroma): four taps of both at a time, shuffled so that
+ * neighbouring taps of each channel sit side by side for madd */
+SIMD_TARGET("sse2")
+static void HScale2SSE2(const int16_t *src, const VideoScaler::Filter &f,
+			unsigned char *dst, int x, int width)
+{
+	int taps = f.taps;
+
+	for (; x + 2 <= width; x += 2) {
+		__m128i acc[2];
+
+		for (int i = 0; i < 2; i++) {
+			const int16_t *c = &f.coeffs[(size_t)(x + i) * taps];
+			const int16_t *s = src + f.start[x + i] * 2;
+			__m128i sum = _mm_setzero_si128();
+
+			for (int k = 0; k < taps; k += 4) {
+				__m128i v = _mm_loadu_si128(
+					(const __m128i *)(s + k * 2));
+				__m128i w = _mm_loadl_epi64(
+					(const __m128i *)(c + k));
+
+				v = _mm_shufflelo_epi16(v,
+							_MM_SHUFFLE(3, 1, 2, 0));
+				v = _mm_shufflehi_epi16(v,
+							_MM_SHUFFLE(3, 1, 2, 0));
+				w = _mm_unpacklo_epi32(w, w);
+				sum = _mm_add_epi32(sum, _mm_madd_epi16(v, w));
+			}
+
+			acc[i] = _mm_add_epi32(sum, _mm_srli_si128(sum, 8));
+		}
+
+		__m128i sums = _mm_unpacklo_epi64(acc[0], acc[1]);
+		int out = _mm_cvtsi128_si32(HPack(sums, sums));
+		memcpy(dst + x * 2, &out, 4);
+	}
+
+	HScaleScalar<2>(src, f, dst, x, width);
+}
+
+/* four channels (RGB): two pixels at a time, interleaved per channel */
+SIMD_TARGET("sse2")
+static void HScale4SSE2(const int16_t *src, const VideoScaler::Filter &f,
+			unsigned char *dst, int x, int width)
+{
+	int taps = f.taps;
+
+	for (; x + 2 <= width; x += 2) {
+		__m128i acc[2];
+
+		for (int i = 0; i < 2; i++) {
+			const int16_t *c = &f.coeffs[(size_t)(x + i) * taps];
+			const int16_t *s = src + f.start[x + i] * 4;
+			__m128i sum = _mm_setzero_si128();
+
+			for (int k = 0; k < taps; k += 2) {
+				__m128i v = _mm_loadu_si128(
+					(const __m128i *)(s + k * 4));
+
+				v = _mm_unpacklo_epi16(v, _mm_srli_si128(v, 8));
+				sum = _mm_add_epi32(
+					sum,
+					_mm_madd_epi16(v, PairCoeffs(c + k)));
+			}
+
+			acc[i] = sum;
+		}
+
+		_mm_storel_epi64((__m128i *)(dst + x * 4),
+				 HPack(acc[0], acc[1]));
+	}
+
+	HScaleScalar<4>(src, f, dst, x, width);
+}
+
+#endif
+
+static ConvertPath GetScalePath()
+{
+	static const ConvertPath path = GetConvertPath();
+	return path;
+}
+
+static VScaleFunc GetVScaleFunc()
+{
+#ifdef SIMD_X86
+	switch (GetScalePath()) {
+	case ConvertPath::AVX2:
+		return VScaleAVX2;
+	case ConvertPath::SSE2:
+	case ConvertPath::SSSE3:
+		return VScaleSSE2;
+	default:
+		break;
+	}
+#endif
+
+	return VScaleScalar;
+}
+
+static HScaleFunc GetHScaleFunc(int channels)
+{
+#ifdef SIMD_X86
+	if (GetScalePath() != ConvertPath::Scalar) {
+		if (channels == 1)
+			return HScale1SSE2;
+		else if (channels == 2)
+			return HScale2SSE2;
+		else
+			return HScale4SSE2;
+	}
+#endif
+
+	if (channels == 1)
+		return HScaleScalar<1>;
+	else if (channels == 2)
+		return HScaleScalar<2>;
+	else
+		return HScaleScalar<4>;
+}
+
+/* ------------------------------------------------------------------------ */
+
+bool CanScaleVideo(VideoFormat format, int srcWidth, int srcHeight,
+		   int dstWidth, int dstHeight)
+{
+	if (srcWidth <= 0 || srcHeight <= 0 || dstWidth <= 0 || dstHeight <= 0)
+		return false;
+
+	switch (format) {
+	case VideoFormat::ARGB:
+	case VideoFormat::XRGB:
+	case VideoFormat::I420:
+	case VideoFormat::NV12:
+	case VideoFormat::YV12:
+	case VideoFormat::Y800:
+	case VideoFormat::I444:
+		return true;
+	case VideoFormat::YVYU:
+	case VideoFormat::YUY2:
+	case VideoFormat::UYVY:
+	case VideoFormat::HDYC:
+		return srcWidth % 2 == 0 && dstWidth % 2 == 0;
+	default:
+		return false;
+	}
+}
+
+/* horizontal filters are padded to a multiple of four taps for the SIMD
+ * paths, vertical ones to pairs of rows */
+#define HTAP_ALIGN 4
+#define VTAP_ALIGN 2
+
+void VideoScaler::AddPlane(int srcWidth, int srcHeight, int dstWidth,
+			   int dstHeight, int channels, int shiftY,
+			   VideoScaling filter)
+{
+	Plane &plane = planes[planeCount++];
+
+	plane.srcWidth = srcWidth;
+	plane.srcHeight = srcHeight;
+	plane.dstWidth = dstWidth;
+	plane.dstHeight = dstHeight;
+	plane.channels = channels;
+	plane.shiftY = shiftY;
+	BuildFilter(plane.h, srcWidth, dstWidth, filter, HTAP_ALIGN);
+	BuildFilter(plane.v, srcHeight, dstHeight, filter, VTAP_ALIGN);
+
+	/* horizontal taps may run past the end of the row with zero weights,
+	 * so the row is padded by a filter's worth of samples */
+	size_t size = (size_t)(srcWidth + plane.h.taps) * channels;
+	tempSize = std::max(tempSize, size);
+}
+
+void VideoScaler::Clear()
+{
+	for (Plane &plane : planes)
+		plane = Plane();
+
+	chroma = Filter();
+	planeCount = 0;
+	dstHeight = 0;
+	tempSize = 0;
+	packed = false;
+}
+
+bool VideoScaler::Reset(VideoFormat format, int srcWidth, int srcHeight,
+			int dstWidth, int dstHeight_, VideoScaling filter)
+{
+	Clear();
+
+	if (filter == VideoScaling::None ||
+	    !CanScaleVideo(format, srcWidth, srcHeight, dstWidth, dstHeight_))
+		return false;
+
+	int srcChromaWidth = (srcWidth + 1) / 2;
+	int srcChromaHeight = (srcHeight + 1) / 2;
+	int dstChromaWidth = (dstWidth + 1) / 2;
+	int dstChromaHeight = (dstHeight_ + 1) / 2;
+
+	dstHeight = dstHeight_;
+
+	switch (format) {
+	case VideoFormat::ARGB:
+	case VideoFormat::XRGB:
+		AddPlane(srcWidth, srcHeight, dstWidth, dstHeight, 4, 0,
+			 filter);
+		break;
+	case VideoFormat::Y800:
+		AddPlane(srcWidth, srcHeight, dstWidth, dstHeight, 1, 0,
+			 filter);
+		break;
+	case VideoFormat::I420:
+	case VideoFormat::YV12:
+		AddPlane(srcWidth, srcHeight, dstWidth, dstHeight, 1, 0,
+			 filter);
+		AddPlane(srcChromaWidth, srcChromaHeight, dstChromaWidth,
+			 dstChromaHeight, 1, 1, filter);
+		AddPlane(srcChromaWidth, srcChromaHeight, dstChromaWidth,
+			 dstChromaHeight, 1, 1, filter);
+		break;
+	case VideoFormat::NV12:
+		AddPlane(srcWidth, srcHeight, dstWidth, dstHeight, 1, 0,
+			 filter);
+		AddPlane(srcChromaWidth, srcChromaHeight, dstChromaWidth,
+			 dstChromaHeight, 2, 1, filter);
+		break;
+	case VideoFormat::I444:
+		for (int i = 0; i < 3; i++)
+			AddPlane(srcWidth, srcHeight, dstWidth, dstHeight, 1,
+				 0, filter);
+		break;
+	default:
+		/* packed 4:2:2: rows are filtered vertically as they are,
+		 * then luma and each chroma channel horizontally */
+		packed = true;
+		lumaOffset = format == VideoFormat::UYVY ||
+					     format == VideoFormat::HDYC
+				     ? 1
+				     : 0;
+		chromaOffset = 1 - lumaOffset;
+
+		AddPlane(srcWidth, srcHeight, dstWidth, dstHeight, 2, 0,
+			 filter);
+		BuildFilter(chroma, srcChromaWidth, dstChromaWidth, filter,
+			    HTAP_ALIGN);
+		tempSize = std::max(tempSize,
+				    (size_t)(srcChromaWidth + chroma.taps) * 4);
+		break;
+	}
+
+	return true;
+}
+
+int VideoScaler::SliceAlign() const
+{
+	for (int i = 0; i < planeCount; i++) {
+		if (planes[i].shiftY)
+			return 2;
+	}
+
+	return 1;
+}
+
+void VideoScaler::ScaleRow(const Plane &plane, const int16_t *temp,
+			   unsigned char *dst) const
+{
+	if (packed) {
+		HScaleStrided(temp + lumaOffset, plane.h, 2, dst + lumaOffset,
+			      2, 0, plane.dstWidth);
+		HScaleStrided(temp + chromaOffset, chroma, 4,
+			      dst + chromaOffset, 4, 0, plane.dstWidth / 2);
+		HScaleStrided(temp + chromaOffset + 2, chroma, 4,
+			      dst + chromaOffset + 2, 4, 0, plane.dstWidth / 2);
+		return;
+	}
+
+	static const HScaleFunc hscale[] = {
+		nullptr,
+		GetHScaleFunc(1),
+		GetHScaleFunc(2),
+		nullptr,
+		GetHScaleFunc(4),
+	};
+
+	hscale[plane.channels](temp, plane.h, dst, 0, plane.dstWidth);
+}
+
+void VideoScaler::ScaleSlice(const unsigned char *const src[3],
+			     const int srcLinesize[3],
+			     unsigned char *const dst[3],
+			     const int dstLinesize[3], int begin, int end) const
+{
+	static const VScaleFunc vscale = GetVScaleFunc();
+	std::vector<int16_t> temp(tempSize);
+	std::vector<const unsigned char *> rows;
+
+	end = std::min(end, dstHeight);
+
+	for (int i = 0; i < planeCount; i++) {
+		const Plane &plane = planes[i];
+		const Filter &v = plane.v;
+		int first = begin >> plane.shiftY;
+		int last = end == dstHeight ? plane.dstHeight
+					    : end >> plane.shiftY;
+
+		rows.resize(v.taps);
+
+		for (int y = first; y < last; y++) {
+			/* taps past the bottom edge have zero weights, but
+			 * still have to point at a real row */
+			for (int k = 0; k < v.taps; k++) {
+				int row = std::min(v.start[y] + k,
+						   plane.srcHeight - 1);
+				rows[k] = src[i] + (ptrdiff_t)row *
+							   srcLinesize[i];
+			}
+
+			vscale(rows.data(), &v.coeffs[(size_t)y * v.taps],
+			       v.taps, temp.data(),
+			       plane.srcWidth * plane.channels);
+			ScaleRow(plane, temp.data(),
+				 dst[i] + (ptrdiff_t)y * dstLinesize[i]);
+		}
+	}
+}
+
+}; /* namespace DShow */
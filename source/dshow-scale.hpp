@@ -0,0 +1,107 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+
+#include <stdint.h>
+#include <vector>
+
+namespace DShow {
+
+/**
+ * Whether frames of this format can be scaled between the given sizes.
+ * Planar YUV, NV12, RGB and packed 4:2:2 (with even widths) can be.
+ */
+bool CanScaleVideo(VideoFormat format, int srcWidth, int srcHeight,
+		   int dstWidth, int dstHeight);
+
+/**
+ * Separable scaler for uncompressed frames.  Filter weights are worked out
+ * once by Reset; each output row is then made by filtering source rows
+ * vertical first, in to a 16-bit row, and that row horizontally, all in
+ * fixed point.
+ */
+class VideoScaler {
+public:
+	struct Filter {
+		int taps = 0;
+		/* per output: the first input used, and taps 14-bit weights
+		 * that sum to one */
+		std::vector<int> start;
+		std::vector<int16_t> coeffs;
+	};
+
+private:
+	struct Plane {
+		int srcWidth = 0, srcHeight = 0;
+		int dstWidth = 0, dstHeight = 0;
+		int channels = 0;
+		int shiftY = 0;
+		Filter h;
+		Filter v;
+	};
+
+	Plane planes[3];
+	int planeCount = 0;
+	int dstHeight = 0;
+	size_t tempSize = 0;
+
+	/* packed 4:2:2 is filtered in place; luma and chroma only differ in
+	 * where their samples are and the horizontal filter */
+	bool packed = false;
+	int lumaOffset = 0;
+	int chromaOffset = 0;
+	Filter chroma;
+
+	void AddPlane(int srcWidth, int srcHeight, int dstWidth, int dstHeight,
+		      int channels, int shiftY, VideoScaling filter);
+	void ScaleRow(const Plane &plane, const int16_t *temp,
+		      unsigned char *dst) const;
+
+public:
+	bool Reset(VideoFormat format, int srcWidth, int srcHeight,
+		   int dstWidth, int dstHeight, VideoScaling filter);
+	void Clear();
+
+	inline bool Active() const { return planeCount != 0; }
+
+	/** Slices must start on multiples of this many rows */
+	int SliceAlign() const;
+
+	/**
+	 * Makes output rows [begin, end) of every plane (chroma rows in
+	 * proportion).  Slices don't share any state, so different slices of
+	 * a frame can be scaled at the same time.  Planes are given in memory
+	 * order and linesizes may be negative.
+	 */
+	void ScaleSlice(const unsigned char *const src[3],
+			const int srcLinesize[3], unsigned char *const dst[3],
+			const int dstLinesize[3], int begin, int end) const;
+
+	inline void Scale(const unsigned char *const src[3],
+			  const int srcLinesize[3], unsigned char *const dst[3],
+			  const int dstLinesize[3]) const
+	{
+		ScaleSlice(src, srcLinesize, dst, dstLinesize, 0, dstHeight);
+	}
+};
+
+}; /* namespace DShow */
@@ -89,13 +89,13 @@ bool Device::GetVideoConfig(VideoConfig &config) const
 	if (context->videoCapture == NULL)
 		return false;
 
-	config = context->videoConfig;
+	config = context->OutputVideoConfig();
 	return true;
 }
 
 bool Device::GetAudioConfig(AudioConfig &config) const
 {
-	if (context->audioCapture == NULL)
+	if (context->audioCapture == NULL && !context->demuxedAudio)
 		return false;
 
 	config = context->audioConfig;
@@ -113,13 +113,31 @@ bool Device::GetVideoDeviceId(DeviceId &id) const
 
 bool Device::GetAudioDeviceId(DeviceId &id) const
 {
-	if (context->audioCapture == NULL)
+	if (context->audioCapture == NULL && !context->demuxedAudio)
 		return false;
 
 	id = context->audioConfig;
 	return true;
 }
 
+bool Device::GetVideoStats(StreamStats &stats) const
+{
+	if (context->videoCapture == NULL)
+		return false;
+
+	context->GetStats(true, stats);
+	return true;
+}
+
+bool Device::GetAudioStats(StreamStats &stats) const
+{
+	if (context->audioCapture == NULL && !context->demuxedAudio)
+		return false;
+
+	context->GetStats(false, stats);
+	return true;
+}
+
 static void OpenPropertyPages(HWND hwnd, IUnknown *propertyObject)
 {
 	if (!propertyObject)
@@ -0,0 +1,179 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <string.h>
+
+namespace DShow {
+
+struct FrameBuffer {
+	virtual ~FrameBuffer() {}
+};
+
+class FramePool;
+
+/**
+ * Keeps a reference on a device sample for as long as a Frame points to its
+ * data.  Sample only needs AddRef/Release, so any COM-style object works.
+ */
+template<typename Sample> class SampleFrameBuffer : public FrameBuffer {
+	std::shared_ptr<FramePool> pool;
+	Sample *sample;
+
+public:
+	inline SampleFrameBuffer(const std::shared_ptr<FramePool> &pool_,
+				 Sample *sample_);
+	virtual ~SampleFrameBuffer();
+};
+
+/** Copy of frame data held in memory recycled through a FramePool. */
+class PooledFrameBuffer : public FrameBuffer {
+	std::shared_ptr<FramePool> pool;
+
+public:
+	std::vector<unsigned char> bytes;
+
+	inline PooledFrameBuffer(const std::shared_ptr<FramePool> &pool_,
+				 std::vector<unsigned char> &&bytes_)
+		: pool(pool_), bytes(std::move(bytes_))
+	{
+	}
+
+	virtual ~PooledFrameBuffer();
+};
+
+/**
+ * Creates frame handles for a stream.  Samples are referenced directly until
+ * maxOutstanding of them are held by frames, after which frame data is
+ * copied in to pooled buffers instead.
+ */
+class FramePool : public std::enable_shared_from_this<FramePool> {
+	friend class PooledFrameBuffer;
+	template<typename Sample> friend class SampleFrameBuffer;
+
+	std::mutex mutex;
+	std::vector<std::vector<unsigned char>> freeBuffers;
+	std::atomic<long> outstanding;
+	long maxOutstanding;
+
+	inline void Recycle(std::vector<unsigned char> &&bytes)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if ((long)freeBuffers.size() < maxOutstanding)
+			freeBuffers.push_back(std::move(bytes));
+	}
+
+public:
+	inline FramePool(long maxOutstanding_)
+		: outstanding(0),
+		  maxOutstanding(maxOutstanding_ > 0 ? maxOutstanding_ : 1)
+	{
+	}
+
+	inline long Outstanding() const { return outstanding; }
+
+	/** Whether Wrap() would reference a sample rather than copy it */
+	inline bool CanWrap() const { return outstanding < maxOutstanding; }
+
+	/**
+	 * Buffer from the pool, which keeps the capacity (and the stale
+	 * contents) it had.  For data that is gathered a piece at a time and
+	 * then handed to Adopt().
+	 */
+	inline std::vector<unsigned char> TakeBuffer()
+	{
+		std::vector<unsigned char> bytes;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!freeBuffers.empty()) {
+			bytes = std::move(freeBuffers.back());
+			freeBuffers.pop_back();
+		}
+
+		return bytes;
+	}
+
+	/** Frame that takes over a buffer, which is recycled in to the pool */
+	inline Frame Adopt(std::vector<unsigned char> &&bytes)
+	{
+		size_t size = bytes.size();
+
+		PooledFrameBuffer *buffer =
+			new PooledFrameBuffer(shared_from_this(),
+					      std::move(bytes));
+		std::shared_ptr<FrameBuffer> ptr(buffer);
+		return Frame(ptr, buffer->bytes.data(), size);
+	}
+
+	/** Frame backed by a pooled buffer, for data produced in place */
+	inline Frame Allocate(size_t size)
+	{
+		std::vector<unsigned char> bytes = TakeBuffer();
+		bytes.resize(size);
+		return Adopt(std::move(bytes));
+	}
+
+	inline Frame Copy(const unsigned char *data, size_t size)
+	{
+		Frame frame = Allocate(size);
+		memcpy(frame.Data(), data, size);
+		return frame;
+	}
+
+	template<typename Sample>
+	inline Frame Wrap(Sample *sample, unsigned char *data, size_t size)
+	{
+		if (!sample || !CanWrap())
+			return Copy(data, size);
+
+		std::shared_ptr<FrameBuffer> ptr(
+			new SampleFrameBuffer<Sample>(shared_from_this(),
+						      sample));
+		return Frame(ptr, data, size);
+	}
+};
+
+template<typename Sample>
+inline SampleFrameBuffer<Sample>::SampleFrameBuffer(
+	const std::shared_ptr<FramePool> &pool_, Sample *sample_)
+	: pool(pool_), sample(sample_)
+{
+	sample->AddRef();
+	pool->outstanding++;
+}
+
+template<typename Sample> SampleFrameBuffer<Sample>::~SampleFrameBuffer()
+{
+	sample->Release();
+	pool->outstanding--;
+}
+
+inline PooledFrameBuffer::~PooledFrameBuffer()
+{
+	pool->Recycle(std::move(bytes));
+}
+
+}; /* namespace DShow */
@@ -0,0 +1,99 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "gap-detector.hpp"
+
+namespace DShow {
+
+/* audio timestamps commonly wander by a few milliseconds */
+#define AUDIO_GAP_TOLERANCE 50000LL
+
+void GapDetector::ResetVideo(long long frameInterval_)
+{
+	frameInterval = frameInterval_;
+	sampleRate = 0;
+	blockAlign = 0;
+	hasLast = false;
+}
+
+void GapDetector::ResetAudio(int sampleRate_, int blockAlign_)
+{
+	frameInterval = 0;
+	sampleRate = sampleRate_;
+	blockAlign = blockAlign_;
+	hasLast = false;
+}
+
+bool GapDetector::Process(long long startTime, bool discontinuity,
+			  size_t size, StreamEvent &event)
+{
+	bool detected = false;
+	long long next = startTime;
+
+	if (sampleRate > 0 && blockAlign > 0)
+		next += (long long)(size / blockAlign) * 10000000LL /
+			sampleRate;
+	else
+		next += frameInterval;
+
+	event.timestamp = startTime;
+	event.gap = 0;
+	event.count = 0;
+
+	if (!hasLast) {
+		/* DirectShow flags the first sample after every start as a
+		 * discontinuity, there's nothing before it to compare with */
+	} else if (discontinuity || startTime < lastStart) {
+		event.type = StreamEventType::Discontinuity;
+		event.gap = startTime - expectedStart;
+		detected = true;
+
+	} else if (startTime == lastStart) {
+		event.type = StreamEventType::DuplicateTimestamp;
+		detected = true;
+
+	} else if (sampleRate > 0 && blockAlign > 0) {
+		long long gap = startTime - expectedStart;
+		if (gap > AUDIO_GAP_TOLERANCE) {
+			event.type = StreamEventType::DroppedFrames;
+			event.gap = gap;
+			event.count = gap * sampleRate / 10000000LL;
+			detected = true;
+		}
+
+	} else if (frameInterval > 0) {
+		long long gap = startTime - expectedStart;
+
+		/* anything past half a frame late is a lost frame */
+		long long frames = (gap + frameInterval / 2) / frameInterval;
+		if (frames > 0) {
+			event.type = StreamEventType::DroppedFrames;
+			event.gap = gap;
+			event.count = frames;
+			detected = true;
+		}
+	}
+
+	hasLast = true;
+	lastStart = startTime;
+	expectedStart = next;
+	return detected;
+}
+
+}; /* namespace DShow */
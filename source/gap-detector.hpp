@@ -0,0 +1,52 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+
+namespace DShow {
+
+/**
+ * Detects lost frames and discontinuities from consecutive sample
+ * timestamps.  Video is checked against the nominal frame interval, audio
+ * against the time covered by the previous buffer's sample count.
+ */
+class GapDetector {
+	long long frameInterval = 0;
+	int sampleRate = 0;
+	int blockAlign = 0;
+
+	bool hasLast = false;
+	long long lastStart = 0;
+	long long expectedStart = 0;
+
+public:
+	void ResetVideo(long long frameInterval);
+	void ResetAudio(int sampleRate, int blockAlign);
+
+	/**
+	 * Checks a sample against the previous one.  Returns true and fills
+	 * out the event if something was detected.
+	 */
+	bool Process(long long startTime, bool discontinuity, size_t size,
+		     StreamEvent &event);
+};
+
+}; /* namespace DShow */
@@ -0,0 +1,500 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "h264-parser.hpp"
+#include "dshow-simd.hpp"
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace DShow {
+
+/* ------------------------------------------------------------------------ */
+/* start codes                                                              */
+
+static inline int LowestBit(uint32_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, value);
+	return (int)index;
+#else
+	return __builtin_ctz(value);
+#endif
+}
+
+/* the third byte of a start code is 1, so wherever a byte is above 1, the
+ * next start code can't begin on it or on either byte before it */
+static size_t FindStartCodeScalar(const uint8_t *data, size_t size, size_t i)
+{
+	while (i + 3 <= size) {
+		uint8_t third = data[i + 2];
+
+		if (third > 1) {
+			i += 3;
+		} else if (third == 0) {
+			i++;
+		} else {
+			if (data[i] == 0 && data[i + 1] == 0)
+				return i;
+			i += 3;
+		}
+	}
+
+	return size;
+}
+
+#ifdef SIMD_X86
+
+SIMD_TARGET("sse2")
+static size_t FindStartCodeSSE2(const uint8_t *data, size_t size)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi8(1);
+	size_t i = 0;
+
+	for (; i + 18 <= size; i += 16) {
+		__m128i b0 = _mm_loadu_si128((const __m128i *)(data + i));
+		__m128i b1 = _mm_loadu_si128((const __m128i *)(data + i + 1));
+		__m128i b2 = _mm_loadu_si128((const __m128i *)(data + i + 2));
+
+		/* most blocks have no 01 byte at all */
+		__m128i third = _mm_cmpeq_epi8(b2, one);
+		if (!_mm_movemask_epi8(third))
+			continue;
+
+		__m128i match = _mm_and_si128(_mm_cmpeq_epi8(b0, zero),
+					      _mm_cmpeq_epi8(b1, zero));
+		int mask = _mm_movemask_epi8(_mm_and_si128(match, third));
+		if (mask)
+			return i + LowestBit((uint32_t)mask);
+	}
+
+	return FindStartCodeScalar(data, size, i);
+}
+
+SIMD_TARGET("avx2")
+static size_t FindStartCodeAVX2(const uint8_t *data, size_t size)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i one = _mm256_set1_epi8(1);
+	size_t i = 0;
+
+	for (; i + 34 <= size; i += 32) {
+		__m256i b0 = _mm256_loadu_si256((const __m256i *)(data + i));
+		__m256i b1 =
+			_mm256_loadu_si256((const __m256i *)(data + i + 1));
+		__m256i b2 =
+			_mm256_loadu_si256((const __m256i *)(data + i + 2));
+
+		__m256i third = _mm256_cmpeq_epi8(b2, one);
+		if (!_mm256_movemask_epi8(third))
+			continue;
+
+		__m256i match = _mm256_and_si256(_mm256_cmpeq_epi8(b0, zero),
+						 _mm256_cmpeq_epi8(b1, zero));
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+			_mm256_and_si256(match, third));
+		if (mask)
+			return i + LowestBit(mask);
+	}
+
+	return FindStartCodeScalar(data, size, i);
+}
+
+#elif defined(SIMD_NEON)
+
+static size_t FindStartCodeNEON(const uint8_t *data, size_t size)
+{
+	const uint8x16_t zero = vdupq_n_u8(0);
+	const uint8x16_t one = vdupq_n_u8(1);
+	size_t i = 0;
+
+	for (; i + 18 <= size; i += 16) {
+		uint8x16_t b0 = vld1q_u8(data + i);
+		uint8x16_t b1 = vld1q_u8(data + i + 1);
+		uint8x16_t b2 = vld1q_u8(data + i + 2);
+
+		uint8x16_t match = vandq_u8(vandq_u8(vceqq_u8(b0, zero),
+						     vceqq_u8(b1, zero)),
+					    vceqq_u8(b2, one));
+
+		/* four bits per byte */
+		uint8x8_t narrow =
+			vshrn_n_u16(vreinterpretq_u16_u8(match), 4);
+		uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(narrow), 0);
+		if (!mask)
+			continue;
+
+		for (int j = 0; j < 16; j++) {
+			if ((mask >> (j * 4)) & 0xF)
+				return i + j;
+		}
+	}
+
+	return FindStartCodeScalar(data, size, i);
+}
+
+#endif
+
+size_t FindStartCode(const unsigned char *data, size_t size)
+{
+	static const ConvertPath path = GetConvertPath();
+	return FindStartCode(data, size, path);
+}
+
+size_t FindStartCode(const unsigned char *data, size_t size,
+		     ConvertPath path)
+{
+	switch (path) {
+#ifdef SIMD_X86
+	case ConvertPath::SSE2:
+	case ConvertPath::SSSE3:
+		return FindStartCodeSSE2(data, size);
+	case ConvertPath::AVX2:
+		return FindStartCodeAVX2(data, size);
+#endif
+#ifdef SIMD_NEON
+	case ConvertPath::NEON:
+		return FindStartCodeNEON(data, size);
+#endif
+	default:
+		return FindStartCodeScalar(data, size, 0);
+	}
+}
+
+void SplitH264(const unsigned char *data, size_t size,
+	       std::vector<H264NAL> &nals)
+{
+	nals.clear();
+
+	size_t pos = FindStartCode(data, size);
+
+	while (pos < size) {
+		size_t start = pos + 3;
+		size_t next = start + FindStartCode(data + start, size - start);
+
+		size_t end = next;
+		while (end > start && data[end - 1] == 0)
+			end--;
+
+		if (end > start) {
+			H264NAL nal;
+			nal.data = data + start;
+			nal.size = end - start;
+			nal.type = data[start] & 0x1F;
+			nals.push_back(nal);
+		}
+
+		pos = next;
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+/* parameter sets                                                           */
+
+/* reads the RBSP of a NAL unit, skipping emulation prevention bytes as it
+ * goes.  Reading past the end gives zeros and sets overrun */
+class BitReader {
+	const uint8_t *data;
+	size_t size;
+	size_t pos = 0;
+	unsigned cache = 0;
+	int left = 0;
+	int zeros = 0;
+
+	inline void LoadByte()
+	{
+		if (pos >= size) {
+			overrun = true;
+			cache = 0;
+			left = 8;
+			return;
+		}
+
+		uint8_t byte = data[pos++];
+		if (zeros >= 2 && byte == 3 && pos < size) {
+			zeros = 0;
+			byte = data[pos++];
+		}
+
+		zeros = byte ? 0 : zeros + 1;
+		cache = byte;
+		left = 8;
+	}
+
+public:
+	bool overrun = false;
+
+	inline BitReader(const uint8_t *data_, size_t size_)
+		: data(data_), size(size_)
+	{
+	}
+
+	inline unsigned Bit()
+	{
+		if (!left)
+			LoadByte();
+		return (cache >> --left) & 1;
+	}
+
+	inline uint32_t Bits(int count)
+	{
+		uint32_t value = 0;
+		while (count--)
+			value = (value << 1) | Bit();
+		return value;
+	}
+
+	inline uint32_t UE()
+	{
+		int zeroBits = 0;
+		while (!Bit()) {
+			if (++zeroBits > 31) {
+				overrun = true;
+				return 0;
+			}
+		}
+
+		return (uint32_t)((1ULL << zeroBits) - 1 + Bits(zeroBits));
+	}
+
+	inline int32_t SE()
+	{
+		uint32_t value = UE();
+		return (value & 1) ? (int32_t)((value + 1) / 2)
+				   : -(int32_t)(value / 2);
+	}
+};
+
+static bool HasChromaInfo(int profile)
+{
+	switch (profile) {
+	case 44:
+	case 83:
+	case 86:
+	case 100:
+	case 110:
+	case 118:
+	case 122:
+	case 128:
+	case 134:
+	case 135:
+	case 138:
+	case 139:
+	case 244:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void SkipScalingList(BitReader &bits, int size)
+{
+	int last = 8;
+	int next = 8;
+
+	for (int i = 0; i < size && !bits.overrun; i++) {
+		if (next)
+			next = (last + bits.SE() + 256) % 256;
+		if (next)
+			last = next;
+	}
+}
+
+static void ParseVUITiming(BitReader &bits, H264SPS &sps)
+{
+	if (bits.Bit()) {
+		/* aspect_ratio_idc, Extended_SAR has the ratio after it */
+		if (bits.Bits(8) == 255)
+			bits.Bits(32);
+	}
+	if (bits.Bit()) /* overscan_info_present_flag */
+		bits.Bit();
+	if (bits.Bit()) { /* video_signal_type_present_flag */
+		bits.Bits(4);
+		if (bits.Bit())
+			bits.Bits(24);
+	}
+	if (bits.Bit()) { /* chroma_loc_info_present_flag */
+		bits.UE();
+		bits.UE();
+	}
+
+	if (bits.Bit()) { /* timing_info_present_flag */
+		uint32_t unitsInTick = bits.Bits(32);
+		uint32_t timeScale = bits.Bits(32);
+
+		/* a frame is two ticks */
+		if (unitsInTick && timeScale && !bits.overrun)
+			sps.frameInterval =
+				(long long)((20000000ULL * unitsInTick +
+					     timeScale / 2) /
+					    timeScale);
+	}
+}
+
+bool ParseH264SPS(const unsigned char *nal, size_t size, H264SPS &sps)
+{
+	if (size < 4 || (nal[0] & 0x1F) != H264_NAL_SPS)
+		return false;
+
+	BitReader bits(nal + 1, size - 1);
+	H264SPS out;
+
+	out.profile = (int)bits.Bits(8);
+	bits.Bits(8); /* constraint flags */
+	out.level = (int)bits.Bits(8);
+	if (bits.UE() > 31)
+		return false;
+
+	bool separatePlanes = false;
+
+	if (HasChromaInfo(out.profile)) {
+		out.chromaFormat = (int)bits.UE();
+		if (out.chromaFormat > 3)
+			return false;
+		if (out.chromaFormat == 3)
+			separatePlanes = !!bits.Bit();
+
+		bits.UE(); /* bit_depth_luma_minus8 */
+		bits.UE(); /* bit_depth_chroma_minus8 */
+		bits.Bit();
+
+		if (bits.Bit()) {
+			int lists = out.chromaFormat == 3 ? 12 : 8;
+			for (int i = 0; i < lists; i++) {
+				if (bits.Bit())
+					SkipScalingList(bits, i < 6 ? 16 : 64);
+			}
+		}
+	}
+
+	bits.UE(); /* log2_max_frame_num_minus4 */
+
+	uint32_t pocType = bits.UE();
+	if (pocType == 0) {
+		bits.UE();
+	} else if (pocType == 1) {
+		bits.Bit();
+		bits.SE();
+		bits.SE();
+
+		uint32_t cycle = bits.UE();
+		if (cycle > 255)
+			return false;
+		for (uint32_t i = 0; i < cycle; i++)
+			bits.SE();
+	} else if (pocType != 2) {
+		return false;
+	}
+
+	bits.UE(); /* max_num_ref_frames */
+	bits.Bit();
+
+	uint32_t widthInMbs = bits.UE() + 1;
+	uint32_t heightInMapUnits = bits.UE() + 1;
+	bool frameMbsOnly = !!bits.Bit();
+	bool mbaff = !frameMbsOnly && bits.Bit();
+	bits.Bit(); /* direct_8x8_inference_flag */
+
+	uint32_t crop[4] = {};
+	if (bits.Bit()) {
+		for (int i = 0; i < 4; i++)
+			crop[i] = bits.UE();
+	}
+
+	if (bits.Bit())
+		ParseVUITiming(bits, out);
+
+	if (bits.overrun || widthInMbs > 1024 || heightInMapUnits > 1024)
+		return false;
+
+	int chroma = separatePlanes ? 0 : out.chromaFormat;
+	int cropX = chroma == 1 || chroma == 2 ? 2 : 1;
+	int cropY = (chroma == 1 ? 2 : 1) * (frameMbsOnly ? 1 : 2);
+
+	long long width = widthInMbs * 16LL -
+			  cropX * ((long long)crop[0] + crop[1]);
+	long long height = heightInMapUnits * 16LL * (frameMbsOnly ? 1 : 2) -
+			   cropY * ((long long)crop[2] + crop[3]);
+	if (width <= 0 || height <= 0)
+		return false;
+
+	out.width = (int)width;
+	out.height = (int)height;
+	out.interlaced = !frameMbsOnly || mbaff;
+	sps = out;
+	return true;
+}
+
+int GetH264FirstMB(const unsigned char *nal, size_t size)
+{
+	int type = size ? nal[0] & 0x1F : 0;
+	if (type != H264_NAL_SLICE && type != H264_NAL_IDR)
+		return -1;
+
+	BitReader bits(nal + 1, size - 1);
+	uint32_t firstMB = bits.UE();
+	return bits.overrun || firstMB > 0xFFFFF ? -1 : (int)firstMB;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void H264Parser::Parse(const unsigned char *data, size_t size,
+		       PacketInfo &info)
+{
+	info = PacketInfo();
+	SplitH264(data, size, nals);
+
+	for (const H264NAL &nal : nals) {
+		if (nal.type == H264_NAL_IDR) {
+			info.keyframe = true;
+
+		} else if (nal.type == H264_NAL_SPS) {
+			/* usually repeated unchanged before every IDR */
+			if (hasSPS && nal.size == spsData.size() &&
+			    memcmp(nal.data, spsData.data(), nal.size) == 0)
+				continue;
+
+			H264SPS parsed;
+			if (!ParseH264SPS(nal.data, nal.size, parsed))
+				continue;
+
+			spsData.assign(nal.data, nal.data + nal.size);
+			sps = parsed;
+			hasSPS = true;
+			info.spsChanged = true;
+		}
+	}
+}
+
+void H264Parser::Reset()
+{
+	nals.clear();
+	spsData.clear();
+	sps = H264SPS();
+	hasSPS = false;
+}
+
+}; /* namespace DShow */
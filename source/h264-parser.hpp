@@ -0,0 +1,115 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+#include "dshow-convert.hpp"
+
+#include <vector>
+#include <stddef.h>
+
+namespace DShow {
+
+#define H264_NAL_SLICE 1
+#define H264_NAL_IDR 5
+#define H264_NAL_SEI 6
+#define H264_NAL_SPS 7
+#define H264_NAL_PPS 8
+#define H264_NAL_AUD 9
+
+/**
+ * Offset of the first 00 00 01 start code in data, or size if there is
+ * none.  Every path gives the same result as the scalar path.
+ */
+size_t FindStartCode(const unsigned char *data, size_t size);
+size_t FindStartCode(const unsigned char *data, size_t size,
+		     ConvertPath path);
+
+/** NAL unit inside an Annex-B buffer, starting with its header byte */
+struct H264NAL {
+	const unsigned char *data;
+	size_t size;
+	int type;
+};
+
+/**
+ * Splits an Annex-B buffer in to NAL units pointing in to data.  The zero
+ * bytes of four byte start codes (and any other trailing zeros) are left
+ * off the NAL unit before them.
+ */
+void SplitH264(const unsigned char *data, size_t size,
+	       std::vector<H264NAL> &nals);
+
+struct H264SPS {
+	int profile = 0;
+	int level = 0;
+	int chromaFormat = 1;
+
+	/** Displayed size, after cropping */
+	int width = 0;
+	int height = 0;
+
+	/** Fields are coded separately or as MBAFF frames */
+	bool interlaced = false;
+
+	/** From the VUI timing info (in 100-nanosecond units), or zero */
+	long long frameInterval = 0;
+};
+
+/** Parses a sequence parameter set NAL unit (header byte included) */
+bool ParseH264SPS(const unsigned char *nal, size_t size, H264SPS &sps);
+
+/**
+ * first_mb_in_slice of a slice NAL unit (header byte included), which is
+ * zero for the first slice of a picture.  -1 if it isn't a slice.
+ */
+int GetH264FirstMB(const unsigned char *nal, size_t size);
+
+/**
+ * Tracks the parameter sets of an H.264 stream one packet at a time.  The
+ * SPS is only parsed again when its bytes change.
+ */
+class H264Parser {
+	std::vector<H264NAL> nals;
+	std::vector<unsigned char> spsData;
+	H264SPS sps;
+	bool hasSPS = false;
+
+public:
+	struct PacketInfo {
+		/** The packet holds an IDR picture */
+		bool keyframe = false;
+
+		/** The packet carried an SPS that differs from the last one */
+		bool spsChanged = false;
+	};
+
+	/** Splits a packet, which must hold whole NAL units */
+	void Parse(const unsigned char *data, size_t size, PacketInfo &info);
+	void Reset();
+
+	inline bool HasSPS() const { return hasSPS; }
+	inline const H264SPS &SPS() const { return sps; }
+
+	/** NAL units of the last packet, pointing in to its data */
+	inline const std::vector<H264NAL> &NALs() const { return nals; }
+};
+
+}; /* namespace DShow */
@@ -0,0 +1,706 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "mjpeg-decoder.hpp"
+#include "dshow-convert.hpp"
+#include "dshow-simd.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef DSHOW_MJPEG_DECODE
+#include <setjmp.h>
+#include <stdio.h>
+#include <jpeglib.h>
+#endif
+
+namespace DShow {
+
+#define MAX_AUTO_DECODE_THREADS 4
+
+/* frames queued or being decoded per thread before new ones are dropped */
+#define PENDING_PER_THREAD 2
+
+/* ------------------------------------------------------------------------ */
+/* chroma rows.  Averages round up, like the packed YUV converters          */
+
+static void AverageRowsScalar(const uint8_t *a, const uint8_t *b,
+			      uint8_t *dst, int width)
+{
+	for (int x = 0; x < width; x++)
+		dst[x] = (uint8_t)((a[x] + b[x] + 1) >> 1);
+}
+
+static void InterleaveUVScalar(const uint8_t *u, const uint8_t *v,
+			       uint8_t *dst, int width)
+{
+	for (int x = 0; x < width; x++) {
+		dst[x * 2] = u[x];
+		dst[x * 2 + 1] = v[x];
+	}
+}
+
+#ifdef SIMD_X86
+
+SIMD_TARGET("sse2")
+static void AverageRowsSSE2(const uint8_t *a, const uint8_t *b, uint8_t *dst,
+			    int width)
+{
+	int x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + x));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + x));
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_avg_epu8(va, vb));
+	}
+
+	AverageRowsScalar(a + x, b + x, dst + x, width - x);
+}
+
+SIMD_TARGET("sse2")
+static void InterleaveUVSSE2(const uint8_t *u, const uint8_t *v, uint8_t *dst,
+			     int width)
+{
+	int x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		__m128i vu = _mm_loadu_si128((const __m128i *)(u + x));
+		__m128i vv = _mm_loadu_si128((const __m128i *)(v + x));
+		_mm_storeu_si128((__m128i *)(dst + x * 2),
+				 _mm_unpacklo_epi8(vu, vv));
+		_mm_storeu_si128((__m128i *)(dst + x * 2 + 16),
+				 _mm_unpackhi_epi8(vu, vv));
+	}
+
+	InterleaveUVScalar(u + x, v + x, dst + x * 2, width - x);
+}
+
+#define AverageRowsSIMD AverageRowsSSE2
+#define InterleaveUVSIMD InterleaveUVSSE2
+
+#elif defined(SIMD_NEON)
+
+static void AverageRowsNEON(const uint8_t *a, const uint8_t *b, uint8_t *dst,
+			    int width)
+{
+	int x = 0;
+
+	for (; x + 16 <= width; x += 16)
+		vst1q_u8(dst + x, vrhaddq_u8(vld1q_u8(a + x), vld1q_u8(b + x)));
+
+	AverageRowsScalar(a + x, b + x, dst + x, width - x);
+}
+
+static void InterleaveUVNEON(const uint8_t *u, const uint8_t *v, uint8_t *dst,
+			     int width)
+{
+	int x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		uint8x16x2_t uv;
+		uv.val[0] = vld1q_u8(u + x);
+		uv.val[1] = vld1q_u8(v + x);
+		vst2q_u8(dst + x * 2, uv);
+	}
+
+	InterleaveUVScalar(u + x, v + x, dst + x * 2, width - x);
+}
+
+#define AverageRowsSIMD AverageRowsNEON
+#define InterleaveUVSIMD InterleaveUVNEON
+
+#endif
+
+typedef void (*AverageRowsFunc)(const uint8_t *a, const uint8_t *b,
+				uint8_t *dst, int width);
+typedef void (*InterleaveUVFunc)(const uint8_t *u, const uint8_t *v,
+				 uint8_t *dst, int width);
+
+struct ChromaKernels {
+	AverageRowsFunc averageRows;
+	InterleaveUVFunc interleaveUV;
+
+	inline ChromaKernels()
+		: averageRows(AverageRowsScalar),
+		  interleaveUV(InterleaveUVScalar)
+	{
+#if defined(SIMD_X86) || defined(SIMD_NEON)
+		if (GetConvertPath() != ConvertPath::Scalar) {
+			averageRows = AverageRowsSIMD;
+			interleaveUV = InterleaveUVSIMD;
+		}
+#endif
+	}
+};
+
+static const ChromaKernels &GetChromaKernels()
+{
+	static ChromaKernels kernels;
+	return kernels;
+}
+
+/* 4:4:4 chroma is averaged over 2x2 blocks */
+static void AverageBlocks(const uint8_t *a, const uint8_t *b, uint8_t *dst,
+			  int width)
+{
+	for (int x = 0; x < width; x++)
+		dst[x] = (uint8_t)((a[x * 2] + a[x * 2 + 1] + b[x * 2] +
+				    b[x * 2 + 1] + 2) >>
+				   2);
+}
+
+/* ------------------------------------------------------------------------ */
+/* libjpeg                                                                  */
+
+#ifdef DSHOW_MJPEG_DECODE
+
+/* components come out of libjpeg in bands of up to 16 rows */
+#define MAX_BAND_ROWS (2 * DCTSIZE)
+
+struct ErrorManager {
+	jpeg_error_mgr pub;
+	jmp_buf jump;
+};
+
+static void ErrorExit(j_common_ptr cinfo)
+{
+	longjmp(((ErrorManager *)cinfo->err)->jump, 1);
+}
+
+/* corrupt frames are dropped without a word, warnings are ignored */
+static void OutputMessage(j_common_ptr) {}
+
+#if JPEG_LIB_VERSION >= 70
+#define DCT_H_SIZE(info) ((info).DCT_h_scaled_size)
+#define DCT_V_SIZE(info) ((info).DCT_v_scaled_size)
+#else
+#define DCT_H_SIZE(info) ((info).DCT_scaled_size)
+#define DCT_V_SIZE(info) ((info).DCT_scaled_size)
+#endif
+
+struct MJPEGDecoder::Context {
+	jpeg_decompress_struct cinfo;
+	ErrorManager error;
+
+	/* a band of each component at the width libjpeg pads them to, plus
+	 * a column for odd widths.  Full height chroma is read two bands at
+	 * a time if a band is a single row */
+	std::vector<uint8_t> band;
+	std::vector<uint8_t> chroma;
+	JSAMPROW rows[3][MAX_BAND_ROWS];
+
+	inline Context()
+	{
+		cinfo.err = jpeg_std_error(&error.pub);
+		error.pub.error_exit = ErrorExit;
+		error.pub.output_message = OutputMessage;
+		jpeg_create_decompress(&cinfo);
+	}
+
+	inline ~Context() { jpeg_destroy_decompress(&cinfo); }
+};
+
+/*
+ * How many luma samples there are to a chroma sample across and down, as
+ * decoded.  With DCT scaling this can differ from the sampling factors in
+ * the file, since libjpeg scales chroma up in the IDCT where it can.  Zero
+ * for grayscale.
+ */
+struct Sampling {
+	int h = 0;
+	int v = 0;
+	bool supported = false;
+};
+
+static int GetRatio(int luma, int chroma)
+{
+	if (chroma <= 0 || luma % chroma)
+		return 0;
+	int ratio = luma / chroma;
+	return ratio == 1 || ratio == 2 ? ratio : 0;
+}
+
+static Sampling GetSampling(const jpeg_decompress_struct &cinfo)
+{
+	Sampling sampling;
+
+	if (cinfo.num_components == 1) {
+		sampling.supported = true;
+		return sampling;
+	}
+	if (cinfo.num_components != 3 ||
+	    cinfo.jpeg_color_space != JCS_YCbCr)
+		return sampling;
+
+	const jpeg_component_info *c = cinfo.comp_info;
+	if (c[1].h_samp_factor != c[2].h_samp_factor ||
+	    c[1].v_samp_factor != c[2].v_samp_factor ||
+	    DCT_H_SIZE(c[1]) != DCT_H_SIZE(c[2]) ||
+	    DCT_V_SIZE(c[1]) != DCT_V_SIZE(c[2]))
+		return sampling;
+
+	sampling.h = GetRatio(c[0].h_samp_factor * DCT_H_SIZE(c[0]),
+			      c[1].h_samp_factor * DCT_H_SIZE(c[1]));
+	sampling.v = GetRatio(c[0].v_samp_factor * DCT_V_SIZE(c[0]),
+			      c[1].v_samp_factor * DCT_V_SIZE(c[1]));
+	sampling.supported = sampling.h && sampling.v;
+	return sampling;
+}
+
+/* writes count rows of output chroma starting at row from one band, which
+ * holds srcRows valid rows when chroma is full height */
+static void WriteChroma(MJPEGDecoder::Context &ctx, const Sampling &sampling,
+			VideoFormat format, uint8_t *const planes[3],
+			const int linesize[3], int row, int count, int width,
+			int srcRows)
+{
+	const ChromaKernels &k = GetChromaKernels();
+	uint8_t *temp = ctx.chroma.data();
+
+	for (int i = 0; i < count; i++) {
+		const uint8_t *u0, *u1, *v0, *v1;
+		const uint8_t *u;
+		const uint8_t *v;
+		uint8_t *tempU = temp;
+		uint8_t *tempV = temp + width;
+
+		if (sampling.v == 2) {
+			u0 = u1 = ctx.rows[1][i];
+			v0 = v1 = ctx.rows[2][i];
+		} else {
+			/* the second row of the last pair may be past the
+			 * bottom of the image */
+			int second = std::min(i * 2 + 1, srcRows - 1);
+			u0 = ctx.rows[1][i * 2];
+			u1 = ctx.rows[1][second];
+			v0 = ctx.rows[2][i * 2];
+			v1 = ctx.rows[2][second];
+		}
+
+		if (sampling.h == 2 && sampling.v == 2) {
+			u = u0;
+			v = v0;
+		} else if (sampling.h == 2) {
+			k.averageRows(u0, u1, tempU, width);
+			k.averageRows(v0, v1, tempV, width);
+			u = tempU;
+			v = tempV;
+		} else {
+			AverageBlocks(u0, u1, tempU, width);
+			AverageBlocks(v0, v1, tempV, width);
+			u = tempU;
+			v = tempV;
+		}
+
+		int y = row + i;
+		if (format == VideoFormat::NV12) {
+			k.interleaveUV(u, v, planes[1] + y * linesize[1],
+				       width);
+		} else {
+			memcpy(planes[1] + y * linesize[1], u, width);
+			memcpy(planes[2] + y * linesize[2], v, width);
+		}
+	}
+}
+
+/* only plain old data from here on, since errors longjmp out */
+static bool ReadFrame(MJPEGDecoder::Context &ctx, VideoFormat format,
+		      uint8_t *const planes[3], const int linesize[3])
+{
+	jpeg_decompress_struct &cinfo = ctx.cinfo;
+	Sampling sampling = GetSampling(cinfo);
+	if (!sampling.supported)
+		return false;
+
+	bool gray = !sampling.h;
+	int width = (int)cinfo.output_width;
+	int height = (int)cinfo.output_height;
+	int chromaWidth = (width + 1) / 2;
+	int chromaHeight = (height + 1) / 2;
+	int components = cinfo.num_components;
+
+	/* rows of each component libjpeg hands over per call */
+	int bandRows[3];
+	size_t bandStride[3];
+
+	for (int c = 0; c < components; c++) {
+		const jpeg_component_info &info = cinfo.comp_info[c];
+		bandRows[c] = info.v_samp_factor * DCT_V_SIZE(info);
+		bandStride[c] = info.width_in_blocks * DCT_H_SIZE(info) + 1;
+	}
+
+	int lumaRows = bandRows[0];
+	int reads = !gray && sampling.v == 1 && lumaRows == 1 ? 2 : 1;
+	size_t offset = 0;
+
+	for (int c = 0; c < components; c++)
+		offset += bandStride[c] * bandRows[c] * reads;
+
+	ctx.band.resize(offset);
+	ctx.chroma.resize(chromaWidth * 2);
+
+	offset = 0;
+	for (int c = 0; c < components; c++) {
+		for (int r = 0; r < bandRows[c] * reads; r++) {
+			ctx.rows[c][r] = ctx.band.data() + offset;
+			offset += bandStride[c];
+		}
+	}
+
+	if (gray) {
+		int chromaBytes = format == VideoFormat::NV12 ? chromaWidth * 2
+							      : chromaWidth;
+		for (int p = 1; p < (format == VideoFormat::NV12 ? 2 : 3); p++)
+			for (int y = 0; y < chromaHeight; y++)
+				memset(planes[p] + y * linesize[p], 128,
+				       chromaBytes);
+	}
+
+	while (cinfo.output_scanline < cinfo.output_height) {
+		int y = (int)cinfo.output_scanline;
+
+		for (int i = 0; i < reads; i++) {
+			if (cinfo.output_scanline >= cinfo.output_height)
+				break;
+
+			JSAMPARRAY data[3];
+			for (int c = 0; c < components; c++)
+				data[c] = ctx.rows[c] + i * bandRows[c];
+
+			if (jpeg_read_raw_data(&cinfo, data, lumaRows) == 0)
+				return false;
+		}
+
+		int rows = std::min(lumaRows * reads, height - y);
+		for (int r = 0; r < rows; r++)
+			memcpy(planes[0] + (y + r) * linesize[0],
+			       ctx.rows[0][r], width);
+
+		if (gray)
+			continue;
+
+		/* odd widths average the last column with itself, in the
+		 * column left after the padding */
+		if (sampling.h == 1 && (width & 1)) {
+			int srcRows = sampling.v == 2 ? (rows + 1) / 2 : rows;
+			for (int c = 1; c < 3; c++)
+				for (int r = 0; r < srcRows; r++)
+					ctx.rows[c][r][width] =
+						ctx.rows[c][r][width - 1];
+		}
+
+		int chromaY = y / 2;
+		int count = std::min(lumaRows * reads / 2,
+				     chromaHeight - chromaY);
+		WriteChroma(ctx, sampling, format, planes, linesize, chromaY,
+			    count, chromaWidth, rows);
+	}
+
+	return true;
+}
+
+MJPEGDecoder::Context *MJPEGDecoder::CreateContext()
+{
+	return new Context;
+}
+
+void MJPEGDecoder::DestroyContext(Context *context)
+{
+	delete context;
+}
+
+static bool DecodeToPlanes(MJPEGDecoder::Context &ctx,
+			   const unsigned char *data, size_t size,
+			   VideoFormat format, int width, int height,
+			   int scale, uint8_t *const planes[3],
+			   const int linesize[3])
+{
+	jpeg_decompress_struct &cinfo = ctx.cinfo;
+	int outputWidth = MJPEGDecoder::ScaledSize(width, scale);
+	int outputHeight = MJPEGDecoder::ScaledSize(height, scale);
+
+	if (setjmp(ctx.error.jump)) {
+		jpeg_abort_decompress(&cinfo);
+		return false;
+	}
+
+	jpeg_mem_src(&cinfo, (unsigned char *)data, (unsigned long)size);
+	if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+		jpeg_abort_decompress(&cinfo);
+		return false;
+	}
+
+	if ((int)cinfo.image_width != width ||
+	    (int)cinfo.image_height != height) {
+		jpeg_abort_decompress(&cinfo);
+		return false;
+	}
+
+	/* scaling happens in the IDCT, which then only computes as many
+	 * samples per block as the smaller size needs */
+	cinfo.scale_num = 1;
+	cinfo.scale_denom = (unsigned int)scale;
+	cinfo.raw_data_out = TRUE;
+	cinfo.do_fancy_upsampling = FALSE;
+	cinfo.dct_method = JDCT_ISLOW;
+	if (cinfo.num_components == 1)
+		cinfo.out_color_space = JCS_GRAYSCALE;
+
+	jpeg_start_decompress(&cinfo);
+
+	if ((int)cinfo.output_width != outputWidth ||
+	    (int)cinfo.output_height != outputHeight ||
+	    !ReadFrame(ctx, format, planes, linesize)) {
+		jpeg_abort_decompress(&cinfo);
+		return false;
+	}
+
+	/* anything after the image (such as padding) doesn't matter */
+	jpeg_abort_decompress(&cinfo);
+	return true;
+}
+
+#else
+
+struct MJPEGDecoder::Context {};
+
+MJPEGDecoder::Context *MJPEGDecoder::CreateContext()
+{
+	return nullptr;
+}
+
+void MJPEGDecoder::DestroyContext(Context *) {}
+
+#endif
+
+bool MJPEGDecoder::DecodeFrame(Context &context, const unsigned char *data,
+			       size_t size, VideoFormat format, int width,
+			       int height, int scale, Frame &frame,
+			       FramePool &pool)
+{
+#ifdef DSHOW_MJPEG_DECODE
+	if (!ValidScale(scale))
+		return false;
+
+	int linesize[3];
+	size_t offset[3];
+	size_t frameSize = GetVideoLayout(format, ScaledSize(width, scale),
+					  ScaledSize(height, scale), linesize,
+					  offset);
+	if (!frameSize)
+		return false;
+
+	frame = pool.Allocate(frameSize);
+
+	uint8_t *planes[3];
+	for (int i = 0; i < 3; i++) {
+		planes[i] = linesize[i] ? frame.Data() + offset[i] : nullptr;
+		frame.SetPlane(i, planes[i], linesize[i]);
+	}
+
+	return DecodeToPlanes(context, data, size, format, width, height,
+			      scale, planes, linesize);
+#else
+	(void)context;
+	(void)data;
+	(void)size;
+	(void)format;
+	(void)width;
+	(void)height;
+	(void)scale;
+	(void)frame;
+	(void)pool;
+	return false;
+#endif
+}
+
+/* ------------------------------------------------------------------------ */
+
+bool MJPEGDecoder::Reset(VideoFormat format_, int width_, int height_,
+			 int scale_, int threadCount,
+			 std::shared_ptr<FramePool> pool_,
+			 DeliverProc deliver_)
+{
+	Stop();
+
+#ifdef DSHOW_MJPEG_DECODE
+	if (format_ != VideoFormat::I420 && format_ != VideoFormat::NV12)
+		return false;
+	if (width_ <= 0 || height_ <= 0 || !ValidScale(scale_) || !pool_ ||
+	    !deliver_)
+		return false;
+
+	if (threadCount <= 0) {
+		threadCount = (int)std::thread::hardware_concurrency();
+		threadCount = std::max(1, std::min(threadCount,
+						   MAX_AUTO_DECODE_THREADS));
+	}
+
+	format = format_;
+	width = width_;
+	height = height_;
+	scale = scale_;
+	pool = std::move(pool_);
+	deliver = std::move(deliver_);
+	maxPending = (size_t)threadCount * PENDING_PER_THREAD;
+	stopping = false;
+
+	for (int i = 0; i < threadCount; i++)
+		threads.emplace_back(&MJPEGDecoder::Run, this);
+	return true;
+#else
+	(void)format_;
+	(void)width_;
+	(void)height_;
+	(void)scale_;
+	(void)threadCount;
+	(void)pool_;
+	(void)deliver_;
+
+	Warning(L"MJPEG decoding isn't available, the library was built "
+		L"without ENABLE_MJPEG_DECODE");
+	return false;
+#endif
+}
+
+void MJPEGDecoder::Stop()
+{
+	if (threads.empty())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+
+	/* threads finish the queue before they exit */
+	jobReady.notify_all();
+	for (std::thread &thread : threads)
+		thread.join();
+
+	threads.clear();
+	results.clear();
+	deliverSeq = submitSeq;
+	pool.reset();
+	deliver = nullptr;
+}
+
+void MJPEGDecoder::Flush()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	delivered.wait(lock, [this]() { return deliverSeq == submitSeq; });
+}
+
+bool MJPEGDecoder::Decode(const Frame &input, long long startTime,
+			  long long stopTime)
+{
+	if (threads.empty())
+		return false;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (submitSeq - deliverSeq >= maxPending)
+			return false;
+
+		Job job;
+		job.seq = submitSeq++;
+		job.input = input;
+		job.startTime = startTime;
+		job.stopTime = stopTime;
+		jobs.push_back(std::move(job));
+	}
+
+	jobReady.notify_one();
+	return true;
+}
+
+void MJPEGDecoder::Run()
+{
+	std::unique_ptr<Context, void (*)(Context *)> context(CreateContext(),
+							     DestroyContext);
+
+	for (;;) {
+		Job job;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobReady.wait(lock, [this]() {
+				return stopping || !jobs.empty();
+			});
+			if (jobs.empty())
+				break;
+
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		Result result;
+		result.startTime = job.startTime;
+		result.stopTime = job.stopTime;
+		result.success = context &&
+				 DecodeFrame(*context, job.input.Data(),
+					     job.input.Size(), format, width,
+					     height, scale, result.frame,
+					     *pool);
+
+		/* lets the device have its sample back before delivery */
+		job.input = Frame();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			results[job.seq] = std::move(result);
+		}
+
+		DeliverReady();
+	}
+}
+
+void MJPEGDecoder::DeliverReady()
+{
+	std::lock_guard<std::mutex> deliverLock(deliverMutex);
+
+	for (;;) {
+		Result result;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = results.find(deliverSeq);
+			if (it == results.end())
+				break;
+
+			result = std::move(it->second);
+			results.erase(it);
+		}
+
+		if (result.success)
+			deliver(result.frame, result.startTime,
+				result.stopTime);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			deliverSeq++;
+		}
+
+		delivered.notify_all();
+	}
+}
+
+}; /* namespace DShow */
@@ -0,0 +1,142 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+#include "frame-buffer.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace DShow {
+
+/**
+ * Decodes MJPEG to I420 or NV12 on threads of its own, several frames at a
+ * time, and hands them back in the order they arrived.  Delivery happens on
+ * whichever decoding thread finishes the next frame due, one frame at a
+ * time.  Needs the library built with ENABLE_MJPEG_DECODE.
+ */
+class MJPEGDecoder {
+public:
+	typedef std::function<void(const Frame &frame, long long startTime,
+				   long long stopTime)>
+		DeliverProc;
+
+	struct Context;
+
+private:
+	struct Job {
+		unsigned long long seq;
+		Frame input;
+		long long startTime;
+		long long stopTime;
+	};
+
+	struct Result {
+		Frame frame;
+		long long startTime;
+		long long stopTime;
+		bool success;
+	};
+
+	VideoFormat format = VideoFormat::Any;
+	int width = 0;
+	int height = 0;
+	int scale = 1;
+	std::shared_ptr<FramePool> pool;
+	DeliverProc deliver;
+
+	std::vector<std::thread> threads;
+	size_t maxPending = 0;
+
+	std::mutex mutex;
+	std::condition_variable jobReady;
+	std::condition_variable delivered;
+	std::deque<Job> jobs;
+	std::map<unsigned long long, Result> results;
+	unsigned long long submitSeq = 0;
+	unsigned long long deliverSeq = 0;
+	bool stopping = false;
+
+	/* held while frames are handed back, which keeps them in order */
+	std::mutex deliverMutex;
+
+	void Run();
+	void DeliverReady();
+
+public:
+	inline ~MJPEGDecoder() { Stop(); }
+
+	/** Frames can be decoded at 1/1, 1/2, 1/4 or 1/8 of their size */
+	static inline bool ValidScale(int scale)
+	{
+		return scale == 1 || scale == 2 || scale == 4 || scale == 8;
+	}
+
+	/** Size of a frame dimension decoded at 1/scale */
+	static inline int ScaledSize(int size, int scale)
+	{
+		return (size + scale - 1) / scale;
+	}
+
+	/**
+	 * Starts decoding threads for frames of the given size, which are
+	 * delivered at 1/scale of it.  threads of zero picks a count from
+	 * the CPU.
+	 */
+	bool Reset(VideoFormat format, int width, int height, int scale,
+		   int threads, std::shared_ptr<FramePool> pool,
+		   DeliverProc deliver);
+
+	/** Delivers everything still being decoded, then ends the threads */
+	void Stop();
+
+	/** Waits until everything submitted so far has been delivered */
+	void Flush();
+
+	inline bool Active() const { return !threads.empty(); }
+
+	/**
+	 * Queues a frame to be decoded.  If the decoders have fallen too far
+	 * behind, the frame is dropped and false is returned.
+	 */
+	bool Decode(const Frame &input, long long startTime,
+		    long long stopTime);
+
+	/**
+	 * Decodes a width x height frame on the calling thread, at 1/scale of
+	 * its size.
+	 */
+	static bool DecodeFrame(Context &context, const unsigned char *data,
+				size_t size, VideoFormat format, int width,
+				int height, int scale, Frame &frame,
+				FramePool &pool);
+
+	static Context *CreateContext();
+	static void DestroyContext(Context *context);
+};
+
+}; /* namespace DShow */
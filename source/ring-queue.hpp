@@ -0,0 +1,130 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <stddef.h>
+
+namespace DShow {
+
+/**
+ * Bounded lock-free queue (Dmitry Vyukov's sequenced ring).  Intended for a
+ * single producer and a single consumer, but Pop may also be called from the
+ * producer thread, which is how the oldest entry is dropped when the queue
+ * is full.
+ */
+template<typename T> class RingQueue {
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T data;
+	};
+
+	std::unique_ptr<Cell[]> cells;
+	size_t mask;
+	size_t depth;
+
+	/* keep the producer and consumer positions on separate cache lines */
+	char pad0[64];
+	std::atomic<size_t> enqueuePos;
+	char pad1[64];
+	std::atomic<size_t> dequeuePos;
+	char pad2[64];
+
+public:
+	inline RingQueue(size_t depth_) : depth(depth_ ? depth_ : 1)
+	{
+		/* one spare cell so the producer never writes to the cell a
+		 * concurrent Pop is still reading from */
+		size_t capacity = 1;
+		while (capacity < depth + 1)
+			capacity <<= 1;
+
+		cells.reset(new Cell[capacity]);
+		mask = capacity - 1;
+
+		for (size_t i = 0; i < capacity; i++)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+
+		enqueuePos.store(0, std::memory_order_relaxed);
+		dequeuePos.store(0, std::memory_order_relaxed);
+	}
+
+	inline size_t Depth() const { return depth; }
+
+	inline size_t Size() const
+	{
+		size_t head = enqueuePos.load();
+		size_t tail = dequeuePos.load();
+		return head - tail;
+	}
+
+	inline bool Empty() const { return Size() == 0; }
+
+	/* producer only */
+	inline bool Push(T &&value)
+	{
+		size_t pos = enqueuePos.load(std::memory_order_relaxed);
+		if (pos - dequeuePos.load() >= depth)
+			return false;
+
+		/* there is room, so the cell is only waiting on a Pop that
+		 * has claimed it to finish */
+		Cell &cell = cells[pos & mask];
+		while (cell.sequence.load(std::memory_order_acquire) != pos)
+			std::this_thread::yield();
+
+		cell.data = std::move(value);
+		cell.sequence.store(pos + 1, std::memory_order_release);
+		enqueuePos.store(pos + 1);
+		return true;
+	}
+
+	inline bool Pop(T &value)
+	{
+		size_t pos = dequeuePos.load(std::memory_order_relaxed);
+
+		for (;;) {
+			Cell &cell = cells[pos & mask];
+			size_t seq = cell.sequence.load(
+				std::memory_order_acquire);
+			ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)(pos + 1);
+
+			if (diff == 0) {
+				if (dequeuePos.compare_exchange_weak(pos,
+								     pos + 1))
+					break;
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = dequeuePos.load(
+					std::memory_order_relaxed);
+			}
+		}
+
+		Cell &cell = cells[pos & mask];
+		value = std::move(cell.data);
+		cell.sequence.store(pos + mask + 1, std::memory_order_release);
+		return true;
+	}
+};
+
+}; /* namespace DShow */
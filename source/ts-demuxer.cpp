@@ -0,0 +1,526 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include "ts-demuxer.hpp"
+
+#include <string.h>
+
+namespace DShow {
+
+#define TS_TIME_WRAP (1LL << 33)
+
+#define PES_HEADER_SIZE 9
+#define PES_FLAG_PTS 0x80
+#define PES_FLAG_DTS 0x40
+
+#define AF_DISCONTINUITY 0x80
+#define AF_RANDOM_ACCESS 0x40
+#define AF_PCR 0x10
+#define AF_OPCR 0x08
+#define AF_SPLICING 0x04
+#define AF_PRIVATE 0x02
+#define AF_EXTENSION 0x01
+
+static inline long long ReadTimestamp(const unsigned char *p)
+{
+	return ((long long)(p[0] & 0x0E) << 29) | ((long long)p[1] << 22) |
+	       ((long long)(p[2] >> 1) << 15) | ((long long)p[3] << 7) |
+	       (long long)(p[4] >> 1);
+}
+
+/* 33-bit timestamps wrap every 26.5 hours.  They are all unwrapped against
+ * the last one seen, whichever stream it came from, so audio and video
+ * stay on the same timeline */
+long long TSDemuxer::Unwrap(long long time)
+{
+	if (!hasTime) {
+		hasTime = true;
+		lastTime = time;
+		return time;
+	}
+
+	long long delta = (time - lastTime) & (TS_TIME_WRAP - 1);
+	if (delta >= TS_TIME_WRAP / 2)
+		delta -= TS_TIME_WRAP;
+
+	lastTime += delta;
+	return lastTime;
+}
+
+void TSDemuxer::SetStream(TSStream type, unsigned pid,
+			  const std::shared_ptr<FramePool> &pool)
+{
+	Stream &stream = streams[(int)type];
+
+	stream = Stream();
+	stream.pid = pid;
+	stream.pool = pool;
+}
+
+void TSDemuxer::Reset()
+{
+	for (Stream &stream : streams) {
+		stream.data.clear();
+		stream.started = false;
+		stream.counter = -1;
+		stream.duplicate = false;
+		stream.discontinuity = false;
+	}
+
+	pat.data.clear();
+	pat.started = false;
+	pmt.data.clear();
+	pmt.started = false;
+
+	carryBytes = 0;
+	synced = false;
+	hasTime = false;
+}
+
+void TSDemuxer::Flush()
+{
+	for (Stream &stream : streams) {
+		if (stream.started && !stream.expected)
+			Deliver(stream);
+		else if (stream.started)
+			DropPES(stream);
+	}
+}
+
+void TSDemuxer::Deliver(Stream &stream)
+{
+	TSPacket &packet = stream.packet;
+
+	stream.started = false;
+	if (stream.data.empty())
+		return;
+
+	packet.frame = stream.pool->Adopt(std::move(stream.data));
+	stream.data = std::vector<unsigned char>();
+
+	if (callback)
+		callback(Type(stream), packet);
+
+	packet.frame.Release();
+}
+
+void TSDemuxer::DropPES(Stream &stream)
+{
+	if (stream.started)
+		stats.droppedPES++;
+
+	stream.started = false;
+	stream.discontinuity = true;
+}
+
+bool TSDemuxer::StartPES(Stream &stream, const unsigned char *data,
+			 size_t size, bool padded)
+{
+	/* the header has to fit in the first transport packet, which it
+	 * always does for audio and video */
+	if (size < PES_HEADER_SIZE || data[0] != 0 || data[1] != 0 ||
+	    data[2] != 1 || (data[6] & 0xC0) != 0x80)
+		return false;
+
+	size_t length = ((size_t)data[4] << 8) | data[5];
+	size_t headerSize = PES_HEADER_SIZE + data[8];
+	int flags = data[7];
+
+	if (headerSize > size || (length && length + 6 < headerSize))
+		return false;
+
+	TSPacket &packet = stream.packet;
+	packet.hasPts = (flags & PES_FLAG_PTS) && data[8] >= 5;
+	packet.hasDts = packet.hasPts && (flags & PES_FLAG_DTS) &&
+			data[8] >= 10;
+	packet.pts = packet.hasPts
+			     ? TS_PTS_TO_TIME(Unwrap(ReadTimestamp(data + 9)))
+			     : 0;
+	packet.dts = packet.hasDts
+			     ? TS_PTS_TO_TIME(Unwrap(ReadTimestamp(data + 14)))
+			     : packet.pts;
+	packet.discontinuity = stream.discontinuity;
+	stream.discontinuity = false;
+
+	/* the buffer of a dropped packet is used again */
+	if (!stream.data.capacity())
+		stream.data = stream.pool->TakeBuffer();
+	stream.data.clear();
+
+	stream.expected = length ? length + 6 - headerSize : 0;
+	stream.started = true;
+
+	AddPayload(stream, data + headerSize, size - headerSize, padded);
+	return true;
+}
+
+void TSDemuxer::AddPayload(Stream &stream, const unsigned char *data,
+			   size_t size, bool padded)
+{
+	if (stream.expected) {
+		size_t left = stream.expected - stream.data.size();
+		if (size > left)
+			size = left;
+	}
+
+	size_t scanned = stream.data.size();
+	stream.data.insert(stream.data.end(), data, data + size);
+
+	if (stream.expected) {
+		if (stream.data.size() == stream.expected)
+			Deliver(stream);
+
+	} else if (size && payloadCallback &&
+		   payloadCallback(Type(stream), stream.packet,
+				   stream.data.data(), stream.data.size(),
+				   scanned, padded)) {
+		Deliver(stream);
+		Restart(stream);
+	}
+}
+
+/* whatever follows a packet that was ended early goes out untimed when the
+ * next one starts */
+void TSDemuxer::Restart(Stream &stream)
+{
+	TSPacket &packet = stream.packet;
+	packet.pts = 0;
+	packet.dts = 0;
+	packet.hasPts = false;
+	packet.hasDts = false;
+	packet.randomAccess = false;
+	packet.discontinuity = false;
+
+	if (!stream.data.capacity())
+		stream.data = stream.pool->TakeBuffer();
+	stream.data.clear();
+
+	stream.started = true;
+}
+
+void TSDemuxer::ParseAdaptation(const unsigned char *field, size_t size,
+				bool &discontinuity, bool &randomAccess,
+				bool &padded)
+{
+	/* an empty field is a single stuffing byte */
+	if (!size) {
+		padded = true;
+		return;
+	}
+
+	int flags = field[0];
+	discontinuity = (flags & AF_DISCONTINUITY) != 0;
+	randomAccess = (flags & AF_RANDOM_ACCESS) != 0;
+
+	if ((flags & AF_PCR) && size >= 7) {
+		long long base = ((long long)field[1] << 25) |
+				 ((long long)field[2] << 17) |
+				 ((long long)field[3] << 9) |
+				 ((long long)field[4] << 1) |
+				 (long long)(field[5] >> 7);
+		int extension = ((field[5] & 1) << 8) | field[6];
+
+		stats.pcr = TS_PCR_TO_TIME(Unwrap(base) * 300 + extension);
+		stats.pcrCount++;
+	}
+
+	/* stuffing after the optional fields pads out a payload that doesn't
+	 * fill the packet */
+	size_t used = 1;
+	if (flags & AF_PCR)
+		used += 6;
+	if (flags & AF_OPCR)
+		used += 6;
+	if (flags & AF_SPLICING)
+		used += 1;
+	if ((flags & AF_PRIVATE) && used < size)
+		used += 1 + field[used];
+	if ((flags & AF_EXTENSION) && used < size)
+		used += 1 + field[used];
+
+	padded = used < size;
+}
+
+/* sections can start part way in to a packet, after the end of the one
+ * before, and can go on over several packets */
+void TSDemuxer::ParseSection(Section &section, const unsigned char *data,
+			     size_t size, bool unitStart)
+{
+	if (unitStart) {
+		size_t pointer = data[0];
+
+		if (pointer >= size) {
+			section.started = false;
+			return;
+		}
+
+		if (section.started)
+			AddSection(section, data + 1, pointer);
+
+		data += 1 + pointer;
+		size -= 1 + pointer;
+
+		section.data.clear();
+		section.started = true;
+
+	} else if (!section.started) {
+		return;
+	}
+
+	AddSection(section, data, size);
+}
+
+void TSDemuxer::AddSection(Section &section, const unsigned char *data,
+			   size_t size)
+{
+	section.data.insert(section.data.end(), data, data + size);
+	if (section.data.size() < 3)
+		return;
+
+	size_t length =
+		3 + (((size_t)(section.data[1] & 0x0F) << 8) | section.data[2]);
+
+	if (length > TS_MAX_SECTION_SIZE) {
+		section.started = false;
+	} else if (section.data.size() >= length) {
+		section.started = false;
+		ProcessSection(section, length);
+	}
+}
+
+static inline bool SameStreams(const TSProgram &a, const TSProgram &b)
+{
+	return a.videoPID == b.videoPID &&
+	       a.videoStreamType == b.videoStreamType &&
+	       a.audioPID == b.audioPID &&
+	       a.audioStreamType == b.audioStreamType &&
+	       a.audioFormat == b.audioFormat;
+}
+
+/* tables are sent several times a second, so they're only parsed when they
+ * change */
+void TSDemuxer::ProcessSection(Section &section, size_t size)
+{
+	const unsigned char *data = section.data.data();
+
+	if (section.last.size() == size &&
+	    memcmp(section.last.data(), data, size) == 0)
+		return;
+
+	TSProgram found = program;
+
+	if (&section == &pat) {
+		if (!ParseTSPAT(data, size, found))
+			return;
+
+		if (found.pmtPID != program.pmtPID) {
+			pmt.data.clear();
+			pmt.last.clear();
+			pmt.started = false;
+		}
+
+		program.programNumber = found.programNumber;
+		program.pmtPID = found.pmtPID;
+
+	} else {
+		if (!ParseTSPMT(data, size, found))
+			return;
+
+		bool changed = !hasProgram || !SameStreams(found, program);
+
+		program = found;
+		hasProgram = true;
+
+		if (changed) {
+			if (found.videoPID != TS_NULL_PID)
+				MoveStream(streams[(int)TSStream::Video],
+					   found.videoPID);
+			if (found.audioPID != TS_NULL_PID)
+				MoveStream(streams[(int)TSStream::Audio],
+					   found.audioPID);
+
+			if (programCallback)
+				programCallback(program);
+		}
+	}
+
+	section.last.assign(data, data + size);
+}
+
+void TSDemuxer::MoveStream(Stream &stream, unsigned pid)
+{
+	if (stream.pid == pid)
+		return;
+
+	stream.pid = pid;
+	stream.data.clear();
+	stream.started = false;
+	stream.counter = -1;
+	stream.duplicate = false;
+	stream.discontinuity = true;
+}
+
+void TSDemuxer::ParsePacket(const unsigned char *packet)
+{
+	bool error = (packet[1] & 0x80) != 0;
+	bool unitStart = (packet[1] & 0x40) != 0;
+	unsigned pid = ((unsigned)(packet[1] & 0x1F) << 8) | packet[2];
+	int control = (packet[3] >> 4) & 3;
+	int counter = packet[3] & 0xF;
+	size_t offset = 4;
+
+	stats.packets++;
+	synced = true;
+
+	if (pid == TS_NULL_PID)
+		return;
+
+	Stream *stream = nullptr;
+	for (Stream &cur : streams) {
+		if (cur.pid == pid && cur.pool)
+			stream = &cur;
+	}
+
+	if (error) {
+		if (stream)
+			DropPES(*stream);
+		return;
+	}
+
+	bool discontinuity = false;
+	bool randomAccess = false;
+	bool padded = false;
+
+	if (control & 2) {
+		size_t length = packet[4];
+		if (length > TS_PACKET_SIZE - 5)
+			return;
+
+		ParseAdaptation(packet + 5, length, discontinuity,
+				randomAccess, padded);
+		offset = 5 + length;
+	}
+
+	if (pid == TS_PAT_PID || pid == program.pmtPID) {
+		if ((control & 1) && offset < TS_PACKET_SIZE)
+			ParseSection(pid == TS_PAT_PID ? pat : pmt,
+				     packet + offset, TS_PACKET_SIZE - offset,
+				     unitStart);
+		return;
+	}
+
+	/* the counter only goes up on packets with a payload */
+	if (!stream || !(control & 1))
+		return;
+
+	if (stream->counter >= 0 && !discontinuity) {
+		if (counter == stream->counter && !stream->duplicate) {
+			stream->duplicate = true;
+			return;
+		}
+
+		if (counter != ((stream->counter + 1) & 0xF)) {
+			stats.continuityErrors++;
+			DropPES(*stream);
+		}
+	}
+
+	stream->counter = counter;
+	stream->duplicate = false;
+
+	if (discontinuity)
+		stream->discontinuity = true;
+
+	const unsigned char *data = packet + offset;
+	size_t size = TS_PACKET_SIZE - offset;
+
+	if (unitStart) {
+		if (stream->started && !stream->expected)
+			Deliver(*stream);
+		else if (stream->started)
+			DropPES(*stream);
+
+		stream->packet.randomAccess = randomAccess;
+
+		if (!StartPES(*stream, data, size, padded))
+			DropPES(*stream);
+
+	} else if (stream->started) {
+		AddPayload(*stream, data, size, padded);
+	}
+}
+
+/* skips to the next sync byte that is followed by another one a packet
+ * later, if the data goes that far */
+size_t TSDemuxer::Resync(const unsigned char *data, size_t size)
+{
+	if (synced)
+		stats.syncLosses++;
+	synced = false;
+
+	for (size_t i = 1; i < size; i++) {
+		if (data[i] != TS_SYNC_BYTE)
+			continue;
+		if (i + TS_PACKET_SIZE >= size ||
+		    data[i + TS_PACKET_SIZE] == TS_SYNC_BYTE)
+			return i;
+	}
+
+	return size;
+}
+
+void TSDemuxer::Input(const unsigned char *data, size_t size)
+{
+	if (carryBytes) {
+		size_t needed = TS_PACKET_SIZE - carryBytes;
+
+		if (size < needed) {
+			memcpy(carry + carryBytes, data, size);
+			carryBytes += size;
+			return;
+		}
+
+		memcpy(carry + carryBytes, data, needed);
+		data += needed;
+		size -= needed;
+		carryBytes = 0;
+
+		ParsePacket(carry);
+	}
+
+	while (size) {
+		if (data[0] != TS_SYNC_BYTE) {
+			size_t skip = Resync(data, size);
+			data += skip;
+			size -= skip;
+			continue;
+		}
+
+		if (size < TS_PACKET_SIZE) {
+			memcpy(carry, data, size);
+			carryBytes = size;
+			break;
+		}
+
+		ParsePacket(data);
+		data += TS_PACKET_SIZE;
+		size -= TS_PACKET_SIZE;
+	}
+}
+
+}; /* namespace DShow */
@@ -0,0 +1,221 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#pragma once
+
+#include "../dshowcapture.hpp"
+#include "frame-buffer.hpp"
+#include "ts-psi.hpp"
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <stddef.h>
+
+namespace DShow {
+
+#define TS_PACKET_SIZE 188
+#define TS_SYNC_BYTE 0x47
+
+/* 90 kHz PES timestamps and the 27 MHz PCR, in 100-nanosecond units */
+#define TS_PTS_TO_TIME(pts) ((pts)*1000LL / 9LL)
+#define TS_PCR_TO_TIME(pcr) ((pcr)*10LL / 27LL)
+
+enum class TSStream {
+	Video,
+	Audio,
+};
+
+/** One PES packet's payload, reassembled from transport stream packets */
+struct TSPacket {
+	Frame frame;
+
+	/** Unwrapped from 33 bits, in 100-nanosecond units */
+	long long pts = 0;
+	long long dts = 0;
+	bool hasPts = false;
+	bool hasDts = false;
+
+	/** The adaptation field flagged a random access point */
+	bool randomAccess = false;
+
+	/**
+	 * Packets were lost before this one (a continuity counter error), or
+	 * the stream flagged a discontinuity in its timestamps
+	 */
+	bool discontinuity = false;
+};
+
+typedef std::function<void(TSStream stream, const TSPacket &packet)>
+	TSPacketProc;
+typedef std::function<void(const TSProgram &program)> TSProgramProc;
+
+/**
+ * Sees an unbounded PES packet's payload as it arrives: all of it so far,
+ * of which the first scanned bytes were seen before, and whether the last
+ * transport packet was padded out, as muxers do at the end of a PES
+ * packet.  Returning true delivers the packet there and then.
+ */
+typedef std::function<bool(TSStream stream, const TSPacket &packet,
+			   const unsigned char *data, size_t size,
+			   size_t scanned, bool padded)>
+	TSPayloadProc;
+
+struct TSStats {
+	unsigned long long packets = 0;
+
+	/** Times the stream lost sync and bytes were skipped to find it */
+	unsigned long long syncLosses = 0;
+	unsigned long long continuityErrors = 0;
+
+	/** PES packets thrown away because some of their data was lost */
+	unsigned long long droppedPES = 0;
+
+	unsigned long long pcrCount = 0;
+
+	/** Last program clock reference, unwrapped, in 100-ns units */
+	long long pcr = 0;
+};
+
+/**
+ * Demultiplexes an MPEG-2 transport stream fed in chunks of any size.  The
+ * payload of each PES packet is copied once, straight from the transport
+ * packets in to a buffer taken from the stream's pool, and delivered as a
+ * frame as soon as it is complete: when its PES_packet_length is reached,
+ * or when the next one starts if it is unbounded.  The payload callback can
+ * end an unbounded packet sooner, and anything that follows it is
+ * delivered without a timestamp.
+ *
+ * Continuity counters are checked per PID.  One duplicate packet is
+ * skipped, and any other gap throws away the PES packet it falls in.
+ *
+ * The PIDs streams are set up with are only a hint.  Once the PAT and PMT
+ * come by, the streams are moved to the first H.264 and the first known
+ * audio stream of the program.
+ */
+class TSDemuxer {
+	struct Stream {
+		unsigned pid = TS_NULL_PID;
+		std::shared_ptr<FramePool> pool;
+
+		std::vector<unsigned char> data;
+		TSPacket packet;
+		size_t expected = 0;
+		bool started = false;
+
+		int counter = -1;
+		bool duplicate = false;
+		bool discontinuity = false;
+	};
+
+	struct Section {
+		std::vector<unsigned char> data;
+		std::vector<unsigned char> last;
+		bool started = false;
+	};
+
+	Stream streams[2];
+	TSPacketProc callback;
+	TSPayloadProc payloadCallback;
+	TSStats stats;
+
+	Section pat;
+	Section pmt;
+	TSProgram program;
+	bool hasProgram = false;
+	TSProgramProc programCallback;
+
+	unsigned char carry[TS_PACKET_SIZE];
+	size_t carryBytes = 0;
+	bool synced = false;
+
+	bool hasTime = false;
+	long long lastTime = 0;
+
+	inline TSStream Type(const Stream &stream) const
+	{
+		return &stream == &streams[(int)TSStream::Video]
+			       ? TSStream::Video
+			       : TSStream::Audio;
+	}
+
+	long long Unwrap(long long time);
+	void ParseAdaptation(const unsigned char *field, size_t size,
+			     bool &discontinuity, bool &randomAccess,
+			     bool &padded);
+	bool StartPES(Stream &stream, const unsigned char *data, size_t size,
+		      bool padded);
+	void AddPayload(Stream &stream, const unsigned char *data,
+			size_t size, bool padded);
+	void Restart(Stream &stream);
+	void Deliver(Stream &stream);
+	void DropPES(Stream &stream);
+	void ParseSection(Section &section, const unsigned char *data,
+			  size_t size, bool unitStart);
+	void AddSection(Section &section, const unsigned char *data,
+			size_t size);
+	void ProcessSection(Section &section, size_t size);
+	void MoveStream(Stream &stream, unsigned pid);
+	void ParsePacket(const unsigned char *packet);
+	size_t Resync(const unsigned char *data, size_t size);
+
+public:
+	inline void SetCallback(const TSPacketProc &callback_)
+	{
+		callback = callback_;
+	}
+
+	inline void SetPayloadCallback(const TSPayloadProc &callback_)
+	{
+		payloadCallback = callback_;
+	}
+
+	/**
+	 * Called from Input() when a PMT moves the streams to other PIDs or
+	 * codecs, after they have been moved
+	 */
+	inline void SetProgramCallback(const TSProgramProc &callback_)
+	{
+		programCallback = callback_;
+	}
+
+	/**
+	 * Delivers the stream's PES packets on the given PID, in to frames
+	 * from pool.  A stream without a pool is skipped.
+	 */
+	void SetStream(TSStream type, unsigned pid,
+		       const std::shared_ptr<FramePool> &pool);
+
+	/**
+	 * Drops partial packets and loses sync, keeping the stream setup and
+	 * the program found so far
+	 */
+	void Reset();
+
+	/** Delivers the unbounded PES packets that are still open */
+	void Flush();
+
+	void Input(const unsigned char *data, size_t size);
+
+	inline const TSStats &Stats() const { return stats; }
+
+	inline bool HasProgram() const { return hasProgram; }
+	inline const TSProgram &Program() const { return program; }
+};
+
+}; /* namespace DShow */
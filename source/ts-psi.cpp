@@ -0,0 +1,202 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include "ts-psi.hpp"
+
+#include <string.h>
+
+namespace DShow {
+
+#define TS_TABLE_PAT 0x00
+#define TS_TABLE_PMT 0x02
+
+/* table_id through last_section_number, and the CRC */
+#define TS_SECTION_HEADER_SIZE 8
+#define TS_SECTION_CRC_SIZE 4
+
+#define TS_DESCRIPTOR_REGISTRATION 0x05
+#define TS_DESCRIPTOR_AC3 0x6A
+#define TS_DESCRIPTOR_EAC3 0x7A
+
+uint32_t GetTSSectionCRC(const unsigned char *data, size_t size)
+{
+	uint32_t crc = 0xFFFFFFFF;
+
+	for (size_t i = 0; i < size; i++) {
+		crc ^= (uint32_t)data[i] << 24;
+
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7
+						 : crc << 1;
+	}
+
+	return crc;
+}
+
+/* checks the header of a long-form section and returns its length */
+static size_t CheckSection(const unsigned char *section, size_t size,
+			   int tableID)
+{
+	if (size < TS_SECTION_HEADER_SIZE + TS_SECTION_CRC_SIZE)
+		return 0;
+	if (section[0] != tableID || !(section[1] & 0x80))
+		return 0;
+
+	size_t length = 3 + (((size_t)(section[1] & 0x0F) << 8) | section[2]);
+	if (length > size || length > TS_MAX_SECTION_SIZE ||
+	    length < TS_SECTION_HEADER_SIZE + TS_SECTION_CRC_SIZE)
+		return 0;
+
+	/* current_next_indicator: sections that aren't in use yet are
+	 * skipped */
+	if (!(section[5] & 0x01))
+		return 0;
+
+	return GetTSSectionCRC(section, length) == 0 ? length : 0;
+}
+
+bool ParseTSPAT(const unsigned char *section, size_t size,
+		TSProgram &program)
+{
+	size_t length = CheckSection(section, size, TS_TABLE_PAT);
+	if (!length)
+		return false;
+
+	size_t end = length - TS_SECTION_CRC_SIZE;
+
+	for (size_t pos = TS_SECTION_HEADER_SIZE; pos + 4 <= end; pos += 4) {
+		unsigned number = ((unsigned)section[pos] << 8) |
+				  section[pos + 1];
+		unsigned pid = ((unsigned)(section[pos + 2] & 0x1F) << 8) |
+			       section[pos + 3];
+
+		/* program zero points to the network information table */
+		if (number) {
+			program.programNumber = number;
+			program.pmtPID = pid;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* private PES streams are told apart by their descriptors */
+static bool IsAC3Private(const unsigned char *desc, size_t size)
+{
+	size_t pos = 0;
+
+	while (pos + 2 <= size) {
+		int tag = desc[pos];
+		size_t length = desc[pos + 1];
+
+		if (pos + 2 + length > size)
+			break;
+
+		if (tag == TS_DESCRIPTOR_AC3 || tag == TS_DESCRIPTOR_EAC3)
+			return true;
+
+		if (tag == TS_DESCRIPTOR_REGISTRATION && length >= 4) {
+			const unsigned char *id = desc + pos + 2;
+
+			if (memcmp(id, "AC-3", 4) == 0 ||
+			    memcmp(id, "EAC3", 4) == 0)
+				return true;
+		}
+
+		pos += 2 + length;
+	}
+
+	return false;
+}
+
+static AudioFormat GetStreamAudioFormat(int type, const unsigned char *desc,
+					size_t size)
+{
+	switch (type) {
+	case TS_STREAM_MPEG1_AUDIO:
+	case TS_STREAM_MPEG2_AUDIO:
+		return AudioFormat::MPGA;
+	case TS_STREAM_AAC_ADTS:
+	case TS_STREAM_AAC_LATM:
+		return AudioFormat::AAC;
+	case TS_STREAM_AC3:
+	case TS_STREAM_EAC3:
+		return AudioFormat::AC3;
+	case TS_STREAM_PRIVATE_PES:
+		return IsAC3Private(desc, size) ? AudioFormat::AC3
+						: AudioFormat::Unknown;
+	}
+
+	return AudioFormat::Unknown;
+}
+
+bool ParseTSPMT(const unsigned char *section, size_t size,
+		TSProgram &program)
+{
+	size_t length = CheckSection(section, size, TS_TABLE_PMT);
+	if (!length || length < TS_SECTION_HEADER_SIZE + 4)
+		return false;
+
+	size_t end = length - TS_SECTION_CRC_SIZE;
+	size_t infoLength = ((size_t)(section[10] & 0x0F) << 8) | section[11];
+	size_t pos = TS_SECTION_HEADER_SIZE + 4 + infoLength;
+
+	program.pcrPID = ((unsigned)(section[8] & 0x1F) << 8) | section[9];
+	program.videoPID = TS_NULL_PID;
+	program.videoStreamType = 0;
+	program.videoFormat = VideoFormat::Unknown;
+	program.audioPID = TS_NULL_PID;
+	program.audioStreamType = 0;
+	program.audioFormat = AudioFormat::Unknown;
+
+	while (pos + 5 <= end) {
+		int type = section[pos];
+		unsigned pid = ((unsigned)(section[pos + 1] & 0x1F) << 8) |
+			       section[pos + 2];
+		size_t esInfoLength =
+			((size_t)(section[pos + 3] & 0x0F) << 8) |
+			section[pos + 4];
+		const unsigned char *desc = section + pos + 5;
+
+		if (pos + 5 + esInfoLength > end)
+			return false;
+
+		AudioFormat audioFormat =
+			GetStreamAudioFormat(type, desc, esInfoLength);
+
+		if (type == TS_STREAM_H264 &&
+		    program.videoPID == TS_NULL_PID) {
+			program.videoPID = pid;
+			program.videoStreamType = type;
+			program.videoFormat = VideoFormat::H264;
+
+		} else if (audioFormat != AudioFormat::Unknown &&
+			   program.audioPID == TS_NULL_PID) {
+			program.audioPID = pid;
+			program.audioStreamType = type;
+			program.audioFormat = audioFormat;
+		}
+
+		pos += 5 + esInfoLength;
+	}
+
+	return true;
+}
+
+}; /* namespace DShow */
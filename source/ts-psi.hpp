@@ -0,0 +1,78 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#pragma once
+
+#include "../dshowcapture.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace DShow {
+
+#define TS_PAT_PID 0
+#define TS_NULL_PID 0x1FFF
+
+/* longest PAT or PMT section, header included */
+#define TS_MAX_SECTION_SIZE 1024
+
+/* PMT stream types */
+#define TS_STREAM_MPEG1_AUDIO 0x03
+#define TS_STREAM_MPEG2_AUDIO 0x04
+#define TS_STREAM_PRIVATE_PES 0x06
+#define TS_STREAM_AAC_ADTS 0x0F
+#define TS_STREAM_AAC_LATM 0x11
+#define TS_STREAM_H264 0x1B
+#define TS_STREAM_AC3 0x81
+#define TS_STREAM_EAC3 0x87
+
+/** Elementary streams of the program found in a transport stream */
+struct TSProgram {
+	unsigned programNumber = 0;
+	unsigned pmtPID = TS_NULL_PID;
+	unsigned pcrPID = TS_NULL_PID;
+
+	/* first stream of each kind the library can deliver */
+	unsigned videoPID = TS_NULL_PID;
+	int videoStreamType = 0;
+	VideoFormat videoFormat = VideoFormat::Unknown;
+
+	unsigned audioPID = TS_NULL_PID;
+	int audioStreamType = 0;
+	AudioFormat audioFormat = AudioFormat::Unknown;
+};
+
+/** CRC-32 used by PSI sections.  Zero over a whole section if it's intact */
+uint32_t GetTSSectionCRC(const unsigned char *data, size_t size);
+
+/**
+ * Parses a program association section, and sets the program number and
+ * PMT PID of program to the first program in it
+ */
+bool ParseTSPAT(const unsigned char *section, size_t size,
+		TSProgram &program);
+
+/**
+ * Parses a program map section, and sets the PCR PID and the video and
+ * audio streams of program from it.  Streams with codecs the library
+ * doesn't know are left out.
+ */
+bool ParseTSPMT(const unsigned char *section, size_t size,
+		TSProgram &program);
+
+}; /* namespace DShow */
@@ -0,0 +1,230 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "worker-pool.hpp"
+#include "log.hpp"
+
+#include <windows.h>
+#include <algorithm>
+
+using namespace std;
+
+namespace DShow {
+
+/* an automatically sized pool stops at this many threads; per-frame work is
+ * mostly memory bound, and more threads just take cores from the encoder */
+#define MAX_AUTO_THREADS 8
+
+/* slices are kept at least this many rows tall, and each thread gets this
+ * many of them so that stealing can even out uneven progress */
+#define MIN_SLICE_ROWS 32
+#define SLICES_PER_THREAD 2
+
+WorkerPool::WorkerPool(int count, unsigned long long affinityMask_)
+	: affinityMask(affinityMask_), queued(0), nextQueue(0)
+{
+	for (int i = 1; i < count; i++)
+		queues.emplace_back(new Queue);
+
+	for (size_t i = 0; i < queues.size(); i++)
+		threads.emplace_back(&WorkerPool::WorkerThread, this, i);
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		lock_guard<mutex> lock(wakeMutex);
+		stopping = true;
+	}
+
+	wake.notify_all();
+
+	for (thread &t : threads)
+		t.join();
+}
+
+/* own queue from the front, everyone else's from the back.  self is out of
+ * range for the forking thread, which only ever steals */
+bool WorkerPool::TakeTask(size_t self, Task &task)
+{
+	size_t count = queues.size();
+
+	for (size_t i = 0; i < count; i++) {
+		size_t index = (self + i) % count;
+		Queue &queue = *queues[index];
+		lock_guard<mutex> lock(queue.mutex);
+
+		if (queue.tasks.empty())
+			continue;
+
+		if (index == self) {
+			task = queue.tasks.front();
+			queue.tasks.pop_front();
+		} else {
+			task = queue.tasks.back();
+			queue.tasks.pop_back();
+		}
+
+		queued--;
+		return true;
+	}
+
+	return false;
+}
+
+void WorkerPool::RunTask(const Task &task)
+{
+	Job &job = *task.job;
+
+	(*job.proc)(task.begin, task.end);
+
+	/* the job lives on the forking thread's stack; once it sees the
+	 * count hit zero under the lock, nothing here touches it again */
+	lock_guard<mutex> lock(job.mutex);
+	if (--job.remaining == 0)
+		job.done.notify_all();
+}
+
+void WorkerPool::WorkerThread(size_t index)
+{
+	if (affinityMask &&
+	    !SetThreadAffinityMask(GetCurrentThread(),
+				   (DWORD_PTR)affinityMask))
+		Warning(L"WorkerPool: Failed to set thread affinity");
+
+	for (;;) {
+		Task task;
+
+		if (TakeTask(index, task)) {
+			RunTask(task);
+			continue;
+		}
+
+		unique_lock<mutex> lock(wakeMutex);
+		wake.wait(lock, [this]() { return queued > 0 || stopping; });
+
+		if (stopping && queued == 0)
+			break;
+	}
+}
+
+void WorkerPool::ParallelSlices(int height, int align, const SliceProc &proc)
+{
+	align = max(align, 1);
+
+	int maxSlices = height / max(MIN_SLICE_ROWS, align);
+	int slices = min(Threads() * SLICES_PER_THREAD, maxSlices);
+
+	if (queues.empty() || slices < 2) {
+		proc(0, height);
+		return;
+	}
+
+	int rows = (height + slices - 1) / slices;
+	rows = (rows + align - 1) / align * align;
+	slices = (height + rows - 1) / rows;
+
+	Job job;
+	job.proc = &proc;
+	job.remaining = slices;
+
+	/* slices are dealt out starting from a different queue each time so
+	 * that concurrent devices don't all pile on the first worker */
+	size_t first = nextQueue++;
+
+	for (int i = 0; i < slices; i++) {
+		Task task = {&job, i * rows, min((i + 1) * rows, height)};
+		Queue &queue = *queues[(first + i) % queues.size()];
+		lock_guard<mutex> lock(queue.mutex);
+		queue.tasks.push_back(task);
+	}
+
+	{
+		lock_guard<mutex> lock(wakeMutex);
+		queued += slices;
+	}
+
+	wake.notify_all();
+
+	Task task;
+	while (TakeTask(queues.size(), task))
+		RunTask(task);
+
+	unique_lock<mutex> lock(job.mutex);
+	job.done.wait(lock, [&job]() { return job.remaining == 0; });
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* the shared pool is swapped rather than resized, so slices already forked
+ * on the old one finish there before its threads are joined */
+static mutex poolMutex;
+static shared_ptr<WorkerPool> *sharedPool = nullptr;
+static int poolThreads = 0;
+static unsigned long long poolAffinity = 0;
+
+static int AutoThreadCount()
+{
+	int count = (int)thread::hardware_concurrency();
+	return min(max(count, 1), MAX_AUTO_THREADS);
+}
+
+shared_ptr<WorkerPool> GetWorkerPool()
+{
+	lock_guard<mutex> lock(poolMutex);
+
+	/* never freed: joining threads from static destructors can deadlock
+	 * while the library is being unloaded */
+	if (!sharedPool)
+		sharedPool = new shared_ptr<WorkerPool>;
+
+	if (!*sharedPool) {
+		int count = poolThreads > 0 ? poolThreads : AutoThreadCount();
+		sharedPool->reset(new WorkerPool(count, poolAffinity));
+	}
+
+	return *sharedPool;
+}
+
+void ParallelSlices(int height, int align, const SliceProc &proc)
+{
+	if (height < MIN_SLICE_ROWS * 2) {
+		proc(0, height);
+		return;
+	}
+
+	GetWorkerPool()->ParallelSlices(height, align, proc);
+}
+
+void SetWorkerThreads(int threads, unsigned long long affinityMask)
+{
+	shared_ptr<WorkerPool> old;
+
+	{
+		lock_guard<mutex> lock(poolMutex);
+		poolThreads = max(threads, 0);
+		poolAffinity = affinityMask;
+
+		/* the next frame creates a pool with the new settings */
+		if (sharedPool)
+			old = move(*sharedPool);
+	}
+}
+
+}; /* namespace DShow */
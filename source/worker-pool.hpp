@@ -0,0 +1,99 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace DShow {
+
+typedef std::function<void(int begin, int end)> SliceProc;
+
+/**
+ * Work stealing pool that per-frame processing is forked across.  Each
+ * worker has its own deque of slices; it takes from the front of its own
+ * and steals from the back of the others' when it runs dry.  The thread
+ * that forks the work steals too while it waits, so a pool of n threads
+ * has n - 1 workers.
+ */
+class WorkerPool {
+	struct Job {
+		const SliceProc *proc;
+		int remaining;
+		std::mutex mutex;
+		std::condition_variable done;
+	};
+
+	struct Task {
+		Job *job;
+		int begin;
+		int end;
+	};
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> threads;
+	unsigned long long affinityMask;
+
+	std::mutex wakeMutex;
+	std::condition_variable wake;
+	std::atomic<int> queued;
+	std::atomic<unsigned> nextQueue;
+	bool stopping = false;
+
+	bool TakeTask(size_t self, Task &task);
+	void RunTask(const Task &task);
+	void WorkerThread(size_t index);
+
+public:
+	WorkerPool(int threads, unsigned long long affinityMask);
+	~WorkerPool();
+
+	inline int Threads() const { return (int)threads.size() + 1; }
+
+	/**
+	 * Runs proc over rows [0, height) in slices that start on multiples
+	 * of align, and returns once they're all done.
+	 */
+	void ParallelSlices(int height, int align, const SliceProc &proc);
+};
+
+/** Pool shared by every device, created on first use */
+std::shared_ptr<WorkerPool> GetWorkerPool();
+
+/**
+ * Forks proc over rows [0, height) on the shared pool.  Frames too small to
+ * be worth splitting are run on the calling thread in one piece.
+ */
+void ParallelSlices(int height, int align, const SliceProc &proc);
+
+}; /* namespace DShow */
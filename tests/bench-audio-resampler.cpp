@@ -0,0 +1,109 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "bench.hpp"
+#include "audio-resampler.hpp"
+
+#include <math.h>
+#include <vector>
+
+using namespace DShow;
+
+/*
+ * Resampler throughput in channel-seconds of input per CPU second, for
+ * each quality and conversion path, over the rates capture cards commonly
+ * offer.  Audio is fed in 10 ms buffers, as devices deliver it.  Everything
+ * runs on one thread, so wall time is CPU time.
+ */
+
+#define CHANNELS 2
+#define SECONDS 1
+
+static const ConvertPath paths[] = {
+	ConvertPath::Scalar,
+	ConvertPath::SSE2,
+	ConvertPath::AVX2,
+	ConvertPath::NEON,
+};
+
+static const char *pathNames[] = {"scalar", "SSE2", "AVX2", "NEON"};
+
+static const AudioResampling qualities[] = {
+	AudioResampling::Fast,
+	AudioResampling::Medium,
+	AudioResampling::Best,
+};
+
+static const char *qualityNames[] = {"fast", "medium", "best"};
+
+int main()
+{
+	static const int rates[][2] = {
+		{44100, 48000},
+		{32000, 48000},
+		{48000, 44100},
+	};
+
+	printf("%-13s  %-7s  %-6s  %12s\n", "rates", "quality", "path",
+	       "ch*s / s");
+
+	for (const auto &rate : rates) {
+		int inRate = rate[0];
+		size_t frames = (size_t)inRate * SECONDS;
+		size_t chunk = (size_t)inRate / 100;
+		std::vector<float> input(frames * CHANNELS);
+
+		for (size_t i = 0; i < frames; i++) {
+			float t = (float)i / (float)inRate;
+			input[i * CHANNELS] = sinf(t * 2764.6f);
+			input[i * CHANNELS + 1] = sinf(t * 6283.2f) * 0.5f;
+		}
+
+		for (int q = 0; q < 3; q++) {
+			for (int p = 0; p < 4; p++) {
+				if (!ConvertPathSupported(paths[p]))
+					continue;
+
+				AudioResampler resampler;
+				std::vector<float> output;
+				long long outputTime;
+
+				resampler.Reset(inRate, rate[1], CHANNELS,
+						qualities[q], paths[p]);
+				output.reserve(frames * 2 * CHANNELS);
+
+				double seconds = BenchTime([&]() {
+					output.clear();
+					for (size_t i = 0; i < frames;
+					     i += chunk)
+						resampler.Process(
+							&input[i * CHANNELS],
+							chunk, 0, output,
+							outputTime);
+				});
+
+				printf("%5d->%5d  %-7s  %-6s  %12.0f\n", inRate,
+				       rate[1], qualityNames[q], pathNames[p],
+				       CHANNELS * SECONDS / seconds);
+			}
+		}
+	}
+
+	return 0;
+}
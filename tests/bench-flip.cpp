@@ -0,0 +1,87 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "bench.hpp"
+#include "dshow-convert.hpp"
+
+#include <vector>
+
+using namespace DShow;
+
+/*
+ * Flipping a bottom-up 32-bit frame, as VideoConfig::topDown does.  The
+ * library flips while it copies the frame in to a pooled buffer, one row
+ * at a time with memcpy (CopyPlane with a negative source linesize).  This
+ * compares that with a naive byte loop.
+ */
+
+static void FlipNaive(const unsigned char *src, unsigned char *dst,
+		      int rowBytes, int height)
+{
+	for (int row = 0; row < height; row++) {
+		const unsigned char *s = src + (height - 1 - row) * rowBytes;
+		unsigned char *d = dst + row * rowBytes;
+
+		for (int x = 0; x < rowBytes; x++)
+			d[x] = s[x];
+	}
+}
+
+static void FlipCopyPlane(const unsigned char *src, unsigned char *dst,
+			  int rowBytes, int height)
+{
+	CopyPlane(src + (height - 1) * rowBytes, -rowBytes, dst, rowBytes,
+		  rowBytes, height);
+}
+
+static void Report(const char *name, double seconds, size_t size)
+{
+	printf("  %-24s %8.3f ms %8.2f GB/s\n", name, seconds * 1000.0,
+	       (double)size / seconds / 1e9);
+}
+
+int main()
+{
+	static const int sizes[][2] = {{640, 480}, {1920, 1080}, {3840, 2160}};
+
+	for (const auto &frame : sizes) {
+		int rowBytes = frame[0] * 4;
+		int height = frame[1];
+		size_t size = (size_t)rowBytes * height;
+
+		std::vector<unsigned char> srcBuffer(size, 0x5A);
+		std::vector<unsigned char> dstBuffer(size);
+		const unsigned char *src = srcBuffer.data();
+		unsigned char *dst = dstBuffer.data();
+
+		printf("%dx%d XRGB, %.1f MB\n", frame[0], height,
+		       (double)size / 1e6);
+
+		Report("naive byte loop", BenchTime([&]() {
+			       FlipNaive(src, dst, rowBytes, height);
+		       }),
+		       size);
+		Report("memcpy rows (CopyPlane)", BenchTime([&]() {
+			       FlipCopyPlane(src, dst, rowBytes, height);
+		       }),
+		       size);
+	}
+
+	return 0;
+}
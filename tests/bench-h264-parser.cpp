@@ -0,0 +1,221 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "bench.hpp"
+#include "h264-parser.hpp"
+
+#include <stdio.h>
+#include <vector>
+
+using namespace DShow;
+
+/*
+ * Start code scanning and packet parsing throughput over an Annex-B
+ * elementary stream.  Takes a recorded stream as a file on the command
+ * line, e.g. from "ffmpeg -i capture.ts -c copy -bsf:v h264_mp4toannexb
+ * capture.h264".  Without one, about 30 MB of 1080p-like stream is made up:
+ * an IDR every 60 frames and P frames in between, with random slice data
+ * that has the emulation prevention a real encoder would add.
+ */
+
+typedef std::vector<unsigned char> Bytes;
+
+static const ConvertPath paths[] = {
+	ConvertPath::Scalar,
+	ConvertPath::SSE2,
+	ConvertPath::AVX2,
+	ConvertPath::NEON,
+};
+
+static const char *pathNames[] = {"scalar", "SSE2", "AVX2", "NEON"};
+
+static const unsigned char aud[] = {0, 0, 0, 1, 0x09, 0xF0};
+
+static const unsigned char spsPPS[] = {
+	0,    0,    0,	  1,	0x67, 0x64, 0x00, 0x28, 0xAC, 0xD9, 0x40,
+	0x78, 0x02, 0x27, 0xE5, 0x84, 0x00, 0x00, 0x03, 0x00, 0x04, 0x00,
+	0x00, 0x03, 0x00, 0xF0, 0x3C, 0x60, 0xC6, 0x58, 0,    0,    0,
+	1,    0x68, 0xEB, 0xE3, 0xCB, 0x22, 0xC0,
+};
+
+static bool ReadFile(const char *path, Bytes &data)
+{
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	data.resize((size_t)ftell(file));
+	fseek(file, 0, SEEK_SET);
+
+	bool success = fread(data.data(), 1, data.size(), file) ==
+		       data.size();
+	fclose(file);
+	return success;
+}
+
+static void AppendSlice(Bytes &stream, int type, size_t size,
+			unsigned int &seed)
+{
+	const unsigned char header[] = {0, 0, 1, (unsigned char)type, 0x88};
+	int zeros = 0;
+
+	stream.insert(stream.end(), header, header + sizeof(header));
+
+	for (size_t i = 0; i < size; i++) {
+		seed = seed * 1103515245u + 12345u;
+
+		/* compressed data has its share of zero bytes */
+		unsigned char value = (unsigned char)(seed >> 24);
+		if ((seed >> 20 & 15) == 0)
+			value = 0;
+
+		if (zeros >= 2 && value <= 3) {
+			stream.push_back(3);
+			zeros = 0;
+		}
+
+		stream.push_back(value);
+		zeros = value ? 0 : zeros + 1;
+	}
+
+	/* a slice can't end in a zero byte */
+	if (!stream.back())
+		stream.push_back(0x80);
+}
+
+static void MakeStream(Bytes &stream)
+{
+	unsigned int seed = 1;
+
+	for (int frame = 0; frame < 1800; frame++) {
+		stream.insert(stream.end(), aud, aud + sizeof(aud));
+
+		if (frame % 60 == 0) {
+			stream.insert(stream.end(), spsPPS,
+				      spsPPS + sizeof(spsPPS));
+			AppendSlice(stream, 0x65, 150000, seed);
+		} else {
+			AppendSlice(stream, 0x41, 12000 + frame % 7 * 1000,
+				    seed);
+		}
+	}
+}
+
+/* access units, split at each AUD or, without them, at each SPS */
+static void SplitPackets(const Bytes &stream, std::vector<size_t> &starts)
+{
+	std::vector<H264NAL> nals;
+	int splitType = H264_NAL_SPS;
+
+	SplitH264(stream.data(), stream.size(), nals);
+
+	for (const H264NAL &nal : nals)
+		if (nal.type == H264_NAL_AUD)
+			splitType = H264_NAL_AUD;
+
+	for (const H264NAL &nal : nals) {
+		if (nal.type != splitType)
+			continue;
+
+		/* back up over the start code and any zeros before it */
+		size_t offset = nal.data - stream.data() - 3;
+		while (offset > 0 && !stream[offset - 1])
+			offset--;
+		starts.push_back(offset);
+	}
+
+	if (starts.empty() || starts[0] != 0)
+		starts.insert(starts.begin(), 0);
+	starts.push_back(stream.size());
+}
+
+int main(int argc, char **argv)
+{
+	Bytes stream;
+
+	if (argc > 1) {
+		if (!ReadFile(argv[1], stream)) {
+			fprintf(stderr, "Can't read %s\n", argv[1]);
+			return 1;
+		}
+	} else {
+		MakeStream(stream);
+	}
+
+	double megabytes = (double)stream.size() / 1e6;
+	std::vector<size_t> starts;
+	SplitPackets(stream, starts);
+	size_t packets = starts.size() - 1;
+
+	printf("%.1f MB, %zu packets\n", megabytes, packets);
+	printf("FindStartCode over the whole stream:\n");
+
+	for (int p = 0; p < 4; p++) {
+		if (!ConvertPathSupported(paths[p]))
+			continue;
+
+		size_t found = 0;
+		double seconds = BenchTime([&]() {
+			const unsigned char *data = stream.data();
+			size_t size = stream.size();
+
+			found = 0;
+			for (;;) {
+				size_t offset =
+					FindStartCode(data, size, paths[p]);
+				if (offset == size)
+					break;
+
+				found++;
+				data += offset + 3;
+				size -= offset + 3;
+			}
+		});
+
+		printf("  %-6s  %8.0f MB/s  (%zu start codes)\n", pathNames[p],
+		       megabytes / seconds, found);
+	}
+
+	H264Parser parser;
+	H264Parser::PacketInfo info;
+	size_t keyframes = 0;
+
+	double seconds = BenchTime([&]() {
+		keyframes = 0;
+		for (size_t i = 0; i < packets; i++) {
+			parser.Parse(stream.data() + starts[i],
+				     starts[i + 1] - starts[i], info);
+			if (info.keyframe)
+				keyframes++;
+		}
+	});
+
+	printf("H264Parser::Parse, one packet at a time:\n");
+	printf("  %8.0f MB/s  %10.0f packets/s  (%zu keyframes)\n",
+	       megabytes / seconds, (double)packets / seconds, keyframes);
+
+	if (parser.HasSPS()) {
+		const H264SPS &sps = parser.SPS();
+		printf("  SPS: %dx%d, profile %d, level %d\n", sps.width,
+		       sps.height, sps.profile, sps.level);
+	}
+
+	return 0;
+}
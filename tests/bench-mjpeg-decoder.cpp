@@ -0,0 +1,250 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "bench.hpp"
+#include "mjpeg-decoder.hpp"
+
+#include <stdio.h>
+#include <jpeglib.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace DShow;
+
+/*
+ * MJPEG decode rate, on one thread through DecodeFrame and through
+ * MJPEGDecoder with 1 to N threads.  Takes recorded frames as JPEG files on
+ * the command line, all of the same size, e.g. pulled out of a capture
+ * with "ffmpeg -i capture.avi -c copy -f image2 frame%04d.jpg".  Without
+ * any, 1080p 4:2:2 frames like UVC cameras send are made up.
+ */
+
+#define SYNTHETIC_FRAMES 60
+#define SYNTHETIC_WIDTH 1920
+#define SYNTHETIC_HEIGHT 1080
+
+typedef std::vector<unsigned char> Bytes;
+
+static bool ReadFile(const char *path, Bytes &data)
+{
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	data.resize((size_t)ftell(file));
+	fseek(file, 0, SEEK_SET);
+
+	bool success = fread(data.data(), 1, data.size(), file) ==
+		       data.size();
+	fclose(file);
+	return success;
+}
+
+static bool GetSize(const Bytes &data, int &width, int &height)
+{
+	jpeg_decompress_struct info;
+	jpeg_error_mgr error;
+
+	info.err = jpeg_std_error(&error);
+	jpeg_create_decompress(&info);
+	jpeg_mem_src(&info, data.data(), (unsigned long)data.size());
+
+	bool success = jpeg_read_header(&info, TRUE) == JPEG_HEADER_OK;
+	width = (int)info.image_width;
+	height = (int)info.image_height;
+
+	jpeg_destroy_decompress(&info);
+	return success;
+}
+
+/* moving gradients with some noise, so the encoder has detail to keep */
+static void MakeFrame(int index, Bytes &jpeg)
+{
+	const int width = SYNTHETIC_WIDTH;
+	const int height = SYNTHETIC_HEIGHT;
+	jpeg_compress_struct info;
+	jpeg_error_mgr error;
+	unsigned char *out = nullptr;
+	unsigned long outSize = 0;
+	unsigned int seed = (unsigned int)index * 2654435761u;
+	Bytes row((size_t)width * 3);
+
+	info.err = jpeg_std_error(&error);
+	jpeg_create_compress(&info);
+	jpeg_mem_dest(&info, &out, &outSize);
+
+	info.image_width = width;
+	info.image_height = height;
+	info.input_components = 3;
+	info.in_color_space = JCS_YCbCr;
+	jpeg_set_defaults(&info);
+	jpeg_set_quality(&info, 85, TRUE);
+
+	/* 4:2:2 */
+	info.comp_info[0].h_samp_factor = 2;
+	info.comp_info[0].v_samp_factor = 1;
+
+	jpeg_start_compress(&info, TRUE);
+
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			seed = seed * 1103515245u + 12345u;
+			row[x * 3] = (unsigned char)(x + y + index * 4 +
+						     (seed >> 28));
+			row[x * 3 + 1] = (unsigned char)(x / 8 + index);
+			row[x * 3 + 2] = (unsigned char)(y / 4);
+		}
+
+		JSAMPROW rows[1] = {row.data()};
+		jpeg_write_scanlines(&info, rows, 1);
+	}
+
+	jpeg_finish_compress(&info);
+	jpeg_destroy_compress(&info);
+
+	jpeg.assign(out, out + outSize);
+	free(out);
+}
+
+static void BenchSingle(const std::vector<Bytes> &frames, int width,
+			int height, VideoFormat format, int scale)
+{
+	MJPEGDecoder::Context *context = MJPEGDecoder::CreateContext();
+	auto pool = std::make_shared<FramePool>(4);
+	size_t next = 0;
+	bool success = true;
+
+	double seconds = BenchTime([&]() {
+		const Bytes &data = frames[next++ % frames.size()];
+		Frame frame;
+		success &= MJPEGDecoder::DecodeFrame(*context, data.data(),
+						     data.size(), format, width,
+						     height, scale, frame,
+						     *pool);
+	});
+
+	MJPEGDecoder::DestroyContext(context);
+
+	printf("  %-4s 1/%d  %8.3f ms  %7.1f fps%s\n",
+	       format == VideoFormat::NV12 ? "NV12" : "I420", scale,
+	       seconds * 1000.0, 1.0 / seconds,
+	       success ? "" : "  (decode failed)");
+}
+
+static void BenchThreads(const std::vector<Bytes> &frames, int width,
+			 int height, int threads)
+{
+	auto inputPool = std::make_shared<FramePool>(1);
+	auto outputPool = std::make_shared<FramePool>(threads * 4);
+	std::vector<Frame> inputs;
+	std::atomic<long long> delivered(0);
+	MJPEGDecoder decoder;
+
+	for (const Bytes &data : frames)
+		inputs.push_back(inputPool->Copy(data.data(), data.size()));
+
+	decoder.Reset(VideoFormat::NV12, width, height, 1, threads,
+		      outputPool,
+		      [&](const Frame &, long long, long long) {
+			      delivered++;
+		      });
+
+	size_t count = inputs.size() * 4;
+	if (count < 240)
+		count = 240;
+
+	double start = BenchNow();
+
+	/* the decoder drops frames it has no room for, so retry until it
+	 * takes them */
+	for (size_t i = 0; i < count; i++) {
+		while (!decoder.Decode(inputs[i % inputs.size()], i, i + 1))
+			std::this_thread::yield();
+	}
+
+	decoder.Flush();
+	double seconds = BenchNow() - start;
+	decoder.Stop();
+
+	printf("  %7d  %7.1f fps%s\n", threads, (double)count / seconds,
+	       delivered == (long long)count ? "" : "  (frames lost)");
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<Bytes> frames;
+	int width = 0;
+	int height = 0;
+
+	for (int i = 1; i < argc; i++) {
+		Bytes data;
+		int frameWidth;
+		int frameHeight;
+
+		if (!ReadFile(argv[i], data) ||
+		    !GetSize(data, frameWidth, frameHeight)) {
+			fprintf(stderr, "%s isn't a JPEG file\n", argv[i]);
+			return 1;
+		}
+
+		if (frames.empty()) {
+			width = frameWidth;
+			height = frameHeight;
+		} else if (frameWidth != width || frameHeight != height) {
+			fprintf(stderr, "%s isn't %dx%d\n", argv[i], width,
+				height);
+			return 1;
+		}
+
+		frames.push_back(std::move(data));
+	}
+
+	if (frames.empty()) {
+		width = SYNTHETIC_WIDTH;
+		height = SYNTHETIC_HEIGHT;
+		frames.resize(SYNTHETIC_FRAMES);
+		for (int i = 0; i < SYNTHETIC_FRAMES; i++)
+			MakeFrame(i, frames[i]);
+	}
+
+	size_t total = 0;
+	for (const Bytes &data : frames)
+		total += data.size();
+
+	printf("%d frames of %dx%d, %zu KB each on average\n",
+	       (int)frames.size(), width, height,
+	       total / frames.size() / 1024);
+
+	printf("one thread, DecodeFrame:\n");
+	for (int scale = 1; scale <= 8; scale *= 2)
+		BenchSingle(frames, width, height, VideoFormat::I420, scale);
+	BenchSingle(frames, width, height, VideoFormat::NV12, 1);
+
+	int maxThreads = (int)std::thread::hardware_concurrency();
+	if (maxThreads < 4)
+		maxThreads = 4;
+
+	printf("MJPEGDecoder, NV12:\n  threads\n");
+	for (int threads = 1; threads <= maxThreads; threads++)
+		BenchThreads(frames, width, height, threads);
+
+	return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include "bench.hpp"
+#include "ts-writer.hpp"
+
+#include <algorithm>
+#include <stdio.h>
+#include <vector>
+
+using namespace DShow;
+
+/*
+ * Demuxing throughput in transport packets a second, fed in chunks of a
+ * few sizes: whole packets as a device sends them, and sizes that split
+ * packets between chunks.  Takes a recorded transport stream as a file on
+ * the command line.  Without one, about 30 MB of stream is made up: 8 Mbps
+ * of video at 60 fps in unbounded PES packets, with a PCR on each, and
+ * 192 kbps of audio in bounded ones.
+ */
+
+typedef std::vector<unsigned char> Bytes;
+
+static bool ReadFile(const char *path, Bytes &data)
+{
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	data.resize((size_t)ftell(file));
+	fseek(file, 0, SEEK_SET);
+
+	bool success = fread(data.data(), 1, data.size(), file) ==
+		       data.size();
+	fclose(file);
+	return success;
+}
+
+static void MakeStream(Bytes &stream)
+{
+	TSWriter writer;
+	Bytes video(8000000 / 8 / 60, 0x5A);
+	Bytes audio(192000 / 8 / 60, 0xA5);
+
+	for (int frame = 0; frame < 1800; frame++) {
+		long long dts = 900000 + frame * 1500LL;
+
+		/* tables go out a few times a second */
+		if (frame % 15 == 0)
+			writer.Tables();
+
+		writer.PES(TSW_VIDEO_PID, video, false, dts + 1500, dts,
+			   dts * 300, frame % 60 ? 0 : 0x40);
+		writer.PES(TSW_AUDIO_PID, audio, true, dts);
+	}
+
+	stream.swap(writer.out);
+}
+
+int main(int argc, char **argv)
+{
+	Bytes stream;
+
+	if (argc > 1) {
+		if (!ReadFile(argv[1], stream)) {
+			fprintf(stderr, "Can't read %s\n", argv[1]);
+			return 1;
+		}
+	} else {
+		MakeStream(stream);
+	}
+
+	double packets = (double)(stream.size() / TS_PACKET_SIZE);
+	printf("%.1f MB, %.0f packets\n", (double)stream.size() / 1e6,
+	       packets);
+
+	const size_t chunks[] = {TS_PACKET_SIZE, TS_PACKET_SIZE * 87, 4096,
+				 65536};
+
+	for (size_t chunk : chunks) {
+		auto videoPool = std::make_shared<FramePool>(8);
+		auto audioPool = std::make_shared<FramePool>(8);
+		size_t delivered = 0;
+
+		TSDemuxer demuxer;
+		demuxer.SetStream(TSStream::Video, TSW_VIDEO_PID, videoPool);
+		demuxer.SetStream(TSStream::Audio, TSW_AUDIO_PID, audioPool);
+		demuxer.SetCallback([&](TSStream, const TSPacket &) {
+			delivered++;
+		});
+
+		double seconds = BenchTime([&]() {
+			delivered = 0;
+			demuxer.Reset();
+
+			for (size_t pos = 0; pos < stream.size();
+			     pos += chunk) {
+				size_t size =
+					std::min(chunk, stream.size() - pos);
+				demuxer.Input(stream.data() + pos, size);
+			}
+
+			demuxer.Flush();
+		});
+
+		printf("  %6zu byte chunks  %6.2fM packets/s  %6.0f MB/s  "
+		       "(%zu PES packets)\n",
+		       chunk, packets / seconds / 1e6,
+		       (double)stream.size() / seconds / 1e6, delivered);
+	}
+
+	return 0;
+}
@@ -0,0 +1,131 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "bench.hpp"
+#include "worker-pool.hpp"
+#include "dshow-convert.hpp"
+#include "dshow-scale.hpp"
+
+#include <thread>
+#include <vector>
+
+using namespace DShow;
+
+/*
+ * Scaling of sliced frame processing from 1 to N threads, on synthetic 4K
+ * frames: packed 4:2:2 to I420 conversion and a bicubic 4K to 1080p scale,
+ * split the same way HDevice splits them.
+ */
+
+#define WIDTH 3840
+#define HEIGHT 2160
+
+struct Planes {
+	std::vector<unsigned char> data;
+	unsigned char *planes[3];
+	int linesize[3];
+
+	Planes(VideoFormat format, int width, int height)
+	{
+		size_t offset[3];
+		data.resize(GetVideoLayout(format, width, height, linesize,
+					   offset));
+
+		for (size_t i = 0; i < data.size(); i++)
+			data[i] = (unsigned char)(i * 7 + i / 4096);
+		for (int i = 0; i < 3; i++)
+			planes[i] = linesize[i] ? &data[offset[i]] : nullptr;
+	}
+};
+
+static void Convert(WorkerPool &pool, const Planes &in, Planes &out)
+{
+	pool.ParallelSlices(HEIGHT, 2, [&](int begin, int end) {
+		unsigned char *dst[3];
+		for (int i = 0; i < 3; i++)
+			dst[i] = out.planes[i] +
+				 (ptrdiff_t)GetPlaneRow(VideoFormat::I420, i,
+							begin) *
+					 out.linesize[i];
+
+		ConvertPackedYUV(VideoFormat::YUY2,
+				 in.planes[0] +
+					 (ptrdiff_t)begin * in.linesize[0],
+				 in.linesize[0], VideoFormat::I420, dst,
+				 out.linesize, WIDTH, end - begin);
+	});
+}
+
+static void Scale(WorkerPool &pool, const VideoScaler &scaler,
+		  const Planes &in, Planes &out, int height)
+{
+	const unsigned char *src[3] = {in.planes[0], in.planes[1],
+				       in.planes[2]};
+
+	pool.ParallelSlices(height, scaler.SliceAlign(),
+			    [&](int begin, int end) {
+				    scaler.ScaleSlice(src, in.linesize,
+						      out.planes, out.linesize,
+						      begin, end);
+			    });
+}
+
+int main(int argc, char **argv)
+{
+	int maxThreads = (int)std::thread::hardware_concurrency();
+	if (argc > 1)
+		maxThreads = atoi(argv[1]);
+	if (maxThreads < 1)
+		maxThreads = 1;
+
+	Planes yuy2(VideoFormat::YUY2, WIDTH, HEIGHT);
+	Planes i420(VideoFormat::I420, WIDTH, HEIGHT);
+	Planes scaled(VideoFormat::I420, 1920, 1080);
+	VideoScaler scaler;
+
+	scaler.Reset(VideoFormat::I420, WIDTH, HEIGHT, 1920, 1080,
+		     VideoScaling::Bicubic);
+
+	double convertBase = 0.0;
+	double scaleBase = 0.0;
+
+	printf("threads  YUY2->I420 4K        speedup  "
+	       "I420 4K->1080p bicubic  speedup\n");
+
+	for (int threads = 1; threads <= maxThreads; threads++) {
+		WorkerPool pool(threads, 0);
+
+		double convert =
+			BenchTime([&]() { Convert(pool, yuy2, i420); });
+		double scale = BenchTime(
+			[&]() { Scale(pool, scaler, i420, scaled, 1080); });
+
+		if (threads == 1) {
+			convertBase = convert;
+			scaleBase = scale;
+		}
+
+		printf("%7d  %8.3f ms/frame  %7.2fx  %8.3f ms/frame        "
+		       "%7.2fx\n",
+		       threads, convert * 1000.0, convertBase / convert,
+		       scale * 1000.0, scaleBase / scale);
+	}
+
+	return 0;
+}
@@ -0,0 +1,58 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <chrono>
+
+/*
+ * Timing for the benchmarks.  These aren't run by ctest, and are only
+ * meaningful in an optimized build.
+ */
+
+static inline double BenchNow()
+{
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch())
+		.count();
+}
+
+/**
+ * Calls func repeatedly for at least minTime seconds, after one untimed
+ * call to warm the caches, and returns the average time of one call in
+ * seconds.
+ */
+template<typename F> static double BenchTime(F func, double minTime = 0.5)
+{
+	long long runs = 0;
+	double start;
+	double elapsed;
+
+	func();
+	start = BenchNow();
+
+	do {
+		func();
+		runs++;
+		elapsed = BenchNow() - start;
+	} while (elapsed < minTime);
+
+	return elapsed / (double)runs;
+}
@@ -0,0 +1,70 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "log.hpp"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <wchar.h>
+
+/* log.cpp needs the rest of DirectShow, the tests just print warnings and
+ * errors */
+
+namespace DShow {
+
+static void Print(const wchar_t *type, const wchar_t *format, va_list args)
+{
+	fwprintf(stderr, L"%ls: ", type);
+	vfwprintf(stderr, format, args);
+	fwprintf(stderr, L"\n");
+}
+
+void Error(const wchar_t *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	Print(L"error", format, args);
+	va_end(args);
+}
+
+void Warning(const wchar_t *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	Print(L"warning", format, args);
+	va_end(args);
+}
+
+void Info(const wchar_t *, ...) {}
+void Debug(const wchar_t *, ...) {}
+
+void ErrorHR(const wchar_t *str, HRESULT hr)
+{
+	Error(L"%ls (0x%08lX)", str, hr);
+}
+
+void WarningHR(const wchar_t *str, HRESULT hr)
+{
+	Warning(L"%ls (0x%08lX)", str, hr);
+}
+
+void InfoHR(const wchar_t *, HRESULT) {}
+void DebugHR(const wchar_t *, HRESULT) {}
+
+}; /* namespace DShow */
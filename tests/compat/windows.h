@@ -0,0 +1,43 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+/*
+ * Just enough of windows.h for the portable sources that log through
+ * log.hpp or pin threads, so that they build on Linux for the tests and
+ * benchmarks.
+ */
+
+#include <stdint.h>
+
+typedef long HRESULT;
+typedef uintptr_t DWORD_PTR;
+typedef void *HANDLE;
+
+static inline HANDLE GetCurrentThread()
+{
+	return nullptr;
+}
+
+/* affinity only matters on Windows, succeed without changing anything */
+static inline DWORD_PTR SetThreadAffinityMask(HANDLE, DWORD_PTR mask)
+{
+	return mask;
+}
@@ -0,0 +1,216 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "test.hpp"
+#include "access-unit.hpp"
+
+#include <algorithm>
+#include <vector>
+
+using namespace DShow;
+
+typedef std::vector<unsigned char> Bytes;
+
+static void Append(Bytes &sample, std::initializer_list<unsigned char> bytes)
+{
+	sample.insert(sample.end(), bytes);
+}
+
+static void AppendAUD(Bytes &sample)
+{
+	Append(sample, {0, 0, 0, 1, 0x09, 0xF0});
+}
+
+/* a P slice whose first_mb_in_slice is 0 or 1 */
+static void AppendSlice(Bytes &sample, int firstMB)
+{
+	Append(sample, {0, 0, 1, 0x41, (unsigned char)(firstMB ? 0x40 : 0x80),
+			0x11, 0x22});
+}
+
+static Bytes Picture(int slices)
+{
+	Bytes sample;
+	AppendAUD(sample);
+	for (int i = 0; i < slices; i++)
+		AppendSlice(sample, i);
+	return sample;
+}
+
+/* feeds whole pictures, one sample each, until the slice count is learned */
+static void Learn(H264AccessUnits &units, int slices)
+{
+	Bytes sample = Picture(slices);
+
+	units.Add(sample.data(), sample.size(), true);
+	CHECK(!units.Complete());
+	CHECK(units.Add(sample.data(), sample.size(), false));
+	CHECK(!units.Complete());
+
+	/* two pictures with the same count */
+	CHECK(units.Add(sample.data(), sample.size(), false));
+	CHECK(units.Complete());
+	units.PacketDone();
+}
+
+static void TestLearnsSliceCount()
+{
+	H264AccessUnits units;
+	Learn(units, 1);
+
+	/* carries on sending each picture as soon as it's complete */
+	Bytes sample = Picture(1);
+	for (int i = 0; i < 5; i++) {
+		CHECK(!units.Add(sample.data(), sample.size(), false));
+		CHECK(units.Complete());
+		units.PacketDone();
+	}
+}
+
+/* the encoder starts splitting pictures in to two slices, each in a sample
+ * of its own.  The first picture is cut short, but after that pictures
+ * have to wait for the next one to start */
+static void TestSliceCountGrows()
+{
+	H264AccessUnits units;
+	Learn(units, 1);
+
+	Bytes first;
+	Bytes second;
+	AppendAUD(first);
+	AppendSlice(first, 0);
+	AppendSlice(second, 1);
+
+	units.Add(first.data(), first.size(), false);
+	CHECK(units.Complete());
+	units.PacketDone();
+	CHECK(!units.Add(second.data(), second.size(), false));
+	CHECK(!units.Complete());
+
+	for (int i = 0; i < 5; i++) {
+		CHECK(units.Add(first.data(), first.size(), false));
+		CHECK(!units.Complete());
+		CHECK(!units.Add(second.data(), second.size(), false));
+		CHECK(!units.Complete());
+	}
+
+	/* single slice pictures again don't bring it back */
+	Bytes sample = Picture(1);
+	for (int i = 0; i < 5; i++) {
+		units.Add(sample.data(), sample.size(), false);
+		CHECK(!units.Complete());
+	}
+
+	units.Reset();
+	Learn(units, 1);
+}
+
+/* a picture with more slices than learned, all in one sample */
+static void TestSliceCountChanges()
+{
+	H264AccessUnits units;
+	Learn(units, 2);
+
+	Bytes three = Picture(3);
+	CHECK(!units.Add(three.data(), three.size(), false));
+	CHECK(!units.Complete());
+
+	Bytes two = Picture(2);
+	for (int i = 0; i < 5; i++) {
+		CHECK(units.Add(two.data(), two.size(), false));
+		CHECK(!units.Complete());
+	}
+}
+
+/* feeds each picture as the demuxer would, a few bytes at a time, so start
+ * codes are cut off at every point */
+static void AddPayload(H264AccessUnits &units, const Bytes &payload,
+		       size_t piece)
+{
+	for (size_t size = 0; size < payload.size();) {
+		size_t scanned = size;
+		size = std::min(size + piece, payload.size());
+		units.AddPayload(payload.data(), size, scanned, true);
+	}
+}
+
+static void TestPayloadPieces()
+{
+	Bytes three = Picture(3);
+
+	for (size_t piece = 1; piece <= 8; piece++) {
+		H264AccessUnits units;
+
+		for (int i = 0; i < 3; i++)
+			AddPayload(units, three, piece);
+		CHECK(units.Complete());
+
+		/* a fourth slice is one too many */
+		Bytes four = Picture(4);
+		AddPayload(units, four, piece);
+		CHECK(!units.Complete());
+	}
+}
+
+/* 7 byte ADTS header for a frame of the given size */
+static void AppendADTS(Bytes &data, size_t size)
+{
+	Append(data, {0xFF, 0xF1, 0x50, (unsigned char)(0x80 | size >> 11),
+		      (unsigned char)(size >> 3),
+		      (unsigned char)(size << 5 | 0x1F), 0xFC});
+	data.resize(data.size() + size - 7, 0x21);
+}
+
+static void TestAudioFrames()
+{
+	AudioAccessUnits units;
+	Bytes stream;
+
+	units.Reset(AudioFormat::AAC);
+	CHECK(units.Active());
+
+	AppendADTS(stream, 300);
+	AppendADTS(stream, 200);
+
+	/* split in the middle of the second header */
+	units.Add(stream.data(), 303);
+	CHECK(!units.Complete());
+	units.Add(stream.data() + 303, 150);
+	CHECK(!units.Complete());
+	units.Add(stream.data() + 453, stream.size() - 453);
+	CHECK(units.Complete());
+	units.PacketDone();
+	CHECK(!units.Complete());
+
+	/* garbage where a header should be gives up */
+	Bytes junk(16, 0x55);
+	units.Add(junk.data(), junk.size());
+	CHECK(!units.Active());
+	CHECK(!units.Complete());
+}
+
+int main()
+{
+	RUN_TEST(TestLearnsSliceCount);
+	RUN_TEST(TestSliceCountGrows);
+	RUN_TEST(TestSliceCountChanges);
+	RUN_TEST(TestPayloadPieces);
+	RUN_TEST(TestAudioFrames);
+	return TestResult();
+}
@@ -0,0 +1,246 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "test.hpp"
+#include "audio-convert.hpp"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+using namespace DShow;
+
+static const AudioFormat inFormats[] = {
+	AudioFormat::Wave16bit,
+	AudioFormat::Wave24bit,
+	AudioFormat::Wave32bit,
+	AudioFormat::WaveFloat,
+};
+
+static const AudioFormat outFormats[] = {
+	AudioFormat::Wave16bit,
+	AudioFormat::WaveFloat,
+	AudioFormat::WaveFloatPlanar,
+};
+
+static const ConvertPath simdPaths[] = {
+	ConvertPath::SSE2,
+	ConvertPath::SSSE3,
+	ConvertPath::AVX2,
+	ConvertPath::NEON,
+};
+
+/* float input mixes in the values that clipping and rounding have to get
+ * right */
+static void FillInput(AudioFormat format, std::vector<unsigned char> &data,
+		      TestRandom &random)
+{
+	if (format != AudioFormat::WaveFloat) {
+		for (unsigned char &value : data)
+			value = (unsigned char)random.Next(256);
+		return;
+	}
+
+	static const float special[] = {
+		0.0f,  -0.0f,	  1.0f,	     -1.0f,	 1.5f,
+		-1.5f, 1e30f,	  -1e30f,    INFINITY,	 -INFINITY,
+		NAN,   0.5f / 32768.0f, 1.5f / 32768.0f, -0.5f / 32768.0f,
+		32767.5f / 32768.0f,
+	};
+	const size_t specialCount = sizeof(special) / sizeof(special[0]);
+
+	float *samples = (float *)data.data();
+	size_t count = data.size() / sizeof(float);
+
+	for (size_t i = 0; i < count; i++) {
+		if (random.Next(4) == 0)
+			samples[i] = special[random.Next(specialCount)];
+		else
+			samples[i] = (float)random.Next(2000001) / 1000000.0f -
+				     1.0f;
+	}
+}
+
+static void TestScalarValues()
+{
+	const int16_t s16[] = {-32768, 0, 16384, 32767};
+	float f[4];
+
+	CHECK(ConvertAudio(AudioFormat::Wave16bit, s16, AudioFormat::WaveFloat,
+			   f, 4, 1, ConvertPath::Scalar));
+	CHECK(f[0] == -1.0f);
+	CHECK(f[1] == 0.0f);
+	CHECK(f[2] == 0.5f);
+
+	const float in[] = {1.0f, -1.0f, NAN, 2.0f, 0.5f / 32768.0f,
+			    1.5f / 32768.0f};
+	int16_t out[6];
+
+	CHECK(ConvertAudio(AudioFormat::WaveFloat, in, AudioFormat::Wave16bit,
+			   out, 6, 1, ConvertPath::Scalar));
+	CHECK_EQ(out[0], 32767);
+	CHECK_EQ(out[1], -32768);
+	CHECK_EQ(out[2], -32768);
+	CHECK_EQ(out[3], 32767);
+	CHECK_EQ(out[4], 0); /* half rounds to even */
+	CHECK_EQ(out[5], 2);
+
+	/* 24-bit is little endian, sign in the top byte */
+	const unsigned char s24[] = {0x00, 0x00, 0x80, 0xFF, 0xFF, 0x7F};
+	CHECK(ConvertAudio(AudioFormat::Wave24bit, s24, AudioFormat::WaveFloat,
+			   f, 2, 1, ConvertPath::Scalar));
+	CHECK(f[0] == -1.0f);
+	CHECK(f[1] == 8388607.0f / 8388608.0f);
+
+	/* planar output is one channel after another */
+	const int16_t stereo[] = {1, 2, 3, 4, 5, 6};
+	float planar[6];
+	CHECK(ConvertAudio(AudioFormat::Wave16bit, stereo,
+			   AudioFormat::WaveFloatPlanar, planar, 3, 2,
+			   ConvertPath::Scalar));
+	CHECK(planar[0] * 32768.0f == 1.0f);
+	CHECK(planar[1] * 32768.0f == 3.0f);
+	CHECK(planar[2] * 32768.0f == 5.0f);
+	CHECK(planar[3] * 32768.0f == 2.0f);
+}
+
+/* every SIMD path has to match the scalar path bit for bit, including the
+ * frames left over past the last full vector */
+static void TestPathsMatchScalar()
+{
+	TestRandom random;
+	int compared = 0;
+
+	for (ConvertPath path : simdPaths) {
+		if (!ConvertPathSupported(path))
+			continue;
+
+		for (AudioFormat inFormat : inFormats) {
+			for (AudioFormat outFormat : outFormats) {
+				if (!CanConvertAudio(inFormat, outFormat))
+					continue;
+
+				for (int channels = 1; channels <= 8;
+				     channels++) {
+					/* long enough to cross blocks */
+					size_t frames = 1 + random.Next(2000);
+					size_t inSize =
+						frames * channels *
+						AudioSampleSize(inFormat);
+					size_t outSize =
+						frames * channels *
+						AudioSampleSize(outFormat);
+					std::vector<unsigned char> in(inSize);
+					std::vector<unsigned char> expected(
+						outSize + 1, 0xCD);
+					std::vector<unsigned char> actual(
+						outSize + 1, 0xCD);
+
+					FillInput(inFormat, in, random);
+					ConvertAudio(inFormat, in.data(),
+						     outFormat,
+						     expected.data(), frames,
+						     channels,
+						     ConvertPath::Scalar);
+					CHECK(ConvertAudio(inFormat, in.data(),
+							   outFormat,
+							   actual.data(),
+							   frames, channels,
+							   path));
+					CHECK(expected == actual);
+					compared++;
+				}
+			}
+		}
+	}
+
+	printf("compared %d conversions\n", compared);
+}
+
+/* the mixing paths may sum in a different order, so they only have to
+ * come close */
+static void TestMixMatchesScalar()
+{
+	static const int layouts[][2] = {{2, 1}, {6, 2}, {8, 2}, {3, 5}};
+	TestRandom random;
+
+	for (ConvertPath path : simdPaths) {
+		if (!ConvertPathSupported(path))
+			continue;
+
+		for (const auto &layout : layouts) {
+			int inChannels = layout[0];
+			int outChannels = layout[1];
+			size_t frames = 61;
+			std::vector<float> matrix;
+			std::vector<int16_t> in(frames * inChannels);
+			std::vector<float> expected(frames * outChannels);
+			std::vector<float> actual(frames * outChannels);
+
+			GetDefaultChannelMatrix(inChannels, outChannels,
+						matrix);
+			for (int16_t &sample : in)
+				sample = (int16_t)random.Next(65536);
+
+			MixAudio(AudioFormat::Wave16bit, in.data(),
+				 inChannels, AudioFormat::WaveFloatPlanar,
+				 expected.data(), outChannels, matrix.data(),
+				 frames, ConvertPath::Scalar);
+			CHECK(MixAudio(AudioFormat::Wave16bit, in.data(),
+				       inChannels,
+				       AudioFormat::WaveFloatPlanar,
+				       actual.data(), outChannels,
+				       matrix.data(), frames, path));
+
+			bool close = true;
+			for (size_t i = 0; i < expected.size(); i++)
+				if (fabsf(expected[i] - actual[i]) > 1e-6f)
+					close = false;
+			CHECK(close);
+		}
+	}
+}
+
+static void TestDownmixMatrix()
+{
+	std::vector<float> matrix;
+
+	/* 5.1: L R C LFE SL SR, center and surrounds at -3 dB, no LFE */
+	GetDefaultChannelMatrix(6, 2, matrix);
+	CHECK_EQ(matrix.size(), 12);
+	CHECK(matrix[3] == 0.0f);
+	CHECK(matrix[6 + 3] == 0.0f);
+	CHECK(matrix[1] == 0.0f);
+	CHECK(fabsf(matrix[2] / matrix[0] - 0.70710678f) < 1e-5f);
+
+	float sum = 0.0f;
+	for (int c = 0; c < 6; c++)
+		sum += matrix[c];
+	CHECK(fabsf(sum - 1.0f) < 1e-5f);
+}
+
+int main()
+{
+	RUN_TEST(TestScalarValues);
+	RUN_TEST(TestPathsMatchScalar);
+	RUN_TEST(TestMixMatchesScalar);
+	RUN_TEST(TestDownmixMatrix);
+	return TestResult();
+}
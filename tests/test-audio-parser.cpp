@@ -0,0 +1,437 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include "test.hpp"
+#include "audio-parser.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+using namespace DShow;
+
+typedef std::vector<unsigned char> Bytes;
+
+#define START_TIME 10000000LL
+
+/* writes bits MSB first, for LATM headers */
+struct BitWriter {
+	Bytes bytes;
+	size_t pos = 0;
+
+	void Put(uint32_t value, int count)
+	{
+		while (count--) {
+			if (!(pos & 7))
+				bytes.push_back(0);
+			if ((value >> count) & 1)
+				bytes.back() |= 0x80 >> (pos & 7);
+			pos++;
+		}
+	}
+};
+
+static void AppendPayload(Bytes &frame, size_t size, TestRandom &random)
+{
+	while (frame.size() < size)
+		frame.push_back((unsigned char)random.Next());
+}
+
+/* AAC LC, 48 kHz stereo */
+static Bytes ADTSFrame(size_t size, TestRandom &random)
+{
+	Bytes frame = {0xFF,
+		       0xF1,
+		       0x4C,
+		       (unsigned char)(0x80 | size >> 11),
+		       (unsigned char)(size >> 3),
+		       (unsigned char)(size << 5 | 0x1F),
+		       0xFC};
+	AppendPayload(frame, size, random);
+	return frame;
+}
+
+static void PutASC(BitWriter &bits)
+{
+	bits.Put(2, 5); /* AAC LC */
+	bits.Put(3, 4); /* 48 kHz */
+	bits.Put(2, 4); /* stereo */
+	bits.Put(0, 3);
+}
+
+/* the same stream in LOAS.  Only the first frame carries the
+ * StreamMuxConfig, in LATM version 0 or 1 */
+static Bytes LOASFrame(size_t size, bool first, int version,
+		       TestRandom &random)
+{
+	BitWriter bits;
+
+	bits.Put(!first, 1); /* useSameStreamMux */
+	if (first) {
+		bits.Put(version, 1);
+		if (version) {
+			bits.Put(0, 1); /* audioMuxVersionA */
+			bits.Put(0, 2); /* taraBufferFullness, one byte */
+			bits.Put(0xFF, 8);
+		}
+		bits.Put(1, 1); /* allStreamsSameTimeFraming */
+		bits.Put(0, 6); /* numSubFrames */
+		bits.Put(0, 4); /* numProgram */
+		bits.Put(0, 3); /* numLayer */
+		if (version) {
+			bits.Put(0, 2); /* ascLen, one byte */
+			bits.Put(16, 8);
+		}
+		PutASC(bits);
+		bits.Put(0, 3); /* frameLengthType */
+		bits.Put(0xFF, 8); /* latmBufferFullness */
+		bits.Put(0, 2); /* otherDataPresent, crcCheckPresent */
+	}
+
+	size_t muxSize = size - LOAS_HEADER_SIZE;
+	Bytes frame = {0x56, (unsigned char)(0xE0 | muxSize >> 8),
+		       (unsigned char)muxSize};
+	frame.insert(frame.end(), bits.bytes.begin(), bits.bytes.end());
+	AppendPayload(frame, size, random);
+	return frame;
+}
+
+/* 384 kbit/s 5.1 AC-3 at 48 kHz, 1536 bytes */
+static Bytes AC3Frame(TestRandom &random)
+{
+	Bytes frame = {0x0B, 0x77, 0x12, 0x34, 0x1C, 0x40, 0xE1};
+	AppendPayload(frame, 1536, random);
+	return frame;
+}
+
+/* 192 kbit/s 5.1 E-AC-3 at 48 kHz, six blocks in 768 bytes, optionally
+ * followed by a dependent substream */
+static Bytes EAC3Frame(bool dependent, TestRandom &random)
+{
+	Bytes frame = {0x0B, 0x77, (unsigned char)(dependent ? 0x41 : 0x01),
+		       0x7F, 0x3F, 0x80};
+	AppendPayload(frame, 768, random);
+	return frame;
+}
+
+struct Output {
+	Bytes data;
+	long long startTime;
+	long long stopTime;
+};
+
+struct Parser {
+	std::shared_ptr<FramePool> pool = std::make_shared<FramePool>(4);
+	AudioFrameParser parser;
+	std::vector<Output> out;
+
+	Parser(AudioFormat format, bool latm = false)
+	{
+		parser.Reset(format, latm, pool,
+			     [this](const Frame &frame, long long startTime,
+				    long long stopTime) {
+				     Output output;
+				     output.data.assign(frame.Data(),
+							frame.Data() +
+								frame.Size());
+				     output.startTime = startTime;
+				     output.stopTime = stopTime;
+				     out.push_back(output);
+			     });
+	}
+
+	/* only the first packet has a timestamp, so every frame is timed
+	 * from the samples before it */
+	void Add(const Bytes &stream, unsigned maxChunk, unsigned seed)
+	{
+		TestRandom random(seed);
+
+		for (size_t pos = 0; pos < stream.size();) {
+			size_t chunk = 1 + random.Next(maxChunk);
+			chunk = std::min(chunk, stream.size() - pos);
+
+			Frame packet = pool->Copy(stream.data() + pos, chunk);
+			parser.Add(packet, pos == 0, START_TIME);
+			pos += chunk;
+		}
+	}
+};
+
+static void CheckFrames(const Parser &parser, const std::vector<Bytes> &frames,
+			int samples, int rate)
+{
+	CHECK_EQ(parser.out.size(), frames.size());
+	if (parser.out.size() != frames.size())
+		return;
+
+	for (size_t i = 0; i < frames.size(); i++) {
+		long long start = START_TIME +
+				  (long long)i * samples * 10000000LL / rate;
+		long long stop = START_TIME + (long long)(i + 1) * samples *
+						      10000000LL / rate;
+
+		CHECK(parser.out[i].data == frames[i]);
+		CHECK_EQ(parser.out[i].startTime, start);
+		CHECK_EQ(parser.out[i].stopTime, stop);
+	}
+}
+
+static void CheckConfig(const Parser &parser, const Bytes &config)
+{
+	CHECK(parser.parser.Config() == config);
+}
+
+static Bytes Join(const std::vector<Bytes> &frames)
+{
+	Bytes stream;
+	for (const Bytes &frame : frames)
+		stream.insert(stream.end(), frame.begin(), frame.end());
+	return stream;
+}
+
+static void TestADTS()
+{
+	TestRandom random;
+	std::vector<Bytes> frames;
+
+	for (int i = 0; i < 204; i++)
+		frames.push_back(ADTSFrame(200 + random.Next(600), random));
+
+	Bytes stream = Join(frames);
+
+	for (unsigned chunk : {1u, 7u, 2000u}) {
+		Parser parser(AudioFormat::AAC);
+		parser.Add(stream, chunk, chunk);
+
+		CheckFrames(parser, frames, 1024, 48000);
+		CheckConfig(parser, {0x11, 0x90});
+		CHECK_EQ(parser.parser.Info().sampleRate, 48000);
+		CHECK_EQ(parser.parser.Info().channels, 2);
+		CHECK_EQ(parser.parser.Info().samples, 1024);
+
+		/* 203 frames of 1024 samples in, rounded down */
+		if (!parser.out.empty())
+			CHECK_EQ(parser.out.back().startTime, 53306666);
+	}
+}
+
+static void TestLOAS()
+{
+	for (int version = 0; version <= 1; version++) {
+		TestRandom random;
+		std::vector<Bytes> frames;
+
+		for (int i = 0; i < 100; i++)
+			frames.push_back(LOASFrame(100 + random.Next(600),
+						   i == 0, version, random));
+
+		Bytes stream = Join(frames);
+
+		for (unsigned chunk : {1u, 7u, 2000u}) {
+			Parser parser(AudioFormat::AAC, true);
+			parser.Add(stream, chunk, chunk);
+
+			CheckFrames(parser, frames, 1024, 48000);
+			CheckConfig(parser, {0x11, 0x90});
+			CHECK_EQ(parser.parser.Info().channels, 2);
+		}
+	}
+}
+
+static void TestAC3()
+{
+	TestRandom random;
+	std::vector<Bytes> frames;
+
+	for (int i = 0; i < 50; i++)
+		frames.push_back(AC3Frame(random));
+
+	Bytes stream = Join(frames);
+
+	for (unsigned chunk : {1u, 7u, 5000u}) {
+		Parser parser(AudioFormat::AC3);
+		parser.Add(stream, chunk, chunk);
+
+		CheckFrames(parser, frames, 1536, 48000);
+		CheckConfig(parser, {0x10, 0x3D, 0xC0});
+		CHECK_EQ(parser.parser.Info().channels, 6);
+		CHECK_EQ(parser.parser.Info().samples, 1536);
+	}
+}
+
+/* dependent substreams go out as frames of their own, with no samples */
+static void TestEAC3()
+{
+	TestRandom random;
+	std::vector<Bytes> frames;
+
+	for (int i = 0; i < 50; i++) {
+		frames.push_back(EAC3Frame(false, random));
+		if (i % 2)
+			frames.push_back(EAC3Frame(true, random));
+	}
+
+	Bytes stream = Join(frames);
+
+	for (unsigned chunk : {1u, 7u, 5000u}) {
+		Parser parser(AudioFormat::AC3);
+		parser.Add(stream, chunk, chunk);
+
+		CheckConfig(parser, {0x06, 0x00, 0x20, 0x0F, 0x00});
+		CHECK_EQ(parser.out.size(), frames.size());
+		if (parser.out.size() != frames.size())
+			continue;
+
+		long long time = START_TIME;
+		for (size_t i = 0; i < frames.size(); i++) {
+			bool dependent = (frames[i][2] & 0xC0) == 0x40;
+			long long duration = dependent ? 0 : 320000;
+
+			CHECK(parser.out[i].data == frames[i]);
+			CHECK_EQ(parser.out[i].startTime, time);
+			CHECK_EQ(parser.out[i].stopTime, time + duration);
+			time += duration;
+		}
+	}
+}
+
+/* each packet's timestamp goes to the first frame that starts in it, and
+ * a packet that is exactly one frame isn't copied */
+static void TestPacketTimes()
+{
+	TestRandom random;
+	Parser parser(AudioFormat::AAC);
+	Bytes first = ADTSFrame(300, random);
+	Bytes second = ADTSFrame(300, random);
+	Bytes both = Join({first, second});
+
+	Frame packet = parser.pool->Copy(first.data(), first.size());
+	const unsigned char *data = nullptr;
+
+	parser.parser.Reset(AudioFormat::AAC, false, parser.pool,
+			    [&](const Frame &frame, long long startTime,
+				long long) {
+				    data = frame.Data();
+				    parser.out.push_back(
+					    {Bytes(), startTime, 0});
+			    });
+
+	parser.parser.Add(packet, true, 5000000);
+	CHECK(data == packet.Data());
+
+	Frame pair = parser.pool->Copy(both.data(), both.size());
+	parser.parser.Add(pair, true, 7000000);
+
+	CHECK_EQ(parser.out.size(), 3);
+	if (parser.out.size() == 3) {
+		CHECK_EQ(parser.out[0].startTime, 5000000);
+		CHECK_EQ(parser.out[1].startTime, 7000000);
+		CHECK_EQ(parser.out[2].startTime, 7000000 + 213333);
+	}
+}
+
+/* junk between frames is skipped */
+static void TestJunk()
+{
+	TestRandom random;
+	std::vector<Bytes> frames;
+	Bytes stream;
+
+	for (int i = 0; i < 20; i++) {
+		Bytes junk(1 + random.Next(20), 0x55);
+		Bytes frame = ADTSFrame(200, random);
+
+		stream.insert(stream.end(), junk.begin(), junk.end());
+		stream.insert(stream.end(), frame.begin(), frame.end());
+		frames.push_back(frame);
+	}
+
+	Parser parser(AudioFormat::AAC);
+	parser.Add(stream, 7, 1);
+	CheckFrames(parser, frames, 1024, 48000);
+}
+
+/* real frames with random data between them, and bytes damaged here and
+ * there.  That mustn't crash the parser, and what comes out of it still
+ * has to be frames */
+static void TestRandomData()
+{
+	const AudioFormat formats[] = {AudioFormat::AAC, AudioFormat::AAC,
+				       AudioFormat::AC3};
+	const unsigned char syncBytes[] = {0xFF, 0x0B, 0x77, 0x56};
+
+	for (int f = 0; f < 3; f++) {
+		TestRandom random(f + 1);
+		Bytes stream;
+
+		for (int i = 0; i < 300; i++) {
+			Bytes frame = f == 0   ? ADTSFrame(300, random)
+				      : f == 1 ? LOASFrame(300, i == 0, 1,
+							   random)
+						: EAC3Frame(i % 2, random);
+			stream.insert(stream.end(), frame.begin(),
+				      frame.end());
+
+			/* plenty of sync words to trip over */
+			size_t junk = random.Next(50);
+			for (size_t j = 0; j < junk; j++) {
+				unsigned value = random.Next(8);
+				if (value < 4)
+					stream.push_back(syncBytes[value]);
+				else
+					stream.push_back(
+						(unsigned char)random.Next());
+			}
+		}
+
+		/* the first frame has the LATM setup the others need */
+		for (size_t i = 0; i < stream.size() / 100; i++) {
+			size_t pos = 300 + random.Next((unsigned)stream.size() -
+						       300);
+			stream[pos] = (unsigned char)random.Next();
+		}
+
+		Parser parser(formats[f], f == 1);
+		parser.Add(stream, 7, f);
+		parser.Add(stream, 5000, f);
+		CHECK(!parser.out.empty());
+
+		for (const Output &output : parser.out) {
+			const unsigned char *data = output.data.data();
+			size_t size = f == 1 ? GetLOASFrameSize(data)
+					     : GetAudioFrameSize(formats[f],
+								 data);
+
+			CHECK_EQ(size, output.data.size());
+			CHECK(output.stopTime >= output.startTime);
+		}
+	}
+}
+
+int main()
+{
+	RUN_TEST(TestADTS);
+	RUN_TEST(TestLOAS);
+	RUN_TEST(TestAC3);
+	RUN_TEST(TestEAC3);
+	RUN_TEST(TestPacketTimes);
+	RUN_TEST(TestJunk);
+	RUN_TEST(TestRandomData);
+	return TestResult();
+}
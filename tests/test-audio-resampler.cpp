@@ -0,0 +1,307 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "test.hpp"
+#include "audio-resampler.hpp"
+
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace DShow;
+
+static const ConvertPath simdPaths[] = {
+	ConvertPath::SSE2,
+	ConvertPath::SSSE3,
+	ConvertPath::AVX2,
+	ConvertPath::NEON,
+};
+
+static const AudioResampling qualities[] = {
+	AudioResampling::Fast,
+	AudioResampling::Medium,
+	AudioResampling::Best,
+};
+
+static const int ratePairs[][2] = {
+	{44100, 48000}, {32000, 48000}, {48000, 44100}, {48000, 32000},
+	{22050, 48000}, {96000, 48000}, {44100, 44099},
+};
+
+/* chunk sizes are odd and uneven, like device buffers */
+static size_t NextChunk(TestRandom &random)
+{
+	return 1 + random.Next(500) * 2;
+}
+
+static size_t Resample(AudioResampler &resampler, const float *input,
+		       size_t frames, int channels, TestRandom &random,
+		       std::vector<float> &output)
+{
+	size_t total = 0;
+	size_t done = 0;
+
+	while (done < frames) {
+		size_t count = std::min(frames - done, NextChunk(random));
+		long long time;
+
+		total += resampler.Process(input + done * channels, count, 0,
+					   output, time);
+		done += count;
+	}
+
+	return total;
+}
+
+/* the dot products of every path sum in the same order, so every SIMD
+ * path has to match the scalar path bit for bit */
+static void TestPathsMatchScalar()
+{
+	TestRandom random;
+	int compared = 0;
+
+	for (ConvertPath path : simdPaths) {
+		if (!ConvertPathSupported(path))
+			continue;
+
+		for (AudioResampling quality : qualities) {
+			for (const auto &rates : ratePairs) {
+				int channels = 1 + (int)random.Next(8);
+				size_t frames = 1 + random.Next(5000);
+				std::vector<float> in(frames * channels);
+				std::vector<float> expected;
+				std::vector<float> actual;
+				AudioResampler scalar;
+				AudioResampler simd;
+
+				for (float &sample : in)
+					sample = (float)random.Next(2000001) /
+							 1000000.0f -
+						 1.0f;
+
+				CHECK(scalar.Reset(rates[0], rates[1],
+						   channels, quality,
+						   ConvertPath::Scalar));
+				CHECK(simd.Reset(rates[0], rates[1], channels,
+						 quality, path));
+
+				/* chunking must not change the output */
+				TestRandom chunks(compared + 1);
+				TestRandom otherChunks(compared + 2);
+				Resample(scalar, in.data(), frames, channels,
+					 chunks, expected);
+				Resample(simd, in.data(), frames, channels,
+					 otherChunks, actual);
+
+				CHECK_EQ(expected.size(), actual.size());
+				CHECK(expected.size() == actual.size() &&
+				      (expected.empty() ||
+				       memcmp(expected.data(), actual.data(),
+					      expected.size() *
+						      sizeof(float)) == 0));
+				compared++;
+			}
+		}
+	}
+
+	printf("compared %d resamplers\n", compared);
+}
+
+/* every second of input has to come out as exactly outRate frames, however
+ * the input is chunked, and the output has to be timed as if it had been
+ * sampled at outRate from the first input frame */
+static void TestRateAndTiming()
+{
+	static const int rates[][2] = {{44100, 48000}, {32000, 48000}};
+	const int seconds = 30;
+	const long long baseTime = 123456789LL;
+	TestRandom random;
+
+	for (const auto &rate : rates) {
+		for (AudioResampling quality : qualities) {
+			int inRate = rate[0];
+			int outRate = rate[1];
+			AudioResampler resampler;
+			std::vector<float> in(inRate * 2);
+			std::vector<float> output;
+			size_t total = 0;
+			size_t lastSecond = 0;
+			long long lastTime = 0;
+			size_t lastCount = 0;
+			bool exact = true;
+			bool continuous = true;
+			bool onClock = true;
+
+			CHECK(resampler.Reset(inRate, outRate, 2, quality));
+
+			for (int s = 0; s < seconds; s++) {
+				size_t done = 0;
+
+				while (done < (size_t)inRate) {
+					size_t count = std::min(
+						inRate - done,
+						NextChunk(random));
+					size_t input = (size_t)s * inRate +
+						       done;
+					long long start =
+						baseTime +
+						(long long)input * 10000000LL /
+							inRate;
+					long long time = 0;
+
+					output.clear();
+					size_t n = resampler.Process(
+						in.data(), count, start,
+						output, time);
+					done += count;
+
+					if (!n)
+						continue;
+
+					/* starts where the last chunk ended,
+					 * give or take both their roundings
+					 * to 100ns */
+					long long expected =
+						lastTime +
+						(long long)lastCount *
+							10000000LL / outRate;
+					if (lastCount &&
+					    llabs(time - expected) > 2)
+						continuous = false;
+
+					/* and where its frames fall on the
+					 * output clock */
+					expected = baseTime +
+						   (long long)total *
+							   10000000LL /
+							   outRate;
+					if (llabs(time - expected) > 1)
+						onClock = false;
+
+					CHECK_EQ(output.size(), n * 2);
+					total += n;
+					lastTime = time;
+					lastCount = n;
+				}
+
+				/* the first second is short by the delay */
+				if (s && total - lastSecond != (size_t)outRate)
+					exact = false;
+				lastSecond = total;
+			}
+
+			/* output lags by the filter delay, no more */
+			size_t lag = (size_t)resampler.Delay() * outRate /
+				     inRate;
+			CHECK(total <= (size_t)seconds * outRate);
+			CHECK(total + lag + 2 >= (size_t)seconds * outRate);
+			CHECK(exact);
+			CHECK(continuous);
+			CHECK(onClock);
+		}
+	}
+}
+
+static double Power(const std::vector<float> &samples, size_t skip)
+{
+	double sum = 0.0;
+	for (size_t i = skip; i < samples.size(); i++)
+		sum += (double)samples[i] * samples[i];
+	return sum / (double)(samples.size() - skip);
+}
+
+static std::vector<float> Sine(int rate, double freq, size_t frames)
+{
+	std::vector<float> samples(frames);
+	for (size_t i = 0; i < frames; i++)
+		samples[i] = (float)(0.5 * sin(2.0 * M_PI * freq * i / rate));
+	return samples;
+}
+
+/* a constant comes out unchanged, the passband is flat and anything above
+ * the output Nyquist is filtered out instead of aliasing */
+static void TestResponse()
+{
+	static const int rates[][2] = {{44100, 48000}, {32000, 48000},
+				       {48000, 44100}, {48000, 32000}};
+	static const double minRejection[] = {40.0, 60.0, 80.0};
+	TestRandom random;
+
+	for (const auto &rate : rates) {
+		for (int q = 0; q < 3; q++) {
+			int inRate = rate[0];
+			int outRate = rate[1];
+			AudioResampler resampler;
+			std::vector<float> output;
+			size_t skip = (size_t)outRate / 10;
+
+			/* DC */
+			std::vector<float> dc(inRate, 0.25f);
+			CHECK(resampler.Reset(inRate, outRate, 1,
+					      qualities[q]));
+			Resample(resampler, dc.data(), dc.size(), 1, random,
+				 output);
+
+			bool flat = output.size() > skip;
+			for (size_t i = skip; i < output.size(); i++)
+				if (fabsf(output[i] - 0.25f) > 0.25f * 1e-3f)
+					flat = false;
+			CHECK(flat);
+
+			/* 1 kHz passes at full level */
+			std::vector<float> tone = Sine(inRate, 1000.0, inRate);
+			resampler.Clear();
+			output.clear();
+			Resample(resampler, tone.data(), tone.size(), 1,
+				 random, output);
+
+			double gain = 10.0 * log10(Power(output, skip) /
+						   Power(tone, skip));
+			CHECK(fabs(gain) < 0.05);
+
+			/* a tone past the output Nyquist is stopped */
+			if (outRate > inRate)
+				continue;
+
+			double freq = std::min(outRate * 0.55, inRate * 0.49);
+
+			tone = Sine(inRate, freq, inRate);
+			resampler.Clear();
+			output.clear();
+			Resample(resampler, tone.data(), tone.size(), 1,
+				 random, output);
+
+			double rejection = 10.0 * log10(Power(tone, skip) /
+							Power(output, skip));
+			printf("%d -> %d quality %d: %.1f dB at %.0f Hz\n",
+			       inRate, outRate, q, rejection, freq);
+			CHECK(rejection > minRejection[q]);
+		}
+	}
+}
+
+int main()
+{
+	RUN_TEST(TestPathsMatchScalar);
+	RUN_TEST(TestRateAndTiming);
+	RUN_TEST(TestResponse);
+	return TestResult();
+}
@@ -0,0 +1,94 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "test.hpp"
+#include "capture-stats.hpp"
+
+#include <thread>
+
+using namespace DShow;
+
+static unsigned long long BucketTotal(const Histogram &histogram)
+{
+	unsigned long long total = 0;
+	for (int i = 0; i < DSHOW_HISTOGRAM_BUCKETS; i++)
+		total += histogram.buckets[i];
+	return total;
+}
+
+static void TestRecordBuckets()
+{
+	AtomicHistogram atomic;
+	Histogram histogram;
+
+	atomic.Record(0);
+	atomic.Record(15);
+	atomic.Record(16);
+	atomic.Record(1000);
+	atomic.Snapshot(histogram);
+
+	CHECK_EQ(histogram.count, 4);
+	CHECK_EQ(histogram.sum, 1031);
+	CHECK_EQ(histogram.buckets[0], 1);
+	CHECK_EQ(histogram.buckets[15], 1);
+	CHECK_EQ(histogram.buckets[16], 1);
+	CHECK_EQ(histogram.Percentile(0.0), 1);
+	CHECK(histogram.Percentile(1.0) > 1000);
+}
+
+/* snapshots taken while another thread records must never have a count
+ * below the total of their buckets */
+static void TestSnapshotWhileRecording()
+{
+	AtomicHistogram atomic;
+	bool consistent = true;
+	unsigned long long lastCount = 0;
+	std::atomic<bool> done(false);
+
+	std::thread writer([&]() {
+		TestRandom random;
+		for (int i = 0; i < 2000000; i++)
+			atomic.Record(random.Next(100000));
+		done = true;
+	});
+
+	while (!done) {
+		Histogram histogram;
+		atomic.Snapshot(histogram);
+
+		if (histogram.count != BucketTotal(histogram) ||
+		    histogram.count < lastCount)
+			consistent = false;
+		lastCount = histogram.count;
+	}
+
+	writer.join();
+	CHECK(consistent);
+
+	Histogram histogram;
+	atomic.Snapshot(histogram);
+	CHECK_EQ(histogram.count, 2000000);
+}
+
+int main()
+{
+	RUN_TEST(TestRecordBuckets);
+	RUN_TEST(TestSnapshotWhileRecording);
+	return TestResult();
+}
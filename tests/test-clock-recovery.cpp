@@ -0,0 +1,160 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "test.hpp"
+#include "clock-recovery.hpp"
+
+using namespace DShow;
+
+#define NOMINAL_30FPS 333667LL
+#define ONE_HOUR 36000000000LL
+
+/*
+ * Feeds a stream whose samples are really interval apart through clock
+ * recovery, with raw timestamps and host arrival times each jittered by up
+ * to +/-jitter.  Returns the largest distance between the output and the
+ * true sample time, or -1 if the output ever failed to increase.
+ */
+static long long RunTrace(ClockRecovery &clock, long long interval,
+			  long long jitter, long long length,
+			  long long duration = 0, int dropEvery = 0)
+{
+	TestRandom random;
+	long long lastOut = 0;
+	long long maxError = 0;
+	long long frames = length / interval;
+
+	for (long long i = 0; i < frames; i++) {
+		if (dropEvery && i % dropEvery == dropEvery - 1)
+			continue;
+
+		long long time = 1000000000LL + i * interval;
+		long long raw = time + random.Next(jitter * 2 + 1) - jitter;
+		long long host = time + random.Next(jitter * 2 + 1) - jitter;
+
+		long long out = clock.Process(raw, host, duration);
+		if (i && out <= lastOut)
+			return -1;
+
+		long long error = out > time ? out - time : time - out;
+		if (error > maxError)
+			maxError = error;
+		lastOut = out;
+	}
+
+	return maxError;
+}
+
+/* a stream that matches its nominal rate comes out perfectly regular */
+static void TestRegularStream()
+{
+	ClockRecovery clock;
+	clock.Reset(NOMINAL_30FPS);
+
+	long long first = clock.Process(5000000, 5000000, 0);
+	TestRandom random;
+
+	for (long long i = 1; i < 1000; i++) {
+		long long time = 5000000 + i * NOMINAL_30FPS;
+		long long raw = time + random.Next(40001) - 20000;
+		CHECK_EQ(clock.Process(raw, time, 0),
+			 first + i * NOMINAL_30FPS);
+	}
+}
+
+/* 30000/1001 nominal against a device that really runs at 30 fps */
+static void TestFastDevice()
+{
+	ClockRecovery clock;
+	clock.Reset(NOMINAL_30FPS);
+
+	long long error = RunTrace(clock, 333333, 20000, ONE_HOUR);
+	CHECK(error >= 0);
+	CHECK(error <= NOMINAL_30FPS / 2 + 40000);
+}
+
+static void TestSlowDevice()
+{
+	ClockRecovery clock;
+	clock.Reset(333333);
+
+	long long error = RunTrace(clock, NOMINAL_30FPS, 20000, ONE_HOUR);
+	CHECK(error >= 0);
+	CHECK(error <= NOMINAL_30FPS / 2 + 40000);
+}
+
+/* lost frames are skipped over rather than squeezed together */
+static void TestDroppedFrames()
+{
+	ClockRecovery clock;
+	clock.Reset(NOMINAL_30FPS);
+
+	long long error = RunTrace(clock, NOMINAL_30FPS, 20000,
+				   ONE_HOUR / 60, 0, 7);
+	CHECK(error >= 0);
+	CHECK(error <= 20000);
+}
+
+/* audio buffers that claim 10 ms while the device delivers them 0.1%
+ * faster */
+static void TestFastAudio()
+{
+	ClockRecovery clock;
+	clock.Reset(0);
+
+	long long error = RunTrace(clock, 99900, 20000, ONE_HOUR / 4, 100000);
+	CHECK(error >= 0);
+	CHECK(error <= 50000 + 40000);
+}
+
+static void TestSlowAudio()
+{
+	ClockRecovery clock;
+	clock.Reset(0);
+
+	long long error = RunTrace(clock, 100100, 20000, ONE_HOUR / 4, 100000);
+	CHECK(error >= 0);
+	CHECK(error <= 50000 + 40000);
+}
+
+static void TestDrift()
+{
+	ClockRecovery clock;
+	clock.Reset(NOMINAL_30FPS);
+
+	/* sample clock running 100 ppm fast against the host */
+	for (long long i = 0; i < 3000; i++) {
+		long long host = i * NOMINAL_30FPS;
+		clock.Process(host + host / 10000, host, 0);
+	}
+
+	CHECK(clock.DriftPpm() > 99.0 && clock.DriftPpm() < 101.0);
+}
+
+int main()
+{
+	RUN_TEST(TestRegularStream);
+	RUN_TEST(TestFastDevice);
+	RUN_TEST(TestSlowDevice);
+	RUN_TEST(TestDroppedFrames);
+	RUN_TEST(TestFastAudio);
+	RUN_TEST(TestSlowAudio);
+	RUN_TEST(TestDrift);
+	return TestResult();
+}
@@ -0,0 +1,205 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "test.hpp"
+#include "dshow-convert.hpp"
+
+#include <string.h>
+#include <vector>
+
+using namespace DShow;
+
+static const VideoFormat inFormats[] = {
+	VideoFormat::YUY2,
+	VideoFormat::YVYU,
+	VideoFormat::UYVY,
+	VideoFormat::HDYC,
+};
+
+static const VideoFormat outFormats[] = {
+	VideoFormat::I420,
+	VideoFormat::YV12,
+	VideoFormat::NV12,
+	VideoFormat::I444,
+};
+
+static const ConvertPath simdPaths[] = {
+	ConvertPath::SSE2,
+	ConvertPath::SSSE3,
+	ConvertPath::AVX2,
+	ConvertPath::NEON,
+};
+
+struct Image {
+	std::vector<unsigned char> data;
+	unsigned char *planes[3];
+	int linesize[3];
+
+	Image(VideoFormat format, int width, int height)
+	{
+		size_t offset[3];
+		size_t size = GetVideoLayout(format, width, height, linesize,
+					     offset);
+
+		/* filled so that anything left unwritten shows up */
+		data.assign(size, 0xCD);
+		for (int i = 0; i < 3; i++)
+			planes[i] = linesize[i] ? &data[offset[i]] : nullptr;
+	}
+};
+
+static void FillRandom(std::vector<unsigned char> &data, TestRandom &random)
+{
+	for (unsigned char &value : data)
+		value = (unsigned char)random.Next(256);
+}
+
+static bool Convert(VideoFormat inFormat, const Image &in,
+		    VideoFormat outFormat, Image &out, int width, int height,
+		    ConvertPath path)
+{
+	return ConvertPackedYUV(inFormat, in.data.data(), in.linesize[0],
+				outFormat, out.planes, out.linesize, width,
+				height, path);
+}
+
+/* one macropixel pair worked out by hand */
+static void TestScalarValues()
+{
+	const unsigned char yuy2[] = {
+		10, 20, 30, 40, /* Y0 U Y1 V */
+		50, 61, 70, 81,
+	};
+	Image in(VideoFormat::YUY2, 2, 2);
+	Image out(VideoFormat::I420, 2, 2);
+
+	memcpy(in.data.data(), yuy2, sizeof(yuy2));
+	CHECK(Convert(VideoFormat::YUY2, in, VideoFormat::I420, out, 2, 2,
+		      ConvertPath::Scalar));
+
+	CHECK_EQ(out.planes[0][0], 10);
+	CHECK_EQ(out.planes[0][1], 30);
+	CHECK_EQ(out.planes[0][2], 50);
+	CHECK_EQ(out.planes[0][3], 70);
+	CHECK_EQ(out.planes[1][0], 41); /* (20 + 61 + 1) / 2 */
+	CHECK_EQ(out.planes[2][0], 61); /* (40 + 81 + 1) / 2 */
+
+	Image yv12(VideoFormat::YV12, 2, 2);
+	CHECK(Convert(VideoFormat::YVYU, in, VideoFormat::YV12, yv12, 2, 2,
+		      ConvertPath::Scalar));
+	CHECK_EQ(yv12.planes[1][0], 41);
+	CHECK_EQ(yv12.planes[2][0], 61);
+
+	Image i444(VideoFormat::I444, 2, 2);
+	CHECK(Convert(VideoFormat::UYVY, in, VideoFormat::I444, i444, 2, 2,
+		      ConvertPath::Scalar));
+	CHECK_EQ(i444.planes[0][0], 20);
+	CHECK_EQ(i444.planes[0][1], 40);
+	CHECK_EQ(i444.planes[1][0], 10);
+	CHECK_EQ(i444.planes[1][1], 10);
+	CHECK_EQ(i444.planes[2][1], 30);
+}
+
+/* every SIMD path has to match the scalar path byte for byte, including
+ * the pixels left over past the last full vector */
+static void TestPathsMatchScalar()
+{
+	TestRandom random;
+	int compared = 0;
+
+	for (ConvertPath path : simdPaths) {
+		if (!ConvertPathSupported(path))
+			continue;
+
+		for (int width = 1; width <= 200; width++) {
+			int height = 1 + random.Next(8);
+
+			for (VideoFormat inFormat : inFormats) {
+				Image in(inFormat, width, height);
+				FillRandom(in.data, random);
+
+				for (VideoFormat outFormat : outFormats) {
+					Image expected(outFormat, width,
+						       height);
+					Image actual(outFormat, width, height);
+
+					Convert(inFormat, in, outFormat,
+						expected, width, height,
+						ConvertPath::Scalar);
+					CHECK(Convert(inFormat, in, outFormat,
+						      actual, width, height,
+						      path));
+					CHECK(expected.data == actual.data);
+					compared++;
+				}
+			}
+		}
+	}
+
+	printf("compared %d conversions\n", compared);
+}
+
+/* a negative linesize reads a bottom-up frame */
+static void TestFlip()
+{
+	const int width = 64;
+	const int height = 6;
+	TestRandom random;
+	Image in(VideoFormat::UYVY, width, height);
+	Image flipped(VideoFormat::UYVY, width, height);
+	Image expected(VideoFormat::NV12, width, height);
+	Image actual(VideoFormat::NV12, width, height);
+	int linesize = in.linesize[0];
+
+	FillRandom(in.data, random);
+	for (int row = 0; row < height; row++)
+		memcpy(&flipped.data[(height - 1 - row) * linesize],
+		       &in.data[row * linesize], linesize);
+
+	ConvertPackedYUV(VideoFormat::UYVY, in.data.data(), linesize,
+			 VideoFormat::NV12, expected.planes, expected.linesize,
+			 width, height);
+	ConvertPackedYUV(VideoFormat::UYVY,
+			 &flipped.data[(height - 1) * linesize], -linesize,
+			 VideoFormat::NV12, actual.planes, actual.linesize,
+			 width, height);
+	CHECK(expected.data == actual.data);
+}
+
+static void TestUnsupported()
+{
+	Image in(VideoFormat::YUY2, 16, 2);
+	Image out(VideoFormat::I420, 16, 2);
+
+	CHECK(!Convert(VideoFormat::I420, in, VideoFormat::I420, out, 16, 2,
+		       ConvertPath::Scalar));
+	CHECK(!Convert(VideoFormat::YUY2, in, VideoFormat::XRGB, out, 16, 2,
+		       ConvertPath::Scalar));
+	CHECK(!Convert(VideoFormat::YUY2, in, VideoFormat::I420, out, 0, 2,
+		       ConvertPath::Scalar));
+}
+
+int main()
+{
+	RUN_TEST(TestScalarValues);
+	RUN_TEST(TestPathsMatchScalar);
+	RUN_TEST(TestFlip);
+	RUN_TEST(TestUnsupported);
+	return TestResult();
+}
@@ -0,0 +1,163 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "test.hpp"
+#include "frame-buffer.hpp"
+
+using namespace DShow;
+
+/* stands in for IMediaSample, which FramePool only AddRefs and Releases */
+struct FakeSample {
+	long refs = 1;
+	unsigned char data[64] = {};
+
+	inline unsigned long AddRef() { return ++refs; }
+	inline unsigned long Release() { return --refs; }
+};
+
+static void TestWrapHoldsSample()
+{
+	auto pool = std::make_shared<FramePool>(2);
+	FakeSample sample;
+
+	{
+		Frame frame = pool->Wrap(&sample, sample.data, 16);
+		CHECK(frame.Valid());
+		CHECK(frame.Data() == sample.data);
+		CHECK_EQ(frame.Size(), 16);
+		CHECK_EQ(sample.refs, 2);
+		CHECK_EQ(pool->Outstanding(), 1);
+
+		/* copies of the handle share the reference */
+		Frame copy = frame;
+		CHECK_EQ(sample.refs, 2);
+		frame.Release();
+		CHECK(!frame.Valid());
+		CHECK_EQ(sample.refs, 2);
+		CHECK(copy.Data() == sample.data);
+	}
+
+	CHECK_EQ(sample.refs, 1);
+	CHECK_EQ(pool->Outstanding(), 0);
+}
+
+static void TestWrapCopiesPastCap()
+{
+	auto pool = std::make_shared<FramePool>(2);
+	FakeSample samples[3];
+
+	for (int i = 0; i < 3; i++)
+		samples[i].data[0] = (unsigned char)(i + 1);
+
+	Frame a = pool->Wrap(&samples[0], samples[0].data, 8);
+	Frame b = pool->Wrap(&samples[1], samples[1].data, 8);
+	CHECK(!pool->CanWrap());
+
+	Frame c = pool->Wrap(&samples[2], samples[2].data, 8);
+	CHECK_EQ(samples[2].refs, 1);
+	CHECK(c.Data() != samples[2].data);
+	CHECK_EQ(c.Data()[0], 3);
+	CHECK_EQ(pool->Outstanding(), 2);
+
+	/* once a sample is let go, the next one is referenced again */
+	a.Release();
+	CHECK_EQ(samples[0].refs, 1);
+	CHECK(pool->CanWrap());
+
+	Frame d = pool->Wrap(&samples[0], samples[0].data, 8);
+	CHECK(d.Data() == samples[0].data);
+	CHECK_EQ(samples[0].refs, 2);
+}
+
+static void TestNullSampleCopies()
+{
+	auto pool = std::make_shared<FramePool>(4);
+	unsigned char data[4] = {1, 2, 3, 4};
+
+	Frame frame = pool->Wrap((FakeSample *)nullptr, data, sizeof(data));
+	CHECK(frame.Valid());
+	CHECK(frame.Data() != data);
+	CHECK_EQ(frame.Data()[3], 4);
+	CHECK_EQ(pool->Outstanding(), 0);
+}
+
+static void TestPooledBuffersRecycle()
+{
+	auto pool = std::make_shared<FramePool>(2);
+	unsigned char *first;
+
+	{
+		Frame frame = pool->Allocate(4096);
+		first = frame.Data();
+	}
+
+	/* the buffer goes back to the pool with its capacity */
+	std::vector<unsigned char> bytes = pool->TakeBuffer();
+	CHECK(bytes.capacity() >= 4096);
+	CHECK(bytes.data() == first);
+
+	bytes.resize(100);
+	Frame adopted = pool->Adopt(std::move(bytes));
+	CHECK_EQ(adopted.Size(), 100);
+	CHECK(adopted.Data() == first);
+}
+
+static void TestFrameOutlivesPool()
+{
+	FakeSample sample;
+	Frame frame;
+
+	{
+		auto pool = std::make_shared<FramePool>(1);
+		frame = pool->Wrap(&sample, sample.data, 4);
+	}
+
+	/* the frame keeps the pool alive until it's released */
+	CHECK_EQ(sample.refs, 2);
+	frame.Release();
+	CHECK_EQ(sample.refs, 1);
+}
+
+static void TestPlanesAndKeyframe()
+{
+	auto pool = std::make_shared<FramePool>(1);
+	Frame frame = pool->Allocate(64);
+
+	frame.SetPlane(0, frame.Data() + 48, -16);
+	frame.SetKeyframe(true);
+	CHECK(frame.Plane(0) == frame.Data() + 48);
+	CHECK_EQ(frame.Linesize(0), -16);
+	CHECK(frame.Keyframe());
+
+	frame.Release();
+	CHECK(!frame.Plane(0));
+	CHECK_EQ(frame.Linesize(0), 0);
+	CHECK(!frame.Keyframe());
+}
+
+int main()
+{
+	RUN_TEST(TestWrapHoldsSample);
+	RUN_TEST(TestWrapCopiesPastCap);
+	RUN_TEST(TestNullSampleCopies);
+	RUN_TEST(TestPooledBuffersRecycle);
+	RUN_TEST(TestFrameOutlivesPool);
+	RUN_TEST(TestPlanesAndKeyframe);
+	return TestResult();
+}
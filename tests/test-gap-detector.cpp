@@ -0,0 +1,97 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "test.hpp"
+#include "gap-detector.hpp"
+
+using namespace DShow;
+
+#define INTERVAL 333333LL
+
+static void TestFirstSampleAfterReset()
+{
+	GapDetector detector;
+	StreamEvent event;
+
+	/* the first sample after a start is always flagged */
+	detector.ResetVideo(INTERVAL);
+	CHECK(!detector.Process(1000000, true, 0, event));
+	CHECK(!detector.Process(1000000 + INTERVAL, false, 0, event));
+
+	detector.ResetVideo(INTERVAL);
+	CHECK(!detector.Process(0, true, 0, event));
+
+	/* but a flag later in the stream is reported */
+	CHECK(detector.Process(INTERVAL, true, 0, event));
+	CHECK(event.type == StreamEventType::Discontinuity);
+}
+
+static void TestVideoGaps()
+{
+	GapDetector detector;
+	StreamEvent event;
+	long long time = 0;
+
+	detector.ResetVideo(INTERVAL);
+	CHECK(!detector.Process(time, false, 0, event));
+
+	/* a little jitter is not a lost frame */
+	time += INTERVAL + INTERVAL / 3;
+	CHECK(!detector.Process(time, false, 0, event));
+
+	time += INTERVAL * 3;
+	CHECK(detector.Process(time, false, 0, event));
+	CHECK(event.type == StreamEventType::DroppedFrames);
+	CHECK_EQ(event.count, 2);
+	CHECK_EQ(event.timestamp, time);
+
+	CHECK(detector.Process(time, false, 0, event));
+	CHECK(event.type == StreamEventType::DuplicateTimestamp);
+
+	CHECK(detector.Process(time - INTERVAL, false, 0, event));
+	CHECK(event.type == StreamEventType::Discontinuity);
+}
+
+static void TestAudioGaps()
+{
+	GapDetector detector;
+	StreamEvent event;
+
+	/* 48 kHz stereo 16-bit, 10 ms buffers */
+	detector.ResetAudio(48000, 4);
+	CHECK(!detector.Process(0, false, 1920, event));
+	CHECK(!detector.Process(100000, false, 1920, event));
+
+	/* within tolerance */
+	CHECK(!detector.Process(230000, false, 1920, event));
+
+	/* 20 ms missing */
+	CHECK(detector.Process(530000, false, 1920, event));
+	CHECK(event.type == StreamEventType::DroppedFrames);
+	CHECK_EQ(event.gap, 200000);
+	CHECK_EQ(event.count, 960);
+}
+
+int main()
+{
+	RUN_TEST(TestFirstSampleAfterReset);
+	RUN_TEST(TestVideoGaps);
+	RUN_TEST(TestAudioGaps);
+	return TestResult();
+}
@@ -0,0 +1,149 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "test.hpp"
+#include "h264-parser.hpp"
+
+#include <vector>
+
+using namespace DShow;
+
+static const ConvertPath simdPaths[] = {
+	ConvertPath::SSE2,
+	ConvertPath::AVX2,
+	ConvertPath::NEON,
+};
+
+/* 1920x1080 high profile, level 4.0, 30 fps */
+static const unsigned char sps[] = {
+	0x67, 0x64, 0x00, 0x28, 0xAC, 0xD9, 0x40, 0x78, 0x02,
+	0x27, 0xE5, 0x84, 0x00, 0x00, 0x03, 0x00, 0x04, 0x00,
+	0x00, 0x03, 0x00, 0xF0, 0x3C, 0x60, 0xC6, 0x58,
+};
+
+/* start codes at every offset, in buffers of every length, and in data
+ * full of zeros that almost make one */
+static void TestFindStartCodePaths()
+{
+	TestRandom random;
+	int compared = 0;
+
+	for (size_t size = 0; size < 300; size++) {
+		std::vector<unsigned char> data(size);
+
+		for (int round = 0; round < 20; round++) {
+			for (unsigned char &value : data)
+				value = random.Next(3) ? 0 : random.Next(3);
+
+			size_t expected = FindStartCode(data.data(), size,
+							ConvertPath::Scalar);
+
+			for (ConvertPath path : simdPaths) {
+				if (!ConvertPathSupported(path))
+					continue;
+
+				CHECK_EQ(FindStartCode(data.data(), size,
+						       path),
+					 expected);
+				compared++;
+			}
+		}
+	}
+
+	const unsigned char none[] = {0, 0, 2, 0, 0, 0, 3, 1, 0, 0};
+	CHECK_EQ(FindStartCode(none, sizeof(none)), sizeof(none));
+
+	const unsigned char last[] = {5, 0, 0, 0, 1};
+	CHECK_EQ(FindStartCode(last, sizeof(last)), 2);
+
+	printf("compared %d scans\n", compared);
+}
+
+static void TestSplit()
+{
+	const unsigned char stream[] = {
+		0, 0, 0, 1, 0x09, 0xF0,       /* AUD, four byte code */
+		0, 0, 1,    0x68, 0xEB, 0,    /* PPS with a trailing zero */
+		0, 0, 1,    0x65, 0x88, 0x84, /* IDR */
+	};
+	std::vector<H264NAL> nals;
+
+	SplitH264(stream, sizeof(stream), nals);
+	CHECK_EQ(nals.size(), 3);
+	if (nals.size() != 3)
+		return;
+
+	CHECK_EQ(nals[0].type, H264_NAL_AUD);
+	CHECK(nals[0].data == stream + 4);
+	CHECK_EQ(nals[0].size, 2);
+	CHECK_EQ(nals[1].type, H264_NAL_PPS);
+	CHECK_EQ(nals[1].size, 2);
+	CHECK_EQ(nals[2].type, H264_NAL_IDR);
+	CHECK_EQ(nals[2].size, 3);
+}
+
+static void TestParseSPS()
+{
+	H264SPS info;
+
+	CHECK(ParseH264SPS(sps, sizeof(sps), info));
+	CHECK_EQ(info.width, 1920);
+	CHECK_EQ(info.height, 1080);
+	CHECK_EQ(info.profile, 100);
+	CHECK_EQ(info.level, 40);
+	CHECK_EQ(info.frameInterval, 333333);
+	CHECK(!info.interlaced);
+
+	CHECK(!ParseH264SPS(sps, 4, info));
+}
+
+static void TestParser()
+{
+	std::vector<unsigned char> packet = {0, 0, 0, 1};
+	packet.insert(packet.end(), sps, sps + sizeof(sps));
+	const unsigned char idr[] = {0, 0, 1, 0x65, 0x88, 0x84};
+	packet.insert(packet.end(), idr, idr + sizeof(idr));
+
+	H264Parser parser;
+	H264Parser::PacketInfo info;
+
+	parser.Parse(packet.data(), packet.size(), info);
+	CHECK(info.keyframe);
+	CHECK(info.spsChanged);
+	CHECK(parser.HasSPS());
+	CHECK_EQ(parser.SPS().width, 1920);
+
+	/* the same SPS again isn't a change */
+	parser.Parse(packet.data(), packet.size(), info);
+	CHECK(!info.spsChanged);
+
+	const unsigned char p[] = {0, 0, 1, 0x41, 0x9A};
+	parser.Parse(p, sizeof(p), info);
+	CHECK(!info.keyframe);
+	CHECK_EQ(GetH264FirstMB(p + 3, 2), 0);
+}
+
+int main()
+{
+	RUN_TEST(TestFindStartCodePaths);
+	RUN_TEST(TestSplit);
+	RUN_TEST(TestParseSPS);
+	RUN_TEST(TestParser);
+	return TestResult();
+}
@@ -0,0 +1,496 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include "test.hpp"
+#include "ts-writer.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+using namespace DShow;
+
+/*
+ * Runs on synthetic streams.  Recorded transport streams can be given on
+ * the command line as well, which are checked to demux the same however
+ * they're split up.
+ */
+
+typedef std::vector<unsigned char> Bytes;
+
+struct Output {
+	TSStream stream;
+	Bytes data;
+	TSPacket packet;
+};
+
+struct Demuxer {
+	std::shared_ptr<FramePool> videoPool = std::make_shared<FramePool>(4);
+	std::shared_ptr<FramePool> audioPool = std::make_shared<FramePool>(4);
+	TSDemuxer demuxer;
+	std::vector<Output> out;
+	int programs = 0;
+
+	Demuxer(unsigned videoPID = TSW_VIDEO_PID,
+		unsigned audioPID = TSW_AUDIO_PID)
+	{
+		demuxer.SetStream(TSStream::Video, videoPID, videoPool);
+		demuxer.SetStream(TSStream::Audio, audioPID, audioPool);
+		demuxer.SetCallback(
+			[this](TSStream stream, const TSPacket &packet) {
+				Output output;
+				output.stream = stream;
+				output.data.assign(packet.frame.Data(),
+						   packet.frame.Data() +
+							   packet.frame.Size());
+				output.packet = packet;
+				output.packet.frame.Release();
+				out.push_back(output);
+			});
+		demuxer.SetProgramCallback(
+			[this](const TSProgram &) { programs++; });
+	}
+
+	/* chunk sizes are random below maxChunk, or all maxChunk if fixed */
+	void Input(const Bytes &stream, size_t maxChunk, bool fixed = false)
+	{
+		TestRandom random((unsigned long long)maxChunk);
+
+		for (size_t pos = 0; pos < stream.size();) {
+			size_t chunk = maxChunk;
+			if (!fixed)
+				chunk = 1 + random.Next((unsigned)maxChunk);
+			chunk = std::min(chunk, stream.size() - pos);
+			demuxer.Input(stream.data() + pos, chunk);
+			pos += chunk;
+		}
+
+		demuxer.Flush();
+	}
+};
+
+static Bytes Payload(size_t size, unsigned seed)
+{
+	TestRandom random(seed);
+	Bytes data(size);
+	for (unsigned char &byte : data)
+		byte = (unsigned char)random.Next();
+	return data;
+}
+
+/* 90 kHz to the demuxer's 100 ns units */
+static inline long long Time(long long time)
+{
+	return TS_PTS_TO_TIME(time);
+}
+
+struct Expected {
+	TSStream stream;
+	Bytes data;
+	long long pts;
+	long long dts;
+};
+
+/* video with B-frame style DTS and unbounded PES packets of all sizes,
+ * around a few transport packets each, and bounded audio */
+static void MakeStream(TSWriter &writer, std::vector<Expected> &expected,
+		       int frames)
+{
+	writer.Tables();
+
+	for (int i = 0; i < frames; i++) {
+		long long dts = 900000 + i * 3000LL;
+		long long pts = dts + (i % 3) * 3000;
+		Bytes video = Payload(1 + i * 97 % 1500, i);
+		Bytes audio = Payload(100 + i * 13 % 400, i + 1000);
+
+		writer.PES(TSW_VIDEO_PID, video, false, pts, dts,
+			   (dts - 9000) * 300);
+		writer.PES(TSW_AUDIO_PID, audio, true, dts);
+
+		expected.push_back({TSStream::Video, video, Time(pts),
+				    Time(dts)});
+		expected.push_back({TSStream::Audio, audio, Time(dts),
+				    Time(dts)});
+
+		/* null packets are skipped */
+		if (i % 10 == 0)
+			writer.Packet(TS_NULL_PID, false, nullptr, 0);
+	}
+}
+
+/* an unbounded packet is only delivered once the next one starts, so the
+ * audio after each video packet comes out first.  Streams that were moved
+ * by the PMT start with a discontinuity */
+static void CheckOutput(const std::vector<Output> &out,
+			const std::vector<Expected> &expected,
+			bool moved = false)
+{
+	CHECK_EQ(out.size(), expected.size());
+	if (out.size() != expected.size())
+		return;
+
+	size_t video = 0, audio = 0;
+	bool seenVideo = false, seenAudio = false;
+	for (const Output &output : out) {
+		bool isVideo = output.stream == TSStream::Video;
+		size_t &next = isVideo ? video : audio;
+
+		while (next < expected.size() &&
+		       expected[next].stream != output.stream)
+			next++;
+		if (next == expected.size())
+			break;
+
+		const Expected &want = expected[next++];
+		bool &seen = isVideo ? seenVideo : seenAudio;
+		CHECK(output.data == want.data);
+		CHECK(output.packet.hasPts);
+		CHECK_EQ(output.packet.pts, want.pts);
+		CHECK_EQ(output.packet.dts, want.dts);
+		CHECK_EQ(output.packet.hasDts, isVideo);
+		CHECK_EQ(output.packet.discontinuity, moved && !seen);
+		seen = true;
+	}
+}
+
+static void TestChunkSizes()
+{
+	TSWriter writer;
+	std::vector<Expected> expected;
+	MakeStream(writer, expected, 100);
+
+	const size_t chunks[] = {TS_PACKET_SIZE, 1, 7, 5000};
+
+	for (size_t chunk : chunks) {
+		Demuxer demuxer;
+		demuxer.Input(writer.out, chunk, chunk == TS_PACKET_SIZE);
+
+		CheckOutput(demuxer.out, expected);
+		CHECK_EQ(demuxer.programs, 1);
+		CHECK(demuxer.demuxer.HasProgram());
+
+		const TSStats &stats = demuxer.demuxer.Stats();
+		CHECK_EQ(stats.packets, writer.out.size() / TS_PACKET_SIZE);
+		CHECK_EQ(stats.syncLosses, 0);
+		CHECK_EQ(stats.continuityErrors, 0);
+		CHECK_EQ(stats.droppedPES, 0);
+	}
+}
+
+/* streams set up on the wrong PIDs are moved by the PMT */
+static void TestProgram()
+{
+	TSWriter writer;
+	std::vector<Expected> expected;
+	MakeStream(writer, expected, 10);
+
+	Demuxer demuxer(0x200, 0x201);
+	demuxer.Input(writer.out, TS_PACKET_SIZE, true);
+
+	const TSProgram &program = demuxer.demuxer.Program();
+	CHECK_EQ(program.pmtPID, TSW_PMT_PID);
+	CHECK_EQ(program.pcrPID, TSW_VIDEO_PID);
+	CHECK_EQ(program.videoPID, TSW_VIDEO_PID);
+	CHECK(program.videoFormat == VideoFormat::H264);
+	CHECK_EQ(program.audioPID, TSW_AUDIO_PID);
+	CHECK(program.audioFormat == AudioFormat::AAC);
+	CheckOutput(demuxer.out, expected, true);
+
+	/* repeated tables don't call back again */
+	TSWriter again;
+	again.Tables();
+	again.Tables();
+	demuxer.Input(again.out, TS_PACKET_SIZE, true);
+	CHECK_EQ(demuxer.programs, 1);
+}
+
+static void TestPCR()
+{
+	TSWriter writer;
+	std::vector<Expected> expected;
+	MakeStream(writer, expected, 20);
+
+	Demuxer demuxer;
+	demuxer.Input(writer.out, TS_PACKET_SIZE, true);
+
+	const TSStats &stats = demuxer.demuxer.Stats();
+	CHECK_EQ(stats.pcrCount, 20);
+	CHECK_EQ(stats.pcr, TS_PCR_TO_TIME((900000 + 19 * 3000LL - 9000) *
+					   300));
+}
+
+/* a lost transport packet throws away the PES packet it was in, and the
+ * next one is flagged */
+static void TestContinuityError()
+{
+	TSWriter writer;
+	Bytes first = Payload(1000, 1);
+	Bytes second = Payload(1000, 2);
+
+	writer.Tables();
+	writer.PES(TSW_AUDIO_PID, first, true, 90000);
+	size_t cut = writer.out.size() - 3 * TS_PACKET_SIZE;
+	writer.out.erase(writer.out.begin() + cut,
+			 writer.out.begin() + cut + TS_PACKET_SIZE);
+	writer.PES(TSW_AUDIO_PID, second, true, 93000);
+
+	Demuxer demuxer;
+	demuxer.Input(writer.out, TS_PACKET_SIZE, true);
+
+	CHECK_EQ(demuxer.out.size(), 1);
+	if (demuxer.out.size() == 1) {
+		CHECK(demuxer.out[0].data == second);
+		CHECK(demuxer.out[0].packet.discontinuity);
+	}
+
+	const TSStats &stats = demuxer.demuxer.Stats();
+	CHECK_EQ(stats.continuityErrors, 1);
+	CHECK_EQ(stats.droppedPES, 1);
+}
+
+/* one copy of a packet is allowed and skipped */
+static void TestDuplicate()
+{
+	TSWriter writer;
+	Bytes data = Payload(1000, 3);
+
+	writer.Tables();
+	writer.PES(TSW_AUDIO_PID, data, true, 90000);
+	size_t copy = writer.out.size() - 3 * TS_PACKET_SIZE;
+	Bytes packet(writer.out.begin() + copy,
+		     writer.out.begin() + copy + TS_PACKET_SIZE);
+	writer.out.insert(writer.out.begin() + copy, packet.begin(),
+			  packet.end());
+
+	Demuxer demuxer;
+	demuxer.Input(writer.out, TS_PACKET_SIZE, true);
+
+	CHECK_EQ(demuxer.out.size(), 1);
+	if (demuxer.out.size() == 1) {
+		CHECK(demuxer.out[0].data == data);
+		CHECK(!demuxer.out[0].packet.discontinuity);
+	}
+	CHECK_EQ(demuxer.demuxer.Stats().continuityErrors, 0);
+}
+
+/* garbage between packets is skipped, once per run of it */
+static void TestResync()
+{
+	TSWriter writer;
+	Bytes first = Payload(500, 4);
+	Bytes second = Payload(500, 5);
+	Bytes junk = Payload(300, 6);
+
+	writer.Tables();
+	writer.PES(TSW_AUDIO_PID, first, true, 90000);
+	std::replace(junk.begin(), junk.end(), (unsigned char)TS_SYNC_BYTE,
+		     (unsigned char)0);
+	writer.out.insert(writer.out.end(), junk.begin(), junk.end());
+	writer.PES(TSW_AUDIO_PID, second, true, 93000);
+
+	for (size_t chunk : {(size_t)1, (size_t)7, (size_t)1000}) {
+		Demuxer demuxer;
+		demuxer.Input(writer.out, chunk);
+
+		CHECK_EQ(demuxer.out.size(), 2);
+		if (demuxer.out.size() == 2) {
+			CHECK(demuxer.out[0].data == first);
+			CHECK(demuxer.out[1].data == second);
+		}
+		CHECK_EQ(demuxer.demuxer.Stats().syncLosses, 1);
+	}
+}
+
+/* timestamps carry on across the 33-bit wrap */
+static void TestTimestampWrap()
+{
+	TSWriter writer;
+	const long long start = (1LL << 33) - 6000;
+
+	writer.Tables();
+	for (int i = 0; i < 4; i++) {
+		Bytes data = Payload(200, i);
+		writer.PES(TSW_AUDIO_PID, data, true, start + i * 3000);
+	}
+
+	Demuxer demuxer;
+	demuxer.Input(writer.out, TS_PACKET_SIZE, true);
+
+	CHECK_EQ(demuxer.out.size(), 4);
+	for (size_t i = 0; i < demuxer.out.size(); i++)
+		CHECK_EQ(demuxer.out[i].packet.pts,
+			 Time(start + (long long)i * 3000));
+}
+
+/* the payload callback sees all of an unbounded packet as it comes, and
+ * can end it as soon as a padded transport packet shows it's done */
+static void TestPayloadCallback()
+{
+	TSWriter writer;
+	Bytes first = Payload(1000, 7);
+	Bytes second = Payload(1000, 8);
+
+	writer.Tables();
+	writer.PES(TSW_VIDEO_PID, first, false, 90000);
+	size_t split = writer.out.size();
+	writer.PES(TSW_VIDEO_PID, second, false, 93000);
+
+	Demuxer demuxer;
+	size_t seen = 0;
+	size_t ends = 0;
+	bool callbackFailed = false;
+
+	demuxer.demuxer.SetPayloadCallback(
+		[&](TSStream stream, const TSPacket &packet,
+		    const unsigned char *data, size_t size, size_t scanned,
+		    bool padded) {
+			const Bytes &payload = packet.pts == Time(90000)
+						       ? first
+						       : second;
+
+			if (stream != TSStream::Video || scanned != seen ||
+			    size > payload.size() ||
+			    memcmp(data, payload.data(), size) != 0)
+				callbackFailed = true;
+
+			seen = size;
+			if (padded) {
+				seen = 0;
+				ends++;
+			}
+			return padded;
+		});
+
+	/* the first packet goes out before the second starts */
+	Bytes head(writer.out.begin(), writer.out.begin() + split);
+	Bytes tail(writer.out.begin() + split, writer.out.end());
+
+	demuxer.demuxer.Input(head.data(), head.size());
+	CHECK_EQ(demuxer.out.size(), 1);
+
+	demuxer.demuxer.Input(tail.data(), tail.size());
+	CHECK_EQ(demuxer.out.size(), 2);
+	demuxer.demuxer.Flush();
+	CHECK_EQ(demuxer.out.size(), 2);
+
+	CHECK(!callbackFailed);
+	CHECK_EQ(ends, 2);
+	if (demuxer.out.size() == 2) {
+		CHECK(demuxer.out[0].data == first);
+		CHECK(demuxer.out[1].data == second);
+	}
+
+	/* anything after a packet that was ended goes out untimed */
+	TSWriter more;
+	more.counters[TSW_VIDEO_PID] = writer.counters[TSW_VIDEO_PID];
+	more.PES(TSW_VIDEO_PID, first, false, 96000);
+	Bytes rest = Payload(100, 9);
+	more.Packet(TSW_VIDEO_PID, false, rest.data(), rest.size());
+	more.PES(TSW_VIDEO_PID, second, false, 99000);
+
+	demuxer.demuxer.SetPayloadCallback(
+		[&](TSStream, const TSPacket &packet, const unsigned char *,
+		    size_t, size_t, bool padded) {
+			return padded && packet.hasPts;
+		});
+	demuxer.out.clear();
+	demuxer.demuxer.Input(more.out.data(), more.out.size());
+
+	CHECK_EQ(demuxer.out.size(), 3);
+	if (demuxer.out.size() == 3) {
+		CHECK(demuxer.out[0].data == first);
+		CHECK(demuxer.out[1].data == rest);
+		CHECK(!demuxer.out[1].packet.hasPts);
+		CHECK(demuxer.out[2].data == second);
+	}
+}
+
+static bool ReadFile(const char *path, Bytes &data)
+{
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	data.resize((size_t)ftell(file));
+	fseek(file, 0, SEEK_SET);
+
+	bool success = fread(data.data(), 1, data.size(), file) ==
+		       data.size();
+	fclose(file);
+	return success;
+}
+
+static bool SameOutput(const std::vector<Output> &a,
+		       const std::vector<Output> &b)
+{
+	if (a.size() != b.size())
+		return false;
+
+	for (size_t i = 0; i < a.size(); i++) {
+		if (a[i].stream != b[i].stream || a[i].data != b[i].data ||
+		    a[i].packet.pts != b[i].packet.pts ||
+		    a[i].packet.dts != b[i].packet.dts)
+			return false;
+	}
+
+	return true;
+}
+
+/* streams are found from the PMT, so the PIDs they start on don't matter */
+static void TestRecorded(const char *path)
+{
+	Bytes stream;
+	if (!ReadFile(path, stream)) {
+		fprintf(stderr, "Can't read %s\n", path);
+		CHECK(false);
+		return;
+	}
+
+	Demuxer whole(TS_NULL_PID, TS_NULL_PID);
+	whole.Input(stream, stream.size(), true);
+
+	const TSStats &stats = whole.demuxer.Stats();
+	printf("%s: %llu packets, %zu PES packets, %llu continuity errors\n",
+	       path, stats.packets, whole.out.size(), stats.continuityErrors);
+	CHECK(whole.demuxer.HasProgram());
+
+	for (size_t chunk : {(size_t)1, (size_t)7, (size_t)5000}) {
+		Demuxer split(TS_NULL_PID, TS_NULL_PID);
+		split.Input(stream, chunk);
+		CHECK(SameOutput(whole.out, split.out));
+	}
+}
+
+int main(int argc, char **argv)
+{
+	RUN_TEST(TestChunkSizes);
+	RUN_TEST(TestProgram);
+	RUN_TEST(TestPCR);
+	RUN_TEST(TestContinuityError);
+	RUN_TEST(TestDuplicate);
+	RUN_TEST(TestResync);
+	RUN_TEST(TestTimestampWrap);
+	RUN_TEST(TestPayloadCallback);
+
+	for (int i = 1; i < argc; i++)
+		TestRecorded(argv[i]);
+
+	return TestResult();
+}
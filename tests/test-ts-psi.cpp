@@ -0,0 +1,132 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include "test.hpp"
+#include "ts-psi.hpp"
+
+#include <vector>
+
+using namespace DShow;
+
+typedef std::vector<unsigned char> Bytes;
+
+/* fills in the section length and appends the CRC */
+static Bytes Finish(Bytes section)
+{
+	section[1] = (unsigned char)(0xB0 | (section.size() + 1) >> 8);
+	section[2] = (unsigned char)(section.size() + 1);
+
+	uint32_t crc = GetTSSectionCRC(section.data(), section.size());
+	for (int shift = 24; shift >= 0; shift -= 8)
+		section.push_back((unsigned char)(crc >> shift));
+	return section;
+}
+
+static void TestCRC()
+{
+	/* the CRC-32/MPEG-2 check value */
+	const unsigned char digits[] = "123456789";
+	CHECK_EQ(GetTSSectionCRC(digits, 9), 0x0376E6E7);
+
+	Bytes section = Finish({0x00, 0, 0, 0, 1, 0xC1, 0, 0, 0, 1, 0xE1, 0});
+	CHECK_EQ(GetTSSectionCRC(section.data(), section.size()), 0);
+}
+
+/* program zero is the network information table, not a program */
+static void TestPAT()
+{
+	Bytes section = Finish({0x00, 0, 0, 0, 1, 0xC1, 0, 0, 0, 0, 0xE0,
+				0x10, 0, 3, 0xE1, 0x23});
+	TSProgram program;
+
+	CHECK(ParseTSPAT(section.data(), section.size(), program));
+	CHECK_EQ(program.programNumber, 3);
+	CHECK_EQ(program.pmtPID, 0x123);
+
+	/* a damaged section, or one that isn't in use yet, is skipped */
+	Bytes damaged = section;
+	damaged[10] ^= 1;
+	CHECK(!ParseTSPAT(damaged.data(), damaged.size(), program));
+
+	Bytes next = section;
+	next[5] &= ~1;
+	next.resize(next.size() - 4);
+	next = Finish(next);
+	CHECK(!ParseTSPAT(next.data(), next.size(), program));
+
+	CHECK(!ParseTSPAT(section.data(), section.size() - 1, program));
+}
+
+static Bytes PMT(const Bytes &streams)
+{
+	Bytes section = {0x02, 0, 0, 0, 1, 0xC1, 0, 0, 0xE1, 0x00, 0xF0, 0};
+	section.insert(section.end(), streams.begin(), streams.end());
+	return Finish(section);
+}
+
+static void TestPMT()
+{
+	/* MPEG-2 video is skipped, and the first H.264 and audio streams
+	 * are taken */
+	Bytes section = PMT({0x02, 0xE1, 0x01, 0xF0, 0,    0x1B, 0xE1,
+			     0x02, 0xF0, 0,    0x0F, 0xE1, 0x03, 0xF0,
+			     0,    0x1B, 0xE1, 0x04, 0xF0, 0});
+	TSProgram program;
+
+	CHECK(ParseTSPMT(section.data(), section.size(), program));
+	CHECK_EQ(program.pcrPID, 0x100);
+	CHECK_EQ(program.videoPID, 0x102);
+	CHECK(program.videoFormat == VideoFormat::H264);
+	CHECK_EQ(program.audioPID, 0x103);
+	CHECK_EQ(program.audioStreamType, TS_STREAM_AAC_ADTS);
+	CHECK(program.audioFormat == AudioFormat::AAC);
+
+	/* a stream running past the end of the section */
+	Bytes truncated = PMT({0x1B, 0xE1, 0x02, 0xF0, 8, 0, 0});
+	CHECK(!ParseTSPMT(truncated.data(), truncated.size(), program));
+}
+
+/* AC-3 in private PES packets is only known by its descriptors */
+static void TestPrivateAC3()
+{
+	TSProgram program;
+
+	Bytes plain = PMT({0x06, 0xE1, 0x05, 0xF0, 0});
+	CHECK(ParseTSPMT(plain.data(), plain.size(), program));
+	CHECK_EQ(program.audioPID, TS_NULL_PID);
+
+	Bytes descriptor = PMT({0x06, 0xE1, 0x05, 0xF0, 3, 0x6A, 1, 0});
+	CHECK(ParseTSPMT(descriptor.data(), descriptor.size(), program));
+	CHECK_EQ(program.audioPID, 0x105);
+	CHECK(program.audioFormat == AudioFormat::AC3);
+
+	Bytes registration = PMT({0x06, 0xE1, 0x06, 0xF0, 6, 0x05, 4, 'E',
+				  'A', 'C', '3'});
+	CHECK(ParseTSPMT(registration.data(), registration.size(), program));
+	CHECK_EQ(program.audioPID, 0x106);
+	CHECK(program.audioFormat == AudioFormat::AC3);
+}
+
+int main()
+{
+	RUN_TEST(TestCRC);
+	RUN_TEST(TestPAT);
+	RUN_TEST(TestPMT);
+	RUN_TEST(TestPrivateAC3);
+	return TestResult();
+}
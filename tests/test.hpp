@@ -0,0 +1,83 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Minimal checks for the unit tests.  A failed check is reported and the
+ * test carries on.  main runs each test with RUN_TEST and returns
+ * TestResult().
+ */
+
+static int testFailures = 0;
+
+#define CHECK(cond)                                                       \
+	do {                                                              \
+		if (!(cond)) {                                            \
+			fprintf(stderr, "%s:%d: check failed: %s\n",      \
+				__FILE__, __LINE__, #cond);               \
+			testFailures++;                                   \
+		}                                                         \
+	} while (false)
+
+#define CHECK_EQ(a, b)                                                    \
+	do {                                                              \
+		long long a_ = (long long)(a);                            \
+		long long b_ = (long long)(b);                            \
+		if (a_ != b_) {                                           \
+			fprintf(stderr, "%s:%d: %s == %s failed: "        \
+					"%lld != %lld\n",                 \
+				__FILE__, __LINE__, #a, #b, a_, b_);      \
+			testFailures++;                                   \
+		}                                                         \
+	} while (false)
+
+#define RUN_TEST(test)                             \
+	do {                                       \
+		int before = testFailures;         \
+		test();                            \
+		printf("%s %s\n", #test,           \
+		       testFailures == before      \
+			       ? "passed"          \
+			       : "FAILED");        \
+	} while (false)
+
+static inline int TestResult()
+{
+	return testFailures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* deterministic pseudo-random numbers, so failures can be reproduced */
+struct TestRandom {
+	unsigned long long state;
+
+	inline TestRandom(unsigned long long seed = 1) : state(seed) {}
+
+	inline unsigned Next()
+	{
+		state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+		return (unsigned)(state >> 33);
+	}
+
+	/** In [0, range) */
+	inline unsigned Next(unsigned range) { return Next() % range; }
+};
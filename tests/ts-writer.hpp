@@ -0,0 +1,210 @@
+/*
+ *  Copyright (C) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#pragma once
+
+#include "ts-demuxer.hpp"
+
+#include <string.h>
+#include <vector>
+
+/*
+ * Builds transport streams for the demuxer tests and benchmark: a PAT, a
+ * PMT with one H.264 and one audio stream, and PES packets split over
+ * transport packets the way a muxer would, with the last one of each
+ * padded out by adaptation field stuffing.
+ */
+
+#define TSW_VIDEO_PID 0x100
+#define TSW_AUDIO_PID 0x101
+#define TSW_PMT_PID 0x1000
+
+/* no PTS or DTS */
+#define TSW_NO_TIME -1LL
+
+struct TSWriter {
+	std::vector<unsigned char> out;
+	int counters[0x2000] = {};
+
+	/**
+	 * Writes one transport packet with as much of data as fits, and
+	 * returns how much that was.  flags are adaptation field flags, and
+	 * a PCR is written if pcr isn't negative.
+	 */
+	size_t Packet(unsigned pid, bool unitStart, const unsigned char *data,
+		      size_t size, long long pcr = -1, int flags = 0)
+	{
+		unsigned char packet[TS_PACKET_SIZE];
+		size_t field = flags || pcr >= 0 ? 2 : 0;
+		if (pcr >= 0)
+			field += 6;
+
+		if (size < 184 - field)
+			field = 184 - size;
+		else
+			size = 184 - field;
+
+		int &counter = counters[pid];
+		packet[0] = TS_SYNC_BYTE;
+		packet[1] = (unsigned char)((unitStart ? 0x40 : 0) | pid >> 8);
+		packet[2] = (unsigned char)pid;
+		packet[3] = (unsigned char)((field ? 0x30 : 0x10) | counter);
+		counter = (counter + 1) & 0xF;
+
+		if (field) {
+			size_t pos = 6;
+
+			packet[4] = (unsigned char)(field - 1);
+			if (field > 1)
+				packet[5] = (unsigned char)(flags |
+							    (pcr >= 0 ? 0x10
+								      : 0));
+
+			if (pcr >= 0) {
+				long long base = pcr / 300;
+				int extension = (int)(pcr % 300);
+
+				packet[6] = (unsigned char)(base >> 25);
+				packet[7] = (unsigned char)(base >> 17);
+				packet[8] = (unsigned char)(base >> 9);
+				packet[9] = (unsigned char)(base >> 1);
+				packet[10] = (unsigned char)((base & 1) << 7 |
+							     0x7E |
+							     extension >> 8);
+				packet[11] = (unsigned char)extension;
+				pos = 12;
+			}
+
+			if (4 + field > pos)
+				memset(packet + pos, 0xFF, 4 + field - pos);
+		}
+
+		if (size)
+			memcpy(packet + 4 + field, data, size);
+		out.insert(out.end(), packet, packet + TS_PACKET_SIZE);
+		return size;
+	}
+
+	/** Writes a section (without its CRC), pointer field first */
+	void Section(unsigned pid, std::vector<unsigned char> section)
+	{
+		section[1] = (unsigned char)(0xB0 | (section.size() + 1) >> 8);
+		section[2] = (unsigned char)(section.size() + 1);
+
+		uint32_t crc = DShow::GetTSSectionCRC(section.data(),
+						      section.size());
+		for (int shift = 24; shift >= 0; shift -= 8)
+			section.push_back((unsigned char)(crc >> shift));
+
+		section.insert(section.begin(), 0);
+
+		const unsigned char *data = section.data();
+		size_t left = section.size();
+		bool first = true;
+
+		while (left) {
+			size_t size = Packet(pid, first, data, left);
+			data += size;
+			left -= size;
+			first = false;
+		}
+	}
+
+	void Tables(int audioType = TS_STREAM_AAC_ADTS)
+	{
+		Section(TS_PAT_PID, {0x00, 0, 0, 0x00, 0x01, 0xC1, 0, 0, 0x00,
+				     0x01, 0xE0 | TSW_PMT_PID >> 8,
+				     TSW_PMT_PID & 0xFF});
+
+		Section(TSW_PMT_PID,
+			{0x02, 0, 0, 0x00, 0x01, 0xC1, 0, 0,
+			 0xE0 | TSW_VIDEO_PID >> 8, TSW_VIDEO_PID & 0xFF, 0xF0,
+			 0x00, TS_STREAM_H264, 0xE0 | TSW_VIDEO_PID >> 8,
+			 TSW_VIDEO_PID & 0xFF, 0xF0, 0x00,
+			 (unsigned char)audioType, 0xE0 | TSW_AUDIO_PID >> 8,
+			 TSW_AUDIO_PID & 0xFF, 0xF0, 0x00});
+	}
+
+	static void Timestamp(std::vector<unsigned char> &pes, int prefix,
+			      long long time)
+	{
+		pes.push_back((unsigned char)(prefix << 4 |
+					      (time >> 29 & 0x0E) | 1));
+		pes.push_back((unsigned char)(time >> 22));
+		pes.push_back((unsigned char)((time >> 14 & 0xFE) | 1));
+		pes.push_back((unsigned char)(time >> 7));
+		pes.push_back((unsigned char)((time << 1 & 0xFE) | 1));
+	}
+
+	/**
+	 * Writes a PES packet.  Times are 90 kHz and wrapped to 33 bits.  An
+	 * unbounded packet leaves PES_packet_length at zero, as video
+	 * usually does.  A PCR goes in the first transport packet if pcr
+	 * isn't negative.
+	 */
+	void PES(unsigned pid, const unsigned char *data, size_t size,
+		 bool bounded, long long pts, long long dts = TSW_NO_TIME,
+		 long long pcr = -1, int flags = 0)
+	{
+		std::vector<unsigned char> pes = {0, 0, 1, 0, 0, 0, 0x80, 0,
+						  0};
+		const long long wrap = 1LL << 33;
+
+		pes[3] = pid == TSW_VIDEO_PID ? 0xE0 : 0xC0;
+
+		if (pts != TSW_NO_TIME) {
+			bool hasDts = dts != TSW_NO_TIME;
+
+			pes[7] = hasDts ? 0xC0 : 0x80;
+			pes[8] = hasDts ? 10 : 5;
+			Timestamp(pes, hasDts ? 3 : 2, pts & (wrap - 1));
+			if (hasDts)
+				Timestamp(pes, 1, dts & (wrap - 1));
+		}
+
+		if (bounded) {
+			size_t length = pes.size() - 6 + size;
+			pes[4] = (unsigned char)(length >> 8);
+			pes[5] = (unsigned char)length;
+		}
+
+		pes.insert(pes.end(), data, data + size);
+
+		const unsigned char *pos = pes.data();
+		size_t left = pes.size();
+		bool first = true;
+
+		while (left) {
+			size_t written = Packet(pid, first, pos, left,
+						first ? pcr : -1,
+						first ? flags : 0);
+			pos += written;
+			left -= written;
+			first = false;
+		}
+	}
+
+	inline void PES(unsigned pid, const std::vector<unsigned char> &data,
+			bool bounded, long long pts,
+			long long dts = TSW_NO_TIME, long long pcr = -1,
+			int flags = 0)
+	{
+		PES(pid, data.data(), data.size(), bounded, pts, dts, pcr,
+		    flags);
+	}
+};